@@ -40,11 +40,17 @@ val kmpPackageName = "com.oldguy.sqlcipher"
 val androidMainDirectory = projectDir.resolve("src").resolve("androidMain")
 val nativeInterop = projectDir.resolve("src/nativeInterop")
 val nativeInteropPath: String = nativeInterop.absolutePath
+// C sources shared by the JNI shim and the cinterop of every native target
+val nativeInteropCommon = nativeInterop.resolve("common")
 
 sqlcipher {
     useGit = false
     version = libs.versions.sqlcipher.get()
-    compilerOptions = SqlcipherExtension.defaultCompilerOptions
+    // session extension (changesets) also requires the preupdate hook. Options here must match
+    // the defines in CMakeLists.txt and the compilerOpts of each Sqlcipher.def
+    compilerOptions = SqlcipherExtension.defaultCompilerOptions +
+            listOf("-DSQLITE_ENABLE_SESSION", "-DSQLITE_ENABLE_PREUPDATE_HOOK", "-DSQLITE_ENABLE_SNAPSHOT",
+                    "-DSQLITE_ENABLE_STMT_SCANSTATUS")
     buildCompilerOptions = mapOf(
         BuildType.androidX64 to SqlcipherExtension.androidCompilerOptions,
         BuildType.androidArm64 to SqlcipherExtension.androidCompilerOptions,
@@ -155,6 +161,36 @@ android {
     }
 }
 
+// The desktop JVM target on a Linux host uses the same JNI shim as Android. The host toolchain and JDK
+// build it from the same CMakeLists.txt, linked with the linuxX64 libsqlite3.a used by cinterop.
+val jvmJniDirectory = layout.buildDirectory.dir("jvmJni").get().asFile
+val configureJvmJni by tasks.registering(Exec::class) {
+    commandLine(
+        "cmake",
+        "-S", androidMainDirectory.resolve("cpp").absolutePath,
+        "-B", jvmJniDirectory.absolutePath,
+        "-DCMAKE_BUILD_TYPE=Release",
+        "-DANDROID_MAIN_PATH=${androidMainDirectory.absolutePath}",
+        "-DOSWINDOWS=0"
+    )
+}
+val buildJvmJni by tasks.registering(Exec::class) {
+    group = "build"
+    description = "Builds libsqlcipher-kotlin.so for the desktop JVM target"
+    dependsOn(configureJvmJni)
+    inputs.dir(androidMainDirectory.resolve("cpp"))
+    inputs.dir(nativeInteropCommon)
+    inputs.file(nativeInterop.resolve("linuxX64/libsqlite3.a"))
+    outputs.file(jvmJniDirectory.resolve("libsqlcipher-kotlin.so"))
+    commandLine("cmake", "--build", jvmJniDirectory.absolutePath, "--target", "sqlcipher-kotlin")
+}
+
+// The Benchmarks test classes run for minutes, so test tasks only include them when KMPSQL_BENCH is set
+tasks.withType<AbstractTestTask>().configureEach {
+    if (System.getenv("KMPSQL_BENCH").isNullOrEmpty())
+        filter { excludeTestsMatching("*.Benchmarks*") }
+}
+
 val githubUri = "skolson/$appleFrameworkName"
 val githubUrl = "https://github.com/$githubUri"
 
@@ -190,9 +226,11 @@ kotlin {
         packageName(kmpPackageName)
         includeDirs.apply {
             allHeaders(nativeInterop.resolve(dirName))
+            allHeaders(nativeInteropCommon)
         }
         compilerOpts += listOf(
             "-I$nativeInteropPath/$dirName",
+            "-I${nativeInteropCommon.absolutePath}",
         )
         extraOpts("-libraryPath", "$nativeInteropPath/$dirName")
     }
@@ -205,6 +243,12 @@ kotlin {
                 }
             }
         }
+        jvm {
+            testRuns["test"].executionTask.configure {
+                dependsOn(buildJvmJni)
+                systemProperty("java.library.path", jvmJniDirectory.absolutePath)
+            }
+        }
     }
 
     val appleXcf = XCFramework()
@@ -275,6 +319,7 @@ kotlin {
                 implementation(libs.bigDecimal)
                 implementation(libs.kotlinx.atomicfu)
                 implementation(libs.kmp.io)
+                implementation(libs.kotlinx.coroutines.core)
             }
         }
         val commonTest by getting {
@@ -282,6 +327,26 @@ kotlin {
                 implementation(kotlin("test-common"))
                 implementation(kotlin("test-annotations-common"))
                 implementation(libs.kotlinx.coroutines.test)
+                implementation(libs.kotlinx.io.core)
+            }
+        }
+        // actual implementations using Sqlite3JniShim, shared by Android and the desktop JVM
+        val jniMain by creating {
+            dependsOn(commonMain)
+        }
+        val androidMain by getting {
+            dependsOn(jniMain)
+        }
+        if (OperatingSystem.current().isLinux) {
+            val jvmMain by getting {
+                dependsOn(jniMain)
+            }
+            val jvmTest by getting {
+                dependencies {
+                    implementation(kotlin("test-junit"))
+                    implementation(libs.junit4)
+                    implementation(libs.kotlinx.coroutines.core)
+                }
             }
         }
         val androidUnitTest by getting {
@@ -302,7 +367,6 @@ kotlin {
             dependencies {
                 implementation(kotlin("test"))
                 implementation(libs.kotlinx.coroutines.core)
-                implementation(libs.kotlinx.io.core)
             }
         }
     }
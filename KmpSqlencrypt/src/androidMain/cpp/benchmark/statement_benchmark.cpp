@@ -0,0 +1,340 @@
+#include <benchmark/benchmark.h>
+#include <sqlite3.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+/**
+ * Microbenchmarks of the sqlite calls made by the JNI shim in database.cpp, using the same variants
+ * the shim uses (UTF-16 prepare, bind and column text, SQLITE_TRANSIENT binds), against an encrypted
+ * database in the temporary directory. This measures the native side only; JNI crossing and Kotlin
+ * costs are not included. Column fetch benchmarks step one row per iteration, so compare them with
+ * the fetch=FetchNone run on the same table to attribute the fetch cost.
+ *
+ * Built when cmake is run with -DKMPSQL_BENCHMARKS=ON on a desktop host, see CMakeLists.txt.
+ */
+
+namespace {
+
+const char *const benchKey = "PRAGMA key = 'kmpsqlBenchmark';";
+const int benchRows = 1000;
+const int wideColumns = 64;
+const int wideRows = 256;
+const int sizedRows = 64;
+const std::vector<int64_t> valueSizes = {16, 256, 4096, 65536};
+
+std::string benchPath(const char *name) {
+    return (std::filesystem::temp_directory_path() / name).string();
+}
+
+void check(sqlite3 *db, int rc, const char *what) {
+    if (rc != SQLITE_OK && rc != SQLITE_ROW && rc != SQLITE_DONE) {
+        std::fprintf(stderr, "%s failed: %d %s\n", what, rc, sqlite3_errmsg(db));
+        std::abort();
+    }
+}
+
+void exec(sqlite3 *db, const std::string &sql) {
+    check(db, sqlite3_exec(db, sql.c_str(), nullptr, nullptr, nullptr), sql.c_str());
+}
+
+sqlite3 *openKeyed(const std::string &path) {
+    sqlite3 *db = nullptr;
+    check(db, sqlite3_open_v2(path.c_str(), &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr),
+          "open");
+    exec(db, benchKey);
+    // the key is only verified, and the KDF run, when the first page is read
+    exec(db, "SELECT count(*) FROM sqlite_master;");
+    return db;
+}
+
+/**
+ * One encrypted database shared by every benchmark, created on first use and removed at exit.
+ * Tables: bench (one column per type), wide (wideColumns text columns) and sized_<n> (text and
+ * blob values of n bytes) for each of valueSizes.
+ */
+class BenchDatabase {
+public:
+    static BenchDatabase &instance() {
+        static BenchDatabase database;
+        return database;
+    }
+
+    sqlite3 *db = nullptr;
+    const std::string path = benchPath("kmpsql_benchmark.db");
+
+    BenchDatabase(const BenchDatabase &) = delete;
+
+    ~BenchDatabase() {
+        sqlite3_close(db);
+        std::filesystem::remove(path);
+    }
+
+private:
+    BenchDatabase() {
+        std::filesystem::remove(path);
+        db = openKeyed(path);
+        exec(db, "BEGIN;");
+        exec(db, "CREATE TABLE bench(id INTEGER PRIMARY KEY, i INTEGER, l INTEGER, d REAL, t TEXT, b BLOB);");
+        exec(db, "WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c WHERE x < " +
+                 std::to_string(benchRows) + ") INSERT INTO bench(i, l, d, t, b) " +
+                 "SELECT x, x * 4294967296, x / 3.0, printf('text value %d', x), randomblob(32) FROM c;");
+        std::string columns;
+        std::string values;
+        for (int i = 0; i < wideColumns; i++) {
+            columns += (i == 0 ? "c" : ", c") + std::to_string(i) + " TEXT";
+            values += (i == 0 ? "" : ", ") + std::string("printf('%016d', x)");
+        }
+        exec(db, "CREATE TABLE wide(" + columns + ");");
+        exec(db, "WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c WHERE x < " +
+                 std::to_string(wideRows) + ") INSERT INTO wide SELECT " + values + " FROM c;");
+        for (auto size: valueSizes) {
+            auto table = "sized_" + std::to_string(size);
+            exec(db, "CREATE TABLE " + table + "(t TEXT, b BLOB);");
+            exec(db, "WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c WHERE x < " +
+                     std::to_string(sizedRows) + ") INSERT INTO " + table +
+                     " SELECT substr(hex(zeroblob(" + std::to_string(size) + ")), 1, " +
+                     std::to_string(size) + "), randomblob(" + std::to_string(size) + ") FROM c;");
+        }
+        exec(db, "COMMIT;");
+    }
+};
+
+std::u16string utf16(const std::string &text) {
+    return {text.begin(), text.end()};
+}
+
+sqlite3_stmt *prepare16(sqlite3 *db, const std::u16string &sql) {
+    sqlite3_stmt *pStmt = nullptr;
+    check(db, sqlite3_prepare16_v2(db, sql.data(), (int) (sql.size() * 2), &pStmt, nullptr), "prepare16_v2");
+    return pStmt;
+}
+
+/**
+ * Steps pStmt to its next row, resetting at the end so every iteration reads a fresh row and
+ * no converted value is reused from a previous fetch.
+ */
+void nextRow(sqlite3_stmt *pStmt) {
+    if (sqlite3_step(pStmt) != SQLITE_ROW) {
+        sqlite3_reset(pStmt);
+        sqlite3_step(pStmt);
+    }
+}
+
+const std::u16string selectSql = u"SELECT id, i, l, d, t, b FROM bench WHERE id = ?";
+const int statementBatch = 64;
+
+/**
+ * prepare and finalize are timed separately over batches of statements, each with manual timing
+ */
+void BM_Prepare(benchmark::State &state) {
+    auto *db = BenchDatabase::instance().db;
+    std::vector<sqlite3_stmt *> statements(statementBatch);
+    for (auto _: state) {
+        auto start = std::chrono::steady_clock::now();
+        for (auto &pStmt: statements)
+            pStmt = prepare16(db, selectSql);
+        auto end = std::chrono::steady_clock::now();
+        for (auto pStmt: statements)
+            sqlite3_finalize(pStmt);
+        state.SetIterationTime(std::chrono::duration<double>(end - start).count());
+    }
+    state.SetItemsProcessed(state.iterations() * statementBatch);
+}
+BENCHMARK(BM_Prepare)->UseManualTime();
+
+void BM_Finalize(benchmark::State &state) {
+    auto *db = BenchDatabase::instance().db;
+    std::vector<sqlite3_stmt *> statements(statementBatch);
+    for (auto _: state) {
+        for (auto &pStmt: statements)
+            pStmt = prepare16(db, selectSql);
+        auto start = std::chrono::steady_clock::now();
+        for (auto pStmt: statements)
+            sqlite3_finalize(pStmt);
+        auto end = std::chrono::steady_clock::now();
+        state.SetIterationTime(std::chrono::duration<double>(end - start).count());
+    }
+    state.SetItemsProcessed(state.iterations() * statementBatch);
+}
+BENCHMARK(BM_Finalize)->UseManualTime();
+
+enum BindType { BindNull, BindInt, BindLong, BindDouble, BindText, BindBlob };
+
+/**
+ * One bind per iteration, of the type in arg 0. Text and blob values are arg 1 bytes long.
+ */
+void BM_Bind(benchmark::State &state) {
+    auto *db = BenchDatabase::instance().db;
+    auto type = static_cast<BindType>(state.range(0));
+    auto size = static_cast<size_t>(state.range(1));
+    auto *pStmt = prepare16(db, u"SELECT ?");
+    std::u16string text(size / 2, u'x');
+    std::vector<char> blob(size, 'b');
+    for (auto _: state) {
+        int rc;
+        switch (type) {
+            case BindNull: rc = sqlite3_bind_null(pStmt, 1); break;
+            case BindInt: rc = sqlite3_bind_int(pStmt, 1, 12345); break;
+            case BindLong: rc = sqlite3_bind_int64(pStmt, 1, 1234567890123LL); break;
+            case BindDouble: rc = sqlite3_bind_double(pStmt, 1, 1234.5678); break;
+            case BindText:
+                rc = sqlite3_bind_text16(pStmt, 1, text.data(), (int) (text.size() * 2), SQLITE_TRANSIENT);
+                break;
+            case BindBlob:
+                rc = sqlite3_bind_blob(pStmt, 1, blob.data(), (int) blob.size(), SQLITE_TRANSIENT);
+                break;
+        }
+        benchmark::DoNotOptimize(rc);
+    }
+    sqlite3_finalize(pStmt);
+    if (type == BindText || type == BindBlob)
+        state.SetBytesProcessed(state.iterations() * (int64_t) size);
+}
+BENCHMARK(BM_Bind)
+    ->ArgNames({"type", "bytes"})
+    ->Args({BindNull, 0})->Args({BindInt, 0})->Args({BindLong, 0})->Args({BindDouble, 0})
+    ->ArgsProduct({{BindText, BindBlob}, valueSizes});
+
+/**
+ * Point select by primary key: bind, step, reset, the shape of SelectStatement.retrieveOne
+ */
+void BM_PointSelect(benchmark::State &state) {
+    auto *db = BenchDatabase::instance().db;
+    auto *pStmt = prepare16(db, selectSql);
+    int id = 0;
+    for (auto _: state) {
+        sqlite3_bind_int(pStmt, 1, id++ % benchRows + 1);
+        benchmark::DoNotOptimize(sqlite3_step(pStmt));
+        sqlite3_reset(pStmt);
+    }
+    sqlite3_finalize(pStmt);
+}
+BENCHMARK(BM_PointSelect);
+
+std::u16string wideSelect(int64_t width) {
+    std::string sql = "SELECT ";
+    for (int64_t i = 0; i < width; i++)
+        sql += (i == 0 ? "c" : ", c") + std::to_string(i);
+    return utf16(sql + " FROM wide");
+}
+
+/**
+ * Step only, over rows arg 0 columns wide
+ */
+void BM_Step(benchmark::State &state) {
+    auto *db = BenchDatabase::instance().db;
+    auto *pStmt = prepare16(db, wideSelect(state.range(0)));
+    for (auto _: state)
+        nextRow(pStmt);
+    sqlite3_finalize(pStmt);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Step)->ArgName("columns")->RangeMultiplier(4)->Range(1, wideColumns);
+
+/**
+ * Step and fetch every column as the shim does for a row: column_type, then bytes16 and text16
+ */
+void BM_ReadRow(benchmark::State &state) {
+    auto *db = BenchDatabase::instance().db;
+    auto width = (int) state.range(0);
+    auto *pStmt = prepare16(db, wideSelect(width));
+    for (auto _: state) {
+        nextRow(pStmt);
+        for (int i = 0; i < width; i++) {
+            benchmark::DoNotOptimize(sqlite3_column_type(pStmt, i));
+            benchmark::DoNotOptimize(sqlite3_column_bytes16(pStmt, i));
+            benchmark::DoNotOptimize(sqlite3_column_text16(pStmt, i));
+        }
+    }
+    sqlite3_finalize(pStmt);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ReadRow)->ArgName("columns")->RangeMultiplier(4)->Range(1, wideColumns);
+
+enum ColumnFetch { FetchInt, FetchLong, FetchDouble, FetchText, FetchBlob, FetchNone };
+
+/**
+ * Steps one row of bench (fixed size types) or sized_<arg 1> (text and blob), then fetches the
+ * column type in arg 0. FetchNone is the step-only baseline.
+ */
+void BM_Column(benchmark::State &state) {
+    auto *db = BenchDatabase::instance().db;
+    auto fetch = static_cast<ColumnFetch>(state.range(0));
+    auto size = state.range(1);
+    auto sql = size == 0
+            ? std::string("SELECT i, l, d FROM bench")
+            : "SELECT t, b FROM sized_" + std::to_string(size);
+    auto *pStmt = prepare16(db, utf16(sql));
+    for (auto _: state) {
+        nextRow(pStmt);
+        switch (fetch) {
+            case FetchInt: benchmark::DoNotOptimize(sqlite3_column_int(pStmt, 0)); break;
+            case FetchLong: benchmark::DoNotOptimize(sqlite3_column_int64(pStmt, 1)); break;
+            case FetchDouble: benchmark::DoNotOptimize(sqlite3_column_double(pStmt, 2)); break;
+            case FetchText:
+                benchmark::DoNotOptimize(sqlite3_column_bytes16(pStmt, 0));
+                benchmark::DoNotOptimize(sqlite3_column_text16(pStmt, 0));
+                break;
+            case FetchBlob:
+                benchmark::DoNotOptimize(sqlite3_column_blob(pStmt, 1));
+                benchmark::DoNotOptimize(sqlite3_column_bytes(pStmt, 1));
+                break;
+            case FetchNone: break;
+        }
+    }
+    sqlite3_finalize(pStmt);
+    if (size > 0)
+        state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK(BM_Column)
+    ->ArgNames({"fetch", "bytes"})
+    ->Args({FetchNone, 0})->Args({FetchInt, 0})->Args({FetchLong, 0})->Args({FetchDouble, 0})
+    ->ArgsProduct({{FetchNone, FetchText, FetchBlob}, valueSizes});
+
+/**
+ * sqlite3_exec with a callback reading every value and column name, as execCallback does before
+ * converting them to java strings. Arg 0 rows per exec.
+ */
+int benchCallback(void *pLength, int numColumns, char **results, char **columnNames) {
+    auto *length = static_cast<size_t *>(pLength);
+    for (int i = 0; i < numColumns; i++) {
+        if (results[i] != nullptr)
+            *length += std::strlen(results[i]);
+        *length += std::strlen(columnNames[i]);
+    }
+    return 0;
+}
+
+void BM_ExecCallback(benchmark::State &state) {
+    auto *db = BenchDatabase::instance().db;
+    auto sql = "SELECT id, i, d, t FROM bench LIMIT " + std::to_string(state.range(0)) + ";";
+    size_t length = 0;
+    for (auto _: state) {
+        check(db, sqlite3_exec(db, sql.c_str(), benchCallback, &length, nullptr), "exec");
+    }
+    benchmark::DoNotOptimize(length);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ExecCallback)->ArgName("rows")->Arg(1)->Arg(100)->Arg(benchRows);
+
+/**
+ * open_v2, PRAGMA key and the first page read that runs the key derivation, then close. Dominated
+ * by the KDF iterations of the cipher settings in use.
+ */
+void BM_OpenKey(benchmark::State &state) {
+    auto &database = BenchDatabase::instance();
+    for (auto _: state) {
+        auto *db = openKeyed(database.path);
+        sqlite3_close(db);
+    }
+}
+BENCHMARK(BM_OpenKey)->Unit(benchmark::kMillisecond);
+
+}
+
+BENCHMARK_MAIN();
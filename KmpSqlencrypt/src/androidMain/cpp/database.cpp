@@ -1,6 +1,8 @@
 #include <jni.h>
+#include <iterator>
 #include <string>
 #include <sqlite3.h>
+#include "kmpsql.h"
 
 /**
  * These "shim" functions were developed under these self-imposed strategic constraints:
@@ -17,6 +19,12 @@ static const char *errorStatementNotOpen = "statement not open";
 static const char *apiExpandedSql = "expanded_sql";
 static const char *callbackName = "callback";
 static const char *callbackSignature = "([Ljava/lang/String;[Ljava/lang/String;)V";
+static const char *conflictName = "conflict";
+static const char *conflictSignature = "(ILjava/lang/String;I)I";
+static const char *shimClassName = "com/oldguy/kiscmp/Sqlite3JniShim";
+static const char *statementClassName = "com/oldguy/kiscmp/Sqlite3StatementJniShim";
+static const char *backupClassName = "com/oldguy/kiscmp/Sqlite3BackupJniShim";
+static const char *sessionClassName = "com/oldguy/kiscmp/Sqlite3SessionJniShim";
 }
 
 /**
@@ -31,13 +39,12 @@ static const char *callbackSignature = "([Ljava/lang/String;[Ljava/lang/String;)
  */
 
 /*
- * Intended to be a singleton, and contain essentially static lookups that only happen once.  Since
- * overhead of these are low, to avoid leaking this reference, it is allocated and initialized at
- * database open, and deleted at database close.  a reference counter is implemented to support
- * multiple simultaneous opens.
- * Note that jclass instances are not intended to be global by default.  The String class, the
- * Sqlite3JniShim class, and the Sqlite3StatementJniShim class are all kept as global refs.  If
- * for some ungodly reason these classes are ever unloaded/reloaded, this stuff breaks.
+ * Singleton of the classes, fields and methods the shim functions use. It is created and filled
+ * once by JNI_OnLoad, before any of the kotlin classes can call a native function, so the shim
+ * functions never look anything up and never see it partly initialized.
+ * Note that jclass instances are not intended to be global by default.  The String class and the
+ * shim classes are all kept as global refs.  If for some ungodly reason these classes are ever
+ * unloaded/reloaded, this stuff breaks.
  */
 class SqliteEnvironment {
 public:
@@ -45,58 +52,62 @@ public:
     jclass stringClass = nullptr;
     jfieldID handleField = nullptr;
     jmethodID errorMethod = nullptr;
+    jmethodID callbackMethod = nullptr;
+    jmethodID conflictMethod = nullptr;
     jclass statementClass = nullptr;
     jfieldID statementHandleField = nullptr;
     jmethodID statementErrorMethod = nullptr;
     jmethodID statementErrorMethod2 = nullptr;
+    jclass backupClass = nullptr;
+    jfieldID backupHandleField = nullptr;
+    jclass sessionClass = nullptr;
+    jfieldID sessionHandleField = nullptr;
 
-    void setDbStatics(JNIEnv *env, jclass dbClass) {
-        if (shimClass != nullptr)
-            env->DeleteGlobalRef(shimClass);
-        shimClass = reinterpret_cast<jclass>(env->NewGlobalRef(dbClass));
-        if (stringClass != nullptr)
-            env->DeleteGlobalRef(stringClass);
-        jclass temp = env->FindClass("java/lang/String");
-        stringClass = reinterpret_cast<jclass>(env->NewGlobalRef(temp));
-        handleField = env->GetFieldID(shimClass, "handle", "J");
-        if (handleField == nullptr) return;
-        errorMethod = env->GetMethodID(shimClass,
-                                       throwErrorName,
-                                       throwErrorSignature);
-    }
-
-    void setStatement(JNIEnv *env, jclass stmtClass) {
-        if (statementClass != nullptr)
-            env->DeleteGlobalRef(statementClass);
-        statementClass = reinterpret_cast<jclass>(env->NewGlobalRef(stmtClass));
-        statementHandleField = env->GetFieldID(statementClass, "handle", "J");
-        statementErrorMethod = env->GetMethodID(statementClass,
-                                                throwErrorName,
-                                                throwErrorSignature);
-        statementErrorMethod2 = env->GetMethodID(statementClass,
-                                                throwErrorName,
-                                                throwErrorSignature2);
-    }
-};
+    /**
+     * @return false if any lookup failed, with the Java exception for it pending
+     */
+    bool init(JNIEnv *env) {
+        if ((stringClass = globalClass(env, "java/lang/String")) == nullptr) return false;
+        if ((shimClass = globalClass(env, shimClassName)) == nullptr) return false;
+        if ((handleField = env->GetFieldID(shimClass, "handle", "J")) == nullptr) return false;
+        if ((errorMethod = env->GetMethodID(shimClass, throwErrorName, throwErrorSignature)) == nullptr)
+            return false;
+        if ((callbackMethod = env->GetMethodID(shimClass, callbackName, callbackSignature)) == nullptr)
+            return false;
+        if ((conflictMethod = env->GetMethodID(shimClass, conflictName, conflictSignature)) == nullptr)
+            return false;
 
-extern "C" {
-static SqliteEnvironment *pShimEnv = nullptr;
+        if ((statementClass = globalClass(env, statementClassName)) == nullptr) return false;
+        if ((statementHandleField = env->GetFieldID(statementClass, "handle", "J")) == nullptr) return false;
+        if ((statementErrorMethod = env->GetMethodID(statementClass,
+                                                     throwErrorName,
+                                                     throwErrorSignature)) == nullptr)
+            return false;
+        if ((statementErrorMethod2 = env->GetMethodID(statementClass,
+                                                      throwErrorName,
+                                                      throwErrorSignature2)) == nullptr)
+            return false;
 
-JNIEXPORT void JNICALL
-Java_com_oldguy_kiscmp_Sqlite3JniShim_nativeInit(JNIEnv *env, jclass clazz) {
-    if (pShimEnv == nullptr) {
-        pShimEnv = new SqliteEnvironment();
+        if ((backupClass = globalClass(env, backupClassName)) == nullptr) return false;
+        if ((backupHandleField = env->GetFieldID(backupClass, "handle", "J")) == nullptr) return false;
+
+        if ((sessionClass = globalClass(env, sessionClassName)) == nullptr) return false;
+        sessionHandleField = env->GetFieldID(sessionClass, "handle", "J");
+        return sessionHandleField != nullptr;
     }
-    pShimEnv->setDbStatics(env, clazz);
-}
 
-JNIEXPORT void JNICALL
-Java_com_oldguy_kiscmp_Sqlite3StatementJniShim_nativeInit(JNIEnv *env, jclass clazz) {
-    if (pShimEnv == nullptr) {
-        pShimEnv = new SqliteEnvironment();
+private:
+    static jclass globalClass(JNIEnv *env, const char *name) {
+        jclass local = env->FindClass(name);
+        if (local == nullptr) return nullptr;
+        auto global = reinterpret_cast<jclass>(env->NewGlobalRef(local));
+        env->DeleteLocalRef(local);
+        return global;
     }
-    pShimEnv->setStatement(env, clazz);
-}
+};
+
+extern "C" {
+static SqliteEnvironment *pShimEnv = nullptr;
 
 jstring emptyString(JNIEnv *env) {
     return env->NewStringUTF("");
@@ -109,6 +120,13 @@ jstring getJString(JNIEnv *env, const char *pString) {
     return emptyString(env);
 }
 
+jlongArray getJLongArray(JNIEnv *env, const sqlite3_int64 *values, int count) {
+    jlongArray array = env->NewLongArray(count);
+    if (count > 0)
+        env->SetLongArrayRegion(array, 0, count, reinterpret_cast<const jlong *>(values));
+    return array;
+}
+
 void throw_exception(
         JNIEnv *env,
         jobject thiz,
@@ -184,19 +202,21 @@ Java_com_oldguy_kiscmp_Sqlite3JniShim_open(JNIEnv *env,
                                               jobject thiz,
                                               jstring path,
                                               jboolean read_only,
-                                              jboolean create_ok) {
+                                              jboolean create_ok,
+                                              jstring vfs_name) {
     if (pShimEnv == nullptr) return -1;
     if (pShimEnv->handleField == nullptr) return -2;
     if (pShimEnv->errorMethod == nullptr) return -3;
 
     const char *path8 = env->GetStringUTFChars(path, nullptr);
+    const char *vfs8 = env->GetStringUTFChars(vfs_name, nullptr);
     int sqliteFlags = SQLITE_OPEN_READWRITE;
     if (read_only == JNI_TRUE)
         sqliteFlags = SQLITE_OPEN_READONLY;
     if (create_ok == JNI_TRUE)
         sqliteFlags += SQLITE_OPEN_CREATE;
     sqlite3 *handle = nullptr;
-    int err = sqlite3_open_v2(path8, &handle, sqliteFlags, nullptr);
+    int err = sqlite3_open_v2(path8, &handle, sqliteFlags, vfs8[0] == 0 ? nullptr : vfs8);
     if (err != SQLITE_OK) {
         const char *msg = path8;
         if (handle != nullptr) {
@@ -209,6 +229,7 @@ Java_com_oldguy_kiscmp_Sqlite3JniShim_open(JNIEnv *env,
 
     done:
     if (path8 != nullptr) env->ReleaseStringUTFChars(path, path8);
+    if (vfs8 != nullptr) env->ReleaseStringUTFChars(vfs_name, vfs8);
     return 0;
 }
 
@@ -266,12 +287,9 @@ int execCallback(void *pInfoIn, int numColumns, char **results, char **columnNam
         jstring str = getJString(env, columnNames[i]);
         env->SetObjectArrayElement(columnArray, i, str);
     }
-    auto callbackMethod = env->GetMethodID(pShimEnv->shimClass,
-                                      callbackName,
-                                      callbackSignature);
     env->CallVoidMethod(
             pInfo->thiz,
-            callbackMethod,
+            pShimEnv->callbackMethod,
             resultArray,
             columnArray);
     return 0;
@@ -309,20 +327,285 @@ Java_com_oldguy_kiscmp_Sqlite3JniShim_lastInsertRowid(JNIEnv *env, jobject thiz)
 }
 
 /**
- * Return the current version. Turns a char array into null terminated string and converts that to jstring
+ * Reads PRAGMA data_version of a schema, without converting it to text and back.
+ * @return the version, or -1 on error
+ */
+JNIEXPORT jlong JNICALL
+Java_com_oldguy_kiscmp_Sqlite3JniShim_dataVersion(JNIEnv *env, jobject thiz, jstring schema) {
+    auto *handle = getDb(env, thiz);
+    if (handle == nullptr) return -1;
+    const char *schema8 = env->GetStringUTFChars(schema, nullptr);
+    char *zSql = sqlite3_mprintf("PRAGMA \"%w\".data_version", schema8);
+    env->ReleaseStringUTFChars(schema, schema8);
+    if (zSql == nullptr) return -1;
+    sqlite3_stmt *pStmt = nullptr;
+    jlong version = -1;
+    if (sqlite3_prepare_v2(handle, zSql, -1, &pStmt, nullptr) == SQLITE_OK
+        && sqlite3_step(pStmt) == SQLITE_ROW)
+        version = sqlite3_column_int64(pStmt, 0);
+    sqlite3_finalize(pStmt);
+    sqlite3_free(zSql);
+    return version;
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_oldguy_kiscmp_Sqlite3JniShim_totalChanges(JNIEnv *env, jobject thiz) {
+    auto *handle = getDb(env, thiz);
+    if (handle == nullptr) return -1;
+    return sqlite3_total_changes64(handle);
+}
+
+/**
+ * Return the current version. SQLITE_VERSION is a null terminated string literal, converted to jstring
  * @param env
  * @param _
  * @return
  */
 JNIEXPORT jstring JNICALL
 Java_com_oldguy_kiscmp_Sqlite3JniShim_version(JNIEnv *env, [[maybe_unused]] jobject thiz) {
-    int sz = sizeof(SQLITE_VERSION);
-    char *wrk = new char(sz + 1);
-    memcpy(wrk, SQLITE_VERSION, sz);
-    wrk[sz] = 0;
-    jstring s = getJString(env, wrk);
-    delete wrk;
-    return s;
+    return getJString(env, SQLITE_VERSION);
+}
+
+/**
+ * True if the Sqlite library linked in was built with the option, given without the SQLITE_
+ * prefix. Optional apis missing from the library are only called after checking this.
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_oldguy_kiscmp_Sqlite3JniShim_compileOptionUsed(JNIEnv *env,
+                                                           [[maybe_unused]] jobject thiz,
+                                                           jstring option) {
+    const char *option8 = env->GetStringUTFChars(option, nullptr);
+    int used = sqlite3_compileoption_used(option8);
+    env->ReleaseStringUTFChars(option, option8);
+    return used ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT jint JNICALL
+Java_com_oldguy_kiscmp_Sqlite3JniShim_registerReadaheadVfs([[maybe_unused]] JNIEnv *env,
+                                                              [[maybe_unused]] jobject thiz,
+                                                              jint max_pages,
+                                                              jboolean make_default) {
+    return kmpsql_readahead_register(nullptr, max_pages, make_default == JNI_TRUE ? 1 : 0);
+}
+
+/**
+ * Sets the readahead window of the main database file of this connection only.
+ * @param max_pages new window, negative to only read it
+ * @return previous window, -1 if not open through a kmpsql VFS
+ */
+JNIEXPORT jint JNICALL
+Java_com_oldguy_kiscmp_Sqlite3JniShim_readaheadWindow(JNIEnv *env, jobject thiz, jint max_pages) {
+    auto *handle = getDb(env, thiz);
+    if (handle == nullptr) return -1;
+    return kmpsql_readahead_file(handle, "main", max_pages);
+}
+
+/**
+ * Registers or reconfigures a latency injecting VFS.
+ * @param config values indexed by the KMPSQL_LATENCY values in kmpsql.h
+ */
+JNIEXPORT jint JNICALL
+Java_com_oldguy_kiscmp_Sqlite3JniShim_registerLatencyVfs(JNIEnv *env,
+                                                            [[maybe_unused]] jobject thiz,
+                                                            jstring vfs_name,
+                                                            jlongArray config) {
+    sqlite3_int64 values[KMPSQL_LATENCY_COUNT] = {};
+    jsize count = env->GetArrayLength(config);
+    if (count > KMPSQL_LATENCY_COUNT)
+        count = KMPSQL_LATENCY_COUNT;
+    env->GetLongArrayRegion(config, 0, count, reinterpret_cast<jlong *>(values));
+    const char *vfs8 = env->GetStringUTFChars(vfs_name, nullptr);
+    int rc = kmpsql_latency_register(vfs8, nullptr, values, KMPSQL_LATENCY_COUNT);
+    env->ReleaseStringUTFChars(vfs_name, vfs8);
+    return rc;
+}
+
+JNIEXPORT jint JNICALL
+Java_com_oldguy_kiscmp_Sqlite3JniShim_registerMetricsVfs([[maybe_unused]] JNIEnv *env,
+                                                            [[maybe_unused]] jobject thiz,
+                                                            jboolean make_default) {
+    return kmpsql_metrics_register(nullptr, make_default == JNI_TRUE ? 1 : 0);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_oldguy_kiscmp_Sqlite3JniShim_registerTrackingVfs([[maybe_unused]] JNIEnv *env,
+                                                             [[maybe_unused]] jobject thiz,
+                                                             jboolean make_default) {
+    return kmpsql_tracking_register(nullptr, make_default == JNI_TRUE ? 1 : 0);
+}
+
+/**
+ * Writes the pages changed since the last delta to a new delta file.
+ * @param info receives the KMPSQL_DELTA values on success
+ * @return Sqlite result code
+ */
+JNIEXPORT jint JNICALL
+Java_com_oldguy_kiscmp_Sqlite3JniShim_writeDelta(JNIEnv *env,
+                                                    jobject thiz,
+                                                    jstring delta_path,
+                                                    jboolean full,
+                                                    jlongArray info) {
+    sqlite3_int64 values[KMPSQL_DELTA_COUNT] = {};
+    auto *handle = getDb(env, thiz);
+    if (handle == nullptr) return SQLITE_MISUSE;
+    const char *path8 = env->GetStringUTFChars(delta_path, nullptr);
+    int rc = kmpsql_delta_write(handle, path8, full == JNI_TRUE ? 1 : 0, values, KMPSQL_DELTA_COUNT);
+    env->ReleaseStringUTFChars(delta_path, path8);
+    if (rc == SQLITE_OK && env->GetArrayLength(info) >= KMPSQL_DELTA_COUNT)
+        env->SetLongArrayRegion(info, 0, KMPSQL_DELTA_COUNT, reinterpret_cast<const jlong *>(values));
+    return rc;
+}
+
+/**
+ * Applies a delta file to a closed copy of a database.
+ * @param info receives the KMPSQL_DELTA values on success
+ * @return Sqlite result code
+ */
+JNIEXPORT jint JNICALL
+Java_com_oldguy_kiscmp_Sqlite3JniShim_applyDelta(JNIEnv *env,
+                                                    [[maybe_unused]] jobject thiz,
+                                                    jstring delta_path,
+                                                    jstring target_path,
+                                                    jlong base_epoch,
+                                                    jlongArray info) {
+    sqlite3_int64 values[KMPSQL_DELTA_COUNT] = {};
+    const char *delta8 = env->GetStringUTFChars(delta_path, nullptr);
+    const char *target8 = env->GetStringUTFChars(target_path, nullptr);
+    int rc = kmpsql_delta_apply(delta8, target8, base_epoch, values, KMPSQL_DELTA_COUNT);
+    env->ReleaseStringUTFChars(delta_path, delta8);
+    env->ReleaseStringUTFChars(target_path, target8);
+    if (rc == SQLITE_OK && env->GetArrayLength(info) >= KMPSQL_DELTA_COUNT)
+        env->SetLongArrayRegion(info, 0, KMPSQL_DELTA_COUNT, reinterpret_cast<const jlong *>(values));
+    return rc;
+}
+
+/**
+ * Metrics kept by a kmpsql VFS, summed over all files it has opened. See kmpsql.h for the
+ * meaning of each index.
+ * @return array of KMPSQL_METRIC_COUNT values, empty if vfs_name is not a kmpsql VFS
+ */
+JNIEXPORT jlongArray JNICALL
+Java_com_oldguy_kiscmp_Sqlite3JniShim_vfsMetrics(JNIEnv *env,
+                                                    [[maybe_unused]] jobject thiz,
+                                                    jstring vfs_name) {
+    sqlite3_int64 metrics[KMPSQL_METRIC_COUNT];
+    const char *vfs8 = env->GetStringUTFChars(vfs_name, nullptr);
+    int rc = kmpsql_vfs_metrics(vfs8, metrics, KMPSQL_METRIC_COUNT);
+    env->ReleaseStringUTFChars(vfs_name, vfs8);
+    return getJLongArray(env, metrics, rc == SQLITE_OK ? KMPSQL_METRIC_COUNT : 0);
+}
+
+/**
+ * Same as vfsMetrics, but only for the main database file of this connection.
+ */
+JNIEXPORT jlongArray JNICALL
+Java_com_oldguy_kiscmp_Sqlite3JniShim_fileMetrics(JNIEnv *env, jobject thiz) {
+    sqlite3_int64 metrics[KMPSQL_METRIC_COUNT];
+    auto *handle = getDb(env, thiz);
+    int rc = SQLITE_NOTFOUND;
+    if (handle != nullptr)
+        rc = kmpsql_vfs_file_metrics(handle, "main", metrics, KMPSQL_METRIC_COUNT);
+    return getJLongArray(env, metrics, rc == SQLITE_OK ? KMPSQL_METRIC_COUNT : 0);
+}
+
+/**
+ * Process-wide Sqlite heap use, including the buffers SqlCipher allocates through Sqlite. Does
+ * not need an open database.
+ * @param reset_highwater true to restart the high water mark at the current use
+ * @return bytes in use and the highest use since the last reset
+ */
+JNIEXPORT jlongArray JNICALL
+Java_com_oldguy_kiscmp_Sqlite3JniShim_memoryStatus([[maybe_unused]] JNIEnv *env,
+                                                      [[maybe_unused]] jobject thiz,
+                                                      jboolean reset_highwater) {
+    sqlite3_int64 values[] = {sqlite3_memory_used(), sqlite3_memory_highwater(reset_highwater)};
+    return getJLongArray(env, values, 2);
+}
+
+/**
+ * sqlite3_db_status of this connection for every op from 0 to SQLITE_DBSTATUS_MAX.
+ * @param reset true to reset the high water marks, and the hit, miss, write and spill counters
+ * @return current value and high water mark of each op in op order, empty if closed
+ */
+JNIEXPORT jlongArray JNICALL
+Java_com_oldguy_kiscmp_Sqlite3JniShim_dbStatus(JNIEnv *env, jobject thiz, jboolean reset) {
+    constexpr int count = (SQLITE_DBSTATUS_MAX + 1) * 2;
+    sqlite3_int64 values[count] = {};
+    auto *handle = getDb(env, thiz);
+    if (handle == nullptr)
+        return getJLongArray(env, values, 0);
+    for (int op = 0; op <= SQLITE_DBSTATUS_MAX; op++) {
+        int current = 0;
+        int highwater = 0;
+        if (sqlite3_db_status(handle, op, &current, &highwater, reset) == SQLITE_OK) {
+            values[op * 2] = current;
+            values[op * 2 + 1] = highwater;
+        }
+    }
+    return getJLongArray(env, values, count);
+}
+
+/**
+ * Copy of the content of a schema of this connection, in database file format.
+ * @return the image, empty if the schema does not exist or on error
+ */
+JNIEXPORT jbyteArray JNICALL
+Java_com_oldguy_kiscmp_Sqlite3JniShim_serialize(JNIEnv *env, jobject thiz, jstring schema) {
+    auto *handle = getDb(env, thiz);
+    if (handle == nullptr) return env->NewByteArray(0);
+    sqlite3_int64 size = 0;
+    const char *schema8 = env->GetStringUTFChars(schema, nullptr);
+    unsigned char *image = sqlite3_serialize(handle, schema8, &size, 0);
+    env->ReleaseStringUTFChars(schema, schema8);
+    if (image == nullptr) return env->NewByteArray(0);
+    jbyteArray bytes = env->NewByteArray(static_cast<jsize>(size));
+    env->SetByteArrayRegion(bytes, 0, static_cast<jsize>(size), reinterpret_cast<jbyte *>(image));
+    sqlite3_free(image);
+    return bytes;
+}
+
+/**
+ * Replaces the content of a schema with a copy of an image. The copy is owned by Sqlite and
+ * freed when the connection closes.
+ * @return Sqlite result code
+ */
+JNIEXPORT jint JNICALL
+Java_com_oldguy_kiscmp_Sqlite3JniShim_deserialize(JNIEnv *env,
+                                                     jobject thiz,
+                                                     jstring schema,
+                                                     jbyteArray image,
+                                                     jboolean read_only) {
+    auto *handle = getDb(env, thiz);
+    if (handle == nullptr) return SQLITE_MISUSE;
+    jsize len = env->GetArrayLength(image);
+    auto *buf = static_cast<unsigned char *>(sqlite3_malloc64(len > 0 ? len : 1));
+    if (buf == nullptr) return SQLITE_NOMEM;
+    env->GetByteArrayRegion(image, 0, len, reinterpret_cast<jbyte *>(buf));
+    unsigned int flags = SQLITE_DESERIALIZE_FREEONCLOSE |
+            (read_only == JNI_TRUE ? SQLITE_DESERIALIZE_READONLY : SQLITE_DESERIALIZE_RESIZEABLE);
+    const char *schema8 = env->GetStringUTFChars(schema, nullptr);
+    int rc = sqlite3_deserialize(handle, schema8, buf, len, len, flags);
+    env->ReleaseStringUTFChars(schema, schema8);
+    return rc;
+}
+
+/**
+ * Replaces the content of a schema with a read-only memory mapping of an image file.
+ * @return Sqlite result code
+ */
+JNIEXPORT jint JNICALL
+Java_com_oldguy_kiscmp_Sqlite3JniShim_deserializeMapped(JNIEnv *env,
+                                                           jobject thiz,
+                                                           jstring schema,
+                                                           jstring path) {
+    auto *handle = getDb(env, thiz);
+    if (handle == nullptr) return SQLITE_MISUSE;
+    const char *schema8 = env->GetStringUTFChars(schema, nullptr);
+    const char *path8 = env->GetStringUTFChars(path, nullptr);
+    int rc = kmpsql_deserialize_mapped(handle, schema8, path8);
+    env->ReleaseStringUTFChars(schema, schema8);
+    env->ReleaseStringUTFChars(path, path8);
+    return rc;
 }
 
 JNIEXPORT jint JNICALL
@@ -520,6 +803,32 @@ Java_com_oldguy_kiscmp_Sqlite3StatementJniShim_isBusy(JNIEnv *env, jobject thiz)
     return JNI_FALSE;
 }
 
+/**
+ * Counters of one loop of the statement's query plan since it was prepared, see
+ * sqlite3_stmt_scanstatus. Requires SQLITE_ENABLE_STMT_SCANSTATUS.
+ * @param index loop number, 0 for the first
+ * @param counts receives the times the loop ran, the rows it visited and its select id
+ * @return EXPLAIN QUERY PLAN detail of the loop, null if index is past the last loop
+ */
+JNIEXPORT jstring JNICALL
+Java_com_oldguy_kiscmp_Sqlite3StatementJniShim_scanStatus(JNIEnv *env, jobject thiz,
+                                                             jint index, jlongArray counts) {
+    auto pStmt = getStatement(env, thiz, "stmt_scanstatus");
+    if (pStmt == nullptr) return nullptr;
+    sqlite3_int64 loops = 0;
+    sqlite3_int64 visits = 0;
+    int selectId = 0;
+    const char *explain = nullptr;
+    if (sqlite3_stmt_scanstatus(pStmt, index, SQLITE_SCANSTAT_NLOOP, &loops) != 0
+        || sqlite3_stmt_scanstatus(pStmt, index, SQLITE_SCANSTAT_NVISIT, &visits) != 0
+        || sqlite3_stmt_scanstatus(pStmt, index, SQLITE_SCANSTAT_SELECTID, &selectId) != 0
+        || sqlite3_stmt_scanstatus(pStmt, index, SQLITE_SCANSTAT_EXPLAIN, &explain) != 0)
+        return nullptr;
+    jlong values[] = {loops, visits, selectId};
+    env->SetLongArrayRegion(counts, 0, 3, values);
+    return getJString(env, explain);
+}
+
 JNIEXPORT jint JNICALL
 Java_com_oldguy_kiscmp_Sqlite3StatementJniShim_columnCount(JNIEnv *env, jobject thiz) {
     auto pStmt = getStatement(env, thiz, "column_count");
@@ -640,4 +949,491 @@ Java_com_oldguy_kiscmp_Sqlite3StatementJniShim_columnBlob(JNIEnv *env, jobject t
     return env->NewByteArray(0);
 }
 
-}
\ No newline at end of file
+/**
+ * Returns the current backup pointer, or nullptr if none.
+ * @param thiz must be an instance of Sqlite3BackupJniShim
+ */
+sqlite3_backup *getBackup(JNIEnv *env, jobject thiz) {
+    return (sqlite3_backup *) env->GetLongField(thiz, pShimEnv->backupHandleField);
+}
+
+/**
+ * Starts an online backup of the main database of source_handle into the main database of
+ * dest_handle.
+ * @return SQLITE_OK, or the error code of the destination connection
+ */
+JNIEXPORT jint JNICALL
+Java_com_oldguy_kiscmp_Sqlite3BackupJniShim_init(JNIEnv *env,
+                                                    jobject thiz,
+                                                    jlong dest_handle,
+                                                    jlong source_handle) {
+    auto *dest = (sqlite3 *) dest_handle;
+    auto *source = (sqlite3 *) source_handle;
+    if (dest == nullptr || source == nullptr) return SQLITE_MISUSE;
+    sqlite3_backup *pBackup = sqlite3_backup_init(dest, "main", source, "main");
+    if (pBackup == nullptr) return sqlite3_errcode(dest);
+    env->SetLongField(thiz, pShimEnv->backupHandleField, (intptr_t) pBackup);
+    return SQLITE_OK;
+}
+
+/**
+ * @return 1 error, 2 done, 3 ok (more pages remain), 4 busy, 5 locked
+ */
+JNIEXPORT jint JNICALL
+Java_com_oldguy_kiscmp_Sqlite3BackupJniShim_stepInt(JNIEnv *env, jobject thiz, jint pages) {
+    auto pBackup = getBackup(env, thiz);
+    if (pBackup != nullptr) {
+        int result = sqlite3_backup_step(pBackup, pages) & 0xff;
+        if (result == SQLITE_DONE) return 2;
+        if (result == SQLITE_OK) return 3;
+        if (result == SQLITE_BUSY) return 4;
+        if (result == SQLITE_LOCKED) return 5;
+    }
+    return 1;
+}
+
+JNIEXPORT jint JNICALL
+Java_com_oldguy_kiscmp_Sqlite3BackupJniShim_remaining(JNIEnv *env, jobject thiz) {
+    auto pBackup = getBackup(env, thiz);
+    return pBackup == nullptr ? 0 : sqlite3_backup_remaining(pBackup);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_oldguy_kiscmp_Sqlite3BackupJniShim_pageCount(JNIEnv *env, jobject thiz) {
+    auto pBackup = getBackup(env, thiz);
+    return pBackup == nullptr ? 0 : sqlite3_backup_pagecount(pBackup);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_oldguy_kiscmp_Sqlite3BackupJniShim_finish(JNIEnv *env, jobject thiz) {
+    auto pBackup = getBackup(env, thiz);
+    if (pBackup == nullptr) return SQLITE_OK;
+    env->SetLongField(thiz, pShimEnv->backupHandleField, 0);
+    return sqlite3_backup_finish(pBackup);
+}
+
+/**
+ * Atomically replaces a closed database file with another file.
+ * @return Sqlite result code
+ */
+JNIEXPORT jint JNICALL
+Java_com_oldguy_kiscmp_Sqlite3JniShim_replaceFile(JNIEnv *env,
+                                                     [[maybe_unused]] jobject thiz,
+                                                     jstring source_path,
+                                                     jstring target_path) {
+    const char *source8 = env->GetStringUTFChars(source_path, nullptr);
+    const char *target8 = env->GetStringUTFChars(target_path, nullptr);
+    int rc = kmpsql_file_replace(source8, target8);
+    env->ReleaseStringUTFChars(source_path, source8);
+    env->ReleaseStringUTFChars(target_path, target8);
+    return rc;
+}
+
+/**
+ * Deletes a closed database file and the files Sqlite keeps next to it.
+ * @return Sqlite result code
+ */
+JNIEXPORT jint JNICALL
+Java_com_oldguy_kiscmp_Sqlite3JniShim_removeFile(JNIEnv *env,
+                                                    [[maybe_unused]] jobject thiz,
+                                                    jstring path) {
+    const char *path8 = env->GetStringUTFChars(path, nullptr);
+    int rc = kmpsql_file_remove(path8);
+    env->ReleaseStringUTFChars(path, path8);
+    return rc;
+}
+
+/**
+ * Records the snapshot read by the open read transaction on a schema. Snapshot pointers are passed
+ * to kotlin as longs, like the other handles.
+ * @param snapshot receives the sqlite3_snapshot pointer in its first entry on success
+ * @return Sqlite result code
+ */
+JNIEXPORT jint JNICALL
+Java_com_oldguy_kiscmp_Sqlite3JniShim_snapshotGet(JNIEnv *env,
+                                                     jobject thiz,
+                                                     jstring schema,
+                                                     jlongArray snapshot) {
+    auto *handle = getDb(env, thiz);
+    if (handle == nullptr) return SQLITE_MISUSE;
+    sqlite3_snapshot *pSnapshot = nullptr;
+    const char *schema8 = env->GetStringUTFChars(schema, nullptr);
+    int rc = sqlite3_snapshot_get(handle, schema8, &pSnapshot);
+    env->ReleaseStringUTFChars(schema, schema8);
+    if (rc == SQLITE_OK) {
+        jlong value = (intptr_t) pSnapshot;
+        env->SetLongArrayRegion(snapshot, 0, 1, &value);
+    }
+    return rc;
+}
+
+/**
+ * Starts the read transaction of a schema on a snapshot recorded by snapshotGet, possibly on
+ * another connection to the same database.
+ * @return Sqlite result code, SQLITE_ERROR_SNAPSHOT if the snapshot is no longer available
+ */
+JNIEXPORT jint JNICALL
+Java_com_oldguy_kiscmp_Sqlite3JniShim_snapshotOpen(JNIEnv *env,
+                                                      jobject thiz,
+                                                      jstring schema,
+                                                      jlong snapshot) {
+    auto *handle = getDb(env, thiz);
+    if (handle == nullptr || snapshot == 0) return SQLITE_MISUSE;
+    const char *schema8 = env->GetStringUTFChars(schema, nullptr);
+    int rc = sqlite3_snapshot_open(handle, schema8, (sqlite3_snapshot *) snapshot);
+    env->ReleaseStringUTFChars(schema, schema8);
+    return rc;
+}
+
+JNIEXPORT jint JNICALL
+Java_com_oldguy_kiscmp_Sqlite3JniShim_snapshotCompare([[maybe_unused]] JNIEnv *env,
+                                                         [[maybe_unused]] jobject thiz,
+                                                         jlong snapshot,
+                                                         jlong other) {
+    if (snapshot == 0 || other == 0) return 0;
+    return sqlite3_snapshot_cmp((sqlite3_snapshot *) snapshot, (sqlite3_snapshot *) other);
+}
+
+JNIEXPORT void JNICALL
+Java_com_oldguy_kiscmp_Sqlite3JniShim_snapshotFree([[maybe_unused]] JNIEnv *env,
+                                                      [[maybe_unused]] jobject thiz,
+                                                      jlong snapshot) {
+    if (snapshot != 0)
+        sqlite3_snapshot_free((sqlite3_snapshot *) snapshot);
+}
+
+/**
+ * Calls the conflict method of the Sqlite3JniShim for each conflict found by a changeset apply.
+ * The conflict type is passed as an ordinal, 0 data, 1 not found, 2 conflict, 3 constraint,
+ * 4 foreign key, and the operation as 0 insert, 1 update, 2 delete. The kotlin return value is
+ * the SQLITE_CHANGESET action, 0 omit, 1 replace, 2 abort. An exception thrown by the kotlin
+ * callback aborts the apply, and is rethrown once the apply returns.
+ */
+int conflictCallback(void *pInfoIn, int eConflict, sqlite3_changeset_iter *pIter) {
+    auto *pInfo = static_cast<CallbackEnv *>(pInfoIn);
+    auto *env = pInfo->env;
+    const char *table = nullptr;
+    int columns = 0;
+    int op = 0;
+    int indirect = 0;
+    sqlite3changeset_op(pIter, &table, &columns, &op, &indirect);
+    int opOrdinal = op == SQLITE_INSERT ? 0 : op == SQLITE_UPDATE ? 1 : 2;
+    jstring tableStr = getJString(env, table);
+    jint action = env->CallIntMethod(pInfo->thiz, pShimEnv->conflictMethod, eConflict - 1, tableStr, opOrdinal);
+    env->DeleteLocalRef(tableStr);
+    if (env->ExceptionCheck()) return SQLITE_CHANGESET_ABORT;
+    return action;
+}
+
+/**
+ * Applies a changeset or patchset in one savepoint, calling conflict for each conflict.
+ * @return Sqlite result code, SQLITE_ABORT if a conflict aborted the apply
+ */
+JNIEXPORT jint JNICALL
+Java_com_oldguy_kiscmp_Sqlite3JniShim_applyChangeset(JNIEnv *env, jobject thiz, jbyteArray changeset) {
+    auto *handle = getDb(env, thiz);
+    if (handle == nullptr) return SQLITE_MISUSE;
+    CallbackEnv info = {env, thiz};
+    jsize len = env->GetArrayLength(changeset);
+    jbyte *pSet = env->GetByteArrayElements(changeset, nullptr);
+    int rc = sqlite3changeset_apply_v2(handle, len, pSet, nullptr, conflictCallback, &info,
+                                       nullptr, nullptr, 0);
+    env->ReleaseByteArrayElements(changeset, pSet, JNI_ABORT);
+    return rc;
+}
+
+/**
+ * Same as applyChangeset, streaming the set from a file.
+ */
+JNIEXPORT jint JNICALL
+Java_com_oldguy_kiscmp_Sqlite3JniShim_applyChangesetFile(JNIEnv *env, jobject thiz, jstring path) {
+    auto *handle = getDb(env, thiz);
+    if (handle == nullptr) return SQLITE_MISUSE;
+    CallbackEnv info = {env, thiz};
+    const char *path8 = env->GetStringUTFChars(path, nullptr);
+    int rc = kmpsql_changeset_apply_file(handle, path8, conflictCallback, &info);
+    env->ReleaseStringUTFChars(path, path8);
+    return rc;
+}
+
+/**
+ * Changeset that undoes the given one. Throws on error.
+ */
+JNIEXPORT jbyteArray JNICALL
+Java_com_oldguy_kiscmp_Sqlite3JniShim_invertChangeset(JNIEnv *env, jobject thiz, jbyteArray changeset) {
+    jsize len = env->GetArrayLength(changeset);
+    jbyte *pSet = env->GetByteArrayElements(changeset, nullptr);
+    int size = 0;
+    void *pInverted = nullptr;
+    int rc = sqlite3changeset_invert(len, pSet, &size, &pInverted);
+    env->ReleaseByteArrayElements(changeset, pSet, JNI_ABORT);
+    if (rc != SQLITE_OK) {
+        throw_exception(env, thiz, "changeset_invert", rc, sqlite3_errstr(rc));
+        return env->NewByteArray(0);
+    }
+    jbyteArray bytes = env->NewByteArray(size);
+    if (size > 0)
+        env->SetByteArrayRegion(bytes, 0, size, reinterpret_cast<jbyte *>(pInverted));
+    sqlite3_free(pInverted);
+    return bytes;
+}
+
+/**
+ * Merges changesets into one with a changegroup, in order. Throws on error.
+ */
+JNIEXPORT jbyteArray JNICALL
+Java_com_oldguy_kiscmp_Sqlite3JniShim_combineChangesets(JNIEnv *env, jobject thiz, jobjectArray changesets) {
+    sqlite3_changegroup *pGroup = nullptr;
+    int rc = sqlite3changegroup_new(&pGroup);
+    jsize count = env->GetArrayLength(changesets);
+    for (jsize i = 0; i < count && rc == SQLITE_OK; i++) {
+        auto changeset = reinterpret_cast<jbyteArray>(env->GetObjectArrayElement(changesets, i));
+        jsize len = env->GetArrayLength(changeset);
+        jbyte *pSet = env->GetByteArrayElements(changeset, nullptr);
+        rc = sqlite3changegroup_add(pGroup, len, pSet);
+        env->ReleaseByteArrayElements(changeset, pSet, JNI_ABORT);
+        env->DeleteLocalRef(changeset);
+    }
+    int size = 0;
+    void *pCombined = nullptr;
+    if (rc == SQLITE_OK)
+        rc = sqlite3changegroup_output(pGroup, &size, &pCombined);
+    sqlite3changegroup_delete(pGroup);
+    if (rc != SQLITE_OK) {
+        throw_exception(env, thiz, "changegroup", rc, sqlite3_errstr(rc));
+        return env->NewByteArray(0);
+    }
+    jbyteArray bytes = env->NewByteArray(size);
+    if (size > 0)
+        env->SetByteArrayRegion(bytes, 0, size, reinterpret_cast<jbyte *>(pCombined));
+    sqlite3_free(pCombined);
+    return bytes;
+}
+
+/**
+ * Returns the current session pointer, or nullptr if none.
+ * @param thiz must be an instance of Sqlite3SessionJniShim
+ */
+sqlite3_session *getSession(JNIEnv *env, jobject thiz) {
+    return (sqlite3_session *) env->GetLongField(thiz, pShimEnv->sessionHandleField);
+}
+
+/**
+ * Creates a session recording changes to one schema of db_handle. No tables are recorded until
+ * attach is called.
+ * @param rowid_tables true to also record tables without a primary key, by rowid
+ * @return Sqlite result code
+ */
+JNIEXPORT jint JNICALL
+Java_com_oldguy_kiscmp_Sqlite3SessionJniShim_create(JNIEnv *env,
+                                                       jobject thiz,
+                                                       jlong db_handle,
+                                                       jstring schema,
+                                                       jboolean rowid_tables) {
+    auto *db = (sqlite3 *) db_handle;
+    if (db == nullptr) return SQLITE_MISUSE;
+    sqlite3_session *pSession = nullptr;
+    const char *schema8 = env->GetStringUTFChars(schema, nullptr);
+    int rc = sqlite3session_create(db, schema8, &pSession);
+    env->ReleaseStringUTFChars(schema, schema8);
+    if (rc == SQLITE_OK && rowid_tables == JNI_TRUE) {
+        int enable = 1;
+        rc = sqlite3session_object_config(pSession, SQLITE_SESSION_OBJCONFIG_ROWID, &enable);
+        if (rc != SQLITE_OK)
+            sqlite3session_delete(pSession);
+    }
+    if (rc == SQLITE_OK)
+        env->SetLongField(thiz, pShimEnv->sessionHandleField, (intptr_t) pSession);
+    return rc;
+}
+
+/**
+ * Starts recording a table, or every table of the schema if table is empty.
+ * @return Sqlite result code
+ */
+JNIEXPORT jint JNICALL
+Java_com_oldguy_kiscmp_Sqlite3SessionJniShim_attach(JNIEnv *env, jobject thiz, jstring table) {
+    auto pSession = getSession(env, thiz);
+    if (pSession == nullptr) return SQLITE_MISUSE;
+    const char *table8 = env->GetStringUTFChars(table, nullptr);
+    int rc = sqlite3session_attach(pSession, table8[0] == 0 ? nullptr : table8);
+    env->ReleaseStringUTFChars(table, table8);
+    return rc;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_oldguy_kiscmp_Sqlite3SessionJniShim_isEmpty(JNIEnv *env, jobject thiz) {
+    auto pSession = getSession(env, thiz);
+    return pSession == nullptr || sqlite3session_isempty(pSession) ? JNI_TRUE : JNI_FALSE;
+}
+
+/**
+ * Changes recorded so far, as one changeset or patchset.
+ * @return the set, empty if nothing was recorded or on error
+ */
+JNIEXPORT jbyteArray JNICALL
+Java_com_oldguy_kiscmp_Sqlite3SessionJniShim_changeset(JNIEnv *env, jobject thiz, jboolean patchset) {
+    auto pSession = getSession(env, thiz);
+    if (pSession == nullptr) return env->NewByteArray(0);
+    int size = 0;
+    void *pSet = nullptr;
+    int rc = patchset == JNI_TRUE
+            ? sqlite3session_patchset(pSession, &size, &pSet)
+            : sqlite3session_changeset(pSession, &size, &pSet);
+    jbyteArray bytes = env->NewByteArray(rc == SQLITE_OK ? size : 0);
+    if (rc == SQLITE_OK && size > 0)
+        env->SetByteArrayRegion(bytes, 0, size, reinterpret_cast<jbyte *>(pSet));
+    sqlite3_free(pSet);
+    return bytes;
+}
+
+/**
+ * Streams the changes recorded so far into a new file.
+ * @return Sqlite result code
+ */
+JNIEXPORT jint JNICALL
+Java_com_oldguy_kiscmp_Sqlite3SessionJniShim_write(JNIEnv *env,
+                                                      jobject thiz,
+                                                      jstring path,
+                                                      jboolean patchset) {
+    auto pSession = getSession(env, thiz);
+    if (pSession == nullptr) return SQLITE_MISUSE;
+    const char *path8 = env->GetStringUTFChars(path, nullptr);
+    int rc = kmpsql_session_write(pSession, path8, patchset == JNI_TRUE ? 1 : 0);
+    env->ReleaseStringUTFChars(path, path8);
+    return rc;
+}
+
+JNIEXPORT void JNICALL
+Java_com_oldguy_kiscmp_Sqlite3SessionJniShim_delete(JNIEnv *env, jobject thiz) {
+    auto pSession = getSession(env, thiz);
+    if (pSession == nullptr) return;
+    env->SetLongField(thiz, pShimEnv->sessionHandleField, 0);
+    sqlite3session_delete(pSession);
+}
+
+/*
+ * Every native function of the shim classes, registered by JNI_OnLoad so the JVM does not have to
+ * resolve each Java_com_oldguy_kiscmp_* symbol the first time it is called. A function added to
+ * a shim class must be added here too, JNI_OnLoad fails if a name or signature does not match.
+ */
+#define KMPSQL_NATIVE(name, signature, function) \
+    {const_cast<char *>(name), const_cast<char *>(signature), reinterpret_cast<void *>(function)}
+
+static const JNINativeMethod shimMethods[] = {
+        KMPSQL_NATIVE("error", "()Ljava/lang/String;", Java_com_oldguy_kiscmp_Sqlite3JniShim_error),
+        KMPSQL_NATIVE("fileName", "()Ljava/lang/String;", Java_com_oldguy_kiscmp_Sqlite3JniShim_fileName),
+        KMPSQL_NATIVE("open", "(Ljava/lang/String;ZZLjava/lang/String;)I", Java_com_oldguy_kiscmp_Sqlite3JniShim_open),
+        KMPSQL_NATIVE("close", "()I", Java_com_oldguy_kiscmp_Sqlite3JniShim_close),
+        KMPSQL_NATIVE("softHeapLimit", "(J)J", Java_com_oldguy_kiscmp_Sqlite3JniShim_softHeapLimit),
+        KMPSQL_NATIVE("busyTimeout", "(I)V", Java_com_oldguy_kiscmp_Sqlite3JniShim_busyTimeout),
+        KMPSQL_NATIVE("exec", "(Ljava/lang/String;)I", Java_com_oldguy_kiscmp_Sqlite3JniShim_exec),
+        KMPSQL_NATIVE("version", "()Ljava/lang/String;", Java_com_oldguy_kiscmp_Sqlite3JniShim_version),
+        KMPSQL_NATIVE("compileOptionUsed", "(Ljava/lang/String;)Z", Java_com_oldguy_kiscmp_Sqlite3JniShim_compileOptionUsed),
+        KMPSQL_NATIVE("lastInsertRowid", "()J", Java_com_oldguy_kiscmp_Sqlite3JniShim_lastInsertRowid),
+        KMPSQL_NATIVE("dataVersion", "(Ljava/lang/String;)J", Java_com_oldguy_kiscmp_Sqlite3JniShim_dataVersion),
+        KMPSQL_NATIVE("totalChanges", "()J", Java_com_oldguy_kiscmp_Sqlite3JniShim_totalChanges),
+        KMPSQL_NATIVE("sleep", "(I)V", Java_com_oldguy_kiscmp_Sqlite3JniShim_sleep),
+        KMPSQL_NATIVE("registerReadaheadVfs", "(IZ)I", Java_com_oldguy_kiscmp_Sqlite3JniShim_registerReadaheadVfs),
+        KMPSQL_NATIVE("readaheadWindow", "(I)I", Java_com_oldguy_kiscmp_Sqlite3JniShim_readaheadWindow),
+        KMPSQL_NATIVE("registerLatencyVfs", "(Ljava/lang/String;[J)I", Java_com_oldguy_kiscmp_Sqlite3JniShim_registerLatencyVfs),
+        KMPSQL_NATIVE("registerMetricsVfs", "(Z)I", Java_com_oldguy_kiscmp_Sqlite3JniShim_registerMetricsVfs),
+        KMPSQL_NATIVE("registerTrackingVfs", "(Z)I", Java_com_oldguy_kiscmp_Sqlite3JniShim_registerTrackingVfs),
+        KMPSQL_NATIVE("writeDelta", "(Ljava/lang/String;Z[J)I", Java_com_oldguy_kiscmp_Sqlite3JniShim_writeDelta),
+        KMPSQL_NATIVE("applyDelta", "(Ljava/lang/String;Ljava/lang/String;J[J)I", Java_com_oldguy_kiscmp_Sqlite3JniShim_applyDelta),
+        KMPSQL_NATIVE("vfsMetrics", "(Ljava/lang/String;)[J", Java_com_oldguy_kiscmp_Sqlite3JniShim_vfsMetrics),
+        KMPSQL_NATIVE("fileMetrics", "()[J", Java_com_oldguy_kiscmp_Sqlite3JniShim_fileMetrics),
+        KMPSQL_NATIVE("memoryStatus", "(Z)[J", Java_com_oldguy_kiscmp_Sqlite3JniShim_memoryStatus),
+        KMPSQL_NATIVE("dbStatus", "(Z)[J", Java_com_oldguy_kiscmp_Sqlite3JniShim_dbStatus),
+        KMPSQL_NATIVE("applyChangeset", "([B)I", Java_com_oldguy_kiscmp_Sqlite3JniShim_applyChangeset),
+        KMPSQL_NATIVE("applyChangesetFile", "(Ljava/lang/String;)I", Java_com_oldguy_kiscmp_Sqlite3JniShim_applyChangesetFile),
+        KMPSQL_NATIVE("invertChangeset", "([B)[B", Java_com_oldguy_kiscmp_Sqlite3JniShim_invertChangeset),
+        KMPSQL_NATIVE("combineChangesets", "([[B)[B", Java_com_oldguy_kiscmp_Sqlite3JniShim_combineChangesets),
+        KMPSQL_NATIVE("serialize", "(Ljava/lang/String;)[B", Java_com_oldguy_kiscmp_Sqlite3JniShim_serialize),
+        KMPSQL_NATIVE("deserialize", "(Ljava/lang/String;[BZ)I", Java_com_oldguy_kiscmp_Sqlite3JniShim_deserialize),
+        KMPSQL_NATIVE("deserializeMapped", "(Ljava/lang/String;Ljava/lang/String;)I", Java_com_oldguy_kiscmp_Sqlite3JniShim_deserializeMapped),
+        KMPSQL_NATIVE("replaceFile", "(Ljava/lang/String;Ljava/lang/String;)I", Java_com_oldguy_kiscmp_Sqlite3JniShim_replaceFile),
+        KMPSQL_NATIVE("removeFile", "(Ljava/lang/String;)I", Java_com_oldguy_kiscmp_Sqlite3JniShim_removeFile),
+        KMPSQL_NATIVE("snapshotGet", "(Ljava/lang/String;[J)I", Java_com_oldguy_kiscmp_Sqlite3JniShim_snapshotGet),
+        KMPSQL_NATIVE("snapshotOpen", "(Ljava/lang/String;J)I", Java_com_oldguy_kiscmp_Sqlite3JniShim_snapshotOpen),
+        KMPSQL_NATIVE("snapshotCompare", "(JJ)I", Java_com_oldguy_kiscmp_Sqlite3JniShim_snapshotCompare),
+        KMPSQL_NATIVE("snapshotFree", "(J)V", Java_com_oldguy_kiscmp_Sqlite3JniShim_snapshotFree)
+};
+
+static const JNINativeMethod statementMethods[] = {
+        KMPSQL_NATIVE("parameterCount", "()I", Java_com_oldguy_kiscmp_Sqlite3StatementJniShim_parameterCount),
+        KMPSQL_NATIVE("isReadOnly", "()Z", Java_com_oldguy_kiscmp_Sqlite3StatementJniShim_isReadOnly),
+        KMPSQL_NATIVE("prepare", "(JLjava/lang/String;)I", Java_com_oldguy_kiscmp_Sqlite3StatementJniShim_prepare),
+        KMPSQL_NATIVE("bindIndex", "(Ljava/lang/String;)I", Java_com_oldguy_kiscmp_Sqlite3StatementJniShim_bindIndex),
+        KMPSQL_NATIVE("bindNull", "(I)I", Java_com_oldguy_kiscmp_Sqlite3StatementJniShim_bindNull),
+        KMPSQL_NATIVE("bindText", "(ILjava/lang/String;)I", Java_com_oldguy_kiscmp_Sqlite3StatementJniShim_bindText),
+        KMPSQL_NATIVE("bindInt", "(II)I", Java_com_oldguy_kiscmp_Sqlite3StatementJniShim_bindInt),
+        KMPSQL_NATIVE("bindLong", "(IJ)I", Java_com_oldguy_kiscmp_Sqlite3StatementJniShim_bindLong),
+        KMPSQL_NATIVE("bindDouble", "(ID)I", Java_com_oldguy_kiscmp_Sqlite3StatementJniShim_bindDouble),
+        KMPSQL_NATIVE("bindBytes", "(I[B)I", Java_com_oldguy_kiscmp_Sqlite3StatementJniShim_bindBytes),
+        KMPSQL_NATIVE("stepInt", "()I", Java_com_oldguy_kiscmp_Sqlite3StatementJniShim_stepInt),
+        KMPSQL_NATIVE("changes", "(J)I", Java_com_oldguy_kiscmp_Sqlite3StatementJniShim_changes),
+        KMPSQL_NATIVE("finalize", "()I", Java_com_oldguy_kiscmp_Sqlite3StatementJniShim_finalize),
+        KMPSQL_NATIVE("clearBindings", "()V", Java_com_oldguy_kiscmp_Sqlite3StatementJniShim_clearBindings),
+        KMPSQL_NATIVE("reset", "()V", Java_com_oldguy_kiscmp_Sqlite3StatementJniShim_reset),
+        KMPSQL_NATIVE("expandedSql", "()Ljava/lang/String;", Java_com_oldguy_kiscmp_Sqlite3StatementJniShim_expandedSql),
+        KMPSQL_NATIVE("isBusy", "()Z", Java_com_oldguy_kiscmp_Sqlite3StatementJniShim_isBusy),
+        KMPSQL_NATIVE("scanStatus", "(I[J)Ljava/lang/String;", Java_com_oldguy_kiscmp_Sqlite3StatementJniShim_scanStatus),
+        KMPSQL_NATIVE("columnCount", "()I", Java_com_oldguy_kiscmp_Sqlite3StatementJniShim_columnCount),
+        KMPSQL_NATIVE("dataCount", "()I", Java_com_oldguy_kiscmp_Sqlite3StatementJniShim_dataCount),
+        KMPSQL_NATIVE("columnName", "(I)Ljava/lang/String;", Java_com_oldguy_kiscmp_Sqlite3StatementJniShim_columnName),
+        KMPSQL_NATIVE("columnDeclaredType", "(I)Ljava/lang/String;", Java_com_oldguy_kiscmp_Sqlite3StatementJniShim_columnDeclaredType),
+        KMPSQL_NATIVE("columnTypeInt", "(I)I", Java_com_oldguy_kiscmp_Sqlite3StatementJniShim_columnTypeInt),
+        KMPSQL_NATIVE("columnText", "(I)Ljava/lang/String;", Java_com_oldguy_kiscmp_Sqlite3StatementJniShim_columnText),
+        KMPSQL_NATIVE("columnBlob", "(I)[B", Java_com_oldguy_kiscmp_Sqlite3StatementJniShim_columnBlob),
+        KMPSQL_NATIVE("columnDouble", "(I)D", Java_com_oldguy_kiscmp_Sqlite3StatementJniShim_columnDouble),
+        KMPSQL_NATIVE("columnInt", "(I)I", Java_com_oldguy_kiscmp_Sqlite3StatementJniShim_columnInt),
+        KMPSQL_NATIVE("columnLong", "(I)J", Java_com_oldguy_kiscmp_Sqlite3StatementJniShim_columnLong)
+};
+
+static const JNINativeMethod backupMethods[] = {
+        KMPSQL_NATIVE("init", "(JJ)I", Java_com_oldguy_kiscmp_Sqlite3BackupJniShim_init),
+        KMPSQL_NATIVE("stepInt", "(I)I", Java_com_oldguy_kiscmp_Sqlite3BackupJniShim_stepInt),
+        KMPSQL_NATIVE("remaining", "()I", Java_com_oldguy_kiscmp_Sqlite3BackupJniShim_remaining),
+        KMPSQL_NATIVE("pageCount", "()I", Java_com_oldguy_kiscmp_Sqlite3BackupJniShim_pageCount),
+        KMPSQL_NATIVE("finish", "()I", Java_com_oldguy_kiscmp_Sqlite3BackupJniShim_finish)
+};
+
+static const JNINativeMethod sessionMethods[] = {
+        KMPSQL_NATIVE("create", "(JLjava/lang/String;Z)I", Java_com_oldguy_kiscmp_Sqlite3SessionJniShim_create),
+        KMPSQL_NATIVE("attach", "(Ljava/lang/String;)I", Java_com_oldguy_kiscmp_Sqlite3SessionJniShim_attach),
+        KMPSQL_NATIVE("isEmpty", "()Z", Java_com_oldguy_kiscmp_Sqlite3SessionJniShim_isEmpty),
+        KMPSQL_NATIVE("changeset", "(Z)[B", Java_com_oldguy_kiscmp_Sqlite3SessionJniShim_changeset),
+        KMPSQL_NATIVE("write", "(Ljava/lang/String;Z)I", Java_com_oldguy_kiscmp_Sqlite3SessionJniShim_write),
+        KMPSQL_NATIVE("delete", "()V", Java_com_oldguy_kiscmp_Sqlite3SessionJniShim_delete)
+};
+
+static bool registerNatives(JNIEnv *env, jclass clazz, const JNINativeMethod *methods, size_t count) {
+    return env->RegisterNatives(clazz, methods, static_cast<jint>(count)) == JNI_OK;
+}
+
+/**
+ * Runs once when System.loadLibrary loads this library, so everything the first database
+ * operation would otherwise pay for is done here: the shim environment lookups, registration of
+ * all the natives, and Sqlite initialization.
+ * @return JNI_ERR if anything fails, which makes loadLibrary throw
+ */
+JNIEXPORT jint JNICALL
+JNI_OnLoad(JavaVM *vm, [[maybe_unused]] void *reserved) {
+    JNIEnv *env = nullptr;
+    if (vm->GetEnv(reinterpret_cast<void **>(&env), JNI_VERSION_1_6) != JNI_OK)
+        return JNI_ERR;
+    auto *shimEnv = new SqliteEnvironment();
+    if (!shimEnv->init(env)
+        || !registerNatives(env, shimEnv->shimClass, shimMethods, std::size(shimMethods))
+        || !registerNatives(env, shimEnv->statementClass, statementMethods, std::size(statementMethods))
+        || !registerNatives(env, shimEnv->backupClass, backupMethods, std::size(backupMethods))
+        || !registerNatives(env, shimEnv->sessionClass, sessionMethods, std::size(sessionMethods))
+        || sqlite3_initialize() != SQLITE_OK) {
+        delete shimEnv;
+        return JNI_ERR;
+    }
+    pShimEnv = shimEnv;
+    return JNI_VERSION_1_6;
+}
+}
@@ -0,0 +1,83 @@
+package com.oldguy.kiscmp
+
+/**
+ * State of an online backup, as reported by [SqlCipherDatabase.backupTo]
+ * @property remaining pages still to be copied
+ * @property pageCount total pages in the source database. Can change during the backup if the
+ * source is written to.
+ */
+data class BackupProgress(
+    val remaining: Int,
+    val pageCount: Int
+) {
+    val copied: Int get() = pageCount - remaining
+
+    /**
+     * Fraction of the pages copied so far, 0.0 to 1.0
+     */
+    val fraction: Double get() = if (pageCount == 0) 1.0 else copied.toDouble() / pageCount
+}
+
+/**
+ * Describes one delta file written by [SqlCipherDatabase.backupChanges] or applied by
+ * [applyBackupDeltas].
+ * @property epoch epoch of the database once this delta is applied. Each delta written starts a
+ * new epoch.
+ * @property baseEpoch epoch a copy must be at for this delta to apply, ignored if [isFull]
+ * @property pages number of pages stored in the delta
+ * @property pageCount size of the database in pages
+ * @property pageSize page size in bytes
+ * @property isFull true if the delta holds every page, so it can be applied without a base copy
+ */
+data class BackupDelta(
+    val epoch: Long = 0,
+    val baseEpoch: Long = 0,
+    val pages: Long = 0,
+    val pageCount: Long = 0,
+    val pageSize: Long = 0,
+    val isFull: Boolean = false
+) {
+    val bytes: Long get() = pages * pageSize
+
+    companion object {
+        /**
+         * Size of the info array used by [SqliteDatabase.writeDelta] and [SqliteDatabase.applyDelta]
+         */
+        const val infoSize = 6
+
+        fun fromArray(values: LongArray): BackupDelta {
+            return BackupDelta(values[0], values[1], values[2], values[3], values[4], values[5] != 0L)
+        }
+    }
+}
+
+/**
+ * Restores a database from delta files written by [SqlCipherDatabase.backupChanges]. Deltas are
+ * applied in order, each must continue the epoch of the one before it. A full delta replaces the
+ * target, so the list usually starts with one. Pages are copied as stored, an encrypted database
+ * stays encrypted with its original key.
+ *
+ * Each delta is checked for its size and checksum and applied to a temporary copy that then
+ * replaces the target, so if one fails the target is left as the previous delta made it.
+ * @param targetPath database file to restore into, must not be open
+ * @param deltaPaths delta files in the order they were written
+ * @param baseEpoch epoch [targetPath] is already at, or -1 if it has no usable content
+ * @return description of the last delta applied
+ * @throws SqliteException if a delta does not continue the previous epoch, is invalid, or can
+ * not be applied
+ */
+fun applyBackupDeltas(targetPath: String, deltaPaths: List<String>, baseEpoch: Long = -1): BackupDelta {
+    val sqliteDb = SqliteDatabase()
+    var epoch = baseEpoch
+    var last = BackupDelta(epoch = baseEpoch)
+    val info = LongArray(BackupDelta.infoSize)
+    deltaPaths.forEach {
+        val rc = sqliteDb.applyDelta(it, targetPath, epoch, info)
+        if (rc != 0)
+            throw SqliteException("Apply of delta $it to $targetPath at epoch $epoch failed, target left at epoch $epoch",
+                "kmpsql_delta_apply", rc)
+        last = BackupDelta.fromArray(info)
+        epoch = last.epoch
+    }
+    return last
+}
@@ -0,0 +1,66 @@
+package com.oldguy.kiscmp
+
+/**
+ * Identifies the committed state of a database as seen by one [SqlCipherDatabase] connection,
+ * taken with [SqlCipherDatabase.changeToken]. Two tokens of the same connection are equal only if
+ * nothing was committed to the database in between, by this connection, another connection or
+ * another process, so caches of query results can be validated by comparing tokens instead of
+ * running the queries again. Taking a token costs one native PRAGMA data_version, comparing
+ * them is O(1).
+ *
+ * Changes made through the connection count as soon as each statement completes, even if its
+ * transaction is later rolled back, so a token may report a change that did not happen. Only rows
+ * changed by INSERT, UPDATE and DELETE are counted for this connection, as by
+ * sqlite3_total_changes64. Schema changes, PRAGMA writes, ANALYZE and VACUUM made through this
+ * connection do not change its token, so call [ChangeTokenCache.invalidate] after them. Commits
+ * of any kind by other connections are always seen. Tokens of different connections, or of one
+ * connection before and after a reopen, are never equal.
+ * @property dataVersion PRAGMA data_version, counts commits of other connections
+ * @property localChanges rows changed through this connection since it was opened
+ */
+data class ChangeToken internal constructor(
+    internal val connectionId: Long,
+    val dataVersion: Long,
+    val localChanges: Long
+)
+
+/**
+ * Holds the result of [load] and reloads it only when the database has changed since it was
+ * loaded, as seen through [db]. For results read through one connection and reused many times.
+ * [load] should only read, a result whose load changed the database is never cached.
+ */
+class ChangeTokenCache<T>(
+    private val db: SqlCipherDatabase,
+    private val load: suspend (SqlCipherDatabase) -> T
+) {
+    private var token: ChangeToken? = null
+    private var value: T? = null
+
+    /**
+     * Number of times [load] ran
+     */
+    var loads = 0L
+        private set
+
+    /**
+     * The cached result if nothing changed since it was loaded, otherwise a newly loaded one
+     */
+    suspend fun get(): T {
+        val current = db.changeToken()
+        if (token != current) {
+            value = load(db)
+            loads++
+            // a commit during the load may or may not be in its result, so cache it only if none
+            token = if (db.changeToken() == current) current else null
+        }
+        @Suppress("UNCHECKED_CAST")
+        return value as T
+    }
+
+    /**
+     * Forces the next [get] to load again
+     */
+    fun invalidate() {
+        token = null
+    }
+}
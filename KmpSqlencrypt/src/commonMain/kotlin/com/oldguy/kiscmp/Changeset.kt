@@ -0,0 +1,96 @@
+package com.oldguy.kiscmp
+
+/**
+ * Records changes made through one [SqlCipherDatabase] connection, using the Sqlite session
+ * extension, so they can be sent elsewhere as one compact binary changeset instead of by comparing
+ * tables. The cost is proportional to the rows changed, not to the table sizes. Each row appears
+ * at most once in a changeset, with its net change since recording started.
+ *
+ * Created by [SqlCipherDatabase.captureChanges]. Recording continues until [close], and the sets
+ * returned always hold everything recorded so far. Changesets contain plain values, they are not
+ * encrypted even when the database is.
+ */
+class ChangeCapture internal constructor(
+    private val session: SqliteSession,
+    private val onClose: (ChangeCapture) -> Unit
+) {
+    var isOpen = true
+        private set
+
+    /**
+     * True if nothing has been recorded yet
+     */
+    val isEmpty: Boolean get() = session.isEmpty()
+
+    /**
+     * Changes recorded so far. Holds the original values of updated and deleted rows, so conflicts
+     * can be detected when applied.
+     */
+    fun changeset(): ByteArray {
+        checkOpen()
+        return session.changeset()
+    }
+
+    /**
+     * Changes recorded so far in the smaller patchset format, which omits original values other
+     * than primary keys.
+     */
+    fun patchset(): ByteArray {
+        checkOpen()
+        return session.changeset(patchset = true)
+    }
+
+    /**
+     * Streams the changes recorded so far into a new file, for sets too large to hold in memory.
+     * @param path file to create or replace
+     * @param patchset true for the patchset format
+     * @throws SqliteException if the file could not be written
+     */
+    fun write(path: String, patchset: Boolean = false) {
+        checkOpen()
+        val rc = session.write(path, patchset)
+        if (rc != 0)
+            throw SqliteException("Changeset write to $path failed", "kmpsql_session_write", rc)
+    }
+
+    /**
+     * Stops recording. Done automatically when the database is closed.
+     */
+    fun close() {
+        if (isOpen) {
+            isOpen = false
+            session.delete()
+            onClose(this)
+        }
+    }
+
+    private fun checkOpen() {
+        if (!isOpen)
+            throw IllegalStateException("Change capture is closed")
+    }
+}
+
+/**
+ * Merges changesets into one, as if all the changes had been recorded by one session in the given
+ * order, so many small sets can be sent or applied as one. Changes to the same row collapse into
+ * a single change, and an insert followed by a delete disappears.
+ * @throws SqliteException if a set is invalid, or changesets are mixed with patchsets
+ * @throws UnsupportedOperationException if SqlCipher was built without the session extension
+ */
+fun combineChangesets(changesets: List<ByteArray>): ByteArray {
+    val db = SqliteDatabase()
+    SqlCipherDatabase.requireCompileOption(db, SqlCipherDatabase.sessionOption, "Changeset combine")
+    return db.combineChangesets(changesets)
+}
+
+/**
+ * Changeset that undoes [changeset], for rolling back changes already applied. Patchsets can not
+ * be inverted.
+ * @throws SqliteException if [changeset] is invalid or is a patchset
+ * @throws UnsupportedOperationException if SqlCipher was built without the session extension
+ */
+fun invertChangeset(changeset: ByteArray): ByteArray {
+    val db = SqliteDatabase()
+    SqlCipherDatabase.requireCompileOption(db, SqlCipherDatabase.sessionOption, "Changeset invert")
+    return db.invertChangeset(changeset)
+}
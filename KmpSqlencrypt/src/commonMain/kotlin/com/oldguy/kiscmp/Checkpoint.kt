@@ -0,0 +1,221 @@
+package com.oldguy.kiscmp
+
+import kotlinx.coroutines.CoroutineScope
+import kotlinx.coroutines.Job
+import kotlinx.coroutines.cancelAndJoin
+import kotlinx.coroutines.delay
+import kotlinx.coroutines.isActive
+import kotlinx.coroutines.launch
+import kotlinx.coroutines.sync.Mutex
+import kotlinx.coroutines.sync.withLock
+import kotlin.time.Duration
+import kotlin.time.Duration.Companion.seconds
+import kotlin.time.TimeMark
+import kotlin.time.TimeSource
+
+/**
+ * Checkpoint modes of sqlite3_wal_checkpoint_v2, in increasing order of how much they wait for
+ * readers and writers.
+ */
+enum class CheckpointMode(val pragma: String) {
+    /** copies what it can without waiting for readers or writers */
+    Passive("PASSIVE"),
+    /** waits for writers, then copies all frames */
+    Full("FULL"),
+    /** as [Full], then also waits for readers so the next writer restarts the WAL from its start */
+    Restart("RESTART"),
+    /** as [Restart], then truncates the WAL file to zero bytes */
+    Truncate("TRUNCATE")
+}
+
+/**
+ * Controls a [WalCheckpointer]. Every [interval] a passive checkpoint runs, which never blocks
+ * anyone. Based on the WAL size it reports and on how long the WAL has gone without being reset,
+ * the worker escalates to a restart or truncate checkpoint, which waits for readers up to the busy
+ * timeout of the worker connection.
+ * @property interval time between checks
+ * @property restartFrames WAL size in frames (pages) at or above which a restart checkpoint runs
+ * @property truncateFrames WAL size in frames at or above which a truncate checkpoint runs, so
+ * the file shrinks back after a burst of writes
+ * @property maxAge longest time the WAL can stay in use without being reset before a restart
+ * checkpoint is forced, even if small
+ * @property busyTimeout how long an escalated checkpoint waits for readers and writers
+ */
+data class WalCheckpointPolicy(
+    val interval: Duration = 1.seconds,
+    val restartFrames: Long = 1000,
+    val truncateFrames: Long = 10000,
+    val maxAge: Duration = 60.seconds,
+    val busyTimeout: Duration = 1.seconds
+) {
+    init {
+        if (!interval.isPositive())
+            throw IllegalArgumentException("interval must be positive, found $interval")
+        if (restartFrames < 1 || truncateFrames < restartFrames)
+            throw IllegalArgumentException("Frame thresholds must satisfy 1 <= restartFrames <= truncateFrames")
+    }
+}
+
+/**
+ * Result of one checkpoint, decoded from the PRAGMA wal_checkpoint row.
+ * @property busy true if the checkpoint could not complete because of readers or writers
+ * @property walFrames frames in the WAL when the checkpoint ran, -1 if not in WAL mode
+ * @property checkpointedFrames frames copied into the database so far, -1 if not in WAL mode
+ * @property duration time the checkpoint took
+ */
+data class CheckpointResult(
+    val mode: CheckpointMode,
+    val busy: Boolean,
+    val walFrames: Long,
+    val checkpointedFrames: Long,
+    val duration: Duration
+) {
+    /**
+     * True if frames remain that could not be copied, meaning readers still use older snapshots
+     */
+    val isStarved: Boolean get() = busy || checkpointedFrames < walFrames
+}
+
+/**
+ * Counters of a [WalCheckpointer] since it started.
+ * @property runs checkpoints run, of any mode
+ * @property restarts restart checkpoints run
+ * @property truncates truncate checkpoints run
+ * @property framesCheckpointed sum of frames copied into the database by each run. Frames copied by
+ * a passive run and again by the escalation that follows are counted twice.
+ * @property walFrames WAL size in frames as of the last run
+ * @property walBytes WAL size in bytes as of the last run, estimated from the page size
+ * @property lastDuration duration of the last run
+ * @property maxDuration longest run
+ * @property totalDuration time spent in all runs
+ * @property starvedRuns runs that could not copy every frame because of readers or writers
+ * @property consecutiveStarved starved runs in a row as of the last run. Keeps growing while a
+ * long running reader prevents the WAL from being reset.
+ */
+data class CheckpointMetrics(
+    val runs: Long = 0,
+    val restarts: Long = 0,
+    val truncates: Long = 0,
+    val framesCheckpointed: Long = 0,
+    val walFrames: Long = 0,
+    val walBytes: Long = 0,
+    val lastDuration: Duration = Duration.ZERO,
+    val maxDuration: Duration = Duration.ZERO,
+    val totalDuration: Duration = Duration.ZERO,
+    val starvedRuns: Long = 0,
+    val consecutiveStarved: Long = 0
+)
+
+/**
+ * Background WAL checkpoint worker, started by [SqlCipherDatabase.startWalCheckpointer]. It uses
+ * its own connection to the database, so checkpoints never run on, or wait for, the connection
+ * used by the application. Automatic checkpoints of the starting connection are disabled while
+ * the worker runs, so writers no longer stall on them.
+ */
+class WalCheckpointer internal constructor(
+    private val owner: SqlCipherDatabase,
+    private val worker: SqlCipherDatabase,
+    private val policy: WalCheckpointPolicy,
+    private val previousAutoCheckpoint: Int,
+    private val pageSize: Long
+) {
+    private val mutex = Mutex()
+    private var job: Job? = null
+    private var lastReset: TimeMark = TimeSource.Monotonic.markNow()
+
+    /**
+     * Current counters. Updated after each run.
+     */
+    var metrics = CheckpointMetrics()
+        private set
+
+    val isRunning: Boolean get() = job?.isActive == true
+
+    internal fun start(scope: CoroutineScope) {
+        job = scope.launch {
+            while (isActive) {
+                delay(policy.interval)
+                tick()
+            }
+        }
+    }
+
+    /**
+     * Runs one checkpoint immediately, outside the schedule.
+     */
+    suspend fun checkpoint(mode: CheckpointMode): CheckpointResult {
+        return mutex.withLock { run(mode) }
+    }
+
+    /**
+     * Stops the worker, waiting for a checkpoint in progress, and closes its connection. The
+     * automatic checkpoint setting of the starting connection is restored if it is still open.
+     */
+    suspend fun stop() {
+        job?.cancelAndJoin()
+        job = null
+        mutex.withLock {
+            if (worker.isOpen)
+                worker.close()
+        }
+        if (owner.isOpen)
+            owner.pragma("$pragmaAutoCheckpoint = $previousAutoCheckpoint") { false }
+    }
+
+    private suspend fun tick() {
+        mutex.withLock {
+            val passive = run(CheckpointMode.Passive)
+            val mode = when {
+                passive.walFrames >= policy.truncateFrames -> CheckpointMode.Truncate
+                passive.walFrames >= policy.restartFrames -> CheckpointMode.Restart
+                passive.walFrames > 0 && lastReset.elapsedNow() >= policy.maxAge -> CheckpointMode.Restart
+                else -> return
+            }
+            run(mode)
+        }
+    }
+
+    private fun run(mode: CheckpointMode): CheckpointResult {
+        val start = TimeSource.Monotonic.markNow()
+        var busy = false
+        var log = -1L
+        var copied = -1L
+        worker.pragma("$pragmaCheckpoint(${mode.pragma})") {
+            busy = it.requireString(0) != "0"
+            log = it.requireString(1).toLong()
+            copied = it.requireString(2).toLong()
+            false
+        }
+        val result = CheckpointResult(mode, busy, log, copied, start.elapsedNow())
+        if (!busy && (mode == CheckpointMode.Restart || mode == CheckpointMode.Truncate))
+            lastReset = TimeSource.Monotonic.markNow()
+        record(result)
+        return result
+    }
+
+    private fun record(result: CheckpointResult) {
+        val frames = if (result.mode == CheckpointMode.Truncate && !result.busy) 0L else maxOf(result.walFrames, 0L)
+        metrics = metrics.let {
+            it.copy(
+                runs = it.runs + 1,
+                restarts = it.restarts + if (result.mode == CheckpointMode.Restart) 1 else 0,
+                truncates = it.truncates + if (result.mode == CheckpointMode.Truncate) 1 else 0,
+                framesCheckpointed = it.framesCheckpointed + maxOf(result.checkpointedFrames, 0L),
+                walFrames = frames,
+                walBytes = if (frames == 0L) 0L else walHeaderBytes + frames * (pageSize + frameHeaderBytes),
+                lastDuration = result.duration,
+                maxDuration = maxOf(it.maxDuration, result.duration),
+                totalDuration = it.totalDuration + result.duration,
+                starvedRuns = it.starvedRuns + if (result.isStarved) 1 else 0,
+                consecutiveStarved = if (result.isStarved) it.consecutiveStarved + 1 else 0
+            )
+        }
+    }
+
+    internal companion object {
+        const val pragmaCheckpoint = "wal_checkpoint"
+        const val pragmaAutoCheckpoint = "wal_autocheckpoint"
+        private const val walHeaderBytes = 32L
+        private const val frameHeaderBytes = 24L
+    }
+}
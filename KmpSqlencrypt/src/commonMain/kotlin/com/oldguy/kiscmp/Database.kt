@@ -1,6 +1,17 @@
 package com.oldguy.kiscmp
 
 import com.oldguy.database.*
+import kotlinx.atomicfu.atomic
+import kotlinx.coroutines.CoroutineDispatcher
+import kotlinx.coroutines.CoroutineScope
+import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.delay
+import kotlinx.coroutines.withContext
+import kotlinx.coroutines.yield
+import kotlin.time.Duration
+import kotlin.time.Duration.Companion.hours
+import kotlin.time.Duration.Companion.milliseconds
+import kotlin.time.TimeSource
 
 class SqliteColumn(name: String, index: Int, type: ColumnType = ColumnType.String, isNullable: Boolean = false):
     Column(name, index, type, isNullable)
@@ -287,6 +298,136 @@ class SqlCipherDatabase:
      */
     var readOnly: Boolean = false
 
+    /**
+     * Name of a registered Sqlite VFS to open the database with. Empty uses the default VFS, or the
+     * readahead VFS if [readaheadPages] is set.
+     */
+    var vfsName: String = ""
+
+    /**
+     * Set to open a named in-memory database shared by every connection in this process opened with
+     * the same name, instead of the private in-memory database or a file at [path]. Uses the
+     * Sqlite memdb VFS. The database exists while at least one connection to it is open, so keep one
+     * open for its lifetime. Read transactions of different connections run concurrently, so
+     * queries can use several threads. A write waits until every open read transaction has ended,
+     * and new reads wait for the write to commit, both for up to [busyTimeout], so keep transactions
+     * on shared databases short.
+     */
+    var sharedMemoryName: String = ""
+
+    /**
+     * Milliseconds a statement waits for a lock held by another connection before failing with
+     * SQLITE_BUSY. Applied at open.
+     */
+    var busyTimeout: Int = defaultTimeout
+
+    /**
+     * Set to open the database through a latency injecting VFS, to simulate slow storage in tests
+     * and benchmarks. The VFS is registered (or reconfigured) at open using [vfsName], or
+     * [latencyVfsName] if that is empty. Takes precedence over [readaheadPages].
+     */
+    var latency: LatencyVfsConfig? = null
+
+    /**
+     * Set to true to open file databases through the change tracking VFS, required by
+     * [backupChanges]. Every connection that writes the database must use it. Writes made without
+     * it are detected from the database header and file time in most cases and make the next
+     * backup full, but not reliably, so they should not happen. Only one process at a time can
+     * track a database, an open from a second process fails with SQLITE_BUSY while the first has
+     * it open. The set of changed pages is kept in a small sidecar file next to the database,
+     * saved at checkpoints, backups and the last close. If the process ends without saving it, the
+     * next backup is full. Ignored if [vfsName] or [latency] is set.
+     */
+    var changeTracking: Boolean = false
+
+    /**
+     * Set to a positive number of bytes to use memory mapped I/O for up to that much of an
+     * unencrypted database, applied with PRAGMA mmap_size after open. Pages inside the mapping are
+     * then used directly instead of being copied by read calls. SqlCipher never maps encrypted
+     * pages, so [open] with a passphrase throws IllegalArgumentException if this is set. Unless
+     * another VFS is configured, the
+     * database is opened through the metrics VFS so [vfsMetrics] reports mapped pages
+     * ([VfsMetrics.fetches]) versus pages read ([VfsMetrics.reads]).
+     */
+    var mmapSize: Long = 0
+
+    /**
+     * If createOk is true and this is set by DSL to a non-default value, it is set by pragma
+     * immediately after open, before [onOpenPragmas]. Sqlite only changes it on a database with no
+     * tables yet, except for switching between [AutoVacuum.Full] and [AutoVacuum.Incremental]. After
+     * open it holds the mode of the database. [AutoVacuum.Incremental] is required by
+     * [startIncrementalVacuum].
+     */
+    var autoVacuum: AutoVacuum = AutoVacuum.None
+
+    /**
+     * Set to true to run [optimize] as the first step of [close], so planner statistics follow the
+     * data without a separate ANALYZE. Skipped if [readOnly].
+     */
+    var optimizeOnClose: Boolean = false
+
+    /**
+     * Rows examined per index by the ANALYZE that [optimize] may run, applied with PRAGMA
+     * analysis_limit. Keeps optimize fast on large tables at the cost of approximate statistics.
+     * 0 examines every row.
+     */
+    var analysisLimit: Int = defaultAnalysisLimit
+
+    /**
+     * If set, invoked once for each registered hot query whose plan was changed by [optimize],
+     * typically to log it
+     */
+    var onPlanChange: ((QueryPlanChange) -> Unit)? = null
+
+    // queries whose plans optimize compares and captureQueryPlans captures, by name
+    private val hotQueries = mutableMapOf<String, HotQuery>()
+
+    private class HotQuery(val sql: String, val bindArgs: SqlValues)
+
+    // sessions must be deleted before the connection closes
+    private val activeCaptures = mutableListOf<ChangeCapture>()
+
+    // set by a PeriodicOptimizer after its worker gathered statistics this connection has not loaded
+    internal val statisticsStale = atomic(false)
+
+    // distinguishes change tokens of each open, as data_version restarts with every connection
+    private var connectionId = 0L
+
+    // snapshots taken by this connection, each holding its read transaction open
+    private val activeSnapshots = mutableListOf<ReadSnapshot>()
+
+    // set only while openImage or openMappedImage is opening, replaces main after the initial open
+    private var imageSource: ((SqliteDatabase) -> Int)? = null
+
+    /**
+     * Set to 2 or more to open file databases through the readahead VFS. Sequential page reads,
+     * like large table scans, are then detected and the following pages are read ahead with one
+     * larger read into a small per-file buffer. The value is the largest readahead window in pages
+     * of this database's file, other databases using the readahead VFS keep their own. Ignored for
+     * in-memory databases or if [vfsName] is set. See [vfsMetrics] for the resulting counters.
+     */
+    var readaheadPages: Int = 0
+
+    /**
+     * Counters of the VFS the main database file was opened with. All zeros unless opened through
+     * a kmpsql VFS like the readahead VFS.
+     */
+    val vfsMetrics: VfsMetrics get() = VfsMetrics.fromArray(sqliteDb.fileMetrics())
+
+    /**
+     * Memory and page cache counters of this connection, all zeros if not open.
+     * @param reset true to restart the high water marks and the cache counters after reading them
+     */
+    fun connectionMemory(reset: Boolean = false): ConnectionMemory =
+        ConnectionMemory.fromArray(sqliteDb.dbStatus(reset))
+
+    /**
+     * Heap used by Sqlite over every connection in the process. Does not need an open database.
+     * @param resetHighwater true to restart [SqliteMemory.highwater] at the current use
+     */
+    fun sqliteMemory(resetHighwater: Boolean = false): SqliteMemory =
+        SqliteMemory.fromArray(sqliteDb.memoryStatus(resetHighwater))
+
     /**
      * If specified, should only use one or more [db.pragma()] functions to issue any desired pragmas
      * that must happen after successful open, but BEFORE the first usage of the database.
@@ -367,15 +508,37 @@ class SqlCipherDatabase:
      */
     override suspend fun open(passphrase: Passphrase)
     {
-        val workPath = path.ifEmpty { inMemoryPath }
-        val rc = sqliteDb.open(workPath, readOnly, createOk)
+        if (mmapSize > 0 && passphrase.passphrase.isNotEmpty())
+            throw IllegalArgumentException("mmapSize $mmapSize can not be used with a passphrase, SqlCipher never maps encrypted pages")
+        val workPath = if (sharedMemoryName.isNotEmpty())
+            "/$sharedMemoryName"
+        else
+            path.ifEmpty { inMemoryPath }
+        val openVfs = openVfsName(workPath)
+        val rc = sqliteDb.open(workPath, readOnly, createOk, openVfs)
         if (rc != 0) {
             throw SqliteException(errorMessage, "open_v2", rc)
         }
+        // the VFS window is only the default of each open, another database may have changed it
+        if (openVfs == readaheadVfsName)
+            sqliteDb.readaheadWindow(readaheadPages)
+        imageSource?.let {
+            val imageRc = it(sqliteDb)
+            if (imageRc != 0) {
+                sqliteDb.close()
+                throw SqliteException("Image load failed", "deserialize", imageRc)
+            }
+        }
         transactionDepth = 0
+        connectionId = openSequence.incrementAndGet()
         val tableCount: Int
         try {
             setup(passphrase)
+            if (mmapSize > 0)
+                pragma("$pragmaMmapSize = $mmapSize") { false }
+            // must precede the first table, and switching to WAL, so before onOpenPragmas
+            if (createOk && autoVacuum != AutoVacuum.None)
+                pragma("${IncrementalVacuumer.pragmaAutoVacuum} = ${autoVacuum.ordinal}") { false }
             onOpenPragmas?.invoke(this)
             try {
                 tableCount = tableCount()
@@ -392,6 +555,7 @@ class SqlCipherDatabase:
             else
                 encoding = queryEncoding()
             sqliteDb.encoding = encoding
+            autoVacuum = AutoVacuum.entries[queryPragmaString(IncrementalVacuumer.pragmaAutoVacuum).toInt()]
             if (tableCount == 0 && !createOk)
                 throw SqliteException("createOk false and database is empty", "open", -1)
             isOpen = true
@@ -432,12 +596,20 @@ class SqlCipherDatabase:
      * database close sees SQLITE_BUSY (5), it will try 3 more times to close before bailing
      */
     override fun close() {
+        activeSnapshots.toList().forEach { it.close() }
         if (transactionDepth > 0)
             throw IllegalStateException("Cannot close database with active transaction")
+        if (optimizeOnClose && isOpen && !readOnly) {
+            try {
+                optimize()
+            } catch (_: SqliteException) {
+            }
+        }
         activeStatements.forEach {
             it.close()
             untrack(it)
         }
+        activeCaptures.toList().forEach { it.close() }
         var rc = sqliteDb.close()
         var count = 0
         while (rc == 5 && count < 3) {
@@ -662,6 +834,714 @@ class SqlCipherDatabase:
         }
     }
 
+    /**
+     * Copies this open database to another file using the Sqlite online backup api, while this
+     * connection stays usable. The copy is done [pagesPerStep] pages at a time, suspending between
+     * steps so other work on this connection can run. Writes made through this connection during the
+     * backup are also applied to the copy. Writes from other connections cause the backup to restart,
+     * so the result is always a consistent snapshot.
+     *
+     * SqlCipher decrypts pages from this database and encrypts them with the destination key, so an
+     * encrypted database can be copied using the same or a different [destPassphrase]. Backup
+     * between an encrypted and an unencrypted database is not supported by SqlCipher, use
+     * sqlcipher_export for that.
+     *
+     * If the coroutine is cancelled or an error occurs, the partial copy is rolled back.
+     *
+     * @param destPath database to copy into. Created if it does not exist, otherwise its content is
+     * replaced. An existing file must be openable with [destPassphrase].
+     * @param destPassphrase key of the copy
+     * @param pagesPerStep pages copied by each step, must be positive
+     * @param bytesPerSecond if positive, steps are delayed as required to keep the average copy rate at
+     * or below this value, so foreground queries are not starved of I/O
+     * @param progress if set, invoked after each step
+     * @return the final progress, with zero pages remaining
+     */
+    suspend fun backupTo(
+        destPath: String,
+        destPassphrase: Passphrase,
+        pagesPerStep: Int = defaultBackupPagesPerStep,
+        bytesPerSecond: Long = 0,
+        progress: ((BackupProgress) -> Unit)? = null
+    ): BackupProgress {
+        if (!isOpen)
+            throw IllegalStateException("Database must be open to start a backup")
+        if (pagesPerStep < 1)
+            throw IllegalArgumentException("pagesPerStep must be positive, found $pagesPerStep")
+        val destination = workerDatabase(destPath)
+        destination.createOk = true
+        destination.open(destPassphrase)
+        try {
+            return backup(destination.sqliteDb, pagesPerStep, bytesPerSecond, progress)
+        } finally {
+            destination.close()
+        }
+    }
+
+    /**
+     * Incremental backup. Writes the pages changed since the previous call to a delta file, copied
+     * as stored so encrypted pages are not decrypted or re-encrypted. The first delta written after
+     * tracking starts is full, and serves as the base copy. Use [applyBackupDeltas] to restore.
+     * A copy made by [backupTo] can not be used as a base, as it is encrypted differently.
+     *
+     * In WAL mode the WAL is checkpointed first. The copy is made holding a write transaction, so
+     * other connections can read but not write until it completes.
+     * Requires [changeTracking], and must not be called inside a transaction.
+     * @param deltaPath file to create
+     * @param full true to copy every page, starting a new base
+     * @return description of the delta written
+     * @throws SqliteException if the delta could not be written. SQLITE_BUSY (5) if other
+     * connections kept the WAL from being reset.
+     */
+    fun backupChanges(deltaPath: String, full: Boolean = false): BackupDelta {
+        if (!isOpen)
+            throw IllegalStateException("Database must be open to write a delta")
+        val info = LongArray(BackupDelta.infoSize)
+        val rc = sqliteDb.writeDelta(deltaPath, full, info)
+        if (rc != 0)
+            throw SqliteException("Delta backup to $deltaPath failed", "kmpsql_delta_write", rc)
+        return BackupDelta.fromArray(info)
+    }
+
+    /**
+     * Copy of the main database as one image in database file format, for example to send it
+     * somewhere or to reopen it later with [openImage] or [openMappedImage].
+     * @param passphrase key of the image. If empty, the image is unencrypted even if this database
+     * is encrypted. Otherwise every page is exported through sqlcipher_export and encrypted with
+     * this key, which also works for an unencrypted database.
+     * @throws SqliteException if the image could not be made
+     */
+    fun serialize(passphrase: Passphrase = Passphrase()): ByteArray {
+        if (!isOpen)
+            throw IllegalStateException("Database must be open to serialize")
+        if (passphrase.passphrase.isEmpty())
+            return sqliteDb.serialize(mainSchema).ifEmpty {
+                throw SqliteException(errorMessage, "serialize", -1)
+            }
+        executeRaw("ATTACH DATABASE '$inMemoryPath' AS $imageSchema;")
+        try {
+            // an empty, resizeable memory image, so serialize returns the pages as stored
+            val rc = sqliteDb.deserialize(imageSchema, ByteArray(0))
+            if (rc != 0)
+                throw SqliteException(errorMessage, "deserialize", rc)
+            pragma("$imageSchema.$pragmaKeyPrefix ${passphrase.keyPragmaText()}") { true }
+            executeRaw("SELECT sqlcipher_export('$imageSchema');")
+            return sqliteDb.serialize(imageSchema).ifEmpty {
+                throw SqliteException(errorMessage, "serialize", -1)
+            }
+        } finally {
+            executeRaw("DETACH DATABASE $imageSchema;")
+        }
+    }
+
+    /**
+     * Opens an in-memory database holding a copy of [image], as returned by [serialize]. Nothing is
+     * written to storage, and changes are lost at close unless serialized again. [path] is left
+     * unchanged. All other configuration, like [onOpenPragmas] and [readOnly], applies as usual.
+     * @param passphrase key the image was encrypted with, empty for an unencrypted image
+     */
+    suspend fun openImage(image: ByteArray, passphrase: Passphrase = Passphrase()) {
+        openFrom(passphrase) { it.deserialize(mainSchema, image, readOnly) }
+    }
+
+    /**
+     * Opens a read-only database that uses a memory mapping of an image file in place, so pages are
+     * neither copied nor read through a VFS. Suits large reference databases shipped with an app.
+     * The file can be a database file or a saved [serialize] result, and must not be changed
+     * while open. Encrypted pages are still decrypted into the page cache as they are used.
+     * @param passphrase key the image was encrypted with, empty for an unencrypted image
+     */
+    suspend fun openMappedImage(imagePath: String, passphrase: Passphrase = Passphrase()) {
+        openFrom(passphrase) { it.deserializeMapped(mainSchema, imagePath) }
+    }
+
+    private suspend fun openFrom(passphrase: Passphrase, source: (SqliteDatabase) -> Int) {
+        val savedPath = path
+        path = inMemoryPath
+        imageSource = source
+        try {
+            open(passphrase)
+        } finally {
+            imageSource = null
+            path = savedPath
+        }
+    }
+
+    /**
+     * True if the linked SqlCipher library was built with [option], such as [sessionOption], named
+     * as sqlite3_compileoption_used expects. The apis that need an option throw
+     * UnsupportedOperationException without it, except [captureQueryPlans], which then leaves out
+     * the loop counters.
+     */
+    fun compileOptionUsed(option: String): Boolean {
+        return sqliteDb.compileOptionUsed(option)
+    }
+
+    /**
+     * Starts recording changes made through this connection, for sync to another copy of the
+     * database. See [ChangeCapture]. Unless [rowidTables] is set, only tables with a declared
+     * PRIMARY KEY are recorded, changes to other tables are silently ignored. Changes made by other
+     * connections are not recorded.
+     * @param tables tables to record, all tables of the schema if empty, including ones created
+     * later
+     * @param schema "main" or the name of an attached database
+     * @param rowidTables true to also record tables without a declared PRIMARY KEY, by rowid. Such
+     * changesets only apply correctly to copies with the same rowids.
+     * @throws SqliteException if the session could not be started
+     * @throws UnsupportedOperationException if SqlCipher was built without [sessionOption]
+     */
+    fun captureChanges(
+        tables: List<String> = emptyList(),
+        schema: String = mainSchema,
+        rowidTables: Boolean = false
+    ): ChangeCapture {
+        if (!isOpen)
+            throw IllegalStateException("Database must be open to capture changes")
+        requireCompileOption(sqliteDb, sessionOption, "Change capture")
+        val session = SqliteSession(sqliteDb)
+        val rc = session.create(schema, rowidTables)
+        if (rc != 0)
+            throw SqliteException(errorMessage, "sqlite3session_create", rc)
+        tables.ifEmpty { listOf("") }.forEach {
+            val attachRc = session.attach(it)
+            if (attachRc != 0) {
+                session.delete()
+                throw SqliteException("Change capture of table $it failed", "sqlite3session_attach", attachRc)
+            }
+        }
+        return ChangeCapture(session) { activeCaptures.remove(it) }.also { activeCaptures.add(it) }
+    }
+
+    /**
+     * PRAGMA data_version of the main database, read natively. Changes when another connection or
+     * process commits, but not for commits made through this connection. See [changeToken] to
+     * detect both.
+     * @throws SqliteException if it can not be read
+     */
+    fun dataVersion(): Long {
+        if (!isOpen)
+            throw IllegalStateException("Database must be open to read data_version")
+        val version = sqliteDb.dataVersion(mainSchema)
+        if (version < 0)
+            throw SqliteException(errorMessage, "dataVersion", -1)
+        return version
+    }
+
+    /**
+     * Token of the committed state of the database as seen by this connection, for cheap change
+     * detection. See [ChangeToken].
+     */
+    fun changeToken(): ChangeToken {
+        return ChangeToken(connectionId, dataVersion(), sqliteDb.totalChanges())
+    }
+
+    /**
+     * True if anything may have been committed to the database since [token] was taken from this
+     * connection. Always true for tokens of other connections or of an earlier open.
+     */
+    fun isChangedSince(token: ChangeToken): Boolean {
+        return changeToken() != token
+    }
+
+    /**
+     * Takes a snapshot of the current committed state of a schema, which connections to the same
+     * database, this one included, can then read with [readSnapshot]. See [ReadSnapshot]. The
+     * read transaction that defines the snapshot is held by a worker connection the snapshot owns,
+     * so this connection is not left in a transaction. The schema must be in WAL mode, and at least
+     * one transaction must have been written to the WAL since it was created.
+     * @param passphrase same passphrase used to open this database, for the worker connection
+     * @param schema "main" or the name of an attached database
+     * @throws IllegalStateException if a file database is not open
+     * @throws SqliteException if the snapshot could not be taken
+     * @throws UnsupportedOperationException if SqlCipher was built without [snapshotOption]
+     */
+    suspend fun takeSnapshot(passphrase: Passphrase, schema: String = mainSchema): ReadSnapshot {
+        if (!isOpen || path == inMemoryPath)
+            throw IllegalStateException("A file database must be open to take a snapshot")
+        requireCompileOption(sqliteDb, snapshotOption, "Read snapshot")
+        val start = TimeSource.Monotonic.markNow()
+        val holder = workerDatabase()
+        holder.open(passphrase)
+        val handle = LongArray(1)
+        try {
+            holder.beginTransaction(TransactionMode.Deferred)
+            holder.transactionDepth++
+            // snapshots record the state read by the current read transaction, so start it
+            holder.executeRaw("select count(*) from \"$schema\".$catalogTable;")
+            val rc = holder.sqliteDb.snapshotGet(schema, handle)
+            if (rc != 0)
+                throw SqliteException(holder.errorMessage, "sqlite3_snapshot_get", rc)
+        } catch (e: Throwable) {
+            holder.closeSnapshotHolder()
+            throw e
+        }
+        return ReadSnapshot(holder.sqliteDb, handle[0], schema, start.elapsedNow()) {
+            activeSnapshots.remove(it)
+            holder.closeSnapshotHolder()
+        }.also { activeSnapshots.add(it) }
+    }
+
+    /**
+     * Ends the read transaction of a worker made by [takeSnapshot], if started, and closes it
+     */
+    private fun closeSnapshotHolder() {
+        if (transactionDepth > 0) {
+            transactionDepth--
+            executeRaw("COMMIT;")
+        }
+        close()
+    }
+
+    /**
+     * Runs [block] in a read transaction of this connection on [snapshot], so every query in it
+     * sees the state the snapshot was taken at. May be used by any number of connections to the
+     * same database, concurrently, including the one that took the snapshot.
+     * @throws IllegalStateException if not open, already inside a transaction, or the snapshot is
+     * closed
+     * @throws SqliteException if the snapshot could not be opened
+     * @throws UnsupportedOperationException if SqlCipher was built without [snapshotOption]
+     */
+    suspend fun <T> readSnapshot(snapshot: ReadSnapshot, block: suspend () -> T): T {
+        if (!isOpen)
+            throw IllegalStateException("Database must be open to read a snapshot")
+        if (!snapshot.isOpen)
+            throw IllegalStateException("Snapshot is closed")
+        if (transactionDepth > 0)
+            throw IllegalStateException("Cannot read a snapshot inside a transaction")
+        requireCompileOption(sqliteDb, snapshotOption, "Read snapshot")
+        val start = TimeSource.Monotonic.markNow()
+        beginTransaction(TransactionMode.Deferred)
+        transactionDepth++
+        try {
+            val rc = sqliteDb.snapshotOpen(snapshot.schema, snapshot.handle)
+            if (rc != 0)
+                throw SqliteException(errorMessage, "sqlite3_snapshot_open", rc)
+            snapshot.recordRead(start.elapsedNow())
+            return block()
+        } finally {
+            transactionDepth--
+            executeRaw("COMMIT;")
+        }
+    }
+
+    /**
+     * Applies a changeset or patchset, as made by [ChangeCapture], to the main database. All changes
+     * are applied natively in one savepoint, which is much faster than replaying them as
+     * statements. [onConflict] is only called for changes that conflict with the current content.
+     * @param onConflict decides each conflict, the default aborts on the first one
+     * @throws SqliteException if the apply fails or is aborted, in which case no change is kept
+     * @throws UnsupportedOperationException if SqlCipher was built without [sessionOption]
+     */
+    fun applyChanges(changeset: ByteArray, onConflict: ChangesetConflictHandler = abortOnConflict) {
+        if (!isOpen)
+            throw IllegalStateException("Database must be open to apply changes")
+        requireCompileOption(sqliteDb, sessionOption, "Changeset apply")
+        val rc = sqliteDb.applyChangeset(changeset, onConflict)
+        if (rc != 0)
+            throw SqliteException(errorMessage, "sqlite3changeset_apply_v2", rc)
+    }
+
+    /**
+     * Same as [applyChanges], streaming the set from a file written by [ChangeCapture.write].
+     */
+    fun applyChanges(path: String, onConflict: ChangesetConflictHandler = abortOnConflict) {
+        if (!isOpen)
+            throw IllegalStateException("Database must be open to apply changes")
+        requireCompileOption(sqliteDb, sessionOption, "Changeset apply")
+        val rc = sqliteDb.applyChangesetFile(path, onConflict)
+        if (rc != 0)
+            throw SqliteException("Apply of $path failed. $errorMessage", "sqlite3changeset_apply_v2_strm", rc)
+    }
+
+    /**
+     * Starts a [WalCheckpointer] for this database, which must be open on a file in WAL journal
+     * mode. Automatic checkpoints are disabled on this connection until the checkpointer is
+     * stopped. Other connections writing the same database keep their own setting, and should use
+     * PRAGMA wal_autocheckpoint = 0 in [onOpenPragmas].
+     * @param scope runs the worker coroutine, usually one with an IO dispatcher
+     * @param passphrase opens the worker connection, must be the key of this database
+     * @throws IllegalStateException if not open or not in WAL mode
+     */
+    suspend fun startWalCheckpointer(
+        scope: CoroutineScope,
+        passphrase: Passphrase,
+        policy: WalCheckpointPolicy = WalCheckpointPolicy()
+    ): WalCheckpointer {
+        if (!isOpen || path == inMemoryPath)
+            throw IllegalStateException("A file database must be open to start a checkpointer")
+        var mode = ""
+        pragma(pragmaJournalMode) {
+            mode = it.requireString(0)
+            false
+        }
+        if (!mode.equals(walMode, true))
+            throw IllegalStateException("Checkpointer requires journal_mode WAL, found $mode")
+        var autoCheckpoint = 0
+        var pageSize = 0L
+        pragma(WalCheckpointer.pragmaAutoCheckpoint) {
+            autoCheckpoint = it.requireString(0).toInt()
+            false
+        }
+        pragma(pragmaPageSize) {
+            pageSize = it.requireString(0).toLong()
+            false
+        }
+        val worker = workerDatabase()
+        worker.open(passphrase)
+        worker.sqliteDb.busyTimeout(policy.busyTimeout.inWholeMilliseconds.toInt())
+        pragma("${WalCheckpointer.pragmaAutoCheckpoint} = 0") { false }
+        return WalCheckpointer(this, worker, policy, autoCheckpoint, pageSize).also { it.start(scope) }
+    }
+
+    /**
+     * Registers a query whose EXPLAIN QUERY PLAN is captured before and after each [optimize], so
+     * plan changes caused by new statistics are reported to [onPlanChange], and by
+     * [captureQueryPlans] for comparison with a [QueryPlanBaseline]. Bind variables in the query
+     * are explained as NULL. Registering a name again replaces its query.
+     * @param name identifies the query in [QueryPlanChange] and [QueryPlanCapture]
+     * @param sql one select statement
+     * @param bindArgs representative values, bound when [captureQueryPlans] runs the query
+     */
+    fun registerHotQuery(name: String, sql: String, bindArgs: SqlValues = SqlValues()) {
+        hotQueries[name] = HotQuery(sql, bindArgs)
+    }
+
+    fun unregisterHotQuery(name: String) {
+        hotQueries.remove(name)
+    }
+
+    /**
+     * Runs EXPLAIN QUERY PLAN for one statement.
+     * @return the detail column of each plan row, in order, indented by two spaces for each level
+     * below the top of the plan
+     */
+    fun explainQueryPlan(sql: String): List<String> {
+        val depths = mutableMapOf<String, Int>()
+        val lines = mutableListOf<String>()
+        executeRaw("EXPLAIN QUERY PLAN $sql") { data, _ ->
+            val depth = depths[data[1]]?.plus(1) ?: 0
+            depths[data[0]] = depth
+            lines.add("  ".repeat(depth) + data[3])
+            0
+        }
+        return lines
+    }
+
+    /**
+     * Captures the plan of every query registered with [registerHotQuery]. Each query is explained,
+     * then run once to the end with its bind values so the rows visited by each loop of its plan
+     * are counted with sqlite3_stmt_scanstatus. Without [scanStatusOption] in the SqlCipher build
+     * the queries are only explained, and the captures have no loops. Queries run on this
+     * connection, so inside an open transaction they see its changes.
+     * @return captures in registration order
+     */
+    fun captureQueryPlans(): List<QueryPlanCapture> {
+        if (!isOpen)
+            throw IllegalStateException("Database must be open to capture query plans")
+        val counted = compileOptionUsed(scanStatusOption)
+        return hotQueries.map { (name, query) ->
+            QueryPlanCapture(name, query.sql, explainQueryPlan(query.sql),
+                if (counted) planLoops(query) else emptyList())
+        }
+    }
+
+    private fun planLoops(query: HotQuery): List<PlanLoop> {
+        val statement = SqlCipherStatement(this, query.sql)
+        try {
+            statement.bind(query.bindArgs)
+            val sqliteStatement = statement.sqliteStatement
+            var result = sqliteStatement.step()
+            while (result == SqliteStepResult.Row)
+                result = sqliteStatement.step()
+            if (result != SqliteStepResult.Done)
+                throw SqliteException("Hot query step result: $result, $errorMessage", "step")
+            val counts = LongArray(3)
+            return buildList {
+                while (true) {
+                    val detail = sqliteStatement.scanStatus(size, counts) ?: break
+                    add(PlanLoop(detail, counts[0], counts[1]))
+                }
+            }
+        } finally {
+            statement.close()
+        }
+    }
+
+    /**
+     * Updates planner statistics where Sqlite estimates they are stale, using PRAGMA optimize with
+     * [analysisLimit]. Usually fast, since only tables changed significantly since their last
+     * analysis are analyzed. The EXPLAIN QUERY PLAN of each query registered with
+     * [registerHotQuery] is captured before and after, and changes are passed to [onPlanChange].
+     * @param allTables true to consider every table, false for only those used by queries already
+     * run on this connection. Use true right after open, false on a connection that has been in use.
+     */
+    fun optimize(allTables: Boolean = false): OptimizeResult {
+        if (!isOpen)
+            throw IllegalStateException("Database must be open to optimize")
+        val before = hotQueries.mapValues { explainQueryPlan(it.value.sql) }
+        val start = TimeSource.Monotonic.markNow()
+        pragma("$pragmaAnalysisLimit = $analysisLimit") { false }
+        executeRaw(if (allTables) "PRAGMA $pragmaOptimize($optimizeAllTablesMask);" else "PRAGMA $pragmaOptimize;")
+        val duration = start.elapsedNow()
+        val changes = before.mapNotNull { (name, plan) ->
+            val sql = hotQueries.getValue(name).sql
+            val after = explainQueryPlan(sql)
+            if (after != plan) QueryPlanChange(name, sql, plan, after) else null
+        }
+        changes.forEach { onPlanChange?.invoke(it) }
+        return OptimizeResult(duration, changes)
+    }
+
+    /**
+     * Starts a [PeriodicOptimizer] that runs [optimize] every [interval] on a worker connection,
+     * for long-lived connections whose data changes over time. This connection loads the new
+     * statistics before its next top level [transaction].
+     * @param scope runs the worker coroutine, usually one with an IO dispatcher
+     * @param passphrase opens the worker connection, must be the key of this database
+     * @throws IllegalArgumentException if [interval] is not positive, before any connection is opened
+     */
+    suspend fun startPeriodicOptimize(
+        scope: CoroutineScope,
+        passphrase: Passphrase,
+        interval: Duration = 1.hours
+    ): PeriodicOptimizer {
+        if (!isOpen || path == inMemoryPath)
+            throw IllegalStateException("A file database must be open to start periodic optimize")
+        if (!interval.isPositive())
+            throw IllegalArgumentException("interval must be positive, found $interval")
+        val worker = workerDatabase()
+        worker.open(passphrase)
+        hotQueries.forEach { (name, query) -> worker.registerHotQuery(name, query.sql, query.bindArgs) }
+        worker.onPlanChange = onPlanChange
+        return PeriodicOptimizer(this, worker, interval).also { it.start(scope) }
+    }
+
+    /**
+     * Starts an [IncrementalVacuumer] for this database, which must be open on a file created with
+     * [autoVacuum] set to [AutoVacuum.Incremental]. Free pages left by deletes are then released in
+     * small steps while the database is idle, instead of by a full VACUUM.
+     * @param scope runs the worker coroutine, usually one with an IO dispatcher
+     * @param passphrase opens the worker connection, must be the key of this database
+     * @throws IllegalStateException if not open or not in incremental auto_vacuum mode
+     */
+    suspend fun startIncrementalVacuum(
+        scope: CoroutineScope,
+        passphrase: Passphrase,
+        policy: IncrementalVacuumPolicy = IncrementalVacuumPolicy()
+    ): IncrementalVacuumer {
+        if (!isOpen || path == inMemoryPath)
+            throw IllegalStateException("A file database must be open to start incremental vacuum")
+        if (autoVacuum != AutoVacuum.Incremental)
+            throw IllegalStateException("Incremental vacuum requires auto_vacuum INCREMENTAL, found $autoVacuum")
+        val worker = workerDatabase()
+        worker.open(passphrase)
+        try {
+            worker.sqliteDb.busyTimeout(policy.busyTimeout.inWholeMilliseconds.toInt())
+            return IncrementalVacuumer(worker, policy).also { it.start(scope) }
+        } catch (e: Throwable) {
+            worker.close()
+            throw e
+        }
+    }
+
+    /**
+     * Compacts the database without holding a lock for the duration of a full VACUUM. A worker
+     * connection, opened with the configuration of this one, copies the database with VACUUM INTO
+     * to a file next to it, encrypted with the same key. The copy runs on [dispatcher], so the
+     * caller's other coroutines can keep reading and writing through this connection meanwhile.
+     * This connection then takes an exclusive lock and compares [changeToken]s to see whether
+     * anything was committed since the copy started. If so the copy is stale and is made again,
+     * up to [onlineAttempts] times, after which it is made on this connection, blocking the caller
+     * so no write can slip in. The copy atomically replaces the database file while the lock is
+     * still held, as kmpsql_file_replace allows for the connection holding it, so the change
+     * tracking sidecar of the old file is dropped and the next [backupChanges] is full. This
+     * connection is then closed, which releases the lock, and reopened with the same
+     * configuration. As with any [close], statements and [ChangeCapture]s still open on it are
+     * closed and can not be used after.
+     *
+     * This connection must be the only one to the database, since others would keep using the
+     * replaced file. In WAL mode every open connection, in this process or another, holds a lock
+     * that makes the exclusive lock fail, so a compaction with others open fails and leaves the
+     * database unchanged. Stop a [WalCheckpointer] or [IncrementalVacuumer], and close any
+     * [ReadSnapshot], whose worker connection counts as another connection, first. In rollback
+     * journal mode idle connections hold no lock and can not be detected. Such a connection would
+     * keep reading the old file, and its writes would fail with SQLITE_READONLY_DBMOVED, so the
+     * caller must make sure none are open.
+     * @param passphrase key of this database, used for the copy and the reopen
+     * @param dispatcher runs the online copies, usually an IO dispatcher
+     * @param onlineAttempts copies made off the caller before falling back to one made on this
+     * connection
+     * @return page counts before and after
+     * @throws SqliteException with SQLITE_BUSY if other connections are open, or if the copy
+     * fails. The original database is left in place, and this connection stays open.
+     */
+    suspend fun compact(
+        passphrase: Passphrase,
+        dispatcher: CoroutineDispatcher = Dispatchers.Default,
+        onlineAttempts: Int = 3
+    ): CompactionResult {
+        if (!isOpen || path == inMemoryPath)
+            throw IllegalStateException("A file database must be open to compact")
+        if (transactionDepth > 0)
+            throw IllegalStateException("Cannot compact with an active transaction")
+        val compactPath = "$path$compactSuffix"
+        val isWal = queryPragmaString(pragmaJournalMode).equals(walMode, true)
+        val pagesBefore = queryPragmaString(pragmaPageCount).toLong()
+        val freeBefore = queryPragmaString(pragmaFreelistCount).toLong()
+        var attempt = 0
+        while (true) {
+            sqliteDb.removeFile(compactPath)
+            val token = changeToken()
+            try {
+                if (attempt < onlineAttempts) {
+                    withContext(dispatcher) {
+                        val worker = workerDatabase()
+                        worker.open(passphrase)
+                        try {
+                            compactCopy(worker, compactPath, passphrase, isWal)
+                        } finally {
+                            worker.close()
+                        }
+                    }
+                    // the caller's other coroutines may be inside a transaction of this connection
+                    while (transactionDepth > 0)
+                        delay(transactionWaitDelay)
+                } else
+                    compactCopy(this, compactPath, passphrase, isWal)
+                lockExclusive()
+            } catch (e: Throwable) {
+                sqliteDb.removeFile(compactPath)
+                throw e
+            }
+            if (!isChangedSince(token))
+                break
+            unlockExclusive()
+            if (attempt >= onlineAttempts) {
+                sqliteDb.removeFile(compactPath)
+                throw SqliteException("Database written during compaction", "compact", sqliteBusy)
+            }
+            attempt++
+        }
+        // nothing suspends while the lock is held, so no write through this connection is lost
+        val rc = sqliteDb.replaceFile(compactPath, path)
+        // closing rolls back the empty exclusive transaction, only now releasing the lock
+        val optimize = optimizeOnClose
+        optimizeOnClose = false
+        try {
+            close()
+        } finally {
+            optimizeOnClose = optimize
+        }
+        open(passphrase)
+        if (rc != 0)
+            throw SqliteException("Replace of $path by compacted copy failed", "kmpsql_file_replace", rc)
+        return CompactionResult(pagesBefore, freeBefore, queryPragmaString(pragmaPageCount).toLong())
+    }
+
+    private suspend fun compactCopy(
+        source: SqlCipherDatabase,
+        compactPath: String,
+        passphrase: Passphrase,
+        isWal: Boolean
+    ) {
+        source.executeRaw("VACUUM INTO '${compactPath.replace("'", "''")}';")
+        // VACUUM INTO always writes a rollback journal database
+        if (isWal) {
+            val copy = workerDatabase(compactPath)
+            copy.open(passphrase)
+            try {
+                copy.pragma("$pragmaJournalMode = $walMode") { false }
+            } finally {
+                copy.close()
+            }
+        }
+    }
+
+    /**
+     * Locks out every other connection, in WAL mode including idle ones, until this one closes
+     * or [unlockExclusive] is called.
+     * @throws SqliteException with SQLITE_BUSY if another connection holds a lock past [busyTimeout],
+     * otherwise the error of the BEGIN
+     */
+    private fun lockExclusive() {
+        pragma("$pragmaLockingMode = $exclusiveLocking") { false }
+        try {
+            executeRaw("BEGIN EXCLUSIVE;")
+        } catch (e: SqliteException) {
+            pragma("$pragmaLockingMode = $normalLocking") { false }
+            if (e.result != sqliteBusy && e.result != sqliteLocked)
+                throw e
+            throw SqliteException("Other connections to $path are open, compaction requires exclusive use",
+                "compact", sqliteBusy)
+        }
+    }
+
+    private fun unlockExclusive() {
+        executeRaw("ROLLBACK;")
+        pragma("$pragmaLockingMode = $normalLocking") { false }
+        // the lock is only dropped by the next access in normal locking mode
+        queryPragmaString(pragmaPageCount)
+    }
+
+    internal fun queryPragmaString(pragmaText: String): String {
+        var value = ""
+        pragma(pragmaText) {
+            value = it.requireString(0)
+            false
+        }
+        return value
+    }
+
+    private suspend fun backup(
+        destination: SqliteDatabase,
+        pagesPerStep: Int,
+        bytesPerSecond: Long,
+        progress: ((BackupProgress) -> Unit)?
+    ): BackupProgress {
+        var pageSize = 0L
+        pragma(pragmaPageSize) {
+            pageSize = it.requireString(0).toLong()
+            false
+        }
+        val backup = SqliteBackup(destination, sqliteDb)
+        val rc = backup.init()
+        if (rc != 0)
+            throw SqliteException(destination.error(), "backup_init", rc)
+        var finished = false
+        try {
+            val start = TimeSource.Monotonic.markNow()
+            var bytes = 0L
+            var status: BackupProgress
+            do {
+                val result = backup.step(pagesPerStep)
+                status = BackupProgress(backup.remaining(), backup.pageCount())
+                when (result) {
+                    SqliteBackupResult.Ok -> {
+                        progress?.invoke(status)
+                        bytes += pagesPerStep * pageSize
+                        val ahead = if (bytesPerSecond > 0)
+                            (bytes * 1000 / bytesPerSecond).milliseconds - start.elapsedNow()
+                        else
+                            0.milliseconds
+                        if (ahead.isPositive()) delay(ahead) else yield()
+                    }
+                    SqliteBackupResult.Busy,
+                    SqliteBackupResult.Locked -> delay(backupBusyDelay)
+                    SqliteBackupResult.Done -> progress?.invoke(status)
+                    SqliteBackupResult.Error -> {}
+                }
+            } while (result != SqliteBackupResult.Done && result != SqliteBackupResult.Error)
+            finished = true
+            val finishRc = backup.finish()
+            if (finishRc != 0)
+                throw SqliteException(destination.error(), "backup_step", finishRc)
+            return status
+        } finally {
+            if (!finished)
+                backup.finish()
+        }
+    }
+
     override suspend fun beginTransaction(mode: TransactionMode) {
         val sql = buildString {
             append("BEGIN ")
@@ -702,6 +1582,8 @@ class SqlCipherDatabase:
 
     override suspend fun transaction(mode: TransactionMode, unitOfWork: suspend () -> Unit) {
         if (transactionDepth == 0) {
+            if (statisticsStale.compareAndSet(true, false))
+                executeRaw("ANALYZE $catalogTable;")
             beginTransaction(mode)
         }
         transactionDepth++
@@ -726,12 +1608,62 @@ class SqlCipherDatabase:
 
     private fun setup(passphrase: Passphrase) {
         softHeapLimit = defaultSoftHeapLimit
-        sqliteDb.busyTimeout(defaultTimeout)
+        sqliteDb.busyTimeout(busyTimeout)
         if (passphrase.passphrase.isNotEmpty()) {
             pragmaKey(passphrase)
         }
     }
 
+    /**
+     * New closed connection configured like this one, for worker connections. Copies everything
+     * that decides how the database is opened and read: VFS and VFS options, [onOpenPragmas] (so
+     * custom cipher settings apply), [busyTimeout] and [analysisLimit]. Not copied are callbacks
+     * and version upgrades, which belong to this instance, and [createOk].
+     * @param otherPath empty for this database. Otherwise a different database, like a backup
+     * destination, which is then not shared memory and not change tracked.
+     */
+    internal fun workerDatabase(otherPath: String = ""): SqlCipherDatabase {
+        val owner = this
+        return sqlcipher {
+            path = otherPath.ifEmpty { owner.path }
+            if (otherPath.isEmpty()) {
+                sharedMemoryName = owner.sharedMemoryName
+                changeTracking = owner.changeTracking
+            }
+            vfsName = owner.vfsName
+            latency = owner.latency
+            readaheadPages = owner.readaheadPages
+            mmapSize = owner.mmapSize
+            busyTimeout = owner.busyTimeout
+            analysisLimit = owner.analysisLimit
+            onOpenPragmas = owner.onOpenPragmas
+        }
+    }
+
+    private fun openVfsName(workPath: String): String {
+        // memdb shares databases whose name starts with a slash
+        if (sharedMemoryName.isNotEmpty())
+            return memdbVfsName
+        latency?.let {
+            val name = vfsName.ifEmpty { latencyVfsName }
+            val rc = sqliteDb.registerLatencyVfs(name, it.toArray())
+            if (rc != 0)
+                throw SqliteException("Latency VFS registration failed", "registerLatencyVfs", rc)
+            return name
+        }
+        if (vfsName.isNotEmpty() || workPath == inMemoryPath)
+            return vfsName
+        val (name, rc) = when {
+            changeTracking -> trackingVfsName to sqliteDb.registerTrackingVfs()
+            readaheadPages >= 2 -> readaheadVfsName to sqliteDb.registerReadaheadVfs(readaheadPages)
+            mmapSize > 0 -> metricsVfsName to sqliteDb.registerMetricsVfs()
+            else -> return vfsName
+        }
+        if (rc != 0)
+            throw SqliteException("VFS $name registration failed", "registerVfs", rc)
+        return name
+    }
+
     private fun integrityCheck() {
         if (integrityCheck) {
             pragma(pragmaIntegrityCheck) {
@@ -769,5 +1701,45 @@ class SqlCipherDatabase:
         private const val pragmaVersion = "cipher_version"
         private const val pragmaUserVersion = "user_version"
         private const val foreignKeys = "foreign_keys"
+        private const val pragmaPageSize = "page_size"
+        private const val pragmaMmapSize = "mmap_size"
+        private const val pragmaJournalMode = "journal_mode"
+        private const val walMode = "wal"
+        private const val pragmaPageCount = "page_count"
+        private const val pragmaFreelistCount = "freelist_count"
+        private const val compactSuffix = "-compact"
+        private const val pragmaLockingMode = "locking_mode"
+        private const val exclusiveLocking = "EXCLUSIVE"
+        private const val normalLocking = "NORMAL"
+        private const val pragmaOptimize = "optimize"
+        private const val pragmaAnalysisLimit = "analysis_limit"
+        private const val optimizeAllTablesMask = "0x10002"
+        const val defaultAnalysisLimit = 400
+        private const val sqliteBusy = 5
+        private const val sqliteLocked = 6
+        private const val mainSchema = "main"
+        private const val imageSchema = "kmpsql_image"
+        const val defaultBackupPagesPerStep = 256
+        private val openSequence = atomic(0L)
+        private val backupBusyDelay = 50.milliseconds
+        private val transactionWaitDelay = 50.milliseconds
+        val abortOnConflict: ChangesetConflictHandler = { _, _, _ -> ConflictAction.Abort }
+
+        /** SQLITE_ENABLE_SESSION, needed by change capture and changesets */
+        const val sessionOption = "ENABLE_SESSION"
+
+        /** SQLITE_ENABLE_SNAPSHOT, needed by read snapshots */
+        const val snapshotOption = "ENABLE_SNAPSHOT"
+
+        /** SQLITE_ENABLE_STMT_SCANSTATUS, needed by the loop counters of query plan captures */
+        const val scanStatusOption = "ENABLE_STMT_SCANSTATUS"
+
+        /**
+         * @throws UnsupportedOperationException if the linked library was built without [option]
+         */
+        internal fun requireCompileOption(db: SqliteDatabase, option: String, feature: String) {
+            if (!db.compileOptionUsed(option))
+                throw UnsupportedOperationException("$feature requires SqlCipher built with SQLITE_$option")
+        }
     }
 }
\ No newline at end of file
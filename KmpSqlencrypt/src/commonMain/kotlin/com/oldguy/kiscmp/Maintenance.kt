@@ -0,0 +1,362 @@
+package com.oldguy.kiscmp
+
+import kotlinx.coroutines.CoroutineScope
+import kotlinx.coroutines.Job
+import kotlinx.coroutines.cancelAndJoin
+import kotlinx.coroutines.delay
+import kotlinx.coroutines.isActive
+import kotlinx.coroutines.launch
+import kotlinx.coroutines.sync.Mutex
+import kotlinx.coroutines.sync.withLock
+import kotlinx.coroutines.yield
+import kotlin.time.Duration
+import kotlin.time.Duration.Companion.milliseconds
+import kotlin.time.Duration.Companion.seconds
+import kotlin.time.TimeSource
+
+/**
+ * Outcome of [SqlCipherDatabase.compact]. Sizes are in pages of the database page size.
+ * @property pagesBefore database size before compaction
+ * @property freePagesBefore unused pages before compaction, the space expected to be reclaimed
+ * @property pagesAfter database size after compaction
+ */
+data class CompactionResult(
+    val pagesBefore: Long,
+    val freePagesBefore: Long,
+    val pagesAfter: Long
+) {
+    val pagesReclaimed: Long get() = pagesBefore - pagesAfter
+}
+
+/**
+ * Values of PRAGMA auto_vacuum. Ordinals must match the pragma values.
+ */
+enum class AutoVacuum {
+    /** free pages stay in the file until a VACUUM */
+    None,
+    /** free pages are removed from the end of the file at every commit */
+    Full,
+    /** free pages are kept until PRAGMA incremental_vacuum, see [IncrementalVacuumer] */
+    Incremental
+}
+
+/**
+ * Controls an [IncrementalVacuumer]. Every [interval] the worker checks whether the database was
+ * idle, meaning no other connection committed since the previous check. If so and at least
+ * [minFreePages] pages are free, it runs PRAGMA incremental_vacuum in steps of [pagesPerStep]
+ * pages, each one a short write transaction, until no free pages remain or [maxRunTime] has passed.
+ * @property interval time between checks
+ * @property pagesPerStep pages released by each step, bounds how long each step holds the write lock
+ * @property minFreePages free pages below which nothing is done
+ * @property maxRunTime time after which a run stops, even if free pages remain. Checked after each
+ * step, so a run can exceed it by one step.
+ * @property busyTimeout how long each step waits for the write lock
+ */
+data class IncrementalVacuumPolicy(
+    val interval: Duration = 5.seconds,
+    val pagesPerStep: Int = 64,
+    val minFreePages: Long = 1,
+    val maxRunTime: Duration = 100.milliseconds,
+    val busyTimeout: Duration = 100.milliseconds
+) {
+    init {
+        if (!interval.isPositive())
+            throw IllegalArgumentException("interval must be positive, found $interval")
+        if (pagesPerStep < 1 || minFreePages < 1)
+            throw IllegalArgumentException("pagesPerStep and minFreePages must be positive")
+    }
+}
+
+/**
+ * Result of one incremental vacuum run.
+ * @property freePagesBefore free pages when the run started
+ * @property pagesReclaimed pages removed from the file
+ * @property steps incremental_vacuum statements run
+ * @property busy true if the run stopped because the write lock was not available
+ * @property duration time the run took
+ */
+data class IncrementalVacuumResult(
+    val freePagesBefore: Long,
+    val pagesReclaimed: Long,
+    val steps: Int,
+    val busy: Boolean,
+    val duration: Duration
+)
+
+/**
+ * Counters of an [IncrementalVacuumer] since it started.
+ * @property runs runs that released pages, or tried to
+ * @property skippedActive checks skipped because another connection had committed since the
+ * previous check
+ * @property steps incremental_vacuum statements run
+ * @property pagesReclaimed pages removed from the file
+ * @property freePages free pages as of the last check or run
+ * @property busyRuns runs stopped because the write lock was not available
+ * @property lastDuration duration of the last run
+ * @property maxDuration longest run
+ */
+data class IncrementalVacuumMetrics(
+    val runs: Long = 0,
+    val skippedActive: Long = 0,
+    val steps: Long = 0,
+    val pagesReclaimed: Long = 0,
+    val freePages: Long = 0,
+    val busyRuns: Long = 0,
+    val lastDuration: Duration = Duration.ZERO,
+    val maxDuration: Duration = Duration.ZERO
+)
+
+/**
+ * Background worker releasing the free pages of a database in auto_vacuum INCREMENTAL mode,
+ * started by [SqlCipherDatabase.startIncrementalVacuum]. Like [WalCheckpointer] it uses its own
+ * connection, so the short write transactions of each step interleave with the writes of the
+ * application instead of one long exclusive VACUUM.
+ */
+class IncrementalVacuumer internal constructor(
+    private val worker: SqlCipherDatabase,
+    private val policy: IncrementalVacuumPolicy
+) {
+    private val mutex = Mutex()
+    private var job: Job? = null
+    private var lastVersion = 0L
+
+    /**
+     * Current counters. Updated after each check.
+     */
+    var metrics = IncrementalVacuumMetrics()
+        private set
+
+    /**
+     * Error other than SQLITE_BUSY or SQLITE_LOCKED that stopped the scheduled checks, null if none
+     * did. The worker connection is closed when this is set, and the scope it was started in is
+     * not affected.
+     */
+    var failure: SqliteException? = null
+        private set
+
+    val isRunning: Boolean get() = job?.isActive == true
+
+    internal fun start(scope: CoroutineScope) {
+        lastVersion = worker.dataVersion()
+        job = scope.launch {
+            try {
+                while (isActive) {
+                    delay(policy.interval)
+                    tick()
+                }
+            } catch (e: SqliteException) {
+                failure = e
+                mutex.withLock {
+                    if (worker.isOpen)
+                        worker.close()
+                }
+            }
+        }
+    }
+
+    /**
+     * Runs immediately, outside the schedule and whether or not the database is idle. Still limited
+     * by [IncrementalVacuumPolicy.maxRunTime].
+     * @throws IllegalStateException if the worker was stopped, or by a [failure]
+     * @throws SqliteException for errors other than SQLITE_BUSY or SQLITE_LOCKED
+     */
+    suspend fun reclaim(): IncrementalVacuumResult {
+        return mutex.withLock {
+            if (!worker.isOpen)
+                throw IllegalStateException("Incremental vacuum worker is closed", failure)
+            run()
+        }
+    }
+
+    /**
+     * Stops the worker, waiting for a run in progress, and closes its connection.
+     */
+    suspend fun stop() {
+        job?.cancelAndJoin()
+        job = null
+        mutex.withLock {
+            if (worker.isOpen)
+                worker.close()
+        }
+    }
+
+    private suspend fun tick() {
+        mutex.withLock {
+            val version = worker.dataVersion()
+            if (version != lastVersion) {
+                lastVersion = version
+                metrics = metrics.copy(skippedActive = metrics.skippedActive + 1)
+                return
+            }
+            val free = worker.queryPragmaString(pragmaFreelistCount).toLong()
+            if (free < policy.minFreePages) {
+                metrics = metrics.copy(freePages = free)
+                return
+            }
+            run()
+        }
+    }
+
+    private suspend fun run(): IncrementalVacuumResult {
+        val start = TimeSource.Monotonic.markNow()
+        val freeBefore = worker.queryPragmaString(pragmaFreelistCount).toLong()
+        var free = freeBefore
+        var steps = 0
+        var busy = false
+        while (free > 0 && (steps == 0 || start.elapsedNow() < policy.maxRunTime)) {
+            try {
+                worker.execute("PRAGMA $pragmaIncrementalVacuum(${policy.pagesPerStep});")
+            } catch (e: SqliteException) {
+                if (e.result != sqliteBusy && e.result != sqliteLocked)
+                    throw e
+                busy = true
+                break
+            }
+            steps++
+            free = worker.queryPragmaString(pragmaFreelistCount).toLong()
+            yield()
+        }
+        val result = IncrementalVacuumResult(freeBefore, freeBefore - free, steps, busy, start.elapsedNow())
+        record(result, free)
+        return result
+    }
+
+    private fun record(result: IncrementalVacuumResult, free: Long) {
+        metrics = metrics.let {
+            it.copy(
+                runs = it.runs + 1,
+                steps = it.steps + result.steps,
+                pagesReclaimed = it.pagesReclaimed + result.pagesReclaimed,
+                freePages = free,
+                busyRuns = it.busyRuns + if (result.busy) 1 else 0,
+                lastDuration = result.duration,
+                maxDuration = maxOf(it.maxDuration, result.duration)
+            )
+        }
+        // own commits do not change data_version, so the next check still sees the database idle
+        lastVersion = worker.dataVersion()
+    }
+
+    internal companion object {
+        const val pragmaAutoVacuum = "auto_vacuum"
+        const val pragmaIncrementalVacuum = "incremental_vacuum"
+        private const val pragmaFreelistCount = "freelist_count"
+        private const val sqliteBusy = 5
+        private const val sqliteLocked = 6
+    }
+}
+
+/**
+ * The query plan of a query registered with [SqlCipherDatabase.registerHotQuery] changed during
+ * [SqlCipherDatabase.optimize].
+ * @property name name the query was registered with
+ * @property before EXPLAIN QUERY PLAN lines before the statistics update, see
+ * [SqlCipherDatabase.explainQueryPlan]
+ * @property after EXPLAIN QUERY PLAN lines after the statistics update
+ */
+data class QueryPlanChange(
+    val name: String,
+    val sql: String,
+    val before: List<String>,
+    val after: List<String>
+)
+
+/**
+ * Outcome of one [SqlCipherDatabase.optimize].
+ * @property duration time taken by PRAGMA optimize, not including the query plan captures
+ * @property planChanges registered hot queries whose plan changed, empty if none are registered
+ */
+data class OptimizeResult(
+    val duration: Duration,
+    val planChanges: List<QueryPlanChange>
+)
+
+/**
+ * Runs [SqlCipherDatabase.optimize] on an interval, started by
+ * [SqlCipherDatabase.startPeriodicOptimize]. Like [WalCheckpointer] it uses a worker connection
+ * opened with the configuration of the connection it was started from, so the ANALYZE never runs
+ * on that connection from another coroutine. The worker ran no queries of its own, so every table
+ * is considered. It captures the plans of the hot queries registered when it was started, and
+ * reports their changes to the same [SqlCipherDatabase.onPlanChange].
+ *
+ * Sqlite only loads new statistics into the connection that gathered them, so after each run the
+ * started from connection is flagged, and reloads them before its next top level
+ * [SqlCipherDatabase.transaction]. A run that finds the database locked past the busy timeout is
+ * skipped.
+ */
+class PeriodicOptimizer internal constructor(
+    private val owner: SqlCipherDatabase,
+    private val worker: SqlCipherDatabase,
+    private val interval: Duration
+) {
+    private val mutex = Mutex()
+    private var job: Job? = null
+
+    /**
+     * Number of optimize runs since start
+     */
+    var runs = 0L
+        private set
+
+    /**
+     * Number of runs skipped because the database was locked
+     */
+    var busyRuns = 0L
+        private set
+
+    /**
+     * Result of the most recent run, null until the first one
+     */
+    var lastResult: OptimizeResult? = null
+        private set
+
+    /**
+     * Error other than SQLITE_BUSY or SQLITE_LOCKED that stopped the runs, null if none did. The
+     * worker connection is closed when this is set, and the scope it was started in is not
+     * affected.
+     */
+    var failure: SqliteException? = null
+        private set
+
+    val isRunning: Boolean get() = job?.isActive == true
+
+    internal fun start(scope: CoroutineScope) {
+        job = scope.launch {
+            while (isActive) {
+                delay(interval)
+                mutex.withLock {
+                    try {
+                        lastResult = worker.optimize(allTables = true)
+                        runs++
+                        owner.statisticsStale.value = true
+                    } catch (e: SqliteException) {
+                        if (e.result != sqliteBusy && e.result != sqliteLocked) {
+                            failure = e
+                            worker.close()
+                            return@launch
+                        }
+                        busyRuns++
+                    }
+                }
+            }
+        }
+    }
+
+    /**
+     * Stops the worker, waiting for a run in progress, and closes its connection. The connection
+     * it was started from stays open.
+     */
+    suspend fun stop() {
+        job?.cancelAndJoin()
+        job = null
+        mutex.withLock {
+            if (worker.isOpen)
+                worker.close()
+        }
+    }
+
+    private companion object {
+        const val sqliteBusy = 5
+        const val sqliteLocked = 6
+    }
+}
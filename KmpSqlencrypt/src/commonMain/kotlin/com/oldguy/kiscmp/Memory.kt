@@ -0,0 +1,97 @@
+package com.oldguy.kiscmp
+
+/**
+ * Heap used by Sqlite in this process, over all connections. SqlCipher allocates its page
+ * buffers and key material through Sqlite, so they are included. Zeros if Sqlite was built with
+ * SQLITE_DEFAULT_MEMSTATUS=0.
+ * @property used bytes currently allocated
+ * @property highwater most bytes allocated at once since the last reset
+ */
+data class SqliteMemory(
+    val used: Long = 0,
+    val highwater: Long = 0
+) {
+    companion object {
+        /**
+         * Decodes the array returned by [SqliteDatabase.memoryStatus]
+         */
+        fun fromArray(values: LongArray): SqliteMemory {
+            if (values.size < 2) return SqliteMemory()
+            return SqliteMemory(values[0], values[1])
+        }
+    }
+}
+
+/**
+ * Memory and page cache counters of one connection, from sqlite3_db_status. Sizes are in bytes.
+ * @property lookasideUsed lookaside slots in use
+ * @property lookasideHighwater most lookaside slots in use at once
+ * @property cacheUsed heap used by the page cache of the connection
+ * @property cacheUsedShared same as [cacheUsed], with caches shared with other connections
+ * divided between them
+ * @property schemaUsed heap used by the schemas of the connection
+ * @property statementUsed heap used by the prepared statements of the connection
+ * @property lookasideHits allocations satisfied from lookaside
+ * @property lookasideMissSize allocations too large for lookaside
+ * @property lookasideMissFull allocations not satisfied because lookaside was full
+ * @property cacheHits page cache hits
+ * @property cacheMisses page cache misses, pages read and for an encrypted database decrypted
+ * @property cacheWrites pages written
+ * @property cacheSpills dirty pages written in the middle of a transaction because the cache was full
+ */
+data class ConnectionMemory(
+    val lookasideUsed: Long = 0,
+    val lookasideHighwater: Long = 0,
+    val cacheUsed: Long = 0,
+    val cacheUsedShared: Long = 0,
+    val schemaUsed: Long = 0,
+    val statementUsed: Long = 0,
+    val lookasideHits: Long = 0,
+    val lookasideMissSize: Long = 0,
+    val lookasideMissFull: Long = 0,
+    val cacheHits: Long = 0,
+    val cacheMisses: Long = 0,
+    val cacheWrites: Long = 0,
+    val cacheSpills: Long = 0
+) {
+    companion object {
+        // sqlite3_db_status ops
+        private const val lookasideUsedOp = 0
+        private const val cacheUsedOp = 1
+        private const val schemaUsedOp = 2
+        private const val stmtUsedOp = 3
+        private const val lookasideHitOp = 4
+        private const val lookasideMissSizeOp = 5
+        private const val lookasideMissFullOp = 6
+        private const val cacheHitOp = 7
+        private const val cacheMissOp = 8
+        private const val cacheWriteOp = 9
+        private const val cacheUsedSharedOp = 11
+        private const val cacheSpillOp = 12
+
+        /**
+         * Decodes the array returned by [SqliteDatabase.dbStatus]. Lookaside hits and misses are
+         * only reported as high water marks, the other counters only as current values. An empty
+         * array (closed connection) decodes to all zeros.
+         */
+        fun fromArray(values: LongArray): ConnectionMemory {
+            fun current(op: Int) = values.getOrElse(op * 2) { 0 }
+            fun highwater(op: Int) = values.getOrElse(op * 2 + 1) { 0 }
+            return ConnectionMemory(
+                current(lookasideUsedOp),
+                highwater(lookasideUsedOp),
+                current(cacheUsedOp),
+                current(cacheUsedSharedOp),
+                current(schemaUsedOp),
+                current(stmtUsedOp),
+                highwater(lookasideHitOp),
+                highwater(lookasideMissSizeOp),
+                highwater(lookasideMissFullOp),
+                current(cacheHitOp),
+                current(cacheMissOp),
+                current(cacheWriteOp),
+                current(cacheSpillOp)
+            )
+        }
+    }
+}
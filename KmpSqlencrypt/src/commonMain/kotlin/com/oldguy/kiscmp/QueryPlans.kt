@@ -0,0 +1,195 @@
+package com.oldguy.kiscmp
+
+/**
+ * One loop of a query plan and the work it did in one run, from sqlite3_stmt_scanstatus.
+ * @property detail EXPLAIN QUERY PLAN detail of the loop, like "SEARCH t USING INDEX t_a (a=?)"
+ * @property loops number of times the loop was started
+ * @property rowsVisited rows visited by the loop over all its starts
+ */
+data class PlanLoop(
+    val detail: String,
+    val loops: Long,
+    val rowsVisited: Long
+)
+
+/**
+ * Plan of one query registered with [SqlCipherDatabase.registerHotQuery], captured by
+ * [SqlCipherDatabase.captureQueryPlans].
+ * @property plan EXPLAIN QUERY PLAN lines, see [SqlCipherDatabase.explainQueryPlan]
+ * @property loops counters of each loop of the plan after running the query once with its bind
+ * values
+ */
+data class QueryPlanCapture(
+    val name: String,
+    val sql: String,
+    val plan: List<String>,
+    val loops: List<PlanLoop>
+) {
+    val rowsVisited: Long get() = loops.sumOf { it.rowsVisited }
+}
+
+/**
+ * @property isFailure true for the changes that usually cost far more than the plan they replace
+ */
+enum class PlanRegressionKind(val isFailure: Boolean) {
+    /** A table that was searched with an index or rowid is now scanned */
+    SeekToScan(true),
+    /** A temporary B-tree for ORDER BY, GROUP BY or DISTINCT is now used */
+    NewTempBTree(true),
+    /** The plan changed in another way */
+    PlanChanged(false),
+    /** The query visited more rows than the baseline allows */
+    MoreRowsVisited(false),
+    /** The query is in the baseline but was not captured */
+    Missing(false),
+    /** The query was captured but is not in the baseline */
+    Added(false)
+}
+
+data class PlanRegression(
+    val name: String,
+    val kind: PlanRegressionKind,
+    val description: String
+) {
+    override fun toString(): String = "$kind $name: $description"
+}
+
+/**
+ * Known good plans of the hot queries, kept as text in a golden file. A run captures the current
+ * plans with [SqlCipherDatabase.captureQueryPlans] and [compare]s them to the baseline, so plan
+ * changes caused by a new Sqlite version, a schema change or new statistics are found before they
+ * show up as slow queries.
+ *
+ * The text has one block per query, lines prefixed with "query:", "sql:", "plan:" and "loop:" and
+ * a blank line between blocks, so a diff of two golden files reads naturally. Line breaks in sql
+ * are written as spaces.
+ */
+class QueryPlanBaseline(val captures: List<QueryPlanCapture>) {
+
+    fun toText(): String = buildString {
+        captures.forEach { capture ->
+            append("$queryPrefix${capture.name}\n")
+            append("$sqlPrefix${capture.sql.replace('\n', ' ')}\n")
+            capture.plan.forEach { append("$planPrefix$it\n") }
+            capture.loops.forEach { append("$loopPrefix${it.loops} ${it.rowsVisited} ${it.detail}\n") }
+            append("\n")
+        }
+    }
+
+    /**
+     * Finds the changes from this baseline to [current], compared by query name. A query that
+     * was searching a table and now scans it, or that now uses a temporary B-tree, is a failure.
+     * Other plan differences and growth in the rows visited are reported but are not failures.
+     * Rows visited are only compared for baseline queries that have loop counters.
+     * @param visitedFactor rows visited may grow by this factor of the baseline before it is
+     * reported
+     * @param visitedSlack rows visited may also grow by this many rows, so tiny tables are not
+     * reported
+     */
+    fun compare(
+        current: List<QueryPlanCapture>,
+        visitedFactor: Double = 2.0,
+        visitedSlack: Long = 100
+    ): List<PlanRegression> {
+        val regressions = mutableListOf<PlanRegression>()
+        val byName = current.associateBy { it.name }
+        captures.forEach { before ->
+            val after = byName[before.name]
+            if (after == null) {
+                regressions.add(PlanRegression(before.name, PlanRegressionKind.Missing, "not captured"))
+                return@forEach
+            }
+            val failures = seekToScan(before, after) + newTempBTrees(before, after)
+            regressions.addAll(failures)
+            if (failures.isEmpty() && before.plan != after.plan)
+                regressions.add(PlanRegression(before.name, PlanRegressionKind.PlanChanged,
+                    "${before.plan} became ${after.plan}"))
+            val allowed = (before.rowsVisited * visitedFactor).toLong() + visitedSlack
+            if (before.loops.isNotEmpty() && after.rowsVisited > allowed)
+                regressions.add(PlanRegression(before.name, PlanRegressionKind.MoreRowsVisited,
+                    "${before.rowsVisited} rows visited became ${after.rowsVisited}"))
+        }
+        val names = captures.map { it.name }.toSet()
+        current.filter { it.name !in names }.forEach {
+            regressions.add(PlanRegression(it.name, PlanRegressionKind.Added, "not in baseline"))
+        }
+        return regressions
+    }
+
+    private fun seekToScan(before: QueryPlanCapture, after: QueryPlanCapture): List<PlanRegression> {
+        val searchedAfter = tables(after.plan, searchPrefix)
+        val scannedAfter = tables(after.plan, scanPrefix)
+        return tables(before.plan, searchPrefix)
+            .filter { it !in searchedAfter && it in scannedAfter }
+            .map { PlanRegression(before.name, PlanRegressionKind.SeekToScan, "table $it is now scanned") }
+    }
+
+    private fun newTempBTrees(before: QueryPlanCapture, after: QueryPlanCapture): List<PlanRegression> {
+        val counts = tempBTrees(before.plan)
+        return tempBTrees(after.plan)
+            .filter { (line, count) -> count > (counts[line] ?: 0) }
+            .map { (line, _) -> PlanRegression(before.name, PlanRegressionKind.NewTempBTree, line) }
+    }
+
+    private fun tables(plan: List<String>, prefix: String): Set<String> = plan
+        .map { it.trim() }
+        .filter { it.startsWith(prefix) }
+        .map { it.substring(prefix.length).substringBefore(' ') }
+        .toSet()
+
+    private fun tempBTrees(plan: List<String>): Map<String, Int> = plan
+        .map { it.trim() }
+        .filter { it.startsWith(tempBTreePrefix) }
+        .groupingBy { it }
+        .eachCount()
+
+    companion object {
+        private const val queryPrefix = "query: "
+        private const val sqlPrefix = "sql: "
+        private const val planPrefix = "plan: "
+        private const val loopPrefix = "loop: "
+        private const val searchPrefix = "SEARCH "
+        private const val scanPrefix = "SCAN "
+        private const val tempBTreePrefix = "USE TEMP B-TREE"
+
+        /**
+         * Reads the text written by [toText]
+         * @throws IllegalArgumentException if a line is not in that format
+         */
+        fun parse(text: String): QueryPlanBaseline {
+            val captures = mutableListOf<QueryPlanCapture>()
+            var name: String? = null
+            var sql = ""
+            val plan = mutableListOf<String>()
+            val loops = mutableListOf<PlanLoop>()
+            fun endQuery() {
+                name?.let { captures.add(QueryPlanCapture(it, sql, plan.toList(), loops.toList())) }
+                name = null
+                sql = ""
+                plan.clear()
+                loops.clear()
+            }
+            text.lines().forEachIndexed { index, line ->
+                when {
+                    line.isBlank() -> endQuery()
+                    line.startsWith(queryPrefix) -> {
+                        endQuery()
+                        name = line.substring(queryPrefix.length)
+                    }
+                    name == null -> throw IllegalArgumentException("Line ${index + 1} is not in a query: $line")
+                    line.startsWith(sqlPrefix) -> sql = line.substring(sqlPrefix.length)
+                    line.startsWith(planPrefix) -> plan.add(line.substring(planPrefix.length))
+                    line.startsWith(loopPrefix) -> {
+                        val fields = line.substring(loopPrefix.length).split(' ', limit = 3)
+                        if (fields.size < 3)
+                            throw IllegalArgumentException("Line ${index + 1} is not a loop: $line")
+                        loops.add(PlanLoop(fields[2], fields[0].toLong(), fields[1].toLong()))
+                    }
+                    else -> throw IllegalArgumentException("Line ${index + 1} unrecognized: $line")
+                }
+            }
+            endQuery()
+            return QueryPlanBaseline(captures)
+        }
+    }
+}
@@ -0,0 +1,68 @@
+package com.oldguy.kiscmp
+
+import kotlin.time.Duration
+
+/**
+ * One committed state of a WAL mode database, taken by [SqlCipherDatabase.takeSnapshot]. Other
+ * connections to the same database read exactly this state inside
+ * [SqlCipherDatabase.readSnapshot], whatever has been committed since, so queries fanned out over
+ * several connections give consistent results without running on one connection.
+ *
+ * The read transaction that defines the snapshot is held open until [close] by a worker
+ * connection the snapshot owns, so the connection that took it is free to read and write as
+ * usual. That open transaction stops checkpoints from overwriting the state in the WAL, so the
+ * snapshot stays readable, but it also stops the WAL from being reset, so snapshots should be
+ * short lived.
+ * @property schema schema the snapshot is of
+ * @property acquireTime time taken to start the read transaction and record the snapshot
+ */
+class ReadSnapshot internal constructor(
+    private val holder: SqliteDatabase,
+    internal val handle: Long,
+    val schema: String,
+    val acquireTime: Duration,
+    private val onClose: (ReadSnapshot) -> Unit
+) : Comparable<ReadSnapshot> {
+    var isOpen = true
+        private set
+
+    /**
+     * Read transactions started on this snapshot by [SqlCipherDatabase.readSnapshot]
+     */
+    var reads = 0L
+        private set
+
+    /**
+     * Longest time taken by [SqlCipherDatabase.readSnapshot] to start a read transaction on this
+     * snapshot
+     */
+    var maxOpenTime = Duration.ZERO
+        private set
+
+    internal fun recordRead(openTime: Duration) {
+        reads++
+        maxOpenTime = maxOf(maxOpenTime, openTime)
+    }
+
+    /**
+     * Orders snapshots of the same database by age, older first. The result is meaningless for
+     * snapshots of different databases.
+     */
+    override fun compareTo(other: ReadSnapshot): Int {
+        if (!isOpen || !other.isOpen)
+            throw IllegalStateException("Closed snapshots can not be compared")
+        return holder.snapshotCompare(handle, other.handle)
+    }
+
+    /**
+     * Releases the snapshot and closes the worker connection holding its read transaction. Done
+     * automatically when the connection that took it is closed.
+     */
+    fun close() {
+        if (isOpen) {
+            isOpen = false
+            holder.snapshotFree(handle)
+            onClose(this)
+        }
+    }
+}
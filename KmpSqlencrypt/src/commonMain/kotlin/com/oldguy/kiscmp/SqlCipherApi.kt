@@ -36,7 +36,10 @@ expect class SqliteDatabase() {
 
     fun fileName(): String
 
-    fun open(path: String, readOnly: Boolean = false, createOk: Boolean = false): Int
+    /**
+     * @param vfsName name of a registered VFS to open the database with. Empty uses the default VFS.
+     */
+    fun open(path: String, readOnly: Boolean = false, createOk: Boolean = false, vfsName: String = ""): Int
 
     fun close(): Int
 
@@ -56,13 +59,221 @@ expect class SqliteDatabase() {
 
     fun version(): String
 
+    /**
+     * True if the linked Sqlite library was built with [option], named without the SQLITE_ prefix,
+     * for example "ENABLE_SESSION". Does not need an open database. Apis of optional extensions
+     * must not be called unless their option is used, as the library may lack them.
+     */
+    fun compileOptionUsed(option: String): Boolean
+
     /**
      * Useful after an Insert statement when a ROWID is expected to be generated by Sqlite during
      * the insert
      */
     fun lastInsertRowid(): Long
 
+    /**
+     * PRAGMA data_version of a schema, read with one prepared statement instead of a text query.
+     * Changes whenever another connection, in this process or another one, commits a change to the
+     * schema. Commits made through this connection do not change it, see [totalChanges].
+     * @return the version, or -1 on error. Only comparable to other values of the same connection.
+     */
+    fun dataVersion(schema: String = "main"): Long
+
+    /**
+     * Rows inserted, updated or deleted through this connection since it was opened, from
+     * sqlite3_total_changes64. Includes changes later rolled back.
+     */
+    fun totalChanges(): Long
+
     fun sleep(millis: Int)
+
+    /**
+     * Registers the readahead VFS named [readaheadVfsName], or changes its window if already
+     * registered. The window is process-wide, it is the one every database subsequently opened
+     * with that VFS name starts with. Use [readaheadWindow] to change it for one connection.
+     * @param maxPages largest number of pages prefetched by one read. Less than 2 disables readahead.
+     * @param makeDefault true to also make it the default VFS
+     * @return Sqlite result code, 0 is success
+     */
+    fun registerReadaheadVfs(maxPages: Int, makeDefault: Boolean = false): Int
+
+    /**
+     * Sets the readahead window of the main database file of this connection, leaving other
+     * files opened through the readahead VFS unchanged.
+     * @param maxPages largest number of pages prefetched by one read, less than 2 disables
+     * readahead. Negative to only read the current window.
+     * @return the previous window, -1 if not open or not opened through a kmpsql VFS
+     */
+    fun readaheadWindow(maxPages: Int): Int
+
+    /**
+     * Registers a VFS that delays reads, writes and syncs to simulate slow storage, or changes the
+     * configuration of one already registered with the same name. Intended for tests and benchmarks,
+     * see [LatencyVfsConfig].
+     * @param vfsName name to use when opening databases with this VFS
+     * @param config values in the order of the KMPSQL_LATENCY indexes in kmpsql.h
+     * @return Sqlite result code, 0 is success
+     */
+    fun registerLatencyVfs(vfsName: String, config: LongArray): Int
+
+    /**
+     * Registers the metrics VFS named [metricsVfsName], which only counts reads and memory mapped
+     * pages of main database files. See [VfsMetrics].
+     * @param makeDefault true to also make it the default VFS
+     * @return Sqlite result code, 0 is success
+     */
+    fun registerMetricsVfs(makeDefault: Boolean = false): Int
+
+    /**
+     * Registers the change tracking VFS named [trackingVfsName]. Databases opened with it record
+     * which pages are written, for use by [writeDelta].
+     * @param makeDefault true to also make it the default VFS
+     * @return Sqlite result code, 0 is success
+     */
+    fun registerTrackingVfs(makeDefault: Boolean = false): Int
+
+    /**
+     * Writes the pages of the main database changed since the previous delta to a new delta file.
+     * @param full true to copy every page
+     * @param info array of at least 6 entries that receives the delta description, see [BackupDelta]
+     * @return Sqlite result code, 0 is success
+     */
+    fun writeDelta(deltaPath: String, full: Boolean, info: LongArray): Int
+
+    /**
+     * Applies a delta file to a copy of a database that is not open. Does not need an open
+     * database.
+     * @param baseEpoch epoch the target is at, -1 if the target has no content yet
+     * @param info array of at least 6 entries that receives the delta description, see [BackupDelta]
+     * @return Sqlite result code, 0 is success
+     */
+    fun applyDelta(deltaPath: String, targetPath: String, baseEpoch: Long, info: LongArray): Int
+
+    /**
+     * Metrics kept by a kmpsql VFS summed over all the files it has opened. See [VfsMetrics].
+     * @return empty if [vfsName] is not a kmpsql VFS
+     */
+    fun vfsMetrics(vfsName: String): LongArray
+
+    /**
+     * Same as [vfsMetrics] but only for the main database file of this connection.
+     * @return empty if closed or not opened using a kmpsql VFS
+     */
+    fun fileMetrics(): LongArray
+
+    /**
+     * Process-wide Sqlite heap use from sqlite3_memory_used and sqlite3_memory_highwater, including
+     * the buffers SqlCipher allocates through Sqlite. Zeros if Sqlite was built with
+     * SQLITE_DEFAULT_MEMSTATUS=0. Does not need an open database.
+     * @param resetHighwater true to restart the high water mark at the current use
+     * @return bytes in use and the highest use since the last reset, see [SqliteMemory]
+     */
+    fun memoryStatus(resetHighwater: Boolean = false): LongArray
+
+    /**
+     * sqlite3_db_status of this connection for every op from 0 to SQLITE_DBSTATUS_MAX.
+     * @param reset true to reset the high water marks, and the cache hit, miss, write and spill
+     * counters
+     * @return current value and high water mark of each op, in op order, see [ConnectionMemory].
+     * Empty if closed.
+     */
+    fun dbStatus(reset: Boolean = false): LongArray
+
+    /**
+     * Copy of the content of one schema, in the same format as a database file. Pages of an
+     * encrypted database are decrypted in the copy, see [SqlCipherDatabase.serialize] for an
+     * encrypted image.
+     * @param schema "main", "temp" or the name of an attached database
+     * @return the image, empty if closed, the schema does not exist or on error
+     */
+    fun serialize(schema: String = "main"): ByteArray
+
+    /**
+     * Replaces the content of a schema with a copy of [image], held in memory until close. The
+     * schema is no longer backed by its file.
+     * @param readOnly true to refuse writes, otherwise the image grows as needed
+     * @return Sqlite result code, 0 is success
+     */
+    fun deserialize(schema: String, image: ByteArray, readOnly: Boolean = false): Int
+
+    /**
+     * Replaces the content of a schema with a read-only memory mapping of an image file, so pages
+     * are used in place without being copied or read. The file must not change until close.
+     * @param path database file, or an image written from [serialize]
+     * @return Sqlite result code, 0 is success
+     */
+    fun deserializeMapped(schema: String, path: String): Int
+
+    /**
+     * Atomically replaces a database file with another, removing leftover WAL, shared memory,
+     * journal and change tracking files of the target. No connection may have the target open.
+     * Does not need an open database.
+     * @return Sqlite result code, 0 is success
+     */
+    fun replaceFile(sourcePath: String, targetPath: String): Int
+
+    /**
+     * Deletes a database file and its WAL, shared memory, journal and change tracking files. Missing
+     * files are ignored. No connection may have it open. Does not need an open database.
+     * @return Sqlite result code, 0 is success
+     */
+    fun removeFile(path: String): Int
+
+    /**
+     * Records the snapshot of a schema read by the current read transaction, so other connections
+     * to the same database can read exactly the same state with [snapshotOpen]. The connection must
+     * be inside BEGIN without having written, and the schema must be in WAL mode with at least one
+     * transaction written to the current WAL file. Requires SQLITE_ENABLE_SNAPSHOT.
+     * @param snapshot receives the snapshot handle in its first entry, to be released with
+     * [snapshotFree]
+     * @return Sqlite result code, 0 is success
+     */
+    fun snapshotGet(schema: String, snapshot: LongArray): Int
+
+    /**
+     * Starts the read transaction of this connection on a snapshot recorded by [snapshotGet]. Must
+     * be called right after BEGIN, before anything reads the schema.
+     * @return Sqlite result code, 0 is success, 769 (SQLITE_ERROR_SNAPSHOT) if a checkpoint has
+     * already overwritten the snapshot
+     */
+    fun snapshotOpen(schema: String, snapshot: Long): Int
+
+    /**
+     * Compares the age of two snapshots of the same database.
+     * @return negative if [snapshot] is older than [other], 0 if the same, positive if newer
+     */
+    fun snapshotCompare(snapshot: Long, other: Long): Int
+
+    fun snapshotFree(snapshot: Long)
+
+    /**
+     * Applies a changeset or patchset made by [SqliteSession] to the main database, in one
+     * savepoint. [conflict] is called only for rows that conflict, and decides what to do with
+     * each. If it returns [ConflictAction.Abort], every change is rolled back.
+     * @return Sqlite result code, 0 is success, 4 (SQLITE_ABORT) if aborted by [conflict]
+     */
+    fun applyChangeset(changeset: ByteArray, conflict: ChangesetConflictHandler): Int
+
+    /**
+     * Same as [applyChangeset], streaming the set from a file written by [SqliteSession.write].
+     */
+    fun applyChangesetFile(path: String, conflict: ChangesetConflictHandler): Int
+
+    /**
+     * Changeset that undoes [changeset]: inserts become deletes, deletes inserts, and updates swap
+     * their old and new values. Patchsets can not be inverted. Does not need an open database.
+     * @throws SqliteException if [changeset] is invalid
+     */
+    fun invertChangeset(changeset: ByteArray): ByteArray
+
+    /**
+     * Merges changesets into one using a Sqlite changegroup, as if they had been recorded by one
+     * session in the given order. Multiple changes to the same row collapse into one, or cancel out.
+     * Does not need an open database.
+     * @throws SqliteException if a changeset is invalid, or changesets are mixed with patchsets
+     */
+    fun combineChangesets(changesets: List<ByteArray>): ByteArray
 }
 
 enum class SqliteColumnType {
@@ -111,6 +322,16 @@ expect class SqliteStatement(db: SqliteDatabase) {
 
     fun isBusy(): Boolean
 
+    /**
+     * Counters of one loop of this statement's query plan, accumulated by every step since it was
+     * prepared. Requires SQLITE_ENABLE_STMT_SCANSTATUS.
+     * @param index loop number, 0 for the first
+     * @param counts receives the number of times the loop ran, the rows it visited, and the id of
+     * the select it belongs to
+     * @return EXPLAIN QUERY PLAN detail of the loop, null if [index] is past the last loop
+     */
+    fun scanStatus(index: Int, counts: LongArray): String?
+
     fun columnCount(): Int
 
     fun dataCount(): Int
@@ -130,4 +351,131 @@ expect class SqliteStatement(db: SqliteDatabase) {
     fun columnInt(index: Int): Int
 
     fun columnLong(index: Int): Long
-}
\ No newline at end of file
+}
+
+enum class SqliteBackupResult {
+    Ok, Done, Busy, Locked, Error
+}
+
+/**
+ * Low level access to the Sqlite online backup api, copying the main database of [source] into the
+ * main database of [destination] a number of pages at a time. Both databases must be open. See
+ * [SqlCipherDatabase.backupTo] for the usual way to use this.
+ */
+expect class SqliteBackup(destination: SqliteDatabase, source: SqliteDatabase) {
+    /**
+     * Starts the backup.
+     * @return 0 if started, otherwise the Sqlite error code. See the destination error() for the text
+     */
+    fun init(): Int
+
+    /**
+     * Copies up to [pages] pages. A negative value copies all remaining pages.
+     */
+    fun step(pages: Int): SqliteBackupResult
+
+    /**
+     * Pages still to be copied as of the last [step]
+     */
+    fun remaining(): Int
+
+    /**
+     * Total pages in the source database as of the last [step]
+     */
+    fun pageCount(): Int
+
+    /**
+     * Releases the backup. If called before [step] returns [SqliteBackupResult.Done], the partial
+     * copy in the destination is rolled back.
+     * @return 0, or the error code of the step that failed
+     */
+    fun finish(): Int
+}
+
+/**
+ * Kind of conflict found while applying a changeset, see the Sqlite docs of
+ * sqlite3changeset_apply_v2 for details. Ordinals must stay in the order of the
+ * SQLITE_CHANGESET_DATA to SQLITE_CHANGESET_FOREIGN_KEY values.
+ */
+enum class ChangesetConflictType {
+    /** the row exists, but its current values do not match the original values in the change */
+    Data,
+    /** the row to update or delete does not exist */
+    NotFound,
+    /** the row to insert already exists */
+    Conflict,
+    /** the change violates a constraint other than the primary key */
+    Constraint,
+    /** foreign key violations remain once all changes are applied */
+    ForeignKey
+}
+
+enum class ChangeOperation {
+    Insert, Update, Delete
+}
+
+/**
+ * Result of a [ChangesetConflictHandler]. Ordinals match the SQLITE_CHANGESET_OMIT, REPLACE and
+ * ABORT values.
+ */
+enum class ConflictAction {
+    /** skip the conflicting change */
+    Omit,
+    /** apply the change anyway. Only allowed for [ChangesetConflictType.Data] and [ChangesetConflictType.Conflict] */
+    Replace,
+    /** stop, and roll back every change already applied */
+    Abort
+}
+
+/**
+ * Called once for each conflict found while applying a changeset, with the kind of conflict, the
+ * table name and the operation of the conflicting change.
+ */
+typealias ChangesetConflictHandler = (type: ChangesetConflictType, table: String, operation: ChangeOperation) -> ConflictAction
+
+/**
+ * Low level access to the Sqlite session extension, recording the changes made through one
+ * connection to the tables of one schema. See [SqlCipherDatabase.captureChanges] for the usual way
+ * to use this.
+ */
+expect class SqliteSession(db: SqliteDatabase) {
+    /**
+     * Creates the session. Nothing is recorded until [attach] is called.
+     * @param schema "main" or the name of an attached database
+     * @param rowidTables true to also record tables without a declared PRIMARY KEY, identifying
+     * their rows by rowid
+     * @return 0 if created, otherwise the Sqlite error code
+     */
+    fun create(schema: String = "main", rowidTables: Boolean = false): Int
+
+    /**
+     * Starts recording changes to [table], or to every table if empty. Unless created with
+     * rowidTables, only tables with a declared PRIMARY KEY are recorded.
+     * @return Sqlite result code, 0 is success
+     */
+    fun attach(table: String = ""): Int
+
+    /**
+     * True if no changes have been recorded
+     */
+    fun isEmpty(): Boolean
+
+    /**
+     * Changes recorded so far as one changeset, or as a patchset if [patchset] is true. A patchset
+     * is smaller as it omits the original values of updated and deleted rows, which limits conflict
+     * detection when applied.
+     * @return the set, empty if nothing was recorded or on error
+     */
+    fun changeset(patchset: Boolean = false): ByteArray
+
+    /**
+     * Same content as [changeset], streamed into a new file at [path] instead of one array.
+     * @return Sqlite result code, 0 is success
+     */
+    fun write(path: String, patchset: Boolean = false): Int
+
+    /**
+     * Stops recording and releases the session. Must be called before the database is closed.
+     */
+    fun delete()
+}
@@ -0,0 +1,114 @@
+package com.oldguy.kiscmp
+
+/**
+ * Name of the readahead VFS. Must match KMPSQL_READAHEAD_VFS in nativeInterop/common/kmpsql.h
+ */
+const val readaheadVfsName = "kmpsql-readahead"
+
+/**
+ * Name of the metrics VFS. Must match KMPSQL_METRICS_VFS in nativeInterop/common/kmpsql.h
+ */
+const val metricsVfsName = "kmpsql-metrics"
+
+/**
+ * Name of the change tracking VFS. Must match KMPSQL_TRACKING_VFS in nativeInterop/common/kmpsql.h
+ */
+const val trackingVfsName = "kmpsql-tracking"
+
+/**
+ * Name of the in-memory VFS built into Sqlite, used for [SqlCipherDatabase.sharedMemoryName] and
+ * by database images
+ */
+const val memdbVfsName = "memdb"
+
+/**
+ * Default name used for a latency VFS by [SqlCipherDatabase.latency] when no VFS name is set.
+ */
+const val latencyVfsName = "kmpsql-latency"
+
+/**
+ * How the delay of each call is chosen from the configured mean. Ordinals must match the
+ * KMPSQL_DISTRIBUTION values in kmpsql.h
+ */
+enum class LatencyDistribution {
+    /** every call is delayed by the mean */
+    Fixed,
+    /** uniformly between zero and twice the mean */
+    Uniform,
+    /** exponentially distributed, mostly short delays with a long tail */
+    Exponential
+}
+
+/**
+ * Configuration of a latency injecting VFS. All times are in microseconds, zero disables the
+ * corresponding delay. Delays apply to every file opened through the VFS, including journals and
+ * WAL files.
+ * @property readMicros mean delay added to each read
+ * @property writeMicros mean delay added to each write
+ * @property syncMicros mean delay added to each sync (fsync)
+ * @property distribution how each delay is drawn from its mean
+ * @property readBytesPerSecond read throughput cap, shared by all files of the VFS. 0 is unlimited.
+ * @property writeBytesPerSecond write throughput cap, shared by all files of the VFS. 0 is unlimited.
+ * @property stallPercent chance in percent (0-100) that a read, write or sync also stalls
+ * @property stallMicros length of each stall
+ */
+data class LatencyVfsConfig(
+    val readMicros: Long = 0,
+    val writeMicros: Long = 0,
+    val syncMicros: Long = 0,
+    val distribution: LatencyDistribution = LatencyDistribution.Fixed,
+    val readBytesPerSecond: Long = 0,
+    val writeBytesPerSecond: Long = 0,
+    val stallPercent: Int = 0,
+    val stallMicros: Long = 0
+) {
+    /**
+     * Values in the order of the KMPSQL_LATENCY indexes, as passed to
+     * [SqliteDatabase.registerLatencyVfs]
+     */
+    fun toArray(): LongArray = longArrayOf(
+        readMicros,
+        writeMicros,
+        syncMicros,
+        distribution.ordinal.toLong(),
+        readBytesPerSecond,
+        writeBytesPerSecond,
+        stallPercent.toLong(),
+        stallMicros
+    )
+}
+
+/**
+ * Counters kept by the kmpsql VFS wrappers, either for one database file or summed over every
+ * file opened through a VFS. Only main database files are counted, except for [injectedMicros].
+ * @property reads number of page reads requested by Sqlite, not including memory mapped pages
+ * @property bufferHits reads satisfied from pages already prefetched
+ * @property prefetches number of larger reads issued to the underlying VFS
+ * @property prefetchedBytes total bytes read by those prefetches
+ * @property windowPages current prefetch window in pages for a file, or the most recently used
+ * window for a VFS. The window doubles while prefetched pages are all used, and halves when
+ * most of them are wasted.
+ * @property injectedMicros total delay added by a latency VFS
+ * @property fetches pages served by memory mapping instead of being read, see
+ * [SqlCipherDatabase.mmapSize]
+ */
+data class VfsMetrics(
+    val reads: Long = 0,
+    val bufferHits: Long = 0,
+    val prefetches: Long = 0,
+    val prefetchedBytes: Long = 0,
+    val windowPages: Long = 0,
+    val injectedMicros: Long = 0,
+    val fetches: Long = 0
+) {
+    companion object {
+        /**
+         * Decodes the array returned by [SqliteDatabase.vfsMetrics] or [SqliteDatabase.fileMetrics].
+         * An empty array (no kmpsql VFS in use) decodes to all zeros.
+         */
+        fun fromArray(values: LongArray): VfsMetrics {
+            if (values.isEmpty()) return VfsMetrics()
+            return VfsMetrics(values[0], values[1], values[2], values[3], values[4], values[5], values[6])
+        }
+    }
+}
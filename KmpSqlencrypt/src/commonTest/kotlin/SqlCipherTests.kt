@@ -5,6 +5,11 @@ import com.oldguy.database.ColumnType
 import com.oldguy.database.Passphrase
 import com.oldguy.database.SqlValue
 import com.oldguy.database.SqlValues
+import com.oldguy.database.TransactionMode
+import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.coroutineScope
+import kotlinx.coroutines.delay
+import kotlinx.coroutines.launch
 import kotlinx.datetime.Clock
 import kotlinx.datetime.LocalDateTime
 import kotlinx.datetime.TimeZone
@@ -13,6 +18,7 @@ import kotlin.test.DefaultAsserter.assertEquals
 import kotlin.test.DefaultAsserter.assertTrue
 import kotlin.test.DefaultAsserter.fail
 import kotlin.test.assertNotNull
+import kotlin.time.Duration.Companion.milliseconds
 
 /**
  * Extension function returns a new LocalDateTime from the current instance, with nanoseconds value truncated to the
@@ -418,7 +424,697 @@ open class SqlCipherTests {
         assertTrue("pwbBadConfirm", badPwd)
     }
 
+    /**
+     * Scans a table much larger than one page through the readahead VFS, the scan should be
+     * detected as sequential and prefetched.
+     */
+    suspend fun testReadahead(dbFolderPath: String) {
+        val path = "$dbFolderPath/Readahead1.db"
+        val passphrase = Passphrase(goodPassphrase)
+        db = sqlcipher {
+            createOk = true
+            readaheadPages = 16
+        }
+        db.use(path, passphrase) {
+            fillScanTable(2000)
+        }
+        db.use(path, passphrase) {
+            assertEquals("readaheadCount", 2000, scanTableCount("select count(*), sum(length(data)) from $scanTbl"))
+            val metrics = db.vfsMetrics
+            assertTrue("readaheadReads", metrics.reads > 0)
+            assertTrue("readaheadPrefetches", metrics.prefetches > 0)
+            assertTrue("readaheadHits", metrics.bufferHits > 0)
+            val other = sqlcipher {
+                createOk = true
+                readaheadPages = 4
+            }
+            other.use("$dbFolderPath/Readahead2.db", passphrase) {
+                assertEquals("readaheadOtherWindow", 4, other.sqliteDb.readaheadWindow(-1))
+                assertEquals("readaheadOwnWindow", 16, db.sqliteDb.readaheadWindow(-1))
+            }
+        }
+    }
+
+    suspend fun testLatency(dbFolderPath: String) {
+        val path = "$dbFolderPath/Latency1.db"
+        val passphrase = Passphrase(goodPassphrase)
+        db = sqlcipher {
+            createOk = true
+            latency = LatencyVfsConfig(
+                readMicros = 100,
+                writeMicros = 200,
+                syncMicros = 1000,
+                distribution = LatencyDistribution.Exponential
+            )
+        }
+        db.use(path, passphrase) {
+            fillScanTable(200)
+            assertEquals("latencyCount", 200, scanTableCount())
+            assertTrue("latencyInjected", db.vfsMetrics.injectedMicros > 0)
+        }
+    }
+
+    suspend fun testBackup(dbFolderPath: String) {
+        val path = "$dbFolderPath/Backup1.db"
+        val copyPath = "$dbFolderPath/Backup1Copy.db"
+        val copyPassphrase = Passphrase("backupPassphrase")
+        db = sqlcipher {
+            createOk = true
+        }
+        db.use(path, Passphrase(goodPassphrase)) {
+            fillScanTable(1000)
+            var steps = 0
+            val result = db.backupTo(copyPath, copyPassphrase, pagesPerStep = 16) {
+                steps++
+            }
+            assertEquals("backupRemaining", 0, result.remaining)
+            assertTrue("backupSteps", steps > 1)
+        }
+        db = sqlcipher {}
+        db.use(copyPath, copyPassphrase) {
+            assertEquals("backupCount", 1000, scanTableCount())
+        }
+    }
+
+    suspend fun testMmap(dbFolderPath: String) {
+        val path = "$dbFolderPath/Mmap1.db"
+        val noPassphrase = Passphrase()
+        db = sqlcipher {
+            createOk = true
+        }
+        db.use(path, noPassphrase) {
+            fillScanTable(1000)
+        }
+        db = sqlcipher {
+            mmapSize = 64L * 1024 * 1024
+        }
+        db.use(path, noPassphrase) {
+            assertEquals("mmapCount", 1000, scanTableCount("select count(*), sum(length(data)) from $scanTbl"))
+            assertTrue("mmapFetches", db.vfsMetrics.fetches > 0)
+        }
+        var rejected = false
+        try {
+            db.open(Passphrase(goodPassphrase))
+        } catch (e: IllegalArgumentException) {
+            rejected = true
+        }
+        assertTrue("mmapEncryptedRejected", rejected && !db.isOpen)
+    }
+
+    suspend fun testSerialize(dbFolderPath: String) {
+        val path = "$dbFolderPath/Image1.db"
+        val passphrase = Passphrase(goodPassphrase)
+        val imagePassphrase = Passphrase("imageKey")
+        var plainImage = ByteArray(0)
+        var encryptedImage = ByteArray(0)
+        db = sqlcipher {
+            createOk = true
+        }
+        db.use(path, passphrase) {
+            fillScanTable(1000)
+            plainImage = db.serialize()
+            encryptedImage = db.serialize(imagePassphrase)
+        }
+        assertEquals("plainHeader", "SQLite format 3", plainImage.copyOf(15).decodeToString())
+        assertTrue("encryptedHeader", encryptedImage.copyOf(15).decodeToString() != "SQLite format 3")
+        val images = listOf(
+            Passphrase() to plainImage,
+            imagePassphrase to encryptedImage
+        )
+        images.forEach { (key, image) ->
+            db = sqlcipher {}
+            db.openImage(image, key)
+            assertEquals("imageCount", 1000, scanTableCount())
+            db.execute("delete from $scanTbl where id > 500;")
+            db.close()
+        }
+        db = sqlcipher {}
+        db.openMappedImage(path, passphrase)
+        assertEquals("mappedCount", 1000, scanTableCount())
+        db.close()
+    }
+
+    suspend fun testChangeCapture(dbFolderPath: String) {
+        val path = "$dbFolderPath/Capture1.db"
+        val changesetPath = "$dbFolderPath/Capture1.changeset"
+        db = sqlcipher {
+            createOk = true
+        }
+        db.use(path, Passphrase(goodPassphrase)) {
+            fillScanTable(1000)
+            if (!db.compileOptionUsed(SqlCipherDatabase.sessionOption)) {
+                assertUnsupported("captureUnsupported") { db.captureChanges(listOf(scanTbl)) }
+                return@use
+            }
+            val capture = db.captureChanges(listOf(scanTbl))
+            assertTrue("captureEmpty", capture.isEmpty)
+            db.execute("update $scanTbl set data = randomblob(500) where id in (10, 500, 990);")
+            db.execute("delete from $scanTbl where id = 20;")
+            assertEquals("captureEmpty", false, capture.isEmpty)
+            val changeset = capture.changeset()
+            val patchset = capture.patchset()
+            assertTrue("changesetSize", changeset.size in 1 until 10000)
+            assertTrue("patchsetSize", patchset.size in 1 until changeset.size)
+            capture.write(changesetPath)
+            capture.close()
+            assertEquals("captureOpen", false, capture.isOpen)
+        }
+    }
+
+    suspend fun testApplyChanges(dbFolderPath: String) {
+        val path = "$dbFolderPath/Source1.db"
+        val replicaPath = "$dbFolderPath/Replica1.db"
+        val createSql = "drop table if exists $scanTbl;create table $scanTbl(id INTEGER PRIMARY KEY, data TEXT);"
+        val changesets = mutableListOf<ByteArray>()
+        db = sqlcipher {
+            createOk = true
+        }
+        if (!db.compileOptionUsed(SqlCipherDatabase.sessionOption)) {
+            db.use(path, Passphrase(goodPassphrase)) {
+                assertUnsupported("applyUnsupported") { db.applyChanges(ByteArray(0)) }
+            }
+            assertUnsupported("combineUnsupported") { combineChangesets(emptyList()) }
+            return
+        }
+        db.use(path, Passphrase(goodPassphrase)) {
+            db.execute(createSql)
+            for (batch in 0 until 5) {
+                val capture = db.captureChanges(listOf(scanTbl))
+                db.transaction {
+                    db.statement("insert into $scanTbl(data) values('row')").use { stmt ->
+                        repeat(100) { stmt.execute() }
+                    }
+                }
+                db.execute("update $scanTbl set data = 'batch$batch' where id = 1;")
+                changesets.add(capture.changeset())
+                capture.close()
+            }
+        }
+        val combined = combineChangesets(changesets)
+        val conflicts = mutableListOf<ChangesetConflictType>()
+        db = sqlcipher {
+            createOk = true
+        }
+        db.use(replicaPath, Passphrase()) {
+            db.execute(createSql)
+            db.execute("insert into $scanTbl(id, data) values(2, 'local');")
+            db.applyChanges(combined) { type, table, operation ->
+                conflicts.add(type)
+                assertEquals("conflictTable", scanTbl, table)
+                assertEquals("conflictOperation", ChangeOperation.Insert, operation)
+                ConflictAction.Replace
+            }
+            assertEquals("conflicts", listOf(ChangesetConflictType.Conflict), conflicts)
+            var count = 0
+            var data = ""
+            db.execute("select count(*), (select data from $scanTbl where id = 1) from $scanTbl") {
+                count = it.requireString(0).toInt()
+                data = it.requireString(1)
+                true
+            }
+            assertEquals("replicaCount", 500, count)
+            assertEquals("replicaData", "batch4", data)
+            db.applyChanges(invertChangeset(combined))
+            assertEquals("invertedCount", 0, scanTableCount())
+        }
+    }
+
+    /**
+     * The non-default cipher page size makes the database unreadable by a worker connection that
+     * does not run the same pragmas.
+     */
+    suspend fun testWalCheckpointer(dbFolderPath: String) {
+        val path = "$dbFolderPath/Wal2.db"
+        val passphrase = Passphrase(goodPassphrase)
+        val policy = WalCheckpointPolicy(interval = 10.milliseconds, restartFrames = 20, truncateFrames = 100)
+        db = sqlcipher {
+            createOk = true
+            onOpenPragmas = {
+                it.pragma("cipher_page_size = 8192") { false }
+                it.pragma("journal_mode = WAL") { false }
+            }
+        }
+        db.use(path, passphrase) {
+            db.execute("drop table if exists $scanTbl;create table $scanTbl(id INTEGER PRIMARY KEY, data BLOB);")
+            coroutineScope {
+                val checkpointer = db.startWalCheckpointer(this, passphrase, policy)
+                repeat(20) {
+                    db.transaction {
+                        db.statement("insert into $scanTbl(data) values(randomblob(500))").use { stmt ->
+                            repeat(100) { stmt.execute() }
+                        }
+                    }
+                    delay(20.milliseconds)
+                }
+                val result = checkpointer.checkpoint(CheckpointMode.Truncate)
+                assertEquals("truncateBusy", false, result.busy)
+                val metrics = checkpointer.metrics
+                assertTrue("checkpointRuns", metrics.runs > 1)
+                assertTrue("checkpointFrames", metrics.framesCheckpointed > 0)
+                assertTrue("checkpointEscalated", metrics.restarts + metrics.truncates > 0)
+                assertEquals("walFrames", 0L, metrics.walFrames)
+                checkpointer.stop()
+                assertEquals("checkpointerRunning", false, checkpointer.isRunning)
+            }
+            var autoCheckpoint = 0
+            db.pragma("wal_autocheckpoint") {
+                autoCheckpoint = it.requireString(0).toInt()
+                false
+            }
+            assertEquals("autoCheckpointRestored", 1000, autoCheckpoint)
+        }
+    }
+
+    suspend fun testCompact(dbFolderPath: String) {
+        val path = "$dbFolderPath/Compact1.db"
+        val passphrase = Passphrase(goodPassphrase)
+        db = sqlcipher {
+            createOk = true
+            onOpenPragmas = { it.pragma("journal_mode = WAL") { false } }
+        }
+        db.use(path, passphrase) {
+            fillScanTable(2000)
+            db.execute("delete from $scanTbl where id % 2 = 0;")
+            val result = coroutineScope {
+                // writes through the compacting connection while the copy runs must survive the swap
+                val writer = launch {
+                    repeat(20) {
+                        db.execute("insert into $scanTbl(data) values(randomblob(500));")
+                        delay(1)
+                    }
+                }
+                db.compact(passphrase).also { writer.join() }
+            }
+            assertTrue("compactOpen", db.isOpen)
+            assertTrue("compactFree", result.freePagesBefore > 0)
+            assertTrue("compactReclaimed", result.pagesReclaimed > result.pagesBefore / 3)
+            assertEquals("compactCount", 1020, scanTableCount())
+            var mode = ""
+            db.pragma("journal_mode") {
+                mode = it.requireString(0)
+                false
+            }
+            assertEquals("compactJournalMode", "wal", mode)
+            var busy = false
+            sqlcipher {}.use(path, passphrase) {
+                try {
+                    db.compact(passphrase)
+                } catch (e: SqliteException) {
+                    busy = e.result == 5
+                }
+            }
+            assertTrue("compactOtherConnection", busy)
+            assertTrue("compactOtherOpen", db.isOpen)
+            assertEquals("compactOtherCount", 1020, scanTableCount())
+        }
+    }
+
+    suspend fun testIncrementalVacuum(dbFolderPath: String) {
+        val path = "$dbFolderPath/IncrVacuum1.db"
+        val passphrase = Passphrase(goodPassphrase)
+        val policy = IncrementalVacuumPolicy(interval = 10.milliseconds, pagesPerStep = 16)
+        db = sqlcipher {
+            createOk = true
+            autoVacuum = AutoVacuum.Incremental
+            onOpenPragmas = { it.pragma("journal_mode = WAL") { false } }
+        }
+        db.sqliteDb.removeFile(path)
+        db.use(path, passphrase) {
+            assertEquals("autoVacuumMode", AutoVacuum.Incremental, db.autoVacuum)
+            fillScanTable(1000)
+            db.execute("delete from $scanTbl where id > 200;")
+            var free = 0L
+            db.pragma("freelist_count") {
+                free = it.requireString(0).toLong()
+                false
+            }
+            assertTrue("freePages", free > 100)
+            coroutineScope {
+                val vacuumer = db.startIncrementalVacuum(this, passphrase, policy)
+                var waited = 0
+                while (vacuumer.metrics.freePages > 0 || vacuumer.metrics.runs == 0L) {
+                    delay(20.milliseconds)
+                    assertTrue("vacuumTimeout", ++waited < 250)
+                }
+                val metrics = vacuumer.metrics
+                assertEquals("reclaimed", free, metrics.pagesReclaimed)
+                assertTrue("vacuumSteps", metrics.steps >= free / 16)
+                assertEquals("reclaimNothing", 0L, vacuumer.reclaim().pagesReclaimed)
+                vacuumer.stop()
+                assertEquals("vacuumerRunning", false, vacuumer.isRunning)
+                assertEquals("vacuumerFailure", null, vacuumer.failure)
+            }
+            db.pragma("freelist_count") {
+                free = it.requireString(0).toLong()
+                false
+            }
+            assertEquals("freeAfter", 0L, free)
+        }
+    }
+
+    suspend fun testOptimize(dbFolderPath: String) {
+        val path = "$dbFolderPath/Optimize1.db"
+        val passphrase = Passphrase(goodPassphrase)
+        val changes = mutableListOf<QueryPlanChange>()
+        db = sqlcipher {
+            createOk = true
+            optimizeOnClose = true
+            onPlanChange = { changes.add(it) }
+        }
+        db.sqliteDb.removeFile(path)
+        db.use(path, passphrase) {
+            db.execute("create table $scanTbl(id INTEGER PRIMARY KEY, a INTEGER, b INTEGER);" +
+                    "create index ${scanTbl}_a on $scanTbl(a);" +
+                    "create index ${scanTbl}_b on $scanTbl(b);" +
+                    "with recursive c(x) as (select 1 union all select x + 1 from c where x < 20000) " +
+                    "insert into $scanTbl(a, b) select x % 2, x from c;")
+            val sql = "select * from $scanTbl where a = 1 and b between ? and 20"
+            db.registerHotQuery("range", sql)
+            val plan = db.explainQueryPlan(sql)
+            assertEquals("planRows", 1, plan.size)
+            assertTrue("planBefore", plan[0].contains("${scanTbl}_a"))
+            db.execute("select count(*) from $scanTbl where a = 1 and b between 10 and 20")
+            val result = db.optimize()
+            assertEquals("planChanges", 1, result.planChanges.size)
+            assertEquals("planChangeReported", result.planChanges, changes)
+            val change = changes[0]
+            assertEquals("planChangeName", "range", change.name)
+            assertEquals("planChangeBefore", plan, change.before)
+            assertTrue("planChangeAfter", change.after[0].contains("${scanTbl}_b"))
+            assertEquals("noPlanChanges", 0, db.optimize().planChanges.size)
+
+            coroutineScope {
+                val optimizer = db.startPeriodicOptimize(this, passphrase, 10.milliseconds)
+                var waited = 0
+                while (optimizer.runs == 0L) {
+                    delay(10.milliseconds)
+                    assertTrue("optimizeTimeout", ++waited < 500)
+                }
+                assertEquals("periodicPlanChanges", 0, optimizer.lastResult?.planChanges?.size)
+                optimizer.stop()
+                assertEquals("optimizerRunning", false, optimizer.isRunning)
+                assertEquals("optimizerFailure", null, optimizer.failure)
+                assertTrue("statisticsStale", db.statisticsStale.value)
+                db.transaction { }
+                assertEquals("statisticsReloaded", false, db.statisticsStale.value)
+            }
+        }
+        assertEquals("planChangesAfterClose", 1, changes.size)
+    }
+
+    suspend fun testQueryPlans(dbFolderPath: String) {
+        val path = "$dbFolderPath/QueryPlans1.db"
+        val passphrase = Passphrase(goodPassphrase)
+        db = sqlcipher { createOk = true }
+        db.sqliteDb.removeFile(path)
+        db.use(path, passphrase) {
+            db.execute("create table $scanTbl(id INTEGER PRIMARY KEY, a INTEGER, b INTEGER);" +
+                    "create index ${scanTbl}_ab on $scanTbl(a, b);" +
+                    "with recursive c(x) as (select 1 union all select x + 1 from c where x < 1000) " +
+                    "insert into $scanTbl(a, b) select x % 100, x from c;")
+            db.registerHotQuery("byA", "select * from $scanTbl where a = ?",
+                SqlValues(SqlValue.IntValue(5)))
+            db.registerHotQuery("sortedB", "select b from $scanTbl where a = ? order by b",
+                SqlValues(SqlValue.IntValue(7)))
+            val counted = db.compileOptionUsed(SqlCipherDatabase.scanStatusOption)
+            val captures = db.captureQueryPlans()
+            assertEquals("captures", listOf("byA", "sortedB"), captures.map { it.name })
+            captures.forEach { capture ->
+                assertTrue("search ${capture.name}", capture.plan[0].startsWith("SEARCH $scanTbl USING"))
+                assertTrue("noTempBTree ${capture.name}", capture.plan.none { it.contains("TEMP B-TREE") })
+                if (counted) {
+                    assertEquals("loops ${capture.name}", 1, capture.loops.size)
+                    assertEquals("loopStarts ${capture.name}", 1L, capture.loops[0].loops)
+                    assertEquals("rowsVisited ${capture.name}", 10L, capture.rowsVisited)
+                } else {
+                    assertTrue("noLoops ${capture.name}", capture.loops.isEmpty())
+                }
+            }
+            val baseline = QueryPlanBaseline(captures)
+            assertEquals("parsed", captures, QueryPlanBaseline.parse(baseline.toText()).captures)
+            assertEquals("unchanged", emptyList<PlanRegression>(), baseline.compare(db.captureQueryPlans()))
+
+            db.execute("drop index ${scanTbl}_ab;")
+            val regressions = baseline.compare(db.captureQueryPlans())
+            val kinds = regressions.groupBy({ it.name }, { it.kind })
+            assertTrue("byASeekToScan", kinds.getValue("byA").contains(PlanRegressionKind.SeekToScan))
+            assertTrue("byANoTempBTree", !kinds.getValue("byA").contains(PlanRegressionKind.NewTempBTree))
+            assertTrue("sortedBSeekToScan", kinds.getValue("sortedB").contains(PlanRegressionKind.SeekToScan))
+            assertTrue("sortedBTempBTree", kinds.getValue("sortedB").contains(PlanRegressionKind.NewTempBTree))
+            if (counted)
+                assertTrue("moreRowsVisited", kinds.getValue("sortedB").contains(PlanRegressionKind.MoreRowsVisited))
+            assertTrue("failures", regressions.any { it.kind.isFailure })
+
+            db.unregisterHotQuery("sortedB")
+            val missing = baseline.compare(db.captureQueryPlans()).filter { it.name == "sortedB" }
+            assertEquals("missing", listOf(PlanRegressionKind.Missing), missing.map { it.kind })
+        }
+    }
+
+    suspend fun testMemoryStatus(dbFolderPath: String) {
+        val path = "$dbFolderPath/Memory1.db"
+        val passphrase = Passphrase(goodPassphrase)
+        db = sqlcipher { createOk = true }
+        db.sqliteDb.removeFile(path)
+        assertEquals("closedConnection", ConnectionMemory(), db.connectionMemory())
+        db.use(path, passphrase) {
+            db.execute("create table $scanTbl(id INTEGER PRIMARY KEY, a INTEGER, b TEXT);" +
+                    "with recursive c(x) as (select 1 union all select x + 1 from c where x < 1000) " +
+                    "insert into $scanTbl(a, b) select x, 'memory ' || x from c;")
+            db.execute("select count(*) from $scanTbl where b like '%9%'")
+            val memory = db.connectionMemory()
+            assertTrue("cacheUsed", memory.cacheUsed > 0)
+            assertTrue("schemaUsed", memory.schemaUsed > 0)
+            assertTrue("cacheWrites", memory.cacheWrites > 0)
+            val sqlite = db.sqliteMemory()
+            assertTrue("sqliteHighwater", sqlite.highwater >= sqlite.used)
+            db.connectionMemory(reset = true)
+            assertEquals("cacheWritesReset", 0L, db.connectionMemory().cacheWrites)
+        }
+        assertEquals("closedAgain", ConnectionMemory(), db.connectionMemory())
+    }
+
+    suspend fun testSnapshots(dbFolderPath: String) {
+        val path = "$dbFolderPath/Snapshot1.db"
+        val passphrase = Passphrase(goodPassphrase)
+        val walPragma: suspend (SqlCipherDatabase) -> Unit = { it.pragma("journal_mode = WAL") { false } }
+        db = sqlcipher {
+            createOk = true
+            onOpenPragmas = walPragma
+        }
+        val writer = sqlcipher { onOpenPragmas = walPragma }
+        val readers = List(2) { sqlcipher { onOpenPragmas = walPragma } }
+        db.use(path, passphrase) {
+            db.execute("drop table if exists $scanTbl;create table $scanTbl(id INTEGER PRIMARY KEY, data TEXT);")
+            db.execute("insert into $scanTbl(data) values('one'), ('two');")
+            if (!db.compileOptionUsed(SqlCipherDatabase.snapshotOption)) {
+                assertUnsupported("snapshotUnsupported") { db.takeSnapshot(passphrase) }
+                return@use
+            }
+            writer.use(path, passphrase) {
+                readers.forEach { it.path = path; it.open(passphrase) }
+                val snapshot = db.takeSnapshot(passphrase)
+                assertTrue("acquireTime", !snapshot.acquireTime.isNegative())
+                writer.execute("insert into $scanTbl(data) values('three');")
+                readers.forEach {
+                    assertEquals("currentCount", 3, scanTableCount(database = it))
+                    val pinned = it.readSnapshot(snapshot) { scanTableCount(database = it) }
+                    assertEquals("snapshotCount", 2, pinned)
+                }
+                assertEquals("snapshotReads", 2L, snapshot.reads)
+                // the snapshot's read transaction is not on the connection that took it
+                assertEquals("ownerCount", 3, scanTableCount())
+                db.execute("insert into $scanTbl(data) values('four');")
+                assertEquals("ownerSnapshotCount", 2, db.readSnapshot(snapshot) { scanTableCount() })
+
+                val later = writer.takeSnapshot(passphrase)
+                assertTrue("snapshotOrder", snapshot < later)
+                later.close()
+                snapshot.close()
+                assertEquals("ownerCountAfterClose", 4, scanTableCount())
+                readers.forEach { it.close() }
+            }
+        }
+    }
+
+    suspend fun testChangeTokens(dbFolderPath: String) {
+        val path = "$dbFolderPath/ChangeToken1.db"
+        val passphrase = Passphrase(goodPassphrase)
+        db = sqlcipher { createOk = true }
+        val other = sqlcipher {}
+        db.use(path, passphrase) {
+            db.execute("drop table if exists $scanTbl;create table $scanTbl(id INTEGER PRIMARY KEY, data TEXT);")
+            val cache = ChangeTokenCache(db) { database ->
+                scanTableCount(database = database)
+            }
+            other.use(path, passphrase) {
+                val token = db.changeToken()
+                assertEquals("tokenStable", token, db.changeToken())
+                assertEquals("unchanged", false, db.isChangedSince(token))
+                assertEquals("cacheLoad", 0, cache.get())
+                assertEquals("cacheHit", 0, cache.get())
+                assertEquals("cacheLoads", 1L, cache.loads)
+
+                val version = db.dataVersion()
+                other.execute("insert into $scanTbl(data) values('other');")
+                assertTrue("otherVersion", db.dataVersion() != version)
+                assertEquals("otherChanged", true, db.isChangedSince(token))
+                assertEquals("cacheReload", 1, cache.get())
+                assertEquals("cacheReloads", 2L, cache.loads)
+
+                val ownToken = db.changeToken()
+                db.execute("insert into $scanTbl(data) values('own');")
+                assertEquals("ownVersion", db.dataVersion(), ownToken.dataVersion)
+                assertEquals("ownChanged", true, db.isChangedSince(ownToken))
+                assertEquals("cacheOwnChange", 2, cache.get())
+                assertEquals("otherConnection", true, other.isChangedSince(db.changeToken()))
+
+                // a commit by another connection during the load must not be hidden by the cache
+                val racing = ChangeTokenCache(db) { database ->
+                    other.execute("insert into $scanTbl(data) values('during load');")
+                    database.changeToken()
+                }
+                racing.get()
+                racing.get()
+                assertEquals("commitDuringLoad", 2L, racing.loads)
+            }
+        }
+    }
+
+    /**
+     * Opens one shared in-memory database from several connections, checks a writer and concurrent
+     * readers coordinate, then measures point query throughput for each reader count, each reader
+     * on its own connection and thread. Prints one line per reader count.
+     */
+    /**
+     * Readers see the writes of another connection to the same shared memory database as they are
+     * committed. Read throughput against reader count is SharedMemoryBenchmark.
+     */
+    suspend fun testSharedMemory() {
+        val name = "kmpsqlShared"
+        val rows = 10000
+        val writer = sqlcipher {
+            sharedMemoryName = name
+            createOk = true
+            busyTimeout = 5000
+        }
+        val open: suspend () -> SqlCipherDatabase = {
+            sqlcipher {
+                sharedMemoryName = name
+                createOk = true
+                busyTimeout = 5000
+            }.also { it.open(Passphrase()) }
+        }
+        writer.open(Passphrase())
+        try {
+            writer.execute("create table $scanTbl(id INTEGER PRIMARY KEY, data TEXT);" +
+                    "with recursive c(x) as (select 1 union all select x + 1 from c where x < $rows) " +
+                    "insert into $scanTbl(data) select 'row ' || x from c;")
+            val separate = sqlcipher { createOk = true }
+            separate.open(Passphrase())
+            assertEquals("separateMemory", 0, separate.tableCount())
+            separate.close()
+
+            val readers = List(2) { open() }
+            coroutineScope {
+                val inserts = launch(Dispatchers.Default) {
+                    repeat(50) {
+                        writer.transaction(TransactionMode.Immediate) {
+                            writer.execute("insert into $scanTbl(data) values('written $it');")
+                        }
+                    }
+                }
+                readers.forEach { reader ->
+                    launch(Dispatchers.Default) {
+                        var last = 0
+                        while (inserts.isActive) {
+                            val count = scanTableCount(database = reader)
+                            assertTrue("countIncreases", count >= last)
+                            last = count
+                        }
+                    }
+                }
+            }
+            readers.forEach { assertEquals("sharedCount", rows + 50, scanTableCount(database = it)) }
+            readers.forEach { it.close() }
+        } finally {
+            writer.close()
+        }
+    }
+
+    suspend fun testBackupChanges(dbFolderPath: String) {
+        val path = "$dbFolderPath/Tracked1.db"
+        val restorePath = "$dbFolderPath/Tracked1Restore.db"
+        val deltas = listOf("$dbFolderPath/Tracked1.delta1", "$dbFolderPath/Tracked1.delta2")
+        val passphrase = Passphrase(goodPassphrase)
+        var lastEpoch = 0L
+        db = sqlcipher {
+            createOk = true
+            changeTracking = true
+        }
+        db.use(path, passphrase) {
+            fillScanTable(1000)
+            val base = db.backupChanges(deltas[0], full = true)
+            assertTrue("deltaBaseFull", base.isFull)
+            db.execute("update $scanTbl set data = randomblob(500) where id in (10, 500, 990);")
+            val delta = db.backupChanges(deltas[1])
+            assertEquals("deltaFull", false, delta.isFull)
+            assertEquals("deltaEpoch", base.epoch, delta.baseEpoch)
+            assertTrue("deltaPages", delta.pages in 1 until base.pages)
+            lastEpoch = delta.epoch
+        }
+        val restored = applyBackupDeltas(restorePath, deltas)
+        assertEquals("restoredEpoch", lastEpoch, restored.epoch)
+        db = sqlcipher {}
+        db.use(restorePath, passphrase) {
+            assertEquals("restoredCount", 1000, scanTableCount())
+        }
+    }
+
+    /**
+     * Recreates [scanTbl] with [rows] rows of 500 random bytes, inserted in one transaction
+     */
+    private suspend fun fillScanTable(rows: Int) {
+        db.execute("drop table if exists $scanTbl;create table $scanTbl(id INTEGER PRIMARY KEY, data BLOB);")
+        db.transaction {
+            db.statement("insert into $scanTbl(data) values(randomblob(500))").use { stmt ->
+                repeat(rows) { stmt.execute() }
+            }
+        }
+    }
+
+    /**
+     * @param sql query whose first column is the count, change it to also read the rows
+     * @return the count of rows in [scanTbl]
+     */
+    private suspend fun scanTableCount(
+        sql: String = "select count(*) from $scanTbl",
+        database: SqlCipherDatabase = db
+    ): Int {
+        var count = 0
+        database.execute(sql) {
+            count = it.requireString(0).toInt()
+            true
+        }
+        return count
+    }
+
+    /**
+     * Checks that [block] is refused with UnsupportedOperationException, as when the SqlCipher
+     * library was built without an optional extension
+     */
+    private suspend fun assertUnsupported(message: String, block: suspend () -> Unit) {
+        var unsupported = false
+        try {
+            block()
+        } catch (e: UnsupportedOperationException) {
+            unsupported = true
+        }
+        assertTrue(message, unsupported)
+    }
+
     companion object {
+        const val scanTbl = "scan1"
         const val create1 = "create table test1(id INTEGER PRIMARY KEY, name VARCHAR(255), date1 DATE, dateTime1 DATETIME, num1 DECIMAL(25,3), real1 REAL, dub DOUBLE, long1 BIGINT, bool1 char(1));"
         const val insert1 = "insert into test1 (id, name, date1, dateTime1, num1, real1, dub, long1, bool1) values(1, 'Any text1 1', '2020-09-01', '2020-09-01T10:00:00', '12345678912345.25', 12345.678901, 999111.999111, 3, 'Y');" +
                 "insert into test1 (id, name, date1, dateTime1, num1, real1, dub, long1, bool1) values(2, 'Any text1 2', '2020-01-01', '2020-01-01T10:00:00', '45678912345.25', 1112345.678901, 11999111.999111, -9223372036854775808, 'N');" +
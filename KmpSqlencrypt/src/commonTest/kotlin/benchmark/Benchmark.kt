@@ -0,0 +1,268 @@
+package com.oldguy.kiscmp.benchmark
+
+import kotlinx.coroutines.CloseableCoroutineDispatcher
+import kotlinx.io.buffered
+import kotlinx.io.files.Path
+import kotlinx.io.files.SystemFileSystem
+import kotlinx.io.files.SystemTemporaryDirectory
+import kotlinx.io.readString
+import kotlinx.io.writeString
+import kotlin.time.Duration
+import kotlin.time.Duration.Companion.milliseconds
+
+/**
+ * What the common benchmark workloads need from the platform running them. Instances are made by
+ * the linuxX64 and JVM test wrappers, so settings and threads are platform code and the workloads
+ * are not.
+ *
+ * The wrapper test classes only run when the KMPSQL_BENCH environment variable is set, the gradle
+ * test tasks exclude them otherwise.
+ *
+ * Settings are read by name, the wrappers use environment variables. Common ones:
+ * - KMPSQL_BENCH_DURATION_MS measurement time of each run, default 500
+ * - KMPSQL_BENCH_THREADS comma separated thread counts, default per benchmark
+ * - KMPSQL_BENCH_OUTPUT directory for result files, default the system temporary directory
+ *
+ * @param name platform reported in every result, "linuxX64" or "jvm"
+ * @param setting returns the value of a named setting, or null if not set
+ * @param threadPool creates a dispatcher with exactly the requested number of threads, so that
+ * workers making blocking sqlite calls really run in parallel
+ * @param managedHeap samples the managed heap, the default reports none
+ */
+class BenchmarkPlatform(
+    val name: String,
+    val setting: (name: String) -> String?,
+    val threadPool: (threads: Int) -> CloseableCoroutineDispatcher,
+    val managedHeap: () -> ManagedHeap = { ManagedHeap() }
+) {
+    val duration: Duration get() = int("KMPSQL_BENCH_DURATION_MS", 500).milliseconds
+    val outputDirectory: String get() = setting("KMPSQL_BENCH_OUTPUT") ?: SystemTemporaryDirectory.toString()
+    val databaseDirectory: String get() = SystemTemporaryDirectory.toString()
+
+    fun int(name: String, default: Int): Int = setting(name)?.toIntOrNull() ?: default
+
+    fun ints(name: String, default: List<Int>): List<Int> {
+        return setting(name)
+            ?.split(',')
+            ?.mapNotNull { it.trim().toIntOrNull() }
+            ?.ifEmpty { null }
+            ?: default
+    }
+
+    fun string(name: String, default: String): String = setting(name) ?: default
+
+    fun threads(default: List<Int>): List<Int> = ints("KMPSQL_BENCH_THREADS", default)
+
+    fun databasePath(fileName: String): String = Path(databaseDirectory, fileName).toString()
+
+    /**
+     * Resident set size of this process from /proc/self/status, 0 where that does not exist
+     */
+    fun residentBytes(): Long {
+        val path = Path(procStatus)
+        if (!SystemFileSystem.exists(path))
+            return 0
+        val text = SystemFileSystem.source(path).buffered().use { it.readString() }
+        val line = text.lines().firstOrNull { it.startsWith(residentPrefix) } ?: return 0
+        val kilobytes = line.substring(residentPrefix.length).trim().substringBefore(' ').toLongOrNull() ?: 0
+        return kilobytes * 1024
+    }
+
+    fun deleteDatabase(fileName: String) {
+        listOf("", "-wal", "-shm", "-journal").forEach {
+            val path = Path(databaseDirectory, fileName + it)
+            if (SystemFileSystem.exists(path))
+                SystemFileSystem.delete(path)
+        }
+    }
+
+    companion object {
+        private const val procStatus = "/proc/self/status"
+        private const val residentPrefix = "VmRSS:"
+    }
+}
+
+/**
+ * Managed heap of the platform, zeros where there is none or it can not be sampled
+ * @property usedBytes heap in use, including garbage not yet collected
+ * @property allocatedBytes bytes allocated by the calling thread since it started, so the
+ * difference of two samples is what the thread allocated in between, collected or not
+ */
+class ManagedHeap(
+    val usedBytes: Long = 0,
+    val allocatedBytes: Long = 0
+)
+
+/**
+ * Operation latencies in nanoseconds. Not thread safe, each worker records into its own instances
+ * and they are merged with [add] after the run.
+ */
+class Latencies {
+    private var values = LongArray(1024)
+    private var sorted = true
+    var count = 0
+        private set
+    var errors = 0
+        private set
+
+    fun record(nanos: Long) {
+        if (count == values.size)
+            values = values.copyOf(values.size * 2)
+        values[count++] = nanos
+        sorted = false
+    }
+
+    fun error() {
+        errors++
+    }
+
+    fun add(other: Latencies) {
+        for (i in 0 until other.count)
+            record(other.values[i])
+        errors += other.errors
+    }
+
+    /**
+     * @param fraction 0.5 for the median, 0.999 for p999
+     * @return latency in nanoseconds at the fraction, 0 if nothing was recorded
+     */
+    fun percentile(fraction: Double): Long {
+        if (count == 0) return 0
+        if (!sorted) {
+            values.sort(0, count)
+            sorted = true
+        }
+        val index = (fraction * count).toInt().coerceIn(0, count - 1)
+        return values[index]
+    }
+
+    val totalNanos: Long get() = (0 until count).sumOf { values[it] }
+}
+
+/**
+ * One result as a flat JSON object, one per line in the output file.
+ */
+class BenchmarkRecord(benchmark: String, platform: String) {
+    private val fields = mutableListOf<Pair<String, Any>>()
+
+    init {
+        add("benchmark", benchmark)
+        add("platform", platform)
+    }
+
+    fun add(name: String, value: Any): BenchmarkRecord {
+        fields.add(name to value)
+        return this
+    }
+
+    fun add(name: String, latencies: Latencies): BenchmarkRecord {
+        add("${name}Count", latencies.count)
+        add("${name}Errors", latencies.errors)
+        add("${name}P50Us", latencies.percentile(0.5) / 1000.0)
+        add("${name}P99Us", latencies.percentile(0.99) / 1000.0)
+        add("${name}P999Us", latencies.percentile(0.999) / 1000.0)
+        return this
+    }
+
+    operator fun get(name: String): Any? = fields.firstOrNull { it.first == name }?.second
+
+    fun toJson(): String = fields.joinToString(",", "{", "}") { (name, value) ->
+        "\"$name\":${jsonValue(value)}"
+    }
+
+    private fun jsonValue(value: Any): String = when (value) {
+        is Number, is Boolean -> value.toString()
+        else -> buildString {
+            append('"')
+            value.toString().forEach {
+                when (it) {
+                    '"' -> append("\\\"")
+                    '\\' -> append("\\\\")
+                    '\n' -> append("\\n")
+                    else -> append(it)
+                }
+            }
+            append('"')
+        }
+    }
+}
+
+/**
+ * Collects the records of one benchmark run and writes them to
+ * `kmpsql-<benchmark>-<platform>.jsonl` in [BenchmarkPlatform.outputDirectory].
+ */
+class BenchmarkOutput(val benchmark: String, val platform: BenchmarkPlatform) {
+    val records = mutableListOf<BenchmarkRecord>()
+
+    fun record(): BenchmarkRecord = BenchmarkRecord(benchmark, platform.name).also { records.add(it) }
+
+    /**
+     * @return path of the file written
+     */
+    fun write(): String {
+        val path = Path(platform.outputDirectory, "kmpsql-$benchmark-${platform.name}.jsonl")
+        SystemFileSystem.sink(path).buffered().use { sink ->
+            records.forEach {
+                sink.writeString(it.toJson())
+                sink.writeString("\n")
+            }
+        }
+        println("$benchmark results written to $path")
+        return path.toString()
+    }
+
+    /**
+     * Reads the records another platform wrote for this benchmark, to compare with this run.
+     * @return the fields of each record as text, empty if that platform has no result file
+     */
+    fun read(platformName: String): List<Map<String, String>> {
+        val path = Path(platform.outputDirectory, "kmpsql-$benchmark-$platformName.jsonl")
+        if (!SystemFileSystem.exists(path))
+            return emptyList()
+        val text = SystemFileSystem.source(path).buffered().use { it.readString() }
+        return text.lines().filter { it.isNotBlank() }.map { parseJson(it) }
+    }
+
+    /**
+     * Only the flat objects written by [BenchmarkRecord.toJson]
+     */
+    private fun parseJson(line: String): Map<String, String> {
+        val fields = mutableMapOf<String, String>()
+        var index = line.indexOf('{') + 1
+        fun string(): String = buildString {
+            index++
+            while (line[index] != '"') {
+                if (line[index] == '\\') {
+                    index++
+                    append(if (line[index] == 'n') '\n' else line[index])
+                } else
+                    append(line[index])
+                index++
+            }
+            index++
+        }
+        while (index < line.length && line[index] == '"') {
+            val name = string()
+            index++
+            fields[name] = if (line[index] == '"')
+                string()
+            else {
+                val end = line.indexOfAny(charArrayOf(',', '}'), index)
+                line.substring(index, end).also { index = end }
+            }
+            index++
+        }
+        return fields
+    }
+}
+
+internal fun Double.format(decimals: Int = 1): String {
+    val text = ((this * pow10(decimals)).toLong().toDouble() / pow10(decimals)).toString()
+    return if (text.endsWith(".0") && decimals == 0) text.dropLast(2) else text
+}
+
+private fun pow10(decimals: Int): Double {
+    var p = 1.0
+    repeat(decimals) { p *= 10.0 }
+    return p
+}
@@ -0,0 +1,254 @@
+package com.oldguy.kiscmp.benchmark
+
+import com.oldguy.database.Passphrase
+import com.oldguy.database.SqlValue
+import com.oldguy.database.SqlValues
+import com.oldguy.kiscmp.SqlCipherDatabase
+import com.oldguy.kiscmp.sqlcipher
+import kotlin.random.Random
+import kotlin.time.DurationUnit
+import kotlin.time.TimeSource
+
+/**
+ * One combination of SqlCipher and journal settings, issued as pragmas from
+ * [SqlCipherDatabase.onOpenPragmas], after the key and before the first read. The defaults are the
+ * SqlCipher 4 defaults and the Sqlite defaults.
+ */
+data class CipherSettings(
+    val pageSize: Int = 4096,
+    val kdfIterations: Int = 256000,
+    val hmacAlgorithm: String = "HMAC_SHA512",
+    val useHmac: Boolean = true,
+    val memorySecurity: Boolean = false,
+    val plaintextHeaderSize: Int = 0,
+    val journalMode: String = "DELETE",
+    val synchronous: String = "FULL"
+) {
+    /**
+     * Order matters, the cipher settings must all precede anything that reads the database. A
+     * plaintext header leaves no room for the salt in the file, so a fixed one is supplied.
+     */
+    fun pragmas(): List<String> = buildList {
+        add("cipher_page_size = $pageSize")
+        add("kdf_iter = $kdfIterations")
+        add("cipher_hmac_algorithm = $hmacAlgorithm")
+        add("cipher_use_hmac = ${onOff(useHmac)}")
+        add("cipher_memory_security = ${onOff(memorySecurity)}")
+        if (plaintextHeaderSize > 0) {
+            add("cipher_plaintext_header_size = $plaintextHeaderSize")
+            add("cipher_salt = \"x'$fixedSalt'\"")
+        }
+        add("journal_mode = $journalMode")
+        add("synchronous = $synchronous")
+    }
+
+    /**
+     * Settings that differ from [other], "baseline" if none do
+     */
+    fun label(other: CipherSettings = CipherSettings()): String {
+        val changes = fields().zip(other.fields())
+            .filter { (mine, theirs) -> mine.second != theirs.second }
+            .joinToString(" ") { (mine, _) -> "${mine.first}=${mine.second}" }
+        return changes.ifEmpty { "baseline" }
+    }
+
+    fun fields(): List<Pair<String, Any>> = listOf(
+        "cipher_page_size" to pageSize,
+        "kdf_iter" to kdfIterations,
+        "cipher_hmac_algorithm" to hmacAlgorithm,
+        "cipher_use_hmac" to onOff(useHmac),
+        "cipher_memory_security" to onOff(memorySecurity),
+        "cipher_plaintext_header_size" to plaintextHeaderSize,
+        "journal_mode" to journalMode,
+        "synchronous" to synchronous
+    )
+
+    private fun onOff(value: Boolean) = if (value) "ON" else "OFF"
+
+    companion object {
+        private const val fixedSalt = "0123456789abcdef0123456789abcdef"
+        val pageSizes = listOf(1024, 4096, 16384)
+        val kdfIterations = listOf(4000, 64000, 256000)
+        val hmacAlgorithms = listOf("HMAC_SHA1", "HMAC_SHA256", "HMAC_SHA512")
+        val plaintextHeaderSizes = listOf(0, 32)
+        val journalModes = listOf("DELETE", "WAL")
+        val synchronousModes = listOf("OFF", "NORMAL", "FULL")
+        private val booleans = listOf(false, true)
+
+        /**
+         * The baseline, then each alternative value of one setting at a time
+         */
+        fun oneAtATime(): List<CipherSettings> {
+            val base = CipherSettings()
+            return (listOf(base) +
+                    pageSizes.map { base.copy(pageSize = it) } +
+                    kdfIterations.map { base.copy(kdfIterations = it) } +
+                    hmacAlgorithms.map { base.copy(hmacAlgorithm = it) } +
+                    booleans.map { base.copy(useHmac = it) } +
+                    booleans.map { base.copy(memorySecurity = it) } +
+                    plaintextHeaderSizes.map { base.copy(plaintextHeaderSize = it) } +
+                    journalModes.map { base.copy(journalMode = it) } +
+                    synchronousModes.map { base.copy(synchronous = it) })
+                .distinct()
+        }
+
+        /**
+         * Every combination of the value lists, 864 of them
+         */
+        fun fullMatrix(): List<CipherSettings> = buildList {
+            pageSizes.forEach { page ->
+                kdfIterations.forEach { kdf ->
+                    hmacAlgorithms.forEach { hmac ->
+                        booleans.forEach { useHmac ->
+                            booleans.forEach { memory ->
+                                plaintextHeaderSizes.forEach { header ->
+                                    journalModes.forEach { journal ->
+                                        synchronousModes.forEach { sync ->
+                                            add(CipherSettings(page, kdf, hmac, useHmac, memory, header, journal, sync))
+                                        }
+                                    }
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Measures each [CipherSettings] combination on a new encrypted database:
+ * - open latency, the median of KMPSQL_CIPHER_OPENS (default 3) opens of the existing file, which
+ * includes key derivation
+ * - insert throughput, KMPSQL_CIPHER_ROWS rows (default 2000) in transactions of
+ * KMPSQL_CIPHER_BATCH rows (default 100)
+ * - scan throughput, on a new connection so every page is read and decrypted
+ * - point read latency, random primary key lookups on another new connection, each prepared, run
+ * and closed as retrieveOne does
+ *
+ * KMPSQL_CIPHER_MATRIX=full runs every combination, the default varies one setting at a time from
+ * the baseline. Prints a comparison table relative to the baseline and writes JSON lines.
+ */
+class CipherMatrixBenchmark(private val platform: BenchmarkPlatform) {
+    private val rows = platform.int("KMPSQL_CIPHER_ROWS", 2000)
+    private val batch = platform.int("KMPSQL_CIPHER_BATCH", 100).coerceAtLeast(1)
+    private val opens = platform.int("KMPSQL_CIPHER_OPENS", 3).coerceAtLeast(1)
+    private val reads = platform.int("KMPSQL_CIPHER_READS", 1000)
+    private val combinations = if (platform.string("KMPSQL_CIPHER_MATRIX", "") == "full")
+        CipherSettings.fullMatrix()
+    else
+        CipherSettings.oneAtATime()
+    private val fileName = "kmpsql-cipher.db"
+    private val passphrase = Passphrase("cipherMatrixKey")
+    private val text = "x".repeat(100)
+
+    class Result(
+        val settings: CipherSettings,
+        val openMillis: Double,
+        val insertsPerSecond: Double,
+        val scanRowsPerSecond: Double,
+        val reads: Latencies
+    )
+
+    suspend fun run(): BenchmarkOutput {
+        val output = BenchmarkOutput("cipher", platform)
+        println("SqlCipher settings on ${platform.name}, rows: $rows, batch: $batch, combinations: ${combinations.size}")
+        val results = combinations.map { measure(it) }
+        val baseline = results.first()
+        println("   open ms  inserts/s    scan rows/s  read p50 us  read p99 us  settings")
+        results.forEach { result ->
+            output.record().apply {
+                add("settings", result.settings.label())
+                result.settings.fields().forEach { (name, value) -> add(name, value) }
+                add("rows", rows)
+                add("batch", batch)
+                add("openMs", result.openMillis)
+                add("insertsPerSecond", result.insertsPerSecond)
+                add("scanRowsPerSecond", result.scanRowsPerSecond)
+                add("read", result.reads)
+            }
+            println(result.openMillis.format(1).padStart(10) +
+                    relative(result.insertsPerSecond, baseline.insertsPerSecond).padStart(11) +
+                    relative(result.scanRowsPerSecond, baseline.scanRowsPerSecond).padStart(15) +
+                    (result.reads.percentile(0.5) / 1000.0).format(1).padStart(13) +
+                    (result.reads.percentile(0.99) / 1000.0).format(1).padStart(13) +
+                    "  " + result.settings.label())
+        }
+        output.write()
+        return output
+    }
+
+    private fun relative(value: Double, baseline: Double): String {
+        val percent = if (baseline > 0) ((value / baseline - 1.0) * 100).format(0) else "?"
+        return "${value.format(0)} ${if (percent.startsWith("-")) "" else "+"}$percent%"
+    }
+
+    private suspend fun open(settings: CipherSettings, create: Boolean): SqlCipherDatabase {
+        val dbPath = platform.databasePath(fileName)
+        return sqlcipher {
+            path = dbPath
+            createOk = create
+            onOpenPragmas = { db -> settings.pragmas().forEach { db.pragma(it) { false } } }
+        }.also { it.open(passphrase) }
+    }
+
+    private suspend fun measure(settings: CipherSettings): Result {
+        platform.deleteDatabase(fileName)
+        var db = open(settings, true)
+        db.execute("create table matrix(id INTEGER PRIMARY KEY, value INTEGER, text TEXT, bytes BLOB);")
+        val bytes = ByteArray(64) { it.toByte() }
+        var start = TimeSource.Monotonic.markNow()
+        val insert = db.statement("insert into matrix(value, text, bytes) values(?, ?, ?)")
+        var id = 0
+        while (id < rows) {
+            db.transaction {
+                repeat(minOf(batch, rows - id)) {
+                    insert.execute(SqlValues(SqlValue.IntValue(id), SqlValue.StringValue(text), SqlValue.BytesValue(bytes)))
+                    id++
+                }
+            }
+        }
+        insert.close()
+        val insertSeconds = start.elapsedNow().toDouble(DurationUnit.SECONDS)
+        db.close()
+
+        val openTimes = List(opens) {
+            start = TimeSource.Monotonic.markNow()
+            db = open(settings, false)
+            val elapsed = start.elapsedNow().toDouble(DurationUnit.MILLISECONDS)
+            if (it < opens - 1)
+                db.close()
+            elapsed
+        }.sorted()
+
+        start = TimeSource.Monotonic.markNow()
+        var scanned = 0
+        db.query("select * from matrix").retrieve { _, _ ->
+            scanned++
+            true
+        }
+        check(scanned == rows) { "scanned $scanned of $rows rows" }
+        val scanSeconds = start.elapsedNow().toDouble(DurationUnit.SECONDS)
+        db.close()
+
+        db = open(settings, false)
+        val latencies = Latencies()
+        val random = Random(rows)
+        repeat(reads) {
+            val mark = TimeSource.Monotonic.markNow()
+            db.query("select * from matrix where id = ?")
+                .retrieveOne(SqlValues(SqlValue.IntValue(random.nextInt(1, rows + 1)))) { _, _ -> }
+            latencies.record(mark.elapsedNow().inWholeNanoseconds)
+        }
+        db.close()
+        platform.deleteDatabase(fileName)
+        return Result(
+            settings,
+            openTimes[openTimes.size / 2],
+            rows / insertSeconds,
+            scanned / scanSeconds,
+            latencies
+        )
+    }
+}
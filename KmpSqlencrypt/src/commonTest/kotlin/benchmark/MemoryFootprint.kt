@@ -0,0 +1,182 @@
+package com.oldguy.kiscmp.benchmark
+
+import com.oldguy.database.Passphrase
+import com.oldguy.database.SqlValue
+import com.oldguy.database.SqlValues
+import com.oldguy.kiscmp.ConnectionMemory
+import com.oldguy.kiscmp.SqlCipherDatabase
+import com.oldguy.kiscmp.SqliteMemory
+import com.oldguy.kiscmp.sqlcipher
+import kotlin.time.DurationUnit
+import kotlin.time.TimeSource
+
+/**
+ * Memory used by each phase of the life of an encrypted database: open, bulk insert, scan and
+ * close. Before and after every phase it samples
+ * - the Sqlite heap, sqlite3_memory_used, with the high water mark reset at the start of the phase
+ * so its peak is reported. SqlCipher allocates its buffers through Sqlite, so they are included.
+ * - the connection's sqlite3_db_status: page cache, schema, statements and lookaside
+ * - the resident set size of the process
+ * - the managed heap in use and the bytes allocated by the benchmark thread, where the platform
+ * provides them. On the JVM the allocations are what the bindings cost in SqlValues, strings and
+ * arrays, and heap growth that survives a round points at leaked references.
+ *
+ * The cycle runs KMPSQL_MEMORY_ROUNDS times (default 3), each on a new file. Memory still held
+ * after close is compared between the first and last round, since a leak grows with every round
+ * while caches filled once do not. KMPSQL_MEMORY_ROWS (default 20000) rows are inserted in
+ * transactions of KMPSQL_MEMORY_BATCH rows (default 1000).
+ *
+ * Writes one record per phase and round to `kmpsql-memory-<platform>.jsonl` and prints the
+ * breakdown in kilobytes.
+ */
+class MemoryFootprintBenchmark(private val platform: BenchmarkPlatform) {
+    private val rows = platform.int("KMPSQL_MEMORY_ROWS", 20000)
+    private val batch = platform.int("KMPSQL_MEMORY_BATCH", 1000).coerceAtLeast(1)
+    private val rounds = platform.int("KMPSQL_MEMORY_ROUNDS", 3).coerceAtLeast(1)
+    private val fileName = "kmpsql-memory.db"
+    private val passphrase = Passphrase("memoryKey")
+    private val text = "memory footprint ".repeat(5)
+    private val bytes = ByteArray(100) { it.toByte() }
+
+    private class Sample(
+        val sqlite: SqliteMemory,
+        val connection: ConnectionMemory,
+        val residentBytes: Long,
+        val heap: ManagedHeap
+    )
+
+    suspend fun run(): BenchmarkOutput {
+        val output = BenchmarkOutput("memory", platform)
+        println("Memory footprint on ${platform.name}, rows: $rows, batch: $batch, rounds: $rounds")
+        println("phase      round  sqlite KB  delta KB   peak KB  cache KB  schema KB  stmt KB" +
+                "    rss KB  rss delta  heap delta  alloc KB  alloc/row")
+        val retained = (1..rounds).map { round(output, it) }
+        output.write()
+        println("Sqlite heap retained after close by round: ${retained.joinToString { "$it" }} bytes")
+        if (retained.last() > retained.first())
+            println("WARNING Sqlite heap retained after close grew by ${retained.last() - retained.first()} " +
+                    "bytes from round 1 to $rounds")
+        return output
+    }
+
+    /**
+     * @return Sqlite heap still allocated after close, compared to before open
+     */
+    private suspend fun round(output: BenchmarkOutput, round: Int): Long {
+        platform.deleteDatabase(fileName)
+        val dbPath = platform.databasePath(fileName)
+        val db = sqlcipher {
+            path = dbPath
+            createOk = true
+        }
+        val start = sample(db)
+        phase(output, db, "open", round, 0) {
+            db.open(passphrase)
+            db.execute("create table memory(id INTEGER PRIMARY KEY, value INTEGER, text TEXT, bytes BLOB);")
+        }
+        phase(output, db, "insert", round, rows) {
+            insert(db)
+        }
+        phase(output, db, "scan", round, rows) {
+            var scanned = 0
+            db.query("select * from memory").retrieve { _, _ ->
+                scanned++
+                true
+            }
+            check(scanned == rows) { "scanned $scanned of $rows rows" }
+        }
+        val end = phase(output, db, "close", round, 0) {
+            db.close()
+        }
+        platform.deleteDatabase(fileName)
+        val retained = end.sqlite.used - start.sqlite.used
+        output.records.last().add("retainedSqliteBytes", retained)
+        return retained
+    }
+
+    private suspend fun insert(db: SqlCipherDatabase) {
+        val statement = db.statement("insert into memory(value, text, bytes) values(?, ?, ?)")
+        var id = 0
+        while (id < rows) {
+            db.transaction {
+                repeat(minOf(batch, rows - id)) {
+                    statement.execute(SqlValues(
+                        SqlValue.IntValue(id),
+                        SqlValue.StringValue(text),
+                        SqlValue.BytesValue(bytes)
+                    ))
+                    id++
+                }
+            }
+        }
+        statement.close()
+    }
+
+    /**
+     * Runs one phase between two samples and records the difference
+     * @param units rows handled by the phase, 0 if it is not per row
+     * @return the sample taken after the phase
+     */
+    private suspend fun phase(
+        output: BenchmarkOutput,
+        db: SqlCipherDatabase,
+        name: String,
+        round: Int,
+        units: Int,
+        block: suspend () -> Unit
+    ): Sample {
+        db.sqliteMemory(resetHighwater = true)
+        val before = sample(db)
+        val mark = TimeSource.Monotonic.markNow()
+        block()
+        val millis = mark.elapsedNow().toDouble(DurationUnit.MILLISECONDS)
+        val after = sample(db)
+        val allocated = after.heap.allocatedBytes - before.heap.allocatedBytes
+        val connection = after.connection
+        output.record()
+            .add("phase", name)
+            .add("round", round)
+            .add("rows", units)
+            .add("durationMs", millis)
+            .add("sqliteUsedBefore", before.sqlite.used)
+            .add("sqliteUsedAfter", after.sqlite.used)
+            .add("sqliteUsedDelta", after.sqlite.used - before.sqlite.used)
+            .add("sqlitePeak", after.sqlite.highwater)
+            .add("cacheUsed", connection.cacheUsed)
+            .add("schemaUsed", connection.schemaUsed)
+            .add("statementUsed", connection.statementUsed)
+            .add("lookasideUsed", connection.lookasideUsed)
+            .add("lookasideHighwater", connection.lookasideHighwater)
+            .add("cacheHits", connection.cacheHits)
+            .add("cacheMisses", connection.cacheMisses)
+            .add("cacheSpills", connection.cacheSpills)
+            .add("residentBefore", before.residentBytes)
+            .add("residentAfter", after.residentBytes)
+            .add("residentDelta", after.residentBytes - before.residentBytes)
+            .add("heapUsedDelta", after.heap.usedBytes - before.heap.usedBytes)
+            .add("allocatedBytes", allocated)
+            .add("allocatedPerRow", if (units > 0) allocated.toDouble() / units else 0.0)
+        println(name.padEnd(10) + "$round".padStart(6) +
+                kilobytes(after.sqlite.used).padStart(11) +
+                kilobytes(after.sqlite.used - before.sqlite.used).padStart(10) +
+                kilobytes(after.sqlite.highwater).padStart(10) +
+                kilobytes(connection.cacheUsed).padStart(10) +
+                kilobytes(connection.schemaUsed).padStart(11) +
+                kilobytes(connection.statementUsed).padStart(9) +
+                kilobytes(after.residentBytes).padStart(10) +
+                kilobytes(after.residentBytes - before.residentBytes).padStart(11) +
+                kilobytes(after.heap.usedBytes - before.heap.usedBytes).padStart(12) +
+                kilobytes(allocated).padStart(10) +
+                (if (units > 0) (allocated.toDouble() / units).format(0) else "-").padStart(11))
+        return after
+    }
+
+    private fun sample(db: SqlCipherDatabase) = Sample(
+        db.sqliteMemory(),
+        db.connectionMemory(),
+        platform.residentBytes(),
+        platform.managedHeap()
+    )
+
+    private fun kilobytes(bytes: Long): String = (bytes / 1024.0).format(1)
+}
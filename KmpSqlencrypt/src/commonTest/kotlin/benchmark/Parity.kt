@@ -0,0 +1,182 @@
+package com.oldguy.kiscmp.benchmark
+
+import com.oldguy.database.Passphrase
+import com.oldguy.database.Query
+import com.oldguy.database.SqlValue
+import com.oldguy.database.SqlValues
+import com.oldguy.kiscmp.SqlCipherDatabase
+import com.oldguy.kiscmp.SqlCipherStatement
+import com.oldguy.kiscmp.sqlcipher
+import kotlin.time.TimeSource
+
+/**
+ * The same operations through the common API on every platform, so the JNI shim used by the JVM
+ * and the cinterop binding used by linuxX64 can be compared one operation at a time. Each
+ * operation runs for [BenchmarkPlatform.duration] and is reported as nanoseconds per unit: per call,
+ * per row, or per cell for the column fetches, where the JNI cost of one call per cell and the
+ * native UTF-8 decoding of columnText show up.
+ *
+ * Results are written to `kmpsql-parity-<platform>.jsonl`. The table printed at the end includes
+ * the results the other platforms left in the same output directory, so running the linuxX64 and
+ * JVM tests one after the other prints them side by side.
+ *
+ * KMPSQL_PARITY_ROWS is the table size, default 1000. The updates run inside one transaction
+ * held open for the run and rolled back, so they measure the statement and not a commit per call.
+ */
+class ParityBenchmark(private val platform: BenchmarkPlatform) {
+    private val rows = platform.int("KMPSQL_PARITY_ROWS", 1000)
+    private val fileName = "kmpsql-parity.db"
+    private val passphrase = Passphrase("parityKey")
+    private val text = "parity text, ASCII and more: é ü ß ж 漢字 ".repeat(2)
+    private val bytes = ByteArray(64) { it.toByte() }
+    private var id = 0
+
+    /**
+     * @param units rows or cells handled by one call of [block]
+     */
+    private class Operation(
+        val name: String,
+        val unit: String,
+        val units: Int,
+        val block: suspend () -> Unit
+    )
+
+    suspend fun run(): BenchmarkOutput {
+        val output = BenchmarkOutput("parity", platform)
+        platform.deleteDatabase(fileName)
+        val dbPath = platform.databasePath(fileName)
+        val db = sqlcipher {
+            path = dbPath
+            createOk = true
+        }
+        db.open(passphrase)
+        val statements = mutableListOf<SqlCipherStatement>()
+        val queries = mutableListOf<Query>()
+        try {
+            load(db)
+            db.execute("BEGIN;")
+            fun statement(sql: String) = (db.statement(sql) as SqlCipherStatement).also { statements.add(it) }
+            fun query(sql: String) = db.query(sql).also { queries.add(it) }
+            val updateInt = statement("update parity set i = ? where id = ?")
+            val updateText = statement("update parity set t = ? where id = ?")
+            val updateBlob = statement("update parity set b = ? where id = ?")
+            val operations = listOf(
+                Operation("prepareFinalize", "call", 1) {
+                    db.statement("select id, i, r, t, b from parity where id = ?").close()
+                },
+                Operation("bindIntExecute", "call", 1) {
+                    updateInt.execute(SqlValues(SqlValue.IntValue(id), SqlValue.IntValue(nextId())))
+                },
+                Operation("bindTextExecute", "call", 1) {
+                    updateText.execute(SqlValues(SqlValue.StringValue(text), SqlValue.IntValue(nextId())))
+                },
+                Operation("bindBlobExecute", "call", 1) {
+                    updateBlob.execute(SqlValues(SqlValue.BytesValue(bytes), SqlValue.IntValue(nextId())))
+                },
+                Operation("pointSelect", "call", 1) {
+                    db.query("select id, i, r, t, b from parity where id = ?")
+                        .retrieveOne(SqlValues(SqlValue.IntValue(nextId()))) { _, _ -> }
+                },
+                query("select id from parity where 0 = 1").let { empty ->
+                    Operation("stepNoRow", "call", 1) { empty.nextRow() }
+                },
+                scan("fetchInteger", query("select i from parity"), 1),
+                scan("fetchDouble", query("select r from parity"), 1),
+                scan("fetchText", query("select t from parity"), 1),
+                scan("fetchBlob", query("select b from parity"), 1),
+                scan("fetchRow", query("select id, i, r, t, b from parity"), 5),
+                Operation("execCallback", "row", 10) {
+                    val first = nextId().coerceAtMost(rows - 9)
+                    db.execute("select id, i, r, t from parity where id between $first and ${first + 9}") { true }
+                }
+            )
+            println("Parity on ${platform.name}, rows: $rows")
+            operations.forEach { operation ->
+                val nanos = measure(operation)
+                output.record()
+                    .add("operation", operation.name)
+                    .add("unit", operation.unit)
+                    .add("nanosPerUnit", nanos)
+                    .add("rows", rows)
+            }
+        } finally {
+            statements.forEach { it.close() }
+            queries.forEach { it.close() }
+            if (db.isOpen)
+                db.execute("ROLLBACK;")
+            db.close()
+            platform.deleteDatabase(fileName)
+        }
+        output.write()
+        printTable(output)
+        return output
+    }
+
+    private suspend fun load(db: SqlCipherDatabase) {
+        db.execute("create table parity(id INTEGER PRIMARY KEY, i INTEGER, r DOUBLE(15), t TEXT, b BLOB);")
+        db.transaction {
+            val insert = db.statement("insert into parity(i, r, t, b) values(?, ?, ?, ?)")
+            repeat(rows) {
+                insert.execute(SqlValues(
+                    SqlValue.IntValue(it),
+                    SqlValue.DoubleValue(it * 1.5),
+                    SqlValue.StringValue(text),
+                    SqlValue.BytesValue(bytes)
+                ))
+            }
+            insert.close()
+        }
+    }
+
+    /**
+     * A full pass of [query] with nextRow, which resets the query at the end so it is reused
+     * without preparing it again
+     */
+    private fun scan(name: String, query: Query, columns: Int): Operation {
+        return Operation(name, if (columns == 1) "row" else "cell", rows * columns) {
+            while (query.nextRow().isNotEmpty) {
+                // every column is fetched and converted by nextRow
+            }
+        }
+    }
+
+    private suspend fun measure(operation: Operation): Double {
+        repeat(10) { operation.block() }
+        var calls = 0L
+        val start = TimeSource.Monotonic.markNow()
+        while (start.elapsedNow() < platform.duration) {
+            operation.block()
+            calls++
+        }
+        return start.elapsedNow().inWholeNanoseconds.toDouble() / (calls * operation.units)
+    }
+
+    private fun nextId(): Int = id++ % rows + 1
+
+    /**
+     * One line per operation, one column per platform with results, and the ratio of each to
+     * this platform
+     */
+    private fun printTable(output: BenchmarkOutput) {
+        val others = platforms.filter { it != platform.name }
+            .associateWith { other -> output.read(other).associate { it["operation"] to it["nanosPerUnit"] } }
+            .filterValues { it.isNotEmpty() }
+        val names = listOf(platform.name) + others.keys
+        println("operation".padEnd(18) + "unit".padEnd(6) +
+                names.joinToString("") { "$it ns".padStart(14) } +
+                others.keys.joinToString("") { "$it/${platform.name}".padStart(16) })
+        output.records.forEach { record ->
+            val operation = record["operation"] as String
+            val mine = record["nanosPerUnit"] as Double
+            val theirs = others.values.map { it[operation]?.toDoubleOrNull() }
+            println(operation.padEnd(18) + (record["unit"] as String).padEnd(6) +
+                    mine.format(1).padStart(14) +
+                    theirs.joinToString("") { (it?.format(1) ?: "-").padStart(14) } +
+                    theirs.joinToString("") { (it?.let { (it / mine).format(2) } ?: "-").padStart(16) })
+        }
+    }
+
+    companion object {
+        val platforms = listOf("linuxX64", "jvm")
+    }
+}
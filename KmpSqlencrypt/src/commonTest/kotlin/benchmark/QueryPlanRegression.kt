@@ -0,0 +1,125 @@
+package com.oldguy.kiscmp.benchmark
+
+import com.oldguy.database.Passphrase
+import com.oldguy.database.SqlValue
+import com.oldguy.database.SqlValues
+import com.oldguy.kiscmp.PlanRegression
+import com.oldguy.kiscmp.QueryPlanBaseline
+import com.oldguy.kiscmp.SqlCipherDatabase
+import com.oldguy.kiscmp.sqlcipher
+import kotlinx.io.buffered
+import kotlinx.io.files.Path
+import kotlinx.io.files.SystemFileSystem
+import kotlinx.io.readString
+import kotlinx.io.writeString
+
+/**
+ * Compares the plans of a set of hot queries with a golden file, so a Sqlite upgrade or schema
+ * change that makes one of them scan a table or sort with a temporary B-tree is caught by a test
+ * instead of in production. The queries are registered with representative bind values on a
+ * small customers and orders schema, analyzed so the plans do not depend on default estimates.
+ *
+ * KMPSQL_PLAN_GOLDEN is the golden file, default [defaultGolden], which is under version control
+ * and relative to the project directory tests run in. The current plans are compared with it and
+ * the differences printed, the failures as FAIL lines. A missing golden file is an error, unless
+ * KMPSQL_PLAN_UPDATE=true, which writes the file instead of comparing, after an intended plan
+ * change. Loop counters are only in golden files written with a library that has
+ * SQLITE_ENABLE_STMT_SCANSTATUS.
+ *
+ * KMPSQL_PLAN_ROWS is the number of orders, default 10000, one customer per ten orders. The
+ * checked in golden file is for the default.
+ */
+class QueryPlanRegression(private val platform: BenchmarkPlatform) {
+    private val rows = platform.int("KMPSQL_PLAN_ROWS", 10000).coerceAtLeast(10)
+    private val golden = platform.string("KMPSQL_PLAN_GOLDEN", defaultGolden)
+    private val update = platform.string("KMPSQL_PLAN_UPDATE", "false").toBoolean()
+    private val fileName = "kmpsql-plans.db"
+
+    class Result(
+        val output: BenchmarkOutput,
+        val regressions: List<PlanRegression>
+    ) {
+        val failures: List<PlanRegression> get() = regressions.filter { it.kind.isFailure }
+    }
+
+    suspend fun run(): Result {
+        val output = BenchmarkOutput("plans", platform)
+        platform.deleteDatabase(fileName)
+        val dbPath = platform.databasePath(fileName)
+        val db = sqlcipher {
+            path = dbPath
+            createOk = true
+        }
+        db.open(Passphrase("planKey"))
+        val captures = try {
+            load(db)
+            register(db)
+            db.captureQueryPlans()
+        } finally {
+            db.close()
+            platform.deleteDatabase(fileName)
+        }
+        val current = QueryPlanBaseline(captures)
+        val path = Path(golden)
+        if (!update && !SystemFileSystem.exists(path))
+            throw IllegalStateException("Golden file $path not found, set KMPSQL_PLAN_UPDATE=true to write it")
+        val regressions = if (update) {
+            SystemFileSystem.sink(path).buffered().use { it.writeString(current.toText()) }
+            println("Query plans of ${captures.size} queries written to $path")
+            emptyList()
+        } else {
+            val text = SystemFileSystem.source(path).buffered().use { it.readString() }
+            QueryPlanBaseline.parse(text).compare(captures)
+        }
+        captures.forEach { capture ->
+            val found = regressions.filter { it.name == capture.name }
+            output.record()
+                .add("query", capture.name)
+                .add("planLines", capture.plan.size)
+                .add("loops", capture.loops.size)
+                .add("rowsVisited", capture.rowsVisited)
+                .add("regressions", found.joinToString("; ") { it.kind.name })
+                .add("failed", found.any { it.kind.isFailure })
+        }
+        println("Query plans on ${platform.name} compared with $path, ${regressions.size} differences")
+        regressions.forEach { println((if (it.kind.isFailure) "FAIL " else "NOTE ") + it) }
+        output.write()
+        return Result(output, regressions)
+    }
+
+    private suspend fun load(db: SqlCipherDatabase) {
+        val customers = rows / 10
+        db.execute("create table customers(id INTEGER PRIMARY KEY, name TEXT, region INTEGER);" +
+                "create index customers_region on customers(region);" +
+                "create table orders(id INTEGER PRIMARY KEY, customer INTEGER, placed INTEGER, total DOUBLE(15));" +
+                "create index orders_customer on orders(customer, placed);" +
+                "create index orders_placed on orders(placed);")
+        db.execute("with recursive c(x) as (select 1 union all select x + 1 from c where x < $customers) " +
+                "insert into customers(name, region) select 'customer ' || x, x % 20 from c;" +
+                "with recursive c(x) as (select 1 union all select x + 1 from c where x < $rows) " +
+                "insert into orders(customer, placed, total) select x % $customers + 1, x, x * 0.5 from c;" +
+                "ANALYZE;")
+    }
+
+    private fun register(db: SqlCipherDatabase) {
+        db.registerHotQuery("customerById",
+            "select * from customers where id = ?",
+            SqlValues(SqlValue.IntValue(42)))
+        db.registerHotQuery("ordersOfCustomer",
+            "select * from orders where customer = ? order by placed desc",
+            SqlValues(SqlValue.IntValue(42)))
+        db.registerHotQuery("recentOrdersInRegion",
+            "select o.id, o.total from customers c join orders o on o.customer = c.id " +
+                    "where c.region = ? and o.placed >= ?",
+            SqlValues(SqlValue.IntValue(3), SqlValue.IntValue(rows - 100)))
+        db.registerHotQuery("latestOrders",
+            "select * from orders order by placed desc limit ?",
+            SqlValues(SqlValue.IntValue(20)))
+        db.registerHotQuery("regionTotals",
+            "select c.region, sum(o.total) from customers c join orders o on o.customer = c.id group by c.region")
+    }
+
+    companion object {
+        const val defaultGolden = "src/commonTest/resources/kmpsql-plans.golden"
+    }
+}
@@ -0,0 +1,351 @@
+package com.oldguy.kiscmp.benchmark
+
+import com.oldguy.database.Passphrase
+import com.oldguy.database.SqlValue
+import com.oldguy.database.SqlValues
+import com.oldguy.database.TransactionMode
+import com.oldguy.kiscmp.SqlCipherDatabase
+import com.oldguy.kiscmp.SqliteException
+import com.oldguy.kiscmp.sqlcipher
+import kotlinx.coroutines.CancellationException
+import kotlinx.coroutines.async
+import kotlinx.coroutines.awaitAll
+import kotlinx.coroutines.coroutineScope
+import kotlinx.coroutines.delay
+import kotlin.random.Random
+import kotlin.time.Duration
+import kotlin.time.Duration.Companion.milliseconds
+import kotlin.time.DurationUnit
+import kotlin.time.TimeMark
+import kotlin.time.TimeSource
+
+/**
+ * Percent of operations that are single row insert transactions, the rest are point reads
+ */
+enum class ScalingWorkload(val writePercent: Int) {
+    Read(0), Write(100), Mixed(20)
+}
+
+/**
+ * [Shared] runs every worker thread on one SqlCipherDatabase, [Separate] gives each its own
+ */
+enum class ScalingMode {
+    Shared, Separate
+}
+
+/**
+ * What the workers of one run counted. Busy and locked are counted per occurrence, an operation
+ * that is retried several times counts several. The rest are correctness problems and should stay 0:
+ * - [transactionDepthViolations] a worker found transactionDepth other than 1 inside its own
+ * transaction, so another thread's transaction was interleaved on the same connection
+ * - [transactionErrors] Sqlite rejected a BEGIN, COMMIT or ROLLBACK, usually for the same reason
+ * - [otherErrors] anything else thrown, by exception class
+ */
+class ScalingCounters {
+    val latencies = Latencies()
+    var writes = 0L
+    var busy = 0L
+    var locked = 0L
+    var gaveUp = 0L
+    var lockWaitNanos = 0L
+    var transactionDepthViolations = 0L
+    var transactionErrors = 0L
+    val otherErrors = mutableMapOf<String, Int>()
+
+    fun add(other: ScalingCounters) {
+        latencies.add(other.latencies)
+        writes += other.writes
+        busy += other.busy
+        locked += other.locked
+        gaveUp += other.gaveUp
+        lockWaitNanos += other.lockWaitNanos
+        transactionDepthViolations += other.transactionDepthViolations
+        transactionErrors += other.transactionErrors
+        other.otherErrors.forEach { (name, count) -> otherErrors[name] = (otherErrors[name] ?: 0) + count }
+    }
+}
+
+/**
+ * Throughput against worker thread count, to see where the library stops scaling. Each thread
+ * count in KMPSQL_BENCH_THREADS (default 1,2,4,8,16,32,64) runs the read only, write only and mixed
+ * [ScalingWorkload]s in each [ScalingMode] for [BenchmarkPlatform.duration].
+ *
+ * Connections use WAL and a busy timeout of 0. A busy or locked operation is retried by the worker
+ * after a 1 ms delay, for up to KMPSQL_SCALING_MAX_WAIT_MS (default 5000), and the time from the
+ * first busy result to the end of the operation is the lock wait time. The key is a raw key, so the
+ * many opens at high thread counts do not spend their time in key derivation.
+ *
+ * Besides the counters in [ScalingCounters], each run compares the rows added to the table with
+ * the writes that reported success. Problems are flagged in the printed curves, and every run is
+ * written to `kmpsql-scaling-<platform>.jsonl` for comparing releases.
+ */
+class ScalingBenchmark(private val platform: BenchmarkPlatform) {
+    private val threadCounts = platform.threads(listOf(1, 2, 4, 8, 16, 32, 64))
+    private val rows = platform.int("KMPSQL_SCALING_ROWS", 10000)
+    private val maxWait = platform.int("KMPSQL_SCALING_MAX_WAIT_MS", 5000).milliseconds
+    private val fileName = "kmpsql-scaling.db"
+    private val passphrase = Passphrase(ByteArray(32) { (it * 7).toByte() })
+
+    class Result(
+        val mode: ScalingMode,
+        val workload: ScalingWorkload,
+        val threads: Int,
+        val seconds: Double,
+        val counters: ScalingCounters,
+        val rowMismatch: Long
+    ) {
+        val operationsPerSecond get() = counters.latencies.count / seconds
+
+        val flags: String get() = buildString {
+            if (counters.transactionDepthViolations > 0)
+                append(" transactionDepth=${counters.transactionDepthViolations}")
+            if (counters.transactionErrors > 0)
+                append(" transactionErrors=${counters.transactionErrors}")
+            if (rowMismatch != 0L)
+                append(" rowMismatch=$rowMismatch")
+            counters.otherErrors.forEach { (name, count) -> append(" $name=$count") }
+        }.trim()
+    }
+
+    suspend fun run(): BenchmarkOutput {
+        val output = BenchmarkOutput("scaling", platform)
+        load()
+        val results = mutableListOf<Result>()
+        try {
+            ScalingMode.entries.forEach { mode ->
+                threadCounts.forEach { threads ->
+                    val connections = List(if (mode == ScalingMode.Shared) 1 else threads) { open() }
+                    try {
+                        ScalingWorkload.entries.forEach { workload ->
+                            results.add(runThreads(mode, workload, threads, connections))
+                        }
+                    } finally {
+                        connections.forEach { it.close() }
+                    }
+                }
+            }
+        } finally {
+            platform.deleteDatabase(fileName)
+        }
+        results.forEach { result ->
+            output.record()
+                .add("mode", result.mode.name)
+                .add("workload", result.workload.name)
+                .add("threads", result.threads)
+                .add("operations", result.counters.latencies.count)
+                .add("operationsPerSecond", result.operationsPerSecond)
+                .add("writes", result.counters.writes)
+                .add("busy", result.counters.busy)
+                .add("locked", result.counters.locked)
+                .add("gaveUp", result.counters.gaveUp)
+                .add("lockWaitMs", result.counters.lockWaitNanos / 1000000.0)
+                .add("transactionDepthViolations", result.counters.transactionDepthViolations)
+                .add("transactionErrors", result.counters.transactionErrors)
+                .add("otherErrors", result.counters.otherErrors.values.sum())
+                .add("rowMismatch", result.rowMismatch)
+                .add("flags", result.flags)
+                .add("op", result.counters.latencies)
+        }
+        printCurves(results)
+        output.write()
+        return output
+    }
+
+    private suspend fun open(): SqlCipherDatabase {
+        val dbPath = platform.databasePath(fileName)
+        return sqlcipher {
+            path = dbPath
+            createOk = true
+            busyTimeout = 0
+            onOpenPragmas = {
+                it.pragma("journal_mode = WAL") { false }
+                it.pragma("synchronous = NORMAL") { false }
+            }
+        }.also { it.open(passphrase) }
+    }
+
+    private suspend fun load() {
+        platform.deleteDatabase(fileName)
+        val db = open()
+        try {
+            db.execute("create table scaling(id INTEGER PRIMARY KEY, worker INTEGER, value TEXT);" +
+                    "with recursive c(x) as (select 1 union all select x + 1 from c where x < $rows) " +
+                    "insert into scaling(worker, value) select -1, printf('row %d', x) from c;")
+        } finally {
+            db.close()
+        }
+    }
+
+    private suspend fun count(db: SqlCipherDatabase): Long {
+        var count = 0L
+        db.query("select count(*) from scaling").retrieveOne { _, row -> count = row.requireLong(0) }
+        return count
+    }
+
+    private suspend fun runThreads(
+        mode: ScalingMode,
+        workload: ScalingWorkload,
+        threads: Int,
+        connections: List<SqlCipherDatabase>
+    ): Result {
+        val before = count(connections[0])
+        val shared = connections.size < threads
+        val workers = List(threads) { Worker(connections[it % connections.size], shared, workload, Random(it)) }
+        val pool = platform.threadPool(threads)
+        val start = TimeSource.Monotonic.markNow()
+        try {
+            coroutineScope {
+                workers.map { worker -> async(pool) { worker.run(platform.duration) } }.awaitAll()
+            }
+        } finally {
+            pool.close()
+        }
+        val seconds = start.elapsedNow().toDouble(DurationUnit.SECONDS)
+        val counters = ScalingCounters().also { total -> workers.forEach { total.add(it.counters) } }
+        val added = count(connections[0]) - before
+        return Result(mode, workload, threads, seconds, counters, added - counters.writes)
+    }
+
+    private inner class Worker(
+        private val db: SqlCipherDatabase,
+        private val shared: Boolean,
+        private val workload: ScalingWorkload,
+        private val random: Random
+    ) {
+        val counters = ScalingCounters()
+        private val worker = random.nextInt()
+
+        suspend fun run(duration: Duration) {
+            val start = TimeSource.Monotonic.markNow()
+            while (start.elapsedNow() < duration) {
+                val write = random.nextInt(100) < workload.writePercent
+                val mark = TimeSource.Monotonic.markNow()
+                val ok = retrying(write) { if (write) write() else read() }
+                if (ok) {
+                    counters.latencies.record(mark.elapsedNow().inWholeNanoseconds)
+                    if (write) counters.writes++
+                } else
+                    counters.latencies.error()
+            }
+        }
+
+        private suspend fun read() {
+            db.query("select value from scaling where id = ?")
+                .retrieveOne(SqlValues(SqlValue.IntValue(random.nextInt(1, rows + 1)))) { _, _ -> }
+        }
+
+        private suspend fun write() {
+            db.transaction(TransactionMode.Immediate) {
+                if (db.transactionDepth != 1)
+                    counters.transactionDepthViolations++
+                val insert = db.statement("insert into scaling(worker, value) values(?, ?)")
+                try {
+                    val inserted = insert.execute(SqlValues(
+                        SqlValue.IntValue(worker),
+                        SqlValue.StringValue("worker $worker")
+                    ))
+                    if (inserted < 0)
+                        throw SqliteException("insert busy", "step", sqliteBusy)
+                } finally {
+                    insert.close()
+                }
+            }
+        }
+
+        /**
+         * Runs [operation] until it succeeds, fails with something other than busy or locked, or
+         * has waited [maxWait]. A busy COMMIT leaves the connection in its transaction, so a busy
+         * write is rolled back before the retry, unless the connection is shared, where the
+         * transaction may belong to another worker.
+         * @return true if [operation] succeeded
+         */
+        private suspend fun retrying(write: Boolean, operation: suspend () -> Unit): Boolean {
+            var waitStart: TimeMark? = null
+            while (true) {
+                try {
+                    operation()
+                    waitStart?.let { counters.lockWaitNanos += it.elapsedNow().inWholeNanoseconds }
+                    return true
+                } catch (e: CancellationException) {
+                    throw e
+                } catch (e: Throwable) {
+                    val cause = sqliteCause(e)
+                    val code = (cause?.result ?: 0) and 0xff
+                    val text = cause?.message ?: ""
+                    when {
+                        code == sqliteBusy || text.contains("Busy") -> counters.busy++
+                        code == sqliteLocked -> counters.locked++
+                        cause != null && text.contains("transaction") -> {
+                            counters.transactionErrors++
+                            return false
+                        }
+                        else -> {
+                            val name = (cause ?: e)::class.simpleName ?: "Throwable"
+                            counters.otherErrors[name] = (counters.otherErrors[name] ?: 0) + 1
+                            return false
+                        }
+                    }
+                    if (write && !shared)
+                        rollbackQuietly()
+                    val started = waitStart ?: TimeSource.Monotonic.markNow().also { waitStart = it }
+                    if (started.elapsedNow() > maxWait) {
+                        counters.lockWaitNanos += started.elapsedNow().inWholeNanoseconds
+                        counters.gaveUp++
+                        return false
+                    }
+                    delay(1)
+                }
+            }
+        }
+
+        private suspend fun rollbackQuietly() {
+            try {
+                db.execute("ROLLBACK;")
+            } catch (e: CancellationException) {
+                throw e
+            } catch (_: Throwable) {
+                // no transaction was active
+            }
+        }
+    }
+
+    private fun sqliteCause(e: Throwable): SqliteException? {
+        var cause: Throwable? = e
+        while (cause != null) {
+            if (cause is SqliteException) return cause
+            cause = cause.cause
+        }
+        return null
+    }
+
+    /**
+     * One table per mode and workload: throughput, speedup over the smallest thread count, busy,
+     * locked and given up operations, total lock wait, and any correctness flags.
+     */
+    private fun printCurves(results: List<Result>) {
+        println("Scaling on ${platform.name}, rows: $rows, duration: ${platform.duration}")
+        results.groupBy { it.mode to it.workload }.forEach { (key, curve) ->
+            println("${key.first} ${key.second}")
+            println("  threads       ops/s  speedup      busy    locked  gave up   wait ms  flags")
+            val base = curve.first().operationsPerSecond
+            curve.forEach {
+                println(it.threads.toString().padStart(9) +
+                        it.operationsPerSecond.format(0).padStart(12) +
+                        (if (base > 0) (it.operationsPerSecond / base).format(2) else "-").padStart(9) +
+                        it.counters.busy.toString().padStart(10) +
+                        it.counters.locked.toString().padStart(10) +
+                        it.counters.gaveUp.toString().padStart(9) +
+                        (it.counters.lockWaitNanos / 1000000.0).format(1).padStart(10) +
+                        "  " + it.flags)
+            }
+        }
+        results.filter { it.flags.isNotEmpty() }.forEach {
+            println("WARNING ${it.mode} ${it.workload} threads: ${it.threads}, ${it.flags}")
+        }
+    }
+
+    companion object {
+        private const val sqliteBusy = 5
+        private const val sqliteLocked = 6
+    }
+}
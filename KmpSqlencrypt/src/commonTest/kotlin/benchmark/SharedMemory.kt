@@ -0,0 +1,91 @@
+package com.oldguy.kiscmp.benchmark
+
+import com.oldguy.database.Passphrase
+import com.oldguy.database.SqlValue
+import com.oldguy.database.SqlValues
+import com.oldguy.kiscmp.SqlCipherDatabase
+import com.oldguy.kiscmp.sqlcipher
+import kotlinx.coroutines.async
+import kotlinx.coroutines.awaitAll
+import kotlinx.coroutines.coroutineScope
+import kotlin.random.Random
+import kotlin.time.DurationUnit
+import kotlin.time.TimeSource
+
+/**
+ * Point read throughput of a shared in-memory database against the number of readers. Each reader
+ * count in KMPSQL_BENCH_THREADS (default 1,2,4) opens that many connections to one database
+ * shared through [SqlCipherDatabase.sharedMemoryName], and each runs random primary key lookups
+ * on its own thread for [BenchmarkPlatform.duration]. KMPSQL_SHARED_ROWS is the table size,
+ * default 10000.
+ *
+ * Each run is written to `kmpsql-shared-<platform>.jsonl` and printed, to see how far reads of
+ * one shared database scale with the readers.
+ */
+class SharedMemoryBenchmark(private val platform: BenchmarkPlatform) {
+    private val readerCounts = platform.threads(listOf(1, 2, 4))
+    private val rows = platform.int("KMPSQL_SHARED_ROWS", 10000).coerceAtLeast(1)
+    private val name = "kmpsqlSharedBench"
+    private val sql = "select data from shared where id = ?"
+
+    suspend fun run(): BenchmarkOutput {
+        val output = BenchmarkOutput("shared", platform)
+        // the database lives as long as one connection to it is open
+        val owner = open()
+        try {
+            owner.execute("drop table if exists shared;create table shared(id INTEGER PRIMARY KEY, data TEXT);" +
+                    "with recursive c(x) as (select 1 union all select x + 1 from c where x < $rows) " +
+                    "insert into shared(data) select 'row ' || x from c;")
+            println("Shared memory reads on ${platform.name}, rows: $rows")
+            readerCounts.forEach { readers(output, it) }
+        } finally {
+            owner.close()
+        }
+        output.write()
+        return output
+    }
+
+    private suspend fun readers(output: BenchmarkOutput, readerCount: Int) {
+        val connections = List(readerCount) { open() }
+        val pool = platform.threadPool(readerCount)
+        val start = TimeSource.Monotonic.markNow()
+        val counts = try {
+            coroutineScope {
+                connections.mapIndexed { index, reader ->
+                    async(pool) { read(reader, Random(index)) }
+                }.awaitAll()
+            }
+        } finally {
+            pool.close()
+            connections.forEach { it.close() }
+        }
+        val seconds = start.elapsedNow().toDouble(DurationUnit.SECONDS)
+        val perSecond = counts.sum() / seconds
+        output.record()
+            .add("readers", readerCount)
+            .add("queries", counts.sum())
+            .add("queriesPerSecond", perSecond)
+            .add("minPerReader", counts.min())
+            .add("maxPerReader", counts.max())
+        println("readers: $readerCount, queries/s: ${perSecond.format(0)}, per reader: ${counts.joinToString()}")
+    }
+
+    private suspend fun read(reader: SqlCipherDatabase, random: Random): Long {
+        val start = TimeSource.Monotonic.markNow()
+        var count = 0L
+        while (start.elapsedNow() < platform.duration) {
+            // retrieveOne closes the query
+            reader.query(sql).retrieveOne(SqlValues(SqlValue.IntValue(random.nextInt(1, rows + 1)))) { _, _ -> }
+            count++
+        }
+        return count
+    }
+
+    private suspend fun open(): SqlCipherDatabase {
+        return sqlcipher {
+            sharedMemoryName = name
+            createOk = true
+            busyTimeout = 5000
+        }.also { it.open(Passphrase()) }
+    }
+}
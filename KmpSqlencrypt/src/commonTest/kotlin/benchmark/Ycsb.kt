@@ -0,0 +1,346 @@
+package com.oldguy.kiscmp.benchmark
+
+import com.oldguy.database.Passphrase
+import com.oldguy.database.SqlValue
+import com.oldguy.database.SqlValues
+import com.oldguy.kiscmp.SqlCipherDatabase
+import com.oldguy.kiscmp.SqlCipherStatement
+import com.oldguy.kiscmp.SqliteException
+import com.oldguy.kiscmp.sqlcipher
+import kotlinx.atomicfu.atomic
+import kotlinx.coroutines.async
+import kotlinx.coroutines.awaitAll
+import kotlinx.coroutines.coroutineScope
+import kotlin.math.pow
+import kotlin.random.Random
+import kotlin.time.Duration
+import kotlin.time.DurationUnit
+import kotlin.time.TimeSource
+
+/**
+ * Zipfian distributed longs in [0, items), 0 the most popular, using the generator of Gray et al.
+ * "Quickly Generating Billion-Record Synthetic Databases" as YCSB does. [zetan] is expensive for
+ * large item counts, so compute it once with [zeta] and share it between generators.
+ */
+class ZipfianGenerator(
+    val items: Long,
+    private val random: Random,
+    private val zetan: Double = zeta(items),
+    private val theta: Double = defaultTheta
+) {
+    private val alpha = 1.0 / (1.0 - theta)
+    private val eta = (1.0 - (2.0 / items).pow(1.0 - theta)) / (1.0 - zeta(2, theta) / zetan)
+    private val halfPowTheta = 1.0 + 0.5.pow(theta)
+
+    fun next(): Long {
+        val u = random.nextDouble()
+        val uz = u * zetan
+        return when {
+            uz < 1.0 -> 0
+            uz < halfPowTheta -> 1
+            else -> (items * (eta * u - eta + 1.0).pow(alpha)).toLong().coerceAtMost(items - 1)
+        }
+    }
+
+    /**
+     * Popular items spread over the key space instead of clustered at the low end, like YCSB's
+     * ScrambledZipfianGenerator
+     */
+    fun nextScrambled(): Long = fnvHash64(next()) % items
+
+    companion object {
+        const val defaultTheta = 0.99
+
+        fun zeta(items: Long, theta: Double = defaultTheta): Double {
+            var sum = 0.0
+            for (i in 1..items)
+                sum += 1.0 / i.toDouble().pow(theta)
+            return sum
+        }
+
+        fun fnvHash64(value: Long): Long {
+            var hash = -0x340d631b7bdddcdbL
+            var v = value
+            repeat(8) {
+                hash = hash xor (v and 0xff)
+                hash *= 0x100000001b3L
+                v = v shr 8
+            }
+            return hash and Long.MAX_VALUE
+        }
+    }
+}
+
+/**
+ * Operation mixes of the YCSB core workloads, in percent. D reads the most recently inserted
+ * records, the others choose keys with a scrambled Zipfian distribution.
+ */
+enum class YcsbWorkload(
+    val read: Int,
+    val update: Int,
+    val insert: Int,
+    val scan: Int,
+    val readModifyWrite: Int,
+    val latest: Boolean = false
+) {
+    A(50, 50, 0, 0, 0),
+    B(95, 5, 0, 0, 0),
+    C(100, 0, 0, 0, 0),
+    D(95, 0, 5, 0, 0, true),
+    E(0, 0, 5, 95, 0),
+    F(50, 0, 0, 0, 50);
+
+    fun operation(percent: Int): YcsbOperation {
+        var limit = read
+        if (percent < limit) return YcsbOperation.Read
+        limit += update
+        if (percent < limit) return YcsbOperation.Update
+        limit += insert
+        if (percent < limit) return YcsbOperation.Insert
+        limit += scan
+        if (percent < limit) return YcsbOperation.Scan
+        return YcsbOperation.ReadModifyWrite
+    }
+}
+
+enum class YcsbOperation {
+    Read, Update, Insert, Scan, ReadModifyWrite
+}
+
+/**
+ * YCSB style workload driver on [SqlCipherDatabase]. Loads an encrypted usertable of
+ * KMPSQL_YCSB_RECORDS records (default 10000) with 10 text fields of 100 characters, then runs each
+ * workload in KMPSQL_YCSB_WORKLOADS (default "ABCDEF") at each thread count for the platform
+ * duration. Each worker thread has its own connection, the database uses WAL. Throughput and
+ * p50/p99/p999 latency per operation type are printed and written as JSON lines.
+ */
+class YcsbBenchmark(private val platform: BenchmarkPlatform) {
+    private val records = platform.int("KMPSQL_YCSB_RECORDS", 10000).toLong()
+    private val workloads = platform.string("KMPSQL_YCSB_WORKLOADS", "ABCDEF")
+        .mapNotNull { c -> YcsbWorkload.entries.firstOrNull { it.name == c.uppercase() } }
+    private val threadCounts = platform.threads(listOf(1, 4))
+    private val fileName = "kmpsql-ycsb.db"
+    private val passphrase = Passphrase("ycsbKey")
+    private val zetan = ZipfianGenerator.zeta(records)
+    private val fieldValues = List(256) { seed ->
+        val random = Random(seed)
+        CharArray(fieldLength) { 'a' + random.nextInt(26) }.concatToString()
+    }
+    private val inserted = atomic(records)
+    private var loaded = false
+
+    suspend fun run(): BenchmarkOutput {
+        val output = BenchmarkOutput("ycsb", platform)
+        println("YCSB on ${platform.name}, records: $records, duration: ${platform.duration}")
+        println("workload threads     ops/s  operation        count errors   p50 us   p99 us  p999 us")
+        workloads.forEach { workload ->
+            threadCounts.forEach { threads ->
+                if (!loaded)
+                    load()
+                val result = runWorkload(workload, threads)
+                // inserts change the key space, start the next run from the loaded records
+                loaded = workload.insert == 0
+                val seconds = platform.duration.toDouble(DurationUnit.SECONDS)
+                val operations = result.values.sumOf { it.count }
+                val record = output.record()
+                    .add("workload", workload.name)
+                    .add("threads", threads)
+                    .add("records", records)
+                    .add("durationMs", platform.duration.inWholeMilliseconds)
+                    .add("operations", operations)
+                    .add("throughputPerSecond", operations / seconds)
+                var first = true
+                result.filterValues { it.count + it.errors > 0 }.forEach { (operation, latencies) ->
+                    record.add(operation.name.replaceFirstChar { it.lowercase() }, latencies)
+                    val prefix = if (first) "${workload.name.padEnd(8)} ${threads.toString().padStart(7)} " +
+                            (operations / seconds).format(0).padStart(9)
+                        else " ".repeat(26)
+                    println("$prefix  ${operation.name.padEnd(15)} ${latencies.count.toString().padStart(6)} " +
+                            "${latencies.errors.toString().padStart(6)} " +
+                            listOf(0.5, 0.99, 0.999).joinToString(" ") {
+                                (latencies.percentile(it) / 1000.0).format(1).padStart(8)
+                            })
+                    first = false
+                }
+            }
+        }
+        platform.deleteDatabase(fileName)
+        output.write()
+        return output
+    }
+
+    private suspend fun open(): SqlCipherDatabase {
+        val dbPath = platform.databasePath(fileName)
+        return sqlcipher {
+            path = dbPath
+            createOk = true
+            busyTimeout = 10000
+            onOpenPragmas = {
+                it.pragma("journal_mode = WAL") { false }
+                it.pragma("synchronous = NORMAL") { false }
+            }
+        }.also { it.open(passphrase) }
+    }
+
+    /**
+     * Recreates usertable with [records] rows, so every run starts from the same data
+     */
+    private suspend fun load() {
+        platform.deleteDatabase(fileName)
+        val db = open()
+        try {
+            db.execute("create table usertable(ycsb_key TEXT PRIMARY KEY, " +
+                    (0 until fieldCount).joinToString { "field$it TEXT" } + ");")
+            db.transaction {
+                val insert = db.statement(insertSql)
+                for (keyNumber in 0 until records)
+                    insert.execute(insertValues(keyNumber, Random(keyNumber)))
+                insert.close()
+            }
+        } finally {
+            db.close()
+        }
+        inserted.value = records
+        loaded = true
+    }
+
+    private fun nextInsertKey(): Long = inserted.getAndIncrement()
+
+    private fun insertedCount(): Long = inserted.value
+
+    private suspend fun runWorkload(workload: YcsbWorkload, threads: Int): Map<YcsbOperation, Latencies> {
+        val workers = List(threads) { Worker(open(), workload, Random(it)) }
+        val pool = platform.threadPool(threads)
+        try {
+            coroutineScope {
+                workers.map { worker -> async(pool) { worker.run(platform.duration) } }.awaitAll()
+            }
+        } finally {
+            pool.close()
+            workers.forEach { it.close() }
+        }
+        return YcsbOperation.entries.associateWith { operation ->
+            Latencies().also { total -> workers.forEach { total.add(it.latencies.getValue(operation)) } }
+        }
+    }
+
+    private fun key(keyNumber: Long): String = "user${ZipfianGenerator.fnvHash64(keyNumber)}"
+
+    private fun insertValues(keyNumber: Long, random: Random): SqlValues {
+        return SqlValues(SqlValue.StringValue(key(keyNumber))).apply {
+            repeat(fieldCount) { add(SqlValue.StringValue(fieldValues[random.nextInt(fieldValues.size)])) }
+        }
+    }
+
+    private inner class Worker(
+        private val db: SqlCipherDatabase,
+        private val workload: YcsbWorkload,
+        private val random: Random
+    ) {
+        val latencies = YcsbOperation.entries.associateWith { Latencies() }
+        private val zipfian = ZipfianGenerator(records, random, zetan)
+        private lateinit var insert: SqlCipherStatement
+        private lateinit var updates: List<SqlCipherStatement>
+
+        init {
+            prepare()
+        }
+
+        /**
+         * A statement that fails a step is closed by the library, so all are prepared again after
+         * an error. Queries close when their retrieve finishes, so those are prepared per operation.
+         */
+        private fun prepare() {
+            insert = db.statement(insertSql) as SqlCipherStatement
+            updates = List(fieldCount) {
+                db.statement("update usertable set field$it = ? where ycsb_key = ?") as SqlCipherStatement
+            }
+        }
+
+        private fun statements() = listOf(insert) + updates
+
+        suspend fun run(duration: Duration) {
+            val start = TimeSource.Monotonic.markNow()
+            while (start.elapsedNow() < duration) {
+                val operation = workload.operation(random.nextInt(100))
+                val mark = TimeSource.Monotonic.markNow()
+                val ok = try {
+                    perform(operation)
+                } catch (e: SqliteException) {
+                    statements().forEach { it.close() }
+                    prepare()
+                    false
+                }
+                val elapsed = mark.elapsedNow().inWholeNanoseconds
+                latencies.getValue(operation).apply { if (ok) record(elapsed) else error() }
+            }
+        }
+
+        private suspend fun perform(operation: YcsbOperation): Boolean {
+            return when (operation) {
+                YcsbOperation.Read -> read(chooseKey())
+                YcsbOperation.Update -> update(chooseKey())
+                YcsbOperation.Insert -> execute(insert, insertValues(nextInsertKey(), random))
+                YcsbOperation.Scan -> {
+                    var rows = 0
+                    db.query(scanSql).retrieve(SqlValues(
+                        SqlValue.StringValue(chooseKey()),
+                        SqlValue.IntValue(random.nextInt(1, maxScanLength + 1))
+                    )) { _, _ ->
+                        rows++
+                        true
+                    }
+                    rows > 0
+                }
+                YcsbOperation.ReadModifyWrite -> {
+                    val key = chooseKey()
+                    read(key) && update(key)
+                }
+            }
+        }
+
+        private fun chooseKey(): String {
+            val keyNumber = if (workload.latest)
+                (insertedCount() - 1 - zipfian.next()).coerceAtLeast(0)
+            else
+                zipfian.nextScrambled()
+            return key(keyNumber)
+        }
+
+        private suspend fun read(key: String): Boolean {
+            return db.query(readSql).retrieveOne(SqlValues(SqlValue.StringValue(key))) { _, _ -> } == 1
+        }
+
+        private fun update(key: String): Boolean {
+            val value = fieldValues[random.nextInt(fieldValues.size)]
+            return execute(
+                updates[random.nextInt(fieldCount)],
+                SqlValues(SqlValue.StringValue(value), SqlValue.StringValue(key))
+            )
+        }
+
+        /**
+         * execute returns -1 when the step was busy after the busy timeout, the statement is reset
+         * so it can be bound again
+         */
+        private fun execute(statement: SqlCipherStatement, values: SqlValues): Boolean {
+            val rows = statement.execute(values)
+            if (rows < 0)
+                statement.sqliteStatement.reset()
+            return rows >= 0
+        }
+
+        fun close() {
+            db.close()
+        }
+    }
+
+    companion object {
+        const val fieldCount = 10
+        const val fieldLength = 100
+        const val maxScanLength = 100
+        private val insertSql = "insert into usertable values(?${", ?".repeat(fieldCount)})"
+        private const val readSql = "select * from usertable where ycsb_key = ?"
+        private const val scanSql = "select * from usertable where ycsb_key >= ? order by ycsb_key limit ?"
+    }
+}
@@ -23,12 +23,13 @@ class Sqlite3JniShim {
         values: Array<String>,
         columnNames: Array<String>) -> Int)? = null
 
+    private var conflictFun: ((type: Int, table: String, operation: Int) -> Int)? = null
 
     external fun error(): String
 
     external fun fileName(): String
 
-    external fun open(path: String, readOnly: Boolean = false, createOk: Boolean = false): Int
+    external fun open(path: String, readOnly: Boolean = false, createOk: Boolean = false, vfsName: String = ""): Int
 
     external fun close(): Int
 
@@ -50,14 +51,85 @@ class Sqlite3JniShim {
 
     external fun version(): String
 
+    external fun compileOptionUsed(option: String): Boolean
+
     /**
      * Useful after an Insert statement when a ROWID is expected to be generated by Sqlite during
      * the insert
      */
     external fun lastInsertRowid(): Long
 
+    external fun dataVersion(schema: String): Long
+
+    external fun totalChanges(): Long
+
     external fun sleep(millis: Int)
 
+    external fun registerReadaheadVfs(maxPages: Int, makeDefault: Boolean): Int
+
+    external fun readaheadWindow(maxPages: Int): Int
+
+    external fun registerLatencyVfs(vfsName: String, config: LongArray): Int
+
+    external fun registerMetricsVfs(makeDefault: Boolean): Int
+
+    external fun registerTrackingVfs(makeDefault: Boolean): Int
+
+    external fun writeDelta(deltaPath: String, full: Boolean, info: LongArray): Int
+
+    external fun applyDelta(deltaPath: String, targetPath: String, baseEpoch: Long, info: LongArray): Int
+
+    external fun vfsMetrics(vfsName: String): LongArray
+
+    external fun fileMetrics(): LongArray
+
+    external fun memoryStatus(resetHighwater: Boolean): LongArray
+
+    external fun dbStatus(reset: Boolean): LongArray
+
+    external fun applyChangeset(changeset: ByteArray): Int
+
+    external fun applyChangesetFile(path: String): Int
+
+    /**
+     * Ordinals passed to and returned by [conflict] are described in database.cpp conflictCallback
+     */
+    fun applyChangeset(changeset: ByteArray, conflict: (type: Int, table: String, operation: Int) -> Int): Int {
+        conflictFun = conflict
+        val rc = applyChangeset(changeset)
+        conflictFun = null
+        return rc
+    }
+
+    fun applyChangesetFile(path: String, conflict: (type: Int, table: String, operation: Int) -> Int): Int {
+        conflictFun = conflict
+        val rc = applyChangesetFile(path)
+        conflictFun = null
+        return rc
+    }
+
+    external fun invertChangeset(changeset: ByteArray): ByteArray
+
+    external fun combineChangesets(changesets: Array<ByteArray>): ByteArray
+
+    external fun serialize(schema: String): ByteArray
+
+    external fun deserialize(schema: String, image: ByteArray, readOnly: Boolean): Int
+
+    external fun deserializeMapped(schema: String, path: String): Int
+
+    external fun replaceFile(sourcePath: String, targetPath: String): Int
+
+    external fun removeFile(path: String): Int
+
+    external fun snapshotGet(schema: String, snapshot: LongArray): Int
+
+    external fun snapshotOpen(schema: String, snapshot: Long): Int
+
+    external fun snapshotCompare(snapshot: Long, other: Long): Int
+
+    external fun snapshotFree(snapshot: Long)
+
     fun throwError(apiName: String, result: Int, message: String) {
         throw SqliteException(message, apiName, result)
     }
@@ -67,12 +139,19 @@ class Sqlite3JniShim {
         callbackFun?.invoke(values, columnNames)
     }
 
+    fun conflict(type: Int, table: String, operation: Int): Int {
+        return conflictFun?.invoke(type, table, operation) ?: 2
+    }
+
     companion object {
-        @JvmStatic private external fun nativeInit()
+        /**
+         * Loading the library runs its JNI_OnLoad, which registers the natives of all the shim
+         * classes and initializes Sqlite. Each shim class calls this before its first native call.
+         */
+        internal fun loadLibrary() {}
 
         init {
             System.loadLibrary("sqlcipher-kotlin")
-            nativeInit()
         }
     }
 }
@@ -128,6 +207,8 @@ class Sqlite3StatementJniShim {
 
     external fun isBusy(): Boolean
 
+    external fun scanStatus(index: Int, counts: LongArray): String?
+
     external fun columnCount(): Int
 
     external fun dataCount(): Int
@@ -157,10 +238,58 @@ class Sqlite3StatementJniShim {
     }
 
     companion object {
-        @JvmStatic private external fun nativeInit()
+        init {
+            Sqlite3JniShim.loadLibrary()
+        }
+    }
+}
 
+/**
+ * One Sqlite online backup in progress. Database handles are passed in from the Sqlite3JniShim
+ * instances of the destination and source.
+ */
+class Sqlite3BackupJniShim {
+    private var handle: Long = 0  // set by init, cleared by finish
+
+    external fun init(destHandle: Long, sourceHandle: Long): Int
+
+    external fun stepInt(pages: Int): Int
+
+    external fun remaining(): Int
+
+    external fun pageCount(): Int
+
+    external fun finish(): Int
+
+    companion object {
         init {
-            nativeInit()
+            Sqlite3JniShim.loadLibrary()
         }
     }
-}
\ No newline at end of file
+}
+
+/**
+ * One Sqlite session recording changes for a changeset. The database handle is passed in from
+ * the Sqlite3JniShim instance of the connection being recorded.
+ */
+class Sqlite3SessionJniShim {
+    private var handle: Long = 0  // set by create, cleared by delete
+
+    external fun create(dbHandle: Long, schema: String, rowidTables: Boolean): Int
+
+    external fun attach(table: String): Int
+
+    external fun isEmpty(): Boolean
+
+    external fun changeset(patchset: Boolean): ByteArray
+
+    external fun write(path: String, patchset: Boolean): Int
+
+    external fun delete()
+
+    companion object {
+        init {
+            Sqlite3JniShim.loadLibrary()
+        }
+    }
+}
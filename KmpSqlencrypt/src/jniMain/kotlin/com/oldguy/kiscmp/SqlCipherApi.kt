@@ -0,0 +1,372 @@
+package com.oldguy.kiscmp
+
+actual class SqliteDatabase {
+    internal val shim = Sqlite3JniShim()
+    actual var encoding = SqliteEncoding.Utf8
+    actual val notDatabaseResult = 26 // must match SQLITE_NOTADB value
+
+    actual fun error(): String {
+        return shim.error()
+    }
+
+    actual fun fileName(): String {
+        return shim.fileName()
+    }
+
+    actual fun open(
+        path: String,
+        readOnly: Boolean,
+        createOk: Boolean,
+        vfsName: String
+    ): Int {
+        return shim.open(path, readOnly, createOk, vfsName)
+    }
+
+    actual fun close(): Int {
+        return shim.close()
+    }
+
+    actual fun softHeapLimit(limit: Long): Long {
+        return shim.softHeapLimit(limit)
+    }
+
+    actual fun busyTimeout(timeout: Int) {
+        return shim.busyTimeout((timeout))
+    }
+
+    actual fun exec(
+        sql: String,
+        callback: ((values: Array<String>, columnNames: Array<String>) -> Int)?
+    ): Int {
+        return callback?.let {
+            shim.exec(sql, it)
+        } ?: shim.exec(sql)
+    }
+
+    actual fun exec(sql: String): Int {
+        return shim.exec(sql)
+    }
+
+    actual fun version(): String {
+        return shim.version()
+    }
+
+    actual fun compileOptionUsed(option: String): Boolean {
+        return shim.compileOptionUsed(option)
+    }
+
+    /**
+     * Useful after an Insert statement when a ROWID is expected to be generated by Sqlite during
+     * the insert
+     */
+    actual fun lastInsertRowid(): Long {
+        return shim.lastInsertRowid()
+    }
+
+    actual fun dataVersion(schema: String): Long {
+        return shim.dataVersion(schema)
+    }
+
+    actual fun totalChanges(): Long {
+        return shim.totalChanges()
+    }
+
+    actual fun sleep(millis: Int) {
+        shim.sleep(millis)
+    }
+
+    actual fun registerReadaheadVfs(maxPages: Int, makeDefault: Boolean): Int {
+        return shim.registerReadaheadVfs(maxPages, makeDefault)
+    }
+
+    actual fun readaheadWindow(maxPages: Int): Int {
+        return shim.readaheadWindow(maxPages)
+    }
+
+    actual fun registerLatencyVfs(vfsName: String, config: LongArray): Int {
+        return shim.registerLatencyVfs(vfsName, config)
+    }
+
+    actual fun registerMetricsVfs(makeDefault: Boolean): Int {
+        return shim.registerMetricsVfs(makeDefault)
+    }
+
+    actual fun registerTrackingVfs(makeDefault: Boolean): Int {
+        return shim.registerTrackingVfs(makeDefault)
+    }
+
+    actual fun writeDelta(deltaPath: String, full: Boolean, info: LongArray): Int {
+        return shim.writeDelta(deltaPath, full, info)
+    }
+
+    actual fun applyDelta(deltaPath: String, targetPath: String, baseEpoch: Long, info: LongArray): Int {
+        return shim.applyDelta(deltaPath, targetPath, baseEpoch, info)
+    }
+
+    actual fun vfsMetrics(vfsName: String): LongArray {
+        return shim.vfsMetrics(vfsName)
+    }
+
+    actual fun fileMetrics(): LongArray {
+        return shim.fileMetrics()
+    }
+
+    actual fun memoryStatus(resetHighwater: Boolean): LongArray {
+        return shim.memoryStatus(resetHighwater)
+    }
+
+    actual fun dbStatus(reset: Boolean): LongArray {
+        return shim.dbStatus(reset)
+    }
+
+    actual fun serialize(schema: String): ByteArray {
+        return shim.serialize(schema)
+    }
+
+    actual fun deserialize(schema: String, image: ByteArray, readOnly: Boolean): Int {
+        return shim.deserialize(schema, image, readOnly)
+    }
+
+    actual fun deserializeMapped(schema: String, path: String): Int {
+        return shim.deserializeMapped(schema, path)
+    }
+
+    actual fun replaceFile(sourcePath: String, targetPath: String): Int {
+        return shim.replaceFile(sourcePath, targetPath)
+    }
+
+    actual fun removeFile(path: String): Int {
+        return shim.removeFile(path)
+    }
+
+    actual fun snapshotGet(schema: String, snapshot: LongArray): Int {
+        return shim.snapshotGet(schema, snapshot)
+    }
+
+    actual fun snapshotOpen(schema: String, snapshot: Long): Int {
+        return shim.snapshotOpen(schema, snapshot)
+    }
+
+    actual fun snapshotCompare(snapshot: Long, other: Long): Int {
+        return shim.snapshotCompare(snapshot, other)
+    }
+
+    actual fun snapshotFree(snapshot: Long) {
+        shim.snapshotFree(snapshot)
+    }
+
+    actual fun applyChangeset(changeset: ByteArray, conflict: ChangesetConflictHandler): Int {
+        return shim.applyChangeset(changeset) { type, table, operation ->
+            conflict(ChangesetConflictType.entries[type], table, ChangeOperation.entries[operation]).ordinal
+        }
+    }
+
+    actual fun applyChangesetFile(path: String, conflict: ChangesetConflictHandler): Int {
+        return shim.applyChangesetFile(path) { type, table, operation ->
+            conflict(ChangesetConflictType.entries[type], table, ChangeOperation.entries[operation]).ordinal
+        }
+    }
+
+    actual fun invertChangeset(changeset: ByteArray): ByteArray {
+        return shim.invertChangeset(changeset)
+    }
+
+    actual fun combineChangesets(changesets: List<ByteArray>): ByteArray {
+        return shim.combineChangesets(changesets.toTypedArray())
+    }
+}
+
+actual class SqliteStatement actual constructor(val db: SqliteDatabase) {
+    private val shim = Sqlite3StatementJniShim()
+
+    actual fun parameterCount(): Int {
+        return shim.parameterCount()
+    }
+
+    actual fun isReadOnly(): Boolean {
+        return shim.isReadOnly()
+    }
+
+    actual fun prepare(sql: String): Int {
+        return shim.prepare(db.shim.handle, sql)
+    }
+
+    actual fun bindIndex(name: String): Int {
+        return shim.bindIndex(name)
+    }
+
+    actual fun bindNull(index: Int): Int {
+        return shim.bindNull(index)
+    }
+
+    actual fun bindText(index: Int, text: String): Int {
+        return shim.bindText(index, text)
+    }
+
+    actual fun bindInt(index: Int, value: Int): Int {
+        return shim.bindInt(index, value)
+    }
+
+    actual fun bindLong(index: Int, value: Long): Int {
+        return shim.bindLong(index, value)
+    }
+
+    actual fun bindDouble(index: Int, value: Double): Int {
+        return shim.bindDouble(index, value)
+    }
+
+    actual fun bindBytes(index: Int, array: ByteArray): Int {
+        return shim.bindBytes(index, array)
+    }
+
+    actual fun step(): SqliteStepResult {
+        val rc = shim.stepInt()
+        return when (rc) {
+            1 -> SqliteStepResult.Error
+            2 -> SqliteStepResult.Done
+            3 -> SqliteStepResult.Row
+            4 -> SqliteStepResult.Busy
+            else -> throw SqliteException("Unsupported return from StepInt(): $rc")
+        }
+    }
+
+    actual fun changes(): Int {
+        return shim.changes(db.shim.handle)
+    }
+
+    actual fun finalize(): Int {
+        return shim.finalize()
+    }
+
+    actual fun clearBindings() {
+        shim.clearBindings()
+    }
+
+    actual fun reset() {
+        shim.reset()
+    }
+
+    /**
+     * The following functions are only useful when preparing and running a select statement.
+     */
+    actual fun expandedSql(): String {
+        return shim.expandedSql()
+    }
+
+    actual fun isBusy(): Boolean {
+        return shim.isBusy()
+    }
+
+    actual fun scanStatus(index: Int, counts: LongArray): String? {
+        return shim.scanStatus(index, counts)
+    }
+
+    actual fun columnCount(): Int {
+        return shim.columnCount()
+    }
+
+    actual fun dataCount(): Int {
+        return shim.dataCount()
+    }
+
+    actual fun columnName(index: Int): String {
+        return shim.columnName(index)
+    }
+
+    actual fun columnDeclaredType(index: Int): String {
+        return shim.columnDeclaredType(index)
+    }
+
+    actual fun columnType(index: Int): SqliteColumnType {
+        val rc = shim.columnTypeInt(index)
+        return when (rc) {
+            1 -> SqliteColumnType.Null
+            2 -> SqliteColumnType.Text
+            3 -> SqliteColumnType.Integer
+            4 -> SqliteColumnType.Float
+            5 -> SqliteColumnType.Blob
+            else -> throw SqliteException("Unsupported return from columnTypeInt($index): $rc")
+        }
+    }
+
+    actual fun columnText(index: Int): String {
+        return shim.columnText(index)
+    }
+
+    actual fun columnBlob(index: Int): ByteArray {
+        return shim.columnBlob(index)
+    }
+
+    actual fun columnDouble(index: Int): Double {
+        return shim.columnDouble(index)
+    }
+
+    actual fun columnInt(index: Int): Int {
+        return shim.columnInt(index)
+    }
+
+    actual fun columnLong(index: Int): Long {
+        return shim.columnLong(index)
+    }
+}
+
+actual class SqliteBackup actual constructor(
+    private val destination: SqliteDatabase,
+    private val source: SqliteDatabase
+) {
+    private val shim = Sqlite3BackupJniShim()
+
+    actual fun init(): Int {
+        return shim.init(destination.shim.handle, source.shim.handle)
+    }
+
+    actual fun step(pages: Int): SqliteBackupResult {
+        return when (shim.stepInt(pages)) {
+            2 -> SqliteBackupResult.Done
+            3 -> SqliteBackupResult.Ok
+            4 -> SqliteBackupResult.Busy
+            5 -> SqliteBackupResult.Locked
+            else -> SqliteBackupResult.Error
+        }
+    }
+
+    actual fun remaining(): Int {
+        return shim.remaining()
+    }
+
+    actual fun pageCount(): Int {
+        return shim.pageCount()
+    }
+
+    actual fun finish(): Int {
+        return shim.finish()
+    }
+}
+
+actual class SqliteSession actual constructor(private val db: SqliteDatabase) {
+    private val shim = Sqlite3SessionJniShim()
+
+    actual fun create(schema: String, rowidTables: Boolean): Int {
+        return shim.create(db.shim.handle, schema, rowidTables)
+    }
+
+    actual fun attach(table: String): Int {
+        return shim.attach(table)
+    }
+
+    actual fun isEmpty(): Boolean {
+        return shim.isEmpty()
+    }
+
+    actual fun changeset(patchset: Boolean): ByteArray {
+        return shim.changeset(patchset)
+    }
+
+    actual fun write(path: String, patchset: Boolean): Int {
+        return shim.write(path, patchset)
+    }
+
+    actual fun delete() {
+        shim.delete()
+    }
+}
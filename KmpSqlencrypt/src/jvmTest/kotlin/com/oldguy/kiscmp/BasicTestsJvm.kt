@@ -0,0 +1,186 @@
+package com.oldguy.kiscmp
+
+import com.oldguy.database.SqlValue
+import kotlinx.coroutines.ExperimentalCoroutinesApi
+import kotlinx.coroutines.runBlocking
+import kotlinx.coroutines.test.runTest
+import kotlin.test.Test
+import kotlin.test.assertEquals
+
+@ExperimentalCoroutinesApi
+class BasicTestsJvm: SqlCipherTests() {
+
+    /**
+     * Run all unencrypted basic tests on UTF-8 encoded in-memory DB
+     */
+    @ExperimentalStdlibApi
+    @Test
+    fun testOpenClose() {
+        db = createDb
+        if (mapBooleanYN)
+            SqlValue.BooleanValue.mapping("N", "Y")
+        runTest {
+            db.use("") {
+                allTests()
+            }
+        }
+    }
+
+    /**
+     * Run all unencrypted basic tests on UTF-16 big endian encoded in-memory DB
+     */
+    @Test
+    fun testOpenCloseUtf16be() {
+        db = createDb16BE
+        if (mapBooleanYN)
+            SqlValue.BooleanValue.mapping("N", "Y")
+        runTest {
+            db.use("") {
+                assertEquals(SqliteEncoding.Utf16BigEndian, db.queryEncoding())
+                allTests()
+            }
+        }
+    }
+
+    /**
+     * Run all unencrypted basic tests on UTF-16 little endian encoded in-memory DB
+     */
+    @Test
+    fun testOpenCloseUtf16le() {
+        db = createDb16LE
+        if (mapBooleanYN)
+            SqlValue.BooleanValue.mapping("N", "Y")
+        runTest {
+            db.use("") {
+                assertEquals(SqliteEncoding.Utf16LittleEndian, db.queryEncoding())
+                allTests()
+            }
+        }
+    }
+
+    @Test
+    fun testEncryption1() {
+        runBlocking {
+            testPasswordsAndUpgrade("/tmp")
+        }
+    }
+
+    @Test
+    fun testReadaheadVfs() {
+        runBlocking {
+            testReadahead("/tmp")
+        }
+    }
+
+    @Test
+    fun testLatencyVfs() {
+        runBlocking {
+            testLatency("/tmp")
+        }
+    }
+
+    @Test
+    fun testBackupTo() {
+        runBlocking {
+            testBackup("/tmp")
+        }
+    }
+
+    @Test
+    fun testIncrementalBackup() {
+        runBlocking {
+            testBackupChanges("/tmp")
+        }
+    }
+
+    @Test
+    fun testMmapSize() {
+        runBlocking {
+            testMmap("/tmp")
+        }
+    }
+
+    @Test
+    fun testSerializeImages() {
+        runBlocking {
+            testSerialize("/tmp")
+        }
+    }
+
+    @Test
+    fun testSessionChangeCapture() {
+        runBlocking {
+            testChangeCapture("/tmp")
+        }
+    }
+
+    @Test
+    fun testChangesetApply() {
+        runBlocking {
+            testApplyChanges("/tmp")
+        }
+    }
+
+    @Test
+    fun testWalCheckpoints() {
+        runBlocking {
+            testWalCheckpointer("/tmp")
+        }
+    }
+
+    @Test
+    fun testOnlineCompaction() {
+        runBlocking {
+            testCompact("/tmp")
+        }
+    }
+
+    @Test
+    fun testIncrementalVacuumScheduler() {
+        runBlocking {
+            testIncrementalVacuum("/tmp")
+        }
+    }
+
+    @Test
+    fun testOptimizeMaintenance() {
+        runBlocking {
+            testOptimize("/tmp")
+        }
+    }
+
+    @Test
+    fun testQueryPlanRegressions() {
+        runBlocking {
+            testQueryPlans("/tmp")
+        }
+    }
+
+    @Test
+    fun testMemoryCounters() {
+        runBlocking {
+            testMemoryStatus("/tmp")
+        }
+    }
+
+    @Test
+    fun testReadSnapshots() {
+        runBlocking {
+            testSnapshots("/tmp")
+        }
+    }
+
+    @Test
+    fun testChangeTokenDetection() {
+        runBlocking {
+            testChangeTokens("/tmp")
+        }
+    }
+
+    @Test
+    fun testSharedMemoryReads() {
+        runBlocking {
+            testSharedMemory()
+        }
+    }
+}
@@ -64,4 +64,123 @@ class BasicTestsLinux: SqlCipherTests() {
             testPasswordsAndUpgrade("/tmp")
         }
     }
-}
\ No newline at end of file
+
+    @Test
+    fun testReadaheadVfs() {
+        runBlocking {
+            testReadahead("/tmp")
+        }
+    }
+
+    @Test
+    fun testLatencyVfs() {
+        runBlocking {
+            testLatency("/tmp")
+        }
+    }
+
+    @Test
+    fun testBackupTo() {
+        runBlocking {
+            testBackup("/tmp")
+        }
+    }
+
+    @Test
+    fun testIncrementalBackup() {
+        runBlocking {
+            testBackupChanges("/tmp")
+        }
+    }
+
+    @Test
+    fun testMmapSize() {
+        runBlocking {
+            testMmap("/tmp")
+        }
+    }
+
+    @Test
+    fun testSerializeImages() {
+        runBlocking {
+            testSerialize("/tmp")
+        }
+    }
+
+    @Test
+    fun testSessionChangeCapture() {
+        runBlocking {
+            testChangeCapture("/tmp")
+        }
+    }
+
+    @Test
+    fun testChangesetApply() {
+        runBlocking {
+            testApplyChanges("/tmp")
+        }
+    }
+
+    @Test
+    fun testWalCheckpoints() {
+        runBlocking {
+            testWalCheckpointer("/tmp")
+        }
+    }
+
+    @Test
+    fun testOnlineCompaction() {
+        runBlocking {
+            testCompact("/tmp")
+        }
+    }
+
+    @Test
+    fun testIncrementalVacuumScheduler() {
+        runBlocking {
+            testIncrementalVacuum("/tmp")
+        }
+    }
+
+    @Test
+    fun testOptimizeMaintenance() {
+        runBlocking {
+            testOptimize("/tmp")
+        }
+    }
+
+    @Test
+    fun testQueryPlanRegressions() {
+        runBlocking {
+            testQueryPlans("/tmp")
+        }
+    }
+
+    @Test
+    fun testMemoryCounters() {
+        runBlocking {
+            testMemoryStatus("/tmp")
+        }
+    }
+
+    @Test
+    fun testReadSnapshots() {
+        runBlocking {
+            testSnapshots("/tmp")
+        }
+    }
+
+    @Test
+    fun testChangeTokenDetection() {
+        runBlocking {
+            testChangeTokens("/tmp")
+        }
+    }
+
+    @Test
+    fun testSharedMemoryReads() {
+        runBlocking {
+            testSharedMemory()
+        }
+    }
+}
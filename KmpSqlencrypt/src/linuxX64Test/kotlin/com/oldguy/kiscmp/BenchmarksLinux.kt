@@ -0,0 +1,108 @@
+package com.oldguy.kiscmp
+
+import com.oldguy.kiscmp.benchmark.BenchmarkPlatform
+import com.oldguy.kiscmp.benchmark.CipherMatrixBenchmark
+import com.oldguy.kiscmp.benchmark.MemoryFootprintBenchmark
+import com.oldguy.kiscmp.benchmark.ParityBenchmark
+import com.oldguy.kiscmp.benchmark.QueryPlanRegression
+import com.oldguy.kiscmp.benchmark.ScalingBenchmark
+import com.oldguy.kiscmp.benchmark.SharedMemoryBenchmark
+import com.oldguy.kiscmp.benchmark.YcsbBenchmark
+import kotlinx.cinterop.ExperimentalForeignApi
+import kotlinx.cinterop.toKString
+import kotlinx.coroutines.DelicateCoroutinesApi
+import kotlinx.coroutines.newFixedThreadPoolContext
+import kotlinx.coroutines.runBlocking
+import platform.posix.getenv
+import kotlin.test.Test
+import kotlin.test.assertTrue
+
+/**
+ * Runs the common benchmarks natively. Settings are environment variables, see [BenchmarkPlatform].
+ * Gradle only runs them when KMPSQL_BENCH is set.
+ */
+@OptIn(ExperimentalForeignApi::class, DelicateCoroutinesApi::class)
+class BenchmarksLinux {
+    private val platform = BenchmarkPlatform(
+        "linuxX64",
+        { getenv(it)?.toKString() },
+        { newFixedThreadPoolContext(it, "benchmark") }
+    )
+
+    @Test
+    fun testYcsb() {
+        runBlocking {
+            YcsbBenchmark(platform).run().records.forEach {
+                assertTrue((it["operations"] as Int) > 0, "ycsb ${it["workload"]} threads: ${it["threads"]}")
+            }
+        }
+    }
+
+    @Test
+    fun testCipherMatrix() {
+        runBlocking {
+            CipherMatrixBenchmark(platform).run().records.forEach {
+                assertTrue((it["readCount"] as Int) > 0, "cipher settings ${it["settings"]}")
+            }
+        }
+    }
+
+    @Test
+    fun testParity() {
+        runBlocking {
+            ParityBenchmark(platform).run().records.forEach {
+                assertTrue((it["nanosPerUnit"] as Double) > 0.0, "parity ${it["operation"]}")
+            }
+        }
+    }
+
+    /**
+     * A shared instance may flag interleaved transactions, separate instances must not
+     */
+    @Test
+    fun testScaling() {
+        runBlocking {
+            ScalingBenchmark(platform).run().records.forEach {
+                val run = "scaling ${it["mode"]} ${it["workload"]} threads: ${it["threads"]}"
+                assertTrue((it["operations"] as Int) > 0, run)
+                if (it["mode"] == "Separate")
+                    assertTrue((it["flags"] as String).isEmpty(), "$run ${it["flags"]}")
+            }
+        }
+    }
+
+    @Test
+    fun testSharedMemoryReads() {
+        runBlocking {
+            SharedMemoryBenchmark(platform).run().records.forEach {
+                assertTrue((it["minPerReader"] as Long) > 0, "shared memory readers: ${it["readers"]}")
+            }
+        }
+    }
+
+    /**
+     * Fails on a seek becoming a scan or a new temporary B-tree compared with the checked in
+     * golden file, or if that file is missing and KMPSQL_PLAN_UPDATE=true is not set
+     */
+    @Test
+    fun testQueryPlanRegression() {
+        runBlocking {
+            val result = QueryPlanRegression(platform).run()
+            assertTrue(result.failures.isEmpty(), result.failures.joinToString("\n"))
+        }
+    }
+
+    /**
+     * Every phase of every round is recorded
+     */
+    @Test
+    fun testMemoryFootprint() {
+        runBlocking {
+            val records = MemoryFootprintBenchmark(platform).run().records
+            assertTrue(records.size % 4 == 0 && records.isNotEmpty(), "memory records: ${records.size}")
+            records.forEach {
+                assertTrue((it["durationMs"] as Double) >= 0.0, "memory ${it["phase"]} round ${it["round"]}")
+            }
+        }
+    }
+}
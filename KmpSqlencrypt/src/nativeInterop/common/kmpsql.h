@@ -0,0 +1,258 @@
+#ifndef KMPSQL_H
+#define KMPSQL_H
+
+#include "sqlite3.h"
+
+/**
+ * Small C layer shared by the JNI shim (androidMain/cpp/database.cpp) and the cinterop bindings of
+ * every Kotlin/Native target. It only holds the pieces that can not be done from kotlin through the
+ * public Sqlite api, like VFS implementations. Same strategy as the JNI shim - keep the logic here
+ * to a minimum, and only pass basic types back and forth.
+ *
+ * Everything is plain C so the same source compiles into the JVM shared library (see CMakeLists.txt)
+ * and into the cinterop klib (see the inline section of each Sqlcipher.def).
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Name of the VFS registered by kmpsql_readahead_register. Wraps the default VFS (or the one named
+ * at registration), and prefetches upcoming pages of the main database file when it detects
+ * sequential page reads.
+ */
+#define KMPSQL_READAHEAD_VFS "kmpsql-readahead"
+
+/*
+ * Name of the VFS registered by kmpsql_metrics_register. Adds nothing but the metrics below, for
+ * databases that only need the read and memory mapped page counts.
+ */
+#define KMPSQL_METRICS_VFS "kmpsql-metrics"
+
+/*
+ * Name of the VFS registered by kmpsql_tracking_register. Records which pages of each main
+ * database file are written, so kmpsql_delta_write can copy only the pages changed since the
+ * previous delta. The set of changed pages is kept in a sidecar file next to the database, named
+ * as the database path plus KMPSQL_TRACKING_SUFFIX.
+ *
+ * The process tracking a database keeps the sidecar write locked, so a second process opening it
+ * through the tracking VFS fails with SQLITE_BUSY. Writes that bypass the VFS are detected from
+ * the database header and the file time and size, and make the next delta full; in WAL mode a
+ * write that leaves page 1 unchanged can go unnoticed on file systems with coarse timestamps.
+ * The sidecar is saved at checkpoints, deltas and the last close. In rollback journal mode it is
+ * only marked unsaved before the first commit that follows a save, so the commit path does not
+ * pay a second sync, and a crash makes the next delta full.
+ */
+#define KMPSQL_TRACKING_VFS "kmpsql-tracking"
+#define KMPSQL_TRACKING_SUFFIX "-kmptrack"
+
+/*
+ * Custom file control opcode understood by files opened through any kmpsql VFS. The argument is
+ * a sqlite3_int64 array of KMPSQL_METRIC_COUNT entries that receives the per-file metrics.
+ */
+#define KMPSQL_FCNTL_METRICS 0x4b4d5101
+
+/*
+ * Custom file control opcode that reads and changes the readahead window of one file. The
+ * argument is an int holding the new largest window in pages, or a negative value to only read
+ * it. It receives the previous value.
+ */
+#define KMPSQL_FCNTL_READAHEAD 0x4b4d5102
+
+/*
+ * Indexes into the metrics arrays returned by kmpsql_vfs_metrics and kmpsql_vfs_file_metrics.
+ */
+#define KMPSQL_METRIC_READS           0   /* xRead calls on main database files */
+#define KMPSQL_METRIC_BUFFER_HITS     1   /* reads satisfied from the readahead buffer */
+#define KMPSQL_METRIC_PREFETCHES      2   /* readahead reads issued to the wrapped VFS */
+#define KMPSQL_METRIC_PREFETCH_BYTES  3   /* bytes read by those prefetches */
+#define KMPSQL_METRIC_WINDOW_PAGES    4   /* current (file) or most recent (vfs) window in pages */
+#define KMPSQL_METRIC_INJECTED_MICROS 5   /* delay added by a latency VFS, all file types */
+#define KMPSQL_METRIC_FETCHES         6   /* pages of main database files served by memory mapping */
+#define KMPSQL_METRIC_COUNT           7
+
+/*
+ * Indexes into the configuration array of kmpsql_latency_register. Missing trailing entries are
+ * treated as zero.
+ */
+#define KMPSQL_LATENCY_READ_MICROS    0   /* mean delay added to each xRead */
+#define KMPSQL_LATENCY_WRITE_MICROS   1   /* mean delay added to each xWrite */
+#define KMPSQL_LATENCY_SYNC_MICROS    2   /* mean delay added to each xSync */
+#define KMPSQL_LATENCY_DISTRIBUTION   3   /* one of the KMPSQL_DISTRIBUTION values */
+#define KMPSQL_LATENCY_READ_BPS       4   /* read throughput cap in bytes per second, 0 unlimited */
+#define KMPSQL_LATENCY_WRITE_BPS      5   /* write throughput cap in bytes per second, 0 unlimited */
+#define KMPSQL_LATENCY_STALL_PERCENT  6   /* chance in percent that a call also stalls */
+#define KMPSQL_LATENCY_STALL_MICROS   7   /* length of a stall */
+#define KMPSQL_LATENCY_COUNT          8
+
+#define KMPSQL_DISTRIBUTION_FIXED       0   /* always the mean */
+#define KMPSQL_DISTRIBUTION_UNIFORM     1   /* uniform between zero and twice the mean */
+#define KMPSQL_DISTRIBUTION_EXPONENTIAL 2   /* exponential with the given mean */
+
+/*
+ * Indexes into the info arrays of kmpsql_delta_write and kmpsql_delta_apply.
+ */
+#define KMPSQL_DELTA_EPOCH       0   /* epoch the database is at once the delta is applied */
+#define KMPSQL_DELTA_BASE_EPOCH  1   /* epoch the delta must be applied to, unused for full deltas */
+#define KMPSQL_DELTA_PAGES       2   /* pages stored in the delta */
+#define KMPSQL_DELTA_PAGE_COUNT  3   /* database size in pages */
+#define KMPSQL_DELTA_PAGE_SIZE   4
+#define KMPSQL_DELTA_FULL        5   /* 1 if the delta holds every page and needs no base */
+#define KMPSQL_DELTA_COUNT       6
+
+/*
+ * Registers the readahead VFS, or changes its configuration if already registered. maxPages is
+ * only the window files get when they are opened, and applies to every later open in the process.
+ * Use kmpsql_readahead_file to give one file its own window.
+ * @param zBaseVfs name of the VFS to wrap, NULL for the current default VFS
+ * @param maxPages largest prefetch window in pages. Values < 2 disable prefetching.
+ * @param makeDefault non-zero to make the readahead VFS the default VFS
+ * @return SQLITE_OK or an error code
+ */
+int kmpsql_readahead_register(const char *zBaseVfs, int maxPages, int makeDefault);
+
+/*
+ * Sets the largest readahead window of the database file behind the schema ("main" if NULL) of
+ * db, without changing any other file.
+ * @param maxPages largest prefetch window in pages, values < 2 disable prefetching for this file.
+ * Negative to only read the current value.
+ * @return the previous window, or -1 if the file was not opened through a kmpsql VFS
+ */
+int kmpsql_readahead_file(sqlite3 *db, const char *zSchema, int maxPages);
+
+/*
+ * Registers the metrics VFS.
+ * @param zBaseVfs name of the VFS to wrap, NULL for the current default VFS
+ * @param makeDefault non-zero to make the metrics VFS the default VFS
+ * @return SQLITE_OK or an error code
+ */
+int kmpsql_metrics_register(const char *zBaseVfs, int makeDefault);
+
+/*
+ * Registers a VFS that delays reads, writes and syncs of every file it opens, to simulate slow
+ * storage for testing. Calling again with the same name changes the configuration.
+ * @param zName name to register, used as the VFS name at open
+ * @param zBaseVfs name of the VFS to wrap, NULL for the current default VFS
+ * @param aConfig configuration values indexed by the KMPSQL_LATENCY values
+ * @param nConfig number of entries in aConfig
+ * @return SQLITE_OK or an error code
+ */
+int kmpsql_latency_register(const char *zName, const char *zBaseVfs, const sqlite3_int64 *aConfig, int nConfig);
+
+/*
+ * Registers the change tracking VFS.
+ * @param zBaseVfs name of the VFS to wrap, NULL for the current default VFS
+ * @param makeDefault non-zero to make the tracking VFS the default VFS
+ * @return SQLITE_OK or an error code
+ */
+int kmpsql_tracking_register(const char *zBaseVfs, int makeDefault);
+
+/*
+ * Drops the change tracking state of a database path whose file was replaced while open.
+ * Connections still open on the old file keep working, but their sidecar is no longer saved, and
+ * the next connection to the path starts a new state whose first delta is full. Does nothing if
+ * the path is not tracked.
+ */
+void kmpsql_tracking_forget(const char *zPath);
+
+/*
+ * Writes the pages of the main database of db changed since the previous delta into a new delta
+ * file, and starts a new epoch. Pages are copied as stored in the file, so an encrypted database
+ * stays encrypted. The database must have been opened with the tracking VFS. The first delta
+ * written after tracking starts, or when the sidecar file was lost, is always full.
+ *
+ * A checkpoint is run first in WAL mode, then the copy is made inside a write transaction so the
+ * file is consistent. Fails with SQLITE_BUSY if other connections prevent the WAL from being
+ * emptied.
+ * @param full non-zero to copy every page regardless of changes
+ * @param aInfo receives up to nInfo values indexed by the KMPSQL_DELTA values, may be NULL
+ * @return SQLITE_OK, SQLITE_NOTFOUND if db was not opened with the tracking VFS, or an error code
+ */
+int kmpsql_delta_write(sqlite3 *db, const char *zDeltaPath, int full, sqlite3_int64 *aInfo, int nInfo);
+
+/*
+ * Applies a delta file to a copy of the database. A full delta replaces the target, otherwise the
+ * target must be at the base epoch of the delta. The target must not be open.
+ *
+ * The delta size and checksum are verified, and the pages are written to "<target>.tmp", a copy of
+ * the target for an incremental delta, which then replaces the target with kmpsql_file_replace.
+ * A truncated or corrupt delta, or a failure part way, leaves the target unchanged.
+ * @param iBaseEpoch epoch the target is currently at, or -1 if it has no content yet
+ * @param aInfo receives up to nInfo values indexed by the KMPSQL_DELTA values, may be NULL
+ * @return SQLITE_OK, SQLITE_MISMATCH if the delta does not apply to iBaseEpoch, SQLITE_CORRUPT
+ * for an invalid delta file, or an error code
+ */
+int kmpsql_delta_apply(const char *zDeltaPath, const char *zTargetPath, sqlite3_int64 iBaseEpoch,
+                       sqlite3_int64 *aInfo, int nInfo);
+
+/*
+ * Replaces the content of a schema of db with a read-only, memory mapped database image file,
+ * without copying it. The mapping is released when db is closed, or when the schema is replaced
+ * by another deserialize. The file must not be changed while mapped. For an encrypted image, key
+ * the schema after this call.
+ * @param zSchema schema to replace, "main" if NULL
+ * @param zPath image file, any database file or the result of sqlite3_serialize
+ * @return SQLITE_OK, SQLITE_CANTOPEN if the file can not be mapped, or an error code
+ */
+int kmpsql_deserialize_mapped(sqlite3 *db, const char *zSchema, const char *zPath);
+
+/*
+ * Atomically replaces a database file with another one, for example a VACUUM INTO copy. The source
+ * is synced, leftover -wal, -shm, -journal and change tracking sidecar files of the target are
+ * removed, then the source is renamed over the target and the directory is synced.
+ *
+ * The target may be open on at most one connection, of the caller, which must hold the exclusive
+ * lock on it (in WAL mode with locking_mode EXCLUSIVE), make no further writes, and be closed
+ * right after. Its files are removed while open, so closing it only touches the replaced file,
+ * and the tracking VFS does not save the sidecar for it, see kmpsql_tracking_forget. Any other
+ * open connection keeps using the replaced file.
+ * @return SQLITE_OK, SQLITE_CANTOPEN if the source does not exist, or an I/O error code
+ */
+int kmpsql_file_replace(const char *zSource, const char *zTarget);
+
+/*
+ * Deletes a database file along with its -wal, -shm, -journal and change tracking sidecar files.
+ * Files that do not exist are ignored. No connection may have the database open.
+ * @return SQLITE_OK or SQLITE_IOERR_DELETE
+ */
+int kmpsql_file_remove(const char *zPath);
+
+#ifdef SQLITE_ENABLE_SESSION
+/*
+ * Streams the changeset, or the smaller patchset, recorded by a session into a new file, without
+ * holding the whole set in memory. Requires a build with SQLITE_ENABLE_SESSION.
+ * @param patchset non-zero to write a patchset instead of a changeset
+ * @return SQLITE_OK, SQLITE_CANTOPEN if the file can not be created, or an error code
+ */
+int kmpsql_session_write(sqlite3_session *pSession, const char *zPath, int patchset);
+
+/*
+ * Applies a changeset or patchset file written by kmpsql_session_write to db, streaming it with
+ * sqlite3changeset_apply_v2_strm. The whole file is applied in one savepoint, so it is rolled
+ * back if xConflict returns SQLITE_CHANGESET_ABORT.
+ * @param xConflict called once per conflict, as for sqlite3changeset_apply_v2
+ * @return SQLITE_OK, SQLITE_CANTOPEN if the file can not be read, SQLITE_ABORT if aborted by
+ * xConflict, or an error code
+ */
+int kmpsql_changeset_apply_file(sqlite3 *db, const char *zPath,
+                                int (*xConflict)(void *, int, sqlite3_changeset_iter *), void *pCtx);
+#endif
+
+/*
+ * Copies up to nOut metrics summed over every file opened through the named kmpsql VFS.
+ * @return SQLITE_OK, or SQLITE_NOTFOUND if zVfs is not a registered kmpsql VFS
+ */
+int kmpsql_vfs_metrics(const char *zVfs, sqlite3_int64 *aOut, int nOut);
+
+/*
+ * Copies up to nOut metrics of the database file behind the schema ("main" if NULL) of db.
+ * @return SQLITE_OK, or SQLITE_NOTFOUND if the file was not opened through a kmpsql VFS
+ */
+int kmpsql_vfs_file_metrics(sqlite3 *db, const char *zSchema, sqlite3_int64 *aOut, int nOut);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KMPSQL_H */
@@ -0,0 +1,124 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "kmpsql.h"
+
+/**
+ * Database images mapped into memory, used in place by the Sqlite memdb VFS through
+ * sqlite3_deserialize. Each mapping is owned by its connection as client data, keyed by schema
+ * name, so Sqlite releases it at close.
+ */
+
+#define KMP_IMAGE_KEY "kmpsql-image-"
+
+typedef struct KmpImage {
+    void *pMap;
+    size_t nMap;
+} KmpImage;
+
+static void kmpImageFree(void *pArg) {
+    KmpImage *pImage = (KmpImage *) pArg;
+    munmap(pImage->pMap, pImage->nMap);
+    sqlite3_free(pImage);
+}
+
+int kmpsql_deserialize_mapped(sqlite3 *db, const char *zSchema, const char *zPath) {
+    struct stat st;
+    KmpImage *pImage;
+    char *zKey;
+    void *pMap;
+    int fd;
+    int rc;
+
+    if (zSchema == NULL) zSchema = "main";
+    fd = open(zPath, O_RDONLY);
+    if (fd < 0) return SQLITE_CANTOPEN;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return SQLITE_CANTOPEN;
+    }
+    pMap = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (pMap == MAP_FAILED) return SQLITE_CANTOPEN;
+    pImage = sqlite3_malloc(sizeof(KmpImage));
+    zKey = sqlite3_mprintf("%s%s", KMP_IMAGE_KEY, zSchema);
+    if (pImage == NULL || zKey == NULL) {
+        munmap(pMap, (size_t) st.st_size);
+        sqlite3_free(pImage);
+        sqlite3_free(zKey);
+        return SQLITE_NOMEM;
+    }
+    pImage->pMap = pMap;
+    pImage->nMap = (size_t) st.st_size;
+    rc = sqlite3_deserialize(db, zSchema, (unsigned char *) pMap, st.st_size, st.st_size,
+                             SQLITE_DESERIALIZE_READONLY);
+    if (rc == SQLITE_OK) {
+        /* replaces, and so unmaps, any image previously mapped for this schema */
+        rc = sqlite3_set_clientdata(db, zKey, pImage, kmpImageFree);
+    } else {
+        kmpImageFree(pImage);
+    }
+    sqlite3_free(zKey);
+    return rc;
+}
+
+static int kmpSyncPath(const char *zPath, int flags) {
+    int fd = open(zPath, flags);
+    int rc;
+    if (fd < 0) return -1;
+    rc = fsync(fd);
+    close(fd);
+    return rc;
+}
+
+/* removes the files a database can leave next to it, not the database itself */
+static int kmpRemoveCompanions(const char *zPath) {
+    static const char *azSuffix[] = {"-wal", "-shm", "-journal", KMPSQL_TRACKING_SUFFIX};
+    char *zName;
+    size_t i;
+
+    for (i = 0; i < sizeof(azSuffix) / sizeof(azSuffix[0]); i++) {
+        zName = sqlite3_mprintf("%s%s", zPath, azSuffix[i]);
+        if (zName == NULL) return SQLITE_NOMEM;
+        if (remove(zName) != 0 && errno != ENOENT) {
+            sqlite3_free(zName);
+            return SQLITE_IOERR_DELETE;
+        }
+        sqlite3_free(zName);
+    }
+    return SQLITE_OK;
+}
+
+int kmpsql_file_remove(const char *zPath) {
+    int rc = kmpRemoveCompanions(zPath);
+    if (rc == SQLITE_OK && remove(zPath) != 0 && errno != ENOENT) rc = SQLITE_IOERR_DELETE;
+    return rc;
+}
+
+int kmpsql_file_replace(const char *zSource, const char *zTarget) {
+    const char *zSlash;
+    char *zName;
+    int rc;
+
+    if (access(zSource, F_OK) != 0) return SQLITE_CANTOPEN;
+    if (kmpSyncPath(zSource, O_RDONLY) != 0) return SQLITE_IOERR_FSYNC;
+    rc = kmpRemoveCompanions(zTarget);
+    if (rc != SQLITE_OK) return rc;
+    if (rename(zSource, zTarget) != 0) return SQLITE_IOERR;
+    kmpsql_tracking_forget(zTarget);
+    zSlash = strrchr(zTarget, '/');
+    zName = zSlash == NULL
+            ? sqlite3_mprintf(".")
+            : sqlite3_mprintf("%.*s", (int) (zSlash - zTarget) + (zSlash == zTarget ? 1 : 0), zTarget);
+    if (zName == NULL) return SQLITE_NOMEM;
+    if (kmpSyncPath(zName, O_RDONLY | O_DIRECTORY) != 0) {
+        sqlite3_free(zName);
+        return SQLITE_IOERR_DIR_FSYNC;
+    }
+    sqlite3_free(zName);
+    return SQLITE_OK;
+}
@@ -0,0 +1,49 @@
+#include <stdio.h>
+#include "kmpsql.h"
+
+#ifdef SQLITE_ENABLE_SESSION
+
+/**
+ * File based variants of the session extension streaming apis, so large changesets go straight
+ * between a file and Sqlite instead of through one buffer in kotlin.
+ */
+
+static int kmpFileOutput(void *pOut, const void *pData, int nData) {
+    return fwrite(pData, 1, (size_t) nData, (FILE *) pOut) == (size_t) nData ? SQLITE_OK : SQLITE_IOERR_WRITE;
+}
+
+static int kmpFileInput(void *pIn, void *pData, int *pnData) {
+    size_t nRead = fread(pData, 1, (size_t) *pnData, (FILE *) pIn);
+    if (nRead == 0 && ferror((FILE *) pIn)) return SQLITE_IOERR_READ;
+    *pnData = (int) nRead;
+    return SQLITE_OK;
+}
+
+int kmpsql_session_write(sqlite3_session *pSession, const char *zPath, int patchset) {
+    FILE *pOut;
+    int rc;
+
+    pOut = fopen(zPath, "wb");
+    if (pOut == NULL) return SQLITE_CANTOPEN;
+    if (patchset)
+        rc = sqlite3session_patchset_strm(pSession, kmpFileOutput, pOut);
+    else
+        rc = sqlite3session_changeset_strm(pSession, kmpFileOutput, pOut);
+    if (fclose(pOut) != 0 && rc == SQLITE_OK) rc = SQLITE_IOERR_WRITE;
+    if (rc != SQLITE_OK) remove(zPath);
+    return rc;
+}
+
+int kmpsql_changeset_apply_file(sqlite3 *db, const char *zPath,
+                                int (*xConflict)(void *, int, sqlite3_changeset_iter *), void *pCtx) {
+    FILE *pIn;
+    int rc;
+
+    pIn = fopen(zPath, "rb");
+    if (pIn == NULL) return SQLITE_CANTOPEN;
+    rc = sqlite3changeset_apply_v2_strm(db, kmpFileInput, pIn, NULL, xConflict, pCtx, NULL, NULL, 0);
+    fclose(pIn);
+    return rc;
+}
+
+#endif /* SQLITE_ENABLE_SESSION */
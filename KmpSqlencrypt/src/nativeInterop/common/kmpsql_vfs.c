@@ -0,0 +1,1305 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "kmpsql.h"
+
+/**
+ * Wrapper VFS used by all of the kmpsql VFS features. Each registered instance wraps another VFS
+ * (usually the platform default) and forwards everything to it, adding the behaviour configured
+ * for that instance. Instances are never unregistered or freed, Sqlite requires a VFS to outlive
+ * every connection that uses it.
+ *
+ * SqlCipher encrypts and decrypts pages above the VFS layer, so everything seen here for an
+ * encrypted database is ciphertext. Nothing in this file depends on page contents.
+ */
+
+#define KMP_MAX_NAME 64
+#define KMP_MIN_WINDOW 2
+#define KMP_INITIAL_WINDOW 4
+#define KMP_SEQUENTIAL_TRIGGER 2   /* consecutive sequential reads before prefetching starts */
+#define KMP_DELTA_ATTEMPTS 20      /* tries at getting an empty WAL before a delta gives up */
+
+/*
+ * Change tracking state of one database file, shared by every connection in the process that
+ * opens it through the tracking VFS. Bit n-1 of aBit is set when page n was written since the
+ * last delta.
+ *
+ * Only one process at a time can track a database. The process holds a write lock on the sidecar
+ * file for as long as it has the database open, so the bitmap it keeps in memory is the only one.
+ * Writers that bypass the tracking VFS are caught by comparing the file with what was last written
+ * through it, see headHash and fileStamp. Neither catches everything: a WAL mode writer that
+ * leaves page 1 unchanged, on a file system with timestamps coarser than the time between its
+ * write and one made here, goes unnoticed, so other writers should be avoided, not relied on.
+ */
+typedef struct KmpTrack KmpTrack;
+struct KmpTrack {
+    KmpTrack *pNext;
+    char *zPath;                   /* database path, the sidecar is this plus KMPSQL_TRACKING_SUFFIX */
+    int nRef;
+    int fd;                        /* sidecar file, write locked while open */
+    sqlite3_mutex *pMutex;         /* protects everything below */
+    int pageSize;                  /* learned from page aligned writes, zero until known */
+    int needsFull;                 /* changes may be missing, next delta must be full */
+    int isChanged;                 /* differs from the sidecar file */
+    int isMarked;                  /* sidecar is marked as missing changes made since it was saved */
+    int isReplaced;                /* file was replaced while open, see kmpsql_tracking_forget */
+    sqlite3_uint64 headHash;       /* hash of the database header as last written, 0 if none */
+    sqlite3_uint64 fileStamp;      /* modification time and size after the last write, see kmpTrackStamp */
+    int isStampStale;              /* written since fileStamp was taken */
+    sqlite3_int64 epoch;           /* number of deltas written */
+    unsigned char *aBit;
+    int nBit;                      /* bytes in aBit */
+};
+
+static KmpTrack *kmpTrackList = NULL;  /* protected by the static app2 mutex */
+
+typedef struct KmpVfs {
+    sqlite3_vfs base;              /* registered with Sqlite, must be first */
+    sqlite3_vfs *pReal;            /* the wrapped VFS */
+    char zName[KMP_MAX_NAME];
+    int maxReadahead;              /* window given to files at open, see KMPSQL_FCNTL_READAHEAD */
+    int isTracking;                /* non-zero to track changed pages of main database files */
+    int hasLatency;                /* non-zero if any aLatency value is set */
+    sqlite3_int64 aLatency[KMPSQL_LATENCY_COUNT];
+    sqlite3_mutex *pDeviceMutex;   /* protects the two throughput clocks below */
+    sqlite3_int64 readFreeAt;      /* monotonic time the simulated device finishes queued reads */
+    sqlite3_int64 writeFreeAt;     /* same for writes */
+    sqlite3_int64 aMetric[KMPSQL_METRIC_COUNT];
+} KmpVfs;
+
+typedef struct KmpFile {
+    sqlite3_file base;             /* must be first */
+    KmpVfs *pVfs;
+    sqlite3_file *pReal;           /* allocated by Sqlite directly after this struct */
+    int isMainDb;
+    int eLock;
+    KmpTrack *pTrack;              /* change tracking of a main database, NULL if not tracked */
+
+    /* readahead state, only used for main database files */
+    int maxReadahead;              /* largest prefetch window in pages, < 2 disables readahead */
+    unsigned char *aBuf;
+    int szBuf;                     /* allocated size of aBuf */
+    int nBuf;                      /* valid bytes in aBuf, zero if nothing buffered */
+    int nBufUsed;                  /* bytes of aBuf handed out to Sqlite so far */
+    sqlite3_int64 iBufOfst;        /* file offset of aBuf[0] */
+    sqlite3_int64 iNextOfst;       /* offset that continues the current sequential run */
+    int nSeq;                      /* length of the current sequential run */
+    int nWindow;                   /* current prefetch window in pages */
+    sqlite3_int64 aMetric[KMPSQL_METRIC_COUNT];
+} KmpFile;
+
+static int kmpOpen(sqlite3_vfs *pVfs, sqlite3_filename zName, sqlite3_file *pFile, int flags, int *pOutFlags);
+
+#define REAL_VFS(p) (((KmpVfs *)(p))->pReal)
+#define REAL_FILE(p) (((KmpFile *)(p))->pReal)
+
+static void kmpCount(KmpFile *p, int metric, sqlite3_int64 n) {
+    p->aMetric[metric] += n;
+    __atomic_fetch_add(&p->pVfs->aMetric[metric], n, __ATOMIC_RELAXED);
+}
+
+static void kmpSetWindow(KmpFile *p, int nWindow) {
+    p->nWindow = nWindow;
+    p->aMetric[KMPSQL_METRIC_WINDOW_PAGES] = nWindow;
+    __atomic_store_n(&p->pVfs->aMetric[KMPSQL_METRIC_WINDOW_PAGES], nWindow, __ATOMIC_RELAXED);
+}
+
+static sqlite3_int64 kmpNowMicros(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (sqlite3_int64) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * Returns a random value in the open interval (0, 1)
+ */
+static double kmpRandomUnit(void) {
+    unsigned int r = 0;
+    sqlite3_randomness(sizeof(r), &r);
+    return ((double) r + 0.5) / 4294967296.0;
+}
+
+/*
+ * Per-call delay for one operation, drawn from the configured distribution, plus an occasional
+ * stall.
+ */
+static sqlite3_int64 kmpLatencyMicros(KmpVfs *pVfs, int meanIndex) {
+    sqlite3_int64 mean = __atomic_load_n(&pVfs->aLatency[meanIndex], __ATOMIC_RELAXED);
+    sqlite3_int64 distribution = __atomic_load_n(&pVfs->aLatency[KMPSQL_LATENCY_DISTRIBUTION], __ATOMIC_RELAXED);
+    sqlite3_int64 stallPercent = __atomic_load_n(&pVfs->aLatency[KMPSQL_LATENCY_STALL_PERCENT], __ATOMIC_RELAXED);
+    sqlite3_int64 delay = mean;
+
+    if (mean > 0 && distribution == KMPSQL_DISTRIBUTION_UNIFORM) {
+        delay = (sqlite3_int64) (2.0 * (double) mean * kmpRandomUnit());
+    } else if (mean > 0 && distribution == KMPSQL_DISTRIBUTION_EXPONENTIAL) {
+        delay = (sqlite3_int64) (-log(kmpRandomUnit()) * (double) mean);
+    }
+    if (stallPercent > 0 && kmpRandomUnit() * 100.0 < (double) stallPercent) {
+        delay += __atomic_load_n(&pVfs->aLatency[KMPSQL_LATENCY_STALL_MICROS], __ATOMIC_RELAXED);
+    }
+    return delay;
+}
+
+/*
+ * Simulates a device with limited bandwidth shared by every file of the VFS. Each transfer is
+ * queued behind the ones before it, the return is how long the caller must wait for it to finish.
+ */
+static sqlite3_int64 kmpThroughputMicros(KmpVfs *pVfs, int bpsIndex, sqlite3_int64 *pFreeAt, sqlite3_int64 nByte) {
+    sqlite3_int64 bytesPerSecond = __atomic_load_n(&pVfs->aLatency[bpsIndex], __ATOMIC_RELAXED);
+    sqlite3_int64 now;
+    sqlite3_int64 done;
+
+    if (bytesPerSecond <= 0) return 0;
+    now = kmpNowMicros();
+    sqlite3_mutex_enter(pVfs->pDeviceMutex);
+    done = (*pFreeAt > now ? *pFreeAt : now) + nByte * 1000000 / bytesPerSecond;
+    *pFreeAt = done;
+    sqlite3_mutex_leave(pVfs->pDeviceMutex);
+    return done - now;
+}
+
+/*
+ * Sleeps for the configured latency of one operation. bpsIndex is negative for operations that
+ * transfer no data.
+ */
+static void kmpInjectLatency(KmpFile *p, int meanIndex, int bpsIndex, sqlite3_int64 *pFreeAt, sqlite3_int64 nByte) {
+    KmpVfs *pVfs = p->pVfs;
+    sqlite3_int64 delay;
+
+    if (!__atomic_load_n(&pVfs->hasLatency, __ATOMIC_RELAXED)) return;
+    delay = kmpLatencyMicros(pVfs, meanIndex);
+    if (bpsIndex >= 0) delay += kmpThroughputMicros(pVfs, bpsIndex, pFreeAt, nByte);
+    if (delay <= 0) return;
+    kmpCount(p, KMPSQL_METRIC_INJECTED_MICROS, delay);
+    while (delay > 0) {
+        int chunk = delay > 1000000000 ? 1000000000 : (int) delay;
+        pVfs->pReal->xSleep(pVfs->pReal, chunk);
+        delay -= chunk;
+    }
+}
+
+static int kmpRealRead(KmpFile *p, void *zBuf, int iAmt, sqlite3_int64 iOfst) {
+    kmpInjectLatency(p, KMPSQL_LATENCY_READ_MICROS, KMPSQL_LATENCY_READ_BPS, &p->pVfs->readFreeAt, iAmt);
+    return p->pReal->pMethods->xRead(p->pReal, zBuf, iAmt, iOfst);
+}
+
+/*
+ * Drops any buffered pages. Before doing so, adapts the window to how much of the buffer was
+ * actually used; a fully consumed buffer doubles the window, one that was mostly wasted halves it.
+ */
+static void kmpDiscardBuffer(KmpFile *p) {
+    if (p->nBuf > 0) {
+        int maxWindow = p->maxReadahead;
+        if (p->nBufUsed >= p->nBuf) {
+            kmpSetWindow(p, p->nWindow * 2 > maxWindow ? maxWindow : p->nWindow * 2);
+        } else if (p->nBufUsed < p->nBuf / 2) {
+            kmpSetWindow(p, p->nWindow / 2 < KMP_MIN_WINDOW ? KMP_MIN_WINDOW : p->nWindow / 2);
+        }
+    }
+    p->nBuf = 0;
+    p->nBufUsed = 0;
+}
+
+/*
+ * Reads the requested page plus as many following pages as the window allows with one call to
+ * the wrapped VFS. Sets *pHandled to zero if prefetching was not possible, in which case the
+ * caller does a normal read.
+ */
+static int kmpPrefetch(KmpFile *p, void *zBuf, int iAmt, sqlite3_int64 iOfst, int *pHandled) {
+    sqlite3_int64 szFile = 0;
+    sqlite3_int64 nWant = (sqlite3_int64) iAmt * p->nWindow;
+    int rc;
+
+    *pHandled = 0;
+    rc = p->pReal->pMethods->xFileSize(p->pReal, &szFile);
+    if (rc != SQLITE_OK) return rc;
+    if (iOfst + nWant > szFile) nWant = szFile - iOfst;
+    if (nWant <= iAmt) return SQLITE_OK;
+    if (nWant > p->szBuf) {
+        unsigned char *aNew = sqlite3_realloc64(p->aBuf, nWant);
+        if (aNew == NULL) return SQLITE_OK;
+        p->aBuf = aNew;
+        p->szBuf = (int) nWant;
+    }
+    rc = kmpRealRead(p, p->aBuf, (int) nWant, iOfst);
+    if (rc == SQLITE_IOERR_SHORT_READ) return SQLITE_OK;
+    if (rc != SQLITE_OK) return rc;
+    p->iBufOfst = iOfst;
+    p->nBuf = (int) nWant;
+    p->nBufUsed = iAmt;
+    memcpy(zBuf, p->aBuf, iAmt);
+    kmpCount(p, KMPSQL_METRIC_PREFETCHES, 1);
+    kmpCount(p, KMPSQL_METRIC_PREFETCH_BYTES, nWant);
+    *pHandled = 1;
+    return SQLITE_OK;
+}
+
+static void kmpPut32(unsigned char *a, sqlite3_uint64 v) {
+    a[0] = (unsigned char) (v >> 24);
+    a[1] = (unsigned char) (v >> 16);
+    a[2] = (unsigned char) (v >> 8);
+    a[3] = (unsigned char) v;
+}
+
+static void kmpPut64(unsigned char *a, sqlite3_uint64 v) {
+    kmpPut32(a, v >> 32);
+    kmpPut32(a + 4, v);
+}
+
+static sqlite3_uint64 kmpGet32(const unsigned char *a) {
+    return ((sqlite3_uint64) a[0] << 24) | ((sqlite3_uint64) a[1] << 16) | ((sqlite3_uint64) a[2] << 8) | a[3];
+}
+
+static sqlite3_uint64 kmpGet64(const unsigned char *a) {
+    return (kmpGet32(a) << 32) | kmpGet32(a + 4);
+}
+
+/*
+ * FNV-1a, used to detect a torn or truncated sidecar file
+ */
+static sqlite3_uint64 kmpHash(sqlite3_uint64 h, const unsigned char *a, int n) {
+    int i;
+    for (i = 0; i < n; i++) {
+        h = (h ^ a[i]) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+#define KMP_HASH_SEED 0xcbf29ce484222325ULL
+#define KMP_TRACK_MAGIC "KMPTRAK2"
+#define KMP_TRACK_HEADER 44        /* magic, epoch, flags, pageSize, nBit, headHash, fileStamp */
+#define KMP_TRACK_FULL 1           /* flag, next delta must be full */
+#define KMP_TRACK_UNSAVED 2        /* flag, pages may have been written since the sidecar was saved */
+#define KMP_DB_HEADER 100          /* database header at the start of page 1 */
+
+/*
+ * Hash of the database header in the file. Every commit in rollback journal mode changes it, as
+ * does every write of page 1 to an encrypted database, so a header that differs from the one last
+ * written through the tracking VFS means another writer changed the file.
+ * @return 0 if the file is shorter than the header or can not be read
+ */
+static sqlite3_uint64 kmpFileHeadHash(sqlite3_file *pReal) {
+    unsigned char aHead[KMP_DB_HEADER];
+    if (pReal->pMethods->xRead(pReal, aHead, KMP_DB_HEADER, 0) != SQLITE_OK) return 0;
+    return kmpHash(KMP_HASH_SEED, aHead, KMP_DB_HEADER);
+}
+
+/*
+ * Hash of the modification time and size of the database file, 0 if it can not be read.
+ */
+static sqlite3_uint64 kmpFileStamp(const char *zPath) {
+    struct stat st;
+    unsigned char aStamp[24];
+    if (stat(zPath, &st) != 0) return 0;
+#ifdef __APPLE__
+    kmpPut64(aStamp, (sqlite3_uint64) st.st_mtimespec.tv_sec);
+    kmpPut64(aStamp + 8, (sqlite3_uint64) st.st_mtimespec.tv_nsec);
+#else
+    kmpPut64(aStamp, (sqlite3_uint64) st.st_mtim.tv_sec);
+    kmpPut64(aStamp + 8, (sqlite3_uint64) st.st_mtim.tv_nsec);
+#endif
+    kmpPut64(aStamp + 16, (sqlite3_uint64) st.st_size);
+    return kmpHash(KMP_HASH_SEED, aStamp, sizeof(aStamp));
+}
+
+/*
+ * Takes a new file stamp after writes made here. Called before the lock covering the writes is
+ * released (the EXCLUSIVE lock in rollback journal mode, the checkpoint lock in WAL mode), so no
+ * other writer can have changed the file in between.
+ */
+static void kmpTrackStamp(KmpTrack *pTrack) {
+    sqlite3_uint64 stamp;
+    sqlite3_mutex_enter(pTrack->pMutex);
+    if (pTrack->isStampStale) {
+        stamp = kmpFileStamp(pTrack->zPath);
+        if (stamp != pTrack->fileStamp) pTrack->isChanged = 1;
+        pTrack->fileStamp = stamp;
+        pTrack->isStampStale = 0;
+    }
+    sqlite3_mutex_leave(pTrack->pMutex);
+}
+
+/*
+ * Replaces the content of the sidecar file and syncs it. The state is passed in rather than taken
+ * from pTrack so a new state can be made durable before it replaces the current one. Caller holds
+ * pTrack->pMutex.
+ */
+static int kmpTrackWriteFile(KmpTrack *pTrack, sqlite3_int64 epoch, int flags, const unsigned char *aBit, int nBit) {
+    int nFile = KMP_TRACK_HEADER + nBit + 8;
+    unsigned char *aFile = sqlite3_malloc(nFile);
+    sqlite3_uint64 h;
+    int ok;
+
+    if (aFile == NULL) return SQLITE_NOMEM;
+    memcpy(aFile, KMP_TRACK_MAGIC, 8);
+    kmpPut64(aFile + 8, epoch);
+    kmpPut32(aFile + 16, flags);
+    kmpPut32(aFile + 20, pTrack->pageSize);
+    kmpPut32(aFile + 24, nBit);
+    kmpPut64(aFile + 28, pTrack->headHash);
+    kmpPut64(aFile + 36, pTrack->fileStamp);
+    if (nBit > 0) memcpy(aFile + KMP_TRACK_HEADER, aBit, nBit);
+    h = kmpHash(KMP_HASH_SEED, aFile, KMP_TRACK_HEADER + nBit);
+    kmpPut64(aFile + KMP_TRACK_HEADER + nBit, h);
+    ok = pwrite(pTrack->fd, aFile, nFile, 0) == nFile
+         && ftruncate(pTrack->fd, nFile) == 0
+         && fsync(pTrack->fd) == 0;
+    sqlite3_free(aFile);
+    return ok ? SQLITE_OK : SQLITE_IOERR_WRITE;
+}
+
+/*
+ * Saves the complete state. Caller holds pTrack->pMutex.
+ */
+static int kmpTrackSave(KmpTrack *pTrack, sqlite3_int64 epoch, int needsFull, const unsigned char *aBit, int nBit) {
+    int rc = kmpTrackWriteFile(pTrack, epoch, needsFull ? KMP_TRACK_FULL : 0, aBit, nBit);
+    if (rc == SQLITE_OK) pTrack->isMarked = 0;
+    return rc;
+}
+
+/*
+ * Marks the sidecar as missing changes, so that if the process ends before the next save the
+ * next delta is full. Writing the bitmap at every sync in rollback journal mode would add a second
+ * fsync to every commit; this costs one when the first change after a save is synced. Caller
+ * holds pTrack->pMutex.
+ */
+static int kmpTrackMark(KmpTrack *pTrack) {
+    int flags = KMP_TRACK_UNSAVED | (pTrack->needsFull ? KMP_TRACK_FULL : 0);
+    int rc = kmpTrackWriteFile(pTrack, pTrack->epoch, flags, NULL, 0);
+    if (rc == SQLITE_OK) pTrack->isMarked = 1;
+    return rc;
+}
+
+/*
+ * Loads the sidecar file. A missing, damaged or unsaved sidecar means changes may have been
+ * missed, so the next delta has to be full.
+ */
+static void kmpTrackLoad(KmpTrack *pTrack) {
+    struct stat st;
+    unsigned char *aFile = NULL;
+    int nFile;
+    int nBit;
+
+    pTrack->needsFull = 1;
+    if (fstat(pTrack->fd, &st) != 0 || st.st_size < KMP_TRACK_HEADER + 8 || st.st_size > 0x7fffffff) return;
+    nFile = (int) st.st_size;
+    aFile = sqlite3_malloc(nFile);
+    if (aFile == NULL) return;
+    if (pread(pTrack->fd, aFile, nFile, 0) == nFile && memcmp(aFile, KMP_TRACK_MAGIC, 8) == 0) {
+        nBit = (int) kmpGet32(aFile + 24);
+        if (nBit >= 0 && nBit == nFile - KMP_TRACK_HEADER - 8
+            && kmpGet64(aFile + nFile - 8) == kmpHash(KMP_HASH_SEED, aFile, nFile - 8)) {
+            int flags = (int) kmpGet32(aFile + 16);
+            pTrack->epoch = (sqlite3_int64) kmpGet64(aFile + 8);
+            pTrack->needsFull = (flags & (KMP_TRACK_FULL | KMP_TRACK_UNSAVED)) != 0;
+            pTrack->pageSize = (int) kmpGet32(aFile + 20);
+            pTrack->headHash = kmpGet64(aFile + 28);
+            pTrack->fileStamp = kmpGet64(aFile + 36);
+            if (nBit > 0) {
+                pTrack->aBit = sqlite3_malloc(nBit);
+                if (pTrack->aBit != NULL) {
+                    memcpy(pTrack->aBit, aFile + KMP_TRACK_HEADER, nBit);
+                    pTrack->nBit = nBit;
+                } else {
+                    pTrack->needsFull = 1;
+                }
+            }
+        }
+    }
+    sqlite3_free(aFile);
+}
+
+/*
+ * Opens and write locks the sidecar of a new tracking state.
+ * @return SQLITE_BUSY if another process is tracking the database
+ */
+static int kmpTrackOpenSidecar(KmpTrack *pTrack) {
+    struct flock lock;
+    char *zSidecar = sqlite3_mprintf("%s%s", pTrack->zPath, KMPSQL_TRACKING_SUFFIX);
+
+    if (zSidecar == NULL) return SQLITE_NOMEM;
+    pTrack->fd = open(zSidecar, O_RDWR | O_CREAT, 0644);
+    sqlite3_free(zSidecar);
+    if (pTrack->fd < 0) return SQLITE_CANTOPEN;
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    if (fcntl(pTrack->fd, F_SETLK, &lock) != 0) {
+        int busy = errno == EACCES || errno == EAGAIN;
+        close(pTrack->fd);
+        pTrack->fd = -1;
+        return busy ? SQLITE_BUSY : SQLITE_IOERR_LOCK;
+    }
+    return SQLITE_OK;
+}
+
+/*
+ * Finds or creates the tracking state of a database path. A new state is checked against the
+ * header of the opened database file pReal.
+ */
+static int kmpTrackAcquire(const char *zPath, sqlite3_file *pReal, KmpTrack **ppOut) {
+    sqlite3_mutex *pMutex = sqlite3_mutex_alloc(SQLITE_MUTEX_STATIC_APP2);
+    KmpTrack *pTrack;
+    int rc = SQLITE_OK;
+
+    sqlite3_mutex_enter(pMutex);
+    for (pTrack = kmpTrackList; pTrack != NULL; pTrack = pTrack->pNext) {
+        if (strcmp(pTrack->zPath, zPath) == 0) break;
+    }
+    if (pTrack == NULL) {
+        pTrack = sqlite3_malloc(sizeof(KmpTrack));
+        if (pTrack == NULL) {
+            rc = SQLITE_NOMEM;
+        } else {
+            memset(pTrack, 0, sizeof(KmpTrack));
+            pTrack->fd = -1;
+            pTrack->zPath = sqlite3_mprintf("%s", zPath);
+            pTrack->pMutex = sqlite3_mutex_alloc(SQLITE_MUTEX_FAST);
+            rc = pTrack->zPath == NULL || pTrack->pMutex == NULL ? SQLITE_NOMEM : kmpTrackOpenSidecar(pTrack);
+            if (rc != SQLITE_OK) {
+                sqlite3_free(pTrack->zPath);
+                sqlite3_mutex_free(pTrack->pMutex);
+                sqlite3_free(pTrack);
+                pTrack = NULL;
+            } else {
+                sqlite3_uint64 headHash = kmpFileHeadHash(pReal);
+                sqlite3_uint64 stamp = kmpFileStamp(zPath);
+                kmpTrackLoad(pTrack);
+                if (pTrack->headHash != headHash || pTrack->fileStamp != stamp) pTrack->needsFull = 1;
+                pTrack->headHash = headHash;
+                pTrack->fileStamp = stamp;
+                pTrack->pNext = kmpTrackList;
+                kmpTrackList = pTrack;
+            }
+        }
+    }
+    if (pTrack != NULL) pTrack->nRef++;
+    sqlite3_mutex_leave(pMutex);
+    *ppOut = pTrack;
+    return rc;
+}
+
+static void kmpTrackRelease(KmpTrack *pTrack) {
+    sqlite3_mutex *pMutex = sqlite3_mutex_alloc(SQLITE_MUTEX_STATIC_APP2);
+    KmpTrack **pp;
+
+    sqlite3_mutex_enter(pMutex);
+    if (--pTrack->nRef == 0) {
+        if (!pTrack->isReplaced) {
+            for (pp = &kmpTrackList; *pp != pTrack; pp = &(*pp)->pNext) {}
+            *pp = pTrack->pNext;
+        }
+        if (pTrack->isChanged && !pTrack->isReplaced) {
+            kmpTrackSave(pTrack, pTrack->epoch, pTrack->needsFull, pTrack->aBit, pTrack->nBit);
+        }
+        /* closing the descriptor releases the lock */
+        close(pTrack->fd);
+        sqlite3_mutex_free(pTrack->pMutex);
+        sqlite3_free(pTrack->aBit);
+        sqlite3_free(pTrack->zPath);
+        sqlite3_free(pTrack);
+    }
+    sqlite3_mutex_leave(pMutex);
+}
+
+void kmpsql_tracking_forget(const char *zPath) {
+    sqlite3_mutex *pMutex;
+    KmpTrack **pp;
+
+    if (sqlite3_initialize() != SQLITE_OK) return;
+    pMutex = sqlite3_mutex_alloc(SQLITE_MUTEX_STATIC_APP2);
+    sqlite3_mutex_enter(pMutex);
+    for (pp = &kmpTrackList; *pp != NULL; pp = &(*pp)->pNext) {
+        if (strcmp((*pp)->zPath, zPath) == 0) {
+            /* out of the list, so the next open of the path starts a new state with a full delta */
+            (*pp)->isReplaced = 1;
+            *pp = (*pp)->pNext;
+            break;
+        }
+    }
+    sqlite3_mutex_leave(pMutex);
+}
+
+/*
+ * Records a write to the main database file. Sqlite writes whole pages, so the page size is
+ * learned from the first page aligned write. A page size change (VACUUM) invalidates the
+ * bitmap, and the next delta becomes full.
+ */
+static void kmpTrackWrite(KmpTrack *pTrack, const void *zBuf, int iAmt, sqlite3_int64 iOfst) {
+    sqlite3_int64 iFirst;
+    sqlite3_int64 iLast;
+    sqlite3_int64 i;
+    int isPage = iAmt >= 512 && iAmt <= 65536 && (iAmt & (iAmt - 1)) == 0 && iOfst % iAmt == 0;
+
+    if (iAmt <= 0) return;
+    sqlite3_mutex_enter(pTrack->pMutex);
+    pTrack->isChanged = 1;
+    pTrack->isStampStale = 1;
+    if (iOfst == 0 && iAmt >= KMP_DB_HEADER) {
+        pTrack->headHash = kmpHash(KMP_HASH_SEED, zBuf, KMP_DB_HEADER);
+    } else if (iOfst < KMP_DB_HEADER) {
+        pTrack->needsFull = 1;
+    }
+    if (isPage && iAmt != pTrack->pageSize) {
+        if (pTrack->pageSize != 0) pTrack->needsFull = 1;
+        pTrack->pageSize = iAmt;
+        if (pTrack->nBit > 0) memset(pTrack->aBit, 0, pTrack->nBit);
+    }
+    if (pTrack->pageSize == 0) {
+        pTrack->needsFull = 1;
+    } else if (!pTrack->needsFull) {
+        iFirst = iOfst / pTrack->pageSize;
+        iLast = (iOfst + iAmt - 1) / pTrack->pageSize;
+        if (iLast / 8 >= pTrack->nBit) {
+            int nNew = (int) (iLast / 8 + 1) * 2;
+            unsigned char *aNew = sqlite3_realloc(pTrack->aBit, nNew);
+            if (aNew == NULL) {
+                pTrack->needsFull = 1;
+                sqlite3_mutex_leave(pTrack->pMutex);
+                return;
+            }
+            memset(aNew + pTrack->nBit, 0, nNew - pTrack->nBit);
+            pTrack->aBit = aNew;
+            pTrack->nBit = nNew;
+        }
+        for (i = iFirst; i <= iLast; i++) {
+            pTrack->aBit[i / 8] |= (unsigned char) (1 << (i % 8));
+        }
+    }
+    sqlite3_mutex_leave(pTrack->pMutex);
+}
+
+static int kmpClose(sqlite3_file *pFile) {
+    KmpFile *p = (KmpFile *) pFile;
+    int rc = p->pReal->pMethods->xClose(p->pReal);
+    sqlite3_free(p->aBuf);
+    p->aBuf = NULL;
+    if (p->pTrack != NULL) {
+        kmpTrackRelease(p->pTrack);
+        p->pTrack = NULL;
+    }
+    return rc;
+}
+
+static int kmpRead(sqlite3_file *pFile, void *zBuf, int iAmt, sqlite3_int64 iOfst) {
+    KmpFile *p = (KmpFile *) pFile;
+    int handled = 0;
+    int rc;
+
+    if (p->isMainDb) kmpCount(p, KMPSQL_METRIC_READS, 1);
+    if (!p->isMainDb || p->maxReadahead < KMP_MIN_WINDOW) {
+        return kmpRealRead(p, zBuf, iAmt, iOfst);
+    }
+    if (p->nBuf > 0 && iOfst >= p->iBufOfst && iOfst + iAmt <= p->iBufOfst + p->nBuf) {
+        memcpy(zBuf, p->aBuf + (iOfst - p->iBufOfst), iAmt);
+        p->nBufUsed += iAmt;
+        p->iNextOfst = iOfst + iAmt;
+        p->nSeq++;
+        kmpCount(p, KMPSQL_METRIC_BUFFER_HITS, 1);
+        return SQLITE_OK;
+    }
+    p->nSeq = (iOfst == p->iNextOfst) ? p->nSeq + 1 : 0;
+    p->iNextOfst = iOfst + iAmt;
+    kmpDiscardBuffer(p);
+    if (p->nSeq >= KMP_SEQUENTIAL_TRIGGER) {
+        rc = kmpPrefetch(p, zBuf, iAmt, iOfst, &handled);
+        if (rc != SQLITE_OK || handled) return rc;
+    }
+    return kmpRealRead(p, zBuf, iAmt, iOfst);
+}
+
+static int kmpWrite(sqlite3_file *pFile, const void *zBuf, int iAmt, sqlite3_int64 iOfst) {
+    KmpFile *p = (KmpFile *) pFile;
+    kmpDiscardBuffer(p);
+    if (p->pTrack != NULL) kmpTrackWrite(p->pTrack, zBuf, iAmt, iOfst);
+    kmpInjectLatency(p, KMPSQL_LATENCY_WRITE_MICROS, KMPSQL_LATENCY_WRITE_BPS, &p->pVfs->writeFreeAt, iAmt);
+    return p->pReal->pMethods->xWrite(p->pReal, zBuf, iAmt, iOfst);
+}
+
+static int kmpTruncate(sqlite3_file *pFile, sqlite3_int64 size) {
+    KmpFile *p = (KmpFile *) pFile;
+    kmpDiscardBuffer(p);
+    if (p->pTrack != NULL) {
+        sqlite3_mutex_enter(p->pTrack->pMutex);
+        p->pTrack->isStampStale = 1;
+        sqlite3_mutex_leave(p->pTrack->pMutex);
+    }
+    return p->pReal->pMethods->xTruncate(p->pReal, size);
+}
+
+/*
+ * The sidecar is made durable before the database file is synced, so a crash can not leave
+ * durable page changes that the next delta would miss. In WAL mode the main database file is only
+ * written and synced by checkpoints, which run without the EXCLUSIVE lock, and the changed pages
+ * are saved then. In rollback journal mode every commit syncs the file, so the sidecar is only
+ * marked as unsaved once and the pages are saved by the next delta or the last close.
+ */
+static int kmpSync(sqlite3_file *pFile, int flags) {
+    KmpFile *p = (KmpFile *) pFile;
+    KmpTrack *pTrack = p->pTrack;
+    int rc = SQLITE_OK;
+
+    if (pTrack != NULL) {
+        sqlite3_mutex_enter(pTrack->pMutex);
+        if (pTrack->isChanged && p->eLock < SQLITE_LOCK_EXCLUSIVE) {
+            rc = kmpTrackSave(pTrack, pTrack->epoch, pTrack->needsFull, pTrack->aBit, pTrack->nBit);
+            if (rc == SQLITE_OK) pTrack->isChanged = 0;
+        } else if (pTrack->isChanged && !pTrack->isMarked) {
+            rc = kmpTrackMark(pTrack);
+        }
+        sqlite3_mutex_leave(pTrack->pMutex);
+        if (rc != SQLITE_OK) return SQLITE_IOERR_FSYNC;
+    }
+    kmpInjectLatency(p, KMPSQL_LATENCY_SYNC_MICROS, -1, NULL, 0);
+    return p->pReal->pMethods->xSync(p->pReal, flags);
+}
+
+static int kmpFileSize(sqlite3_file *pFile, sqlite3_int64 *pSize) {
+    return REAL_FILE(pFile)->pMethods->xFileSize(REAL_FILE(pFile), pSize);
+}
+
+/*
+ * Acquiring a SHARED lock starts a new read transaction in rollback journal mode. Another
+ * connection or process may have changed the file since the buffer was filled.
+ */
+static int kmpLock(sqlite3_file *pFile, int eLock) {
+    KmpFile *p = (KmpFile *) pFile;
+    int rc;
+    if (p->eLock == SQLITE_LOCK_NONE) kmpDiscardBuffer(p);
+    rc = p->pReal->pMethods->xLock(p->pReal, eLock);
+    if (rc == SQLITE_OK) p->eLock = eLock;
+    return rc;
+}
+
+static int kmpUnlock(sqlite3_file *pFile, int eLock) {
+    KmpFile *p = (KmpFile *) pFile;
+    int rc;
+    if (p->pTrack != NULL) kmpTrackStamp(p->pTrack);
+    rc = p->pReal->pMethods->xUnlock(p->pReal, eLock);
+    if (rc == SQLITE_OK) p->eLock = eLock;
+    return rc;
+}
+
+static int kmpCheckReservedLock(sqlite3_file *pFile, int *pResOut) {
+    return REAL_FILE(pFile)->pMethods->xCheckReservedLock(REAL_FILE(pFile), pResOut);
+}
+
+static int kmpFileControl(sqlite3_file *pFile, int op, void *pArg) {
+    KmpFile *p = (KmpFile *) pFile;
+    if (op == KMPSQL_FCNTL_METRICS) {
+        memcpy(pArg, p->aMetric, sizeof(p->aMetric));
+        return SQLITE_OK;
+    }
+    if (op == KMPSQL_FCNTL_READAHEAD) {
+        int maxPages = *(int *) pArg;
+        *(int *) pArg = p->maxReadahead;
+        if (maxPages >= 0) {
+            kmpDiscardBuffer(p);
+            p->maxReadahead = maxPages;
+            if (p->nWindow > maxPages && maxPages >= KMP_MIN_WINDOW) kmpSetWindow(p, maxPages);
+        }
+        return SQLITE_OK;
+    }
+    return p->pReal->pMethods->xFileControl(p->pReal, op, pArg);
+}
+
+static int kmpSectorSize(sqlite3_file *pFile) {
+    return REAL_FILE(pFile)->pMethods->xSectorSize(REAL_FILE(pFile));
+}
+
+static int kmpDeviceCharacteristics(sqlite3_file *pFile) {
+    return REAL_FILE(pFile)->pMethods->xDeviceCharacteristics(REAL_FILE(pFile));
+}
+
+static int kmpShmMap(sqlite3_file *pFile, int iPg, int pgsz, int bExtend, void volatile **pp) {
+    sqlite3_file *pReal = REAL_FILE(pFile);
+    if (pReal->pMethods->iVersion < 2) return SQLITE_IOERR;
+    return pReal->pMethods->xShmMap(pReal, iPg, pgsz, bExtend, pp);
+}
+
+/*
+ * In WAL mode the database file stays SHARED locked between transactions, so a new read
+ * transaction is only visible here as a WAL read-mark lock. Checkpoints run by other connections
+ * can rewrite main database pages between transactions.
+ */
+static int kmpShmLock(sqlite3_file *pFile, int offset, int n, int flags) {
+    KmpFile *p = (KmpFile *) pFile;
+    if (flags & SQLITE_SHM_LOCK) kmpDiscardBuffer(p);
+    if ((flags & SQLITE_SHM_UNLOCK) && p->pTrack != NULL) kmpTrackStamp(p->pTrack);
+    if (p->pReal->pMethods->iVersion < 2) return SQLITE_IOERR;
+    return p->pReal->pMethods->xShmLock(p->pReal, offset, n, flags);
+}
+
+static void kmpShmBarrier(sqlite3_file *pFile) {
+    sqlite3_file *pReal = REAL_FILE(pFile);
+    if (pReal->pMethods->iVersion >= 2) pReal->pMethods->xShmBarrier(pReal);
+}
+
+static int kmpShmUnmap(sqlite3_file *pFile, int deleteFlag) {
+    sqlite3_file *pReal = REAL_FILE(pFile);
+    if (pReal->pMethods->iVersion < 2) return SQLITE_OK;
+    return pReal->pMethods->xShmUnmap(pReal, deleteFlag);
+}
+
+/*
+ * Sqlite falls back to xRead when no mapping is returned, so only mapped pages are counted.
+ */
+static int kmpFetch(sqlite3_file *pFile, sqlite3_int64 iOfst, int iAmt, void **pp) {
+    KmpFile *p = (KmpFile *) pFile;
+    int rc;
+    if (p->pReal->pMethods->iVersion < 3) {
+        *pp = NULL;
+        return SQLITE_OK;
+    }
+    rc = p->pReal->pMethods->xFetch(p->pReal, iOfst, iAmt, pp);
+    if (rc == SQLITE_OK && *pp != NULL && p->isMainDb) kmpCount(p, KMPSQL_METRIC_FETCHES, 1);
+    return rc;
+}
+
+static int kmpUnfetch(sqlite3_file *pFile, sqlite3_int64 iOfst, void *pPage) {
+    sqlite3_file *pReal = REAL_FILE(pFile);
+    if (pReal->pMethods->iVersion < 3) return SQLITE_OK;
+    return pReal->pMethods->xUnfetch(pReal, iOfst, pPage);
+}
+
+static const sqlite3_io_methods kmpIoMethods = {
+        3,
+        kmpClose,
+        kmpRead,
+        kmpWrite,
+        kmpTruncate,
+        kmpSync,
+        kmpFileSize,
+        kmpLock,
+        kmpUnlock,
+        kmpCheckReservedLock,
+        kmpFileControl,
+        kmpSectorSize,
+        kmpDeviceCharacteristics,
+        kmpShmMap,
+        kmpShmLock,
+        kmpShmBarrier,
+        kmpShmUnmap,
+        kmpFetch,
+        kmpUnfetch
+};
+
+static int kmpOpen(sqlite3_vfs *pVfs, sqlite3_filename zName, sqlite3_file *pFile, int flags, int *pOutFlags) {
+    KmpVfs *pKmp = (KmpVfs *) pVfs;
+    KmpFile *p = (KmpFile *) pFile;
+    int rc;
+
+    memset(p, 0, sizeof(KmpFile));
+    p->pVfs = pKmp;
+    p->pReal = (sqlite3_file *) &p[1];
+    p->isMainDb = (flags & SQLITE_OPEN_MAIN_DB) != 0;
+    p->maxReadahead = __atomic_load_n(&pKmp->maxReadahead, __ATOMIC_RELAXED);
+    p->nWindow = KMP_INITIAL_WINDOW;
+    p->aMetric[KMPSQL_METRIC_WINDOW_PAGES] = KMP_INITIAL_WINDOW;
+    rc = pKmp->pReal->xOpen(pKmp->pReal, zName, p->pReal, flags, pOutFlags);
+    p->base.pMethods = p->pReal->pMethods != NULL ? &kmpIoMethods : NULL;
+    if (rc == SQLITE_OK && p->isMainDb && zName != NULL && __atomic_load_n(&pKmp->isTracking, __ATOMIC_RELAXED)) {
+        rc = kmpTrackAcquire(zName, p->pReal, &p->pTrack);
+        if (rc != SQLITE_OK) {
+            p->pReal->pMethods->xClose(p->pReal);
+            p->base.pMethods = NULL;
+        }
+    }
+    return rc;
+}
+
+static int kmpDelete(sqlite3_vfs *pVfs, const char *zName, int syncDir) {
+    return REAL_VFS(pVfs)->xDelete(REAL_VFS(pVfs), zName, syncDir);
+}
+
+static int kmpAccess(sqlite3_vfs *pVfs, const char *zName, int flags, int *pResOut) {
+    return REAL_VFS(pVfs)->xAccess(REAL_VFS(pVfs), zName, flags, pResOut);
+}
+
+static int kmpFullPathname(sqlite3_vfs *pVfs, const char *zName, int nOut, char *zOut) {
+    return REAL_VFS(pVfs)->xFullPathname(REAL_VFS(pVfs), zName, nOut, zOut);
+}
+
+static void *kmpDlOpen(sqlite3_vfs *pVfs, const char *zPath) {
+    return REAL_VFS(pVfs)->xDlOpen(REAL_VFS(pVfs), zPath);
+}
+
+static void kmpDlError(sqlite3_vfs *pVfs, int nByte, char *zErrMsg) {
+    REAL_VFS(pVfs)->xDlError(REAL_VFS(pVfs), nByte, zErrMsg);
+}
+
+static void (*kmpDlSym(sqlite3_vfs *pVfs, void *pHandle, const char *zSymbol))(void) {
+    return REAL_VFS(pVfs)->xDlSym(REAL_VFS(pVfs), pHandle, zSymbol);
+}
+
+static void kmpDlClose(sqlite3_vfs *pVfs, void *pHandle) {
+    REAL_VFS(pVfs)->xDlClose(REAL_VFS(pVfs), pHandle);
+}
+
+static int kmpRandomness(sqlite3_vfs *pVfs, int nByte, char *zOut) {
+    return REAL_VFS(pVfs)->xRandomness(REAL_VFS(pVfs), nByte, zOut);
+}
+
+static int kmpSleep(sqlite3_vfs *pVfs, int microseconds) {
+    return REAL_VFS(pVfs)->xSleep(REAL_VFS(pVfs), microseconds);
+}
+
+static int kmpCurrentTime(sqlite3_vfs *pVfs, double *pTime) {
+    return REAL_VFS(pVfs)->xCurrentTime(REAL_VFS(pVfs), pTime);
+}
+
+static int kmpGetLastError(sqlite3_vfs *pVfs, int nByte, char *zOut) {
+    return REAL_VFS(pVfs)->xGetLastError(REAL_VFS(pVfs), nByte, zOut);
+}
+
+static int kmpCurrentTimeInt64(sqlite3_vfs *pVfs, sqlite3_int64 *pTime) {
+    sqlite3_vfs *pReal = REAL_VFS(pVfs);
+    if (pReal->iVersion >= 2 && pReal->xCurrentTimeInt64 != NULL)
+        return pReal->xCurrentTimeInt64(pReal, pTime);
+    double now = 0.0;
+    int rc = pReal->xCurrentTime(pReal, &now);
+    *pTime = (sqlite3_int64) (now * 86400000.0);
+    return rc;
+}
+
+/*
+ * Returns the registered kmpsql VFS with this name, or NULL if there is none.
+ */
+static KmpVfs *kmpVfsFind(const char *zName) {
+    sqlite3_vfs *pVfs = sqlite3_vfs_find(zName);
+    if (pVfs != NULL && pVfs->xOpen == kmpOpen) return (KmpVfs *) pVfs;
+    return NULL;
+}
+
+/*
+ * Finds the named kmpsql VFS, registering a new one wrapping zBaseVfs if it does not exist yet.
+ * Caller holds the static app mutex.
+ */
+static int kmpVfsRegister(const char *zName, const char *zBaseVfs, int makeDefault, KmpVfs **ppOut) {
+    KmpVfs *pKmp = kmpVfsFind(zName);
+    sqlite3_vfs *pReal;
+    int rc;
+
+    *ppOut = NULL;
+    if (pKmp != NULL) {
+        *ppOut = pKmp;
+        return makeDefault ? sqlite3_vfs_register(&pKmp->base, 1) : SQLITE_OK;
+    }
+    if (strlen(zName) >= KMP_MAX_NAME) return SQLITE_MISUSE;
+    if (sqlite3_vfs_find(zName) != NULL) return SQLITE_MISUSE;
+    pReal = sqlite3_vfs_find(zBaseVfs);
+    if (pReal == NULL) return SQLITE_NOTFOUND;
+    pKmp = sqlite3_malloc(sizeof(KmpVfs));
+    if (pKmp == NULL) return SQLITE_NOMEM;
+    memset(pKmp, 0, sizeof(KmpVfs));
+    strcpy(pKmp->zName, zName);
+    pKmp->pReal = pReal;
+    pKmp->base.iVersion = 2;
+    pKmp->base.szOsFile = (int) sizeof(KmpFile) + pReal->szOsFile;
+    pKmp->base.mxPathname = pReal->mxPathname;
+    pKmp->base.zName = pKmp->zName;
+    pKmp->base.pAppData = NULL;
+    pKmp->base.xOpen = kmpOpen;
+    pKmp->base.xDelete = kmpDelete;
+    pKmp->base.xAccess = kmpAccess;
+    pKmp->base.xFullPathname = kmpFullPathname;
+    pKmp->base.xDlOpen = kmpDlOpen;
+    pKmp->base.xDlError = kmpDlError;
+    pKmp->base.xDlSym = kmpDlSym;
+    pKmp->base.xDlClose = kmpDlClose;
+    pKmp->base.xRandomness = kmpRandomness;
+    pKmp->base.xSleep = kmpSleep;
+    pKmp->base.xCurrentTime = kmpCurrentTime;
+    pKmp->base.xGetLastError = kmpGetLastError;
+    pKmp->base.xCurrentTimeInt64 = kmpCurrentTimeInt64;
+    rc = sqlite3_vfs_register(&pKmp->base, makeDefault);
+    if (rc != SQLITE_OK) {
+        sqlite3_free(pKmp);
+        return rc;
+    }
+    *ppOut = pKmp;
+    return SQLITE_OK;
+}
+
+int kmpsql_readahead_register(const char *zBaseVfs, int maxPages, int makeDefault) {
+    sqlite3_mutex *pMutex;
+    KmpVfs *pKmp = NULL;
+    int rc = sqlite3_initialize();
+
+    if (rc != SQLITE_OK) return rc;
+    pMutex = sqlite3_mutex_alloc(SQLITE_MUTEX_STATIC_APP1);
+    sqlite3_mutex_enter(pMutex);
+    rc = kmpVfsRegister(KMPSQL_READAHEAD_VFS, zBaseVfs, makeDefault, &pKmp);
+    if (rc == SQLITE_OK) {
+        __atomic_store_n(&pKmp->maxReadahead, maxPages, __ATOMIC_RELAXED);
+    }
+    sqlite3_mutex_leave(pMutex);
+    return rc;
+}
+
+int kmpsql_metrics_register(const char *zBaseVfs, int makeDefault) {
+    sqlite3_mutex *pMutex;
+    KmpVfs *pKmp = NULL;
+    int rc = sqlite3_initialize();
+
+    if (rc != SQLITE_OK) return rc;
+    pMutex = sqlite3_mutex_alloc(SQLITE_MUTEX_STATIC_APP1);
+    sqlite3_mutex_enter(pMutex);
+    rc = kmpVfsRegister(KMPSQL_METRICS_VFS, zBaseVfs, makeDefault, &pKmp);
+    sqlite3_mutex_leave(pMutex);
+    return rc;
+}
+
+int kmpsql_latency_register(const char *zName, const char *zBaseVfs, const sqlite3_int64 *aConfig, int nConfig) {
+    sqlite3_mutex *pMutex;
+    KmpVfs *pKmp = NULL;
+    int hasLatency = 0;
+    int i;
+    int rc = sqlite3_initialize();
+
+    if (rc != SQLITE_OK) return rc;
+    if (zName == NULL || zName[0] == 0) return SQLITE_MISUSE;
+    pMutex = sqlite3_mutex_alloc(SQLITE_MUTEX_STATIC_APP1);
+    sqlite3_mutex_enter(pMutex);
+    rc = kmpVfsRegister(zName, zBaseVfs, 0, &pKmp);
+    if (rc == SQLITE_OK && pKmp->pDeviceMutex == NULL) {
+        pKmp->pDeviceMutex = sqlite3_mutex_alloc(SQLITE_MUTEX_FAST);
+        if (pKmp->pDeviceMutex == NULL) rc = SQLITE_NOMEM;
+    }
+    if (rc == SQLITE_OK) {
+        for (i = 0; i < KMPSQL_LATENCY_COUNT; i++) {
+            sqlite3_int64 value = i < nConfig ? aConfig[i] : 0;
+            if (value < 0) value = 0;
+            if (value > 0 && i != KMPSQL_LATENCY_DISTRIBUTION) hasLatency = 1;
+            __atomic_store_n(&pKmp->aLatency[i], value, __ATOMIC_RELAXED);
+        }
+        __atomic_store_n(&pKmp->hasLatency, hasLatency, __ATOMIC_RELAXED);
+    }
+    sqlite3_mutex_leave(pMutex);
+    return rc;
+}
+
+int kmpsql_vfs_metrics(const char *zVfs, sqlite3_int64 *aOut, int nOut) {
+    KmpVfs *pKmp = kmpVfsFind(zVfs);
+    int i;
+    if (pKmp == NULL) return SQLITE_NOTFOUND;
+    for (i = 0; i < nOut && i < KMPSQL_METRIC_COUNT; i++) {
+        aOut[i] = __atomic_load_n(&pKmp->aMetric[i], __ATOMIC_RELAXED);
+    }
+    return SQLITE_OK;
+}
+
+int kmpsql_readahead_file(sqlite3 *db, const char *zSchema, int maxPages) {
+    int value = maxPages;
+    int rc = sqlite3_file_control(db, zSchema != NULL ? zSchema : "main", KMPSQL_FCNTL_READAHEAD, &value);
+    return rc == SQLITE_OK ? value : -1;
+}
+
+int kmpsql_vfs_file_metrics(sqlite3 *db, const char *zSchema, sqlite3_int64 *aOut, int nOut) {
+    sqlite3_int64 aMetric[KMPSQL_METRIC_COUNT];
+    int i;
+    int rc;
+
+    memset(aMetric, 0, sizeof(aMetric));
+    rc = sqlite3_file_control(db, zSchema != NULL ? zSchema : "main", KMPSQL_FCNTL_METRICS, aMetric);
+    if (rc != SQLITE_OK) return rc;
+    for (i = 0; i < nOut && i < KMPSQL_METRIC_COUNT; i++) {
+        aOut[i] = aMetric[i];
+    }
+    return SQLITE_OK;
+}
+
+int kmpsql_tracking_register(const char *zBaseVfs, int makeDefault) {
+    sqlite3_mutex *pMutex;
+    KmpVfs *pKmp = NULL;
+    int rc = sqlite3_initialize();
+
+    if (rc != SQLITE_OK) return rc;
+    pMutex = sqlite3_mutex_alloc(SQLITE_MUTEX_STATIC_APP1);
+    sqlite3_mutex_enter(pMutex);
+    rc = kmpVfsRegister(KMPSQL_TRACKING_VFS, zBaseVfs, makeDefault, &pKmp);
+    if (rc == SQLITE_OK) {
+        __atomic_store_n(&pKmp->isTracking, 1, __ATOMIC_RELAXED);
+    }
+    sqlite3_mutex_leave(pMutex);
+    return rc;
+}
+
+static int kmpQueryText(sqlite3 *db, const char *zSql, char *zOut, int nOut) {
+    sqlite3_stmt *pStmt = NULL;
+    int rc = sqlite3_prepare_v2(db, zSql, -1, &pStmt, NULL);
+    zOut[0] = 0;
+    if (rc != SQLITE_OK) return rc;
+    if (sqlite3_step(pStmt) == SQLITE_ROW && sqlite3_column_text(pStmt, 0) != NULL) {
+        sqlite3_snprintf(nOut, zOut, "%s", (const char *) sqlite3_column_text(pStmt, 0));
+    }
+    return sqlite3_finalize(pStmt);
+}
+
+/*
+ * Starts a write transaction with every committed change in the main database file. In WAL mode
+ * that means the WAL has to be checkpointed and reset, and no other connection can append to it
+ * while the write lock is held.
+ */
+static int kmpDeltaBegin(sqlite3 *db) {
+    char zMode[16];
+    sqlite3_file *pWal = NULL;
+    sqlite3_int64 szWal = 0;
+    int attempt;
+    int rc = kmpQueryText(db, "PRAGMA main.journal_mode", zMode, sizeof(zMode));
+
+    if (rc != SQLITE_OK) return rc;
+    if (sqlite3_stricmp(zMode, "wal") != 0) return sqlite3_exec(db, "BEGIN IMMEDIATE", NULL, NULL, NULL);
+    for (attempt = 0; attempt < KMP_DELTA_ATTEMPTS; attempt++) {
+        rc = sqlite3_wal_checkpoint_v2(db, "main", SQLITE_CHECKPOINT_TRUNCATE, NULL, NULL);
+        if (rc != SQLITE_OK && rc != SQLITE_BUSY) return rc;
+        rc = sqlite3_exec(db, "BEGIN IMMEDIATE", NULL, NULL, NULL);
+        if (rc != SQLITE_OK && rc != SQLITE_BUSY) return rc;
+        if (rc == SQLITE_OK) {
+            szWal = 0;
+            rc = sqlite3_file_control(db, "main", SQLITE_FCNTL_JOURNAL_POINTER, &pWal);
+            if (rc == SQLITE_OK && pWal != NULL && pWal->pMethods != NULL) {
+                rc = pWal->pMethods->xFileSize(pWal, &szWal);
+            }
+            if (rc == SQLITE_OK && szWal == 0) return SQLITE_OK;
+            sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+            if (rc != SQLITE_OK) return rc;
+        }
+        sqlite3_sleep(10 * (attempt + 1));
+    }
+    return SQLITE_BUSY;
+}
+
+#define KMP_DELTA_MAGIC "KMPDELT2"
+#define KMP_DELTA_HEADER 48        /* magic, pageSize, flags, epoch, baseEpoch, pageCount, nPage, checksum */
+#define KMP_DELTA_SUMMED 40        /* header bytes covered by the checksum, which follows them */
+
+/*
+ * Checksum of a delta, hash of its page records followed by the header bytes before the checksum.
+ * @param h hash of the page records, started from KMP_HASH_SEED
+ */
+static sqlite3_uint64 kmpDeltaSum(sqlite3_uint64 h, const unsigned char *aHead) {
+    return kmpHash(h, aHead, KMP_DELTA_SUMMED);
+}
+
+static void kmpDeltaInfo(const unsigned char *aHead, sqlite3_int64 *aInfo, int nInfo) {
+    sqlite3_int64 aValue[KMPSQL_DELTA_COUNT];
+    int i;
+    aValue[KMPSQL_DELTA_EPOCH] = (sqlite3_int64) kmpGet64(aHead + 16);
+    aValue[KMPSQL_DELTA_BASE_EPOCH] = (sqlite3_int64) kmpGet64(aHead + 24);
+    aValue[KMPSQL_DELTA_PAGES] = (sqlite3_int64) kmpGet32(aHead + 36);
+    aValue[KMPSQL_DELTA_PAGE_COUNT] = (sqlite3_int64) kmpGet32(aHead + 32);
+    aValue[KMPSQL_DELTA_PAGE_SIZE] = (sqlite3_int64) kmpGet32(aHead + 8);
+    aValue[KMPSQL_DELTA_FULL] = (sqlite3_int64) (kmpGet32(aHead + 12) & 1);
+    for (i = 0; aInfo != NULL && i < nInfo && i < KMPSQL_DELTA_COUNT; i++) {
+        aInfo[i] = aValue[i];
+    }
+}
+
+/*
+ * Copies the pages into the delta file. Caller holds the write transaction.
+ */
+static int kmpDeltaCopy(sqlite3 *db, KmpFile *p, const char *zDeltaPath, int full, unsigned char *aHead) {
+    KmpTrack *pTrack = p->pTrack;
+    char zPageSize[16];
+    unsigned char *aBit = NULL;
+    unsigned char *aPage = NULL;
+    unsigned char aPgno[4];
+    sqlite3_int64 szFile = 0;
+    sqlite3_uint64 headHash;
+    sqlite3_uint64 stamp;
+    sqlite3_uint64 sum = KMP_HASH_SEED;
+    sqlite3_int64 epoch;
+    sqlite3_int64 nPage;
+    sqlite3_int64 nCopied = 0;
+    sqlite3_int64 i;
+    int pageSize;
+    int nBit;
+    FILE *f = NULL;
+    int rc = kmpQueryText(db, "PRAGMA main.page_size", zPageSize, sizeof(zPageSize));
+
+    if (rc != SQLITE_OK) return rc;
+    pageSize = (int) strtol(zPageSize, NULL, 10);
+    if (pageSize < 512) return SQLITE_ERROR;
+    rc = p->base.pMethods->xFileSize(&p->base, &szFile);
+    if (rc != SQLITE_OK) return rc;
+    nPage = szFile / pageSize;
+    headHash = kmpFileHeadHash(p->pReal);
+    stamp = kmpFileStamp(pTrack->zPath);
+
+    sqlite3_mutex_enter(pTrack->pMutex);
+    if (pTrack->needsFull || pTrack->pageSize != pageSize || pTrack->headHash != headHash
+        || pTrack->isStampStale || pTrack->fileStamp != stamp) full = 1;
+    epoch = pTrack->epoch;
+    nBit = full ? 0 : pTrack->nBit;
+    aBit = nBit > 0 ? sqlite3_malloc(nBit) : NULL;
+    if (aBit != NULL) memcpy(aBit, pTrack->aBit, nBit);
+    sqlite3_mutex_leave(pTrack->pMutex);
+    if (nBit > 0 && aBit == NULL) return SQLITE_NOMEM;
+
+    memcpy(aHead, KMP_DELTA_MAGIC, 8);
+    kmpPut32(aHead + 8, pageSize);
+    kmpPut32(aHead + 12, full ? 1 : 0);
+    kmpPut64(aHead + 16, epoch + 1);
+    kmpPut64(aHead + 24, epoch);
+    kmpPut32(aHead + 32, nPage);
+    kmpPut32(aHead + 36, 0);
+    kmpPut64(aHead + 40, 0);
+    aPage = sqlite3_malloc(pageSize);
+    f = fopen(zDeltaPath, "wb");
+    if (aPage == NULL) rc = SQLITE_NOMEM;
+    else if (f == NULL) rc = SQLITE_CANTOPEN;
+    else if (fwrite(aHead, KMP_DELTA_HEADER, 1, f) != 1) rc = SQLITE_IOERR_WRITE;
+    for (i = 0; rc == SQLITE_OK && i < nPage; i++) {
+        if (!full && (i / 8 >= nBit || (aBit[i / 8] & (1 << (i % 8))) == 0)) continue;
+        rc = p->base.pMethods->xRead(&p->base, aPage, pageSize, i * pageSize);
+        if (rc != SQLITE_OK) break;
+        kmpPut32(aPgno, i + 1);
+        if (fwrite(aPgno, 4, 1, f) != 1 || fwrite(aPage, pageSize, 1, f) != 1) rc = SQLITE_IOERR_WRITE;
+        sum = kmpHash(kmpHash(sum, aPgno, 4), aPage, pageSize);
+        nCopied++;
+    }
+    if (rc == SQLITE_OK) {
+        kmpPut32(aHead + 36, nCopied);
+        kmpPut64(aHead + 40, kmpDeltaSum(sum, aHead));
+        if (fseek(f, 0, SEEK_SET) != 0
+            || fwrite(aHead, KMP_DELTA_HEADER, 1, f) != 1
+            || fflush(f) != 0
+            || fsync(fileno(f)) != 0) rc = SQLITE_IOERR_WRITE;
+    }
+    if (f != NULL && fclose(f) != 0 && rc == SQLITE_OK) rc = SQLITE_IOERR_WRITE;
+    if (rc == SQLITE_OK) {
+        /* nothing can write the file while the transaction is held, so all recorded pages are in this delta */
+        sqlite3_mutex_enter(pTrack->pMutex);
+        rc = kmpTrackSave(pTrack, epoch + 1, 0, NULL, 0);
+        if (rc == SQLITE_OK) {
+            pTrack->epoch = epoch + 1;
+            pTrack->needsFull = 0;
+            pTrack->isChanged = 0;
+            if (pTrack->nBit > 0) memset(pTrack->aBit, 0, pTrack->nBit);
+        }
+        sqlite3_mutex_leave(pTrack->pMutex);
+    } else if (f != NULL) {
+        remove(zDeltaPath);
+    }
+    sqlite3_free(aPage);
+    sqlite3_free(aBit);
+    return rc;
+}
+
+int kmpsql_delta_write(sqlite3 *db, const char *zDeltaPath, int full, sqlite3_int64 *aInfo, int nInfo) {
+    unsigned char aHead[KMP_DELTA_HEADER];
+    sqlite3_file *pFile = NULL;
+    int rc = sqlite3_file_control(db, "main", SQLITE_FCNTL_FILE_POINTER, &pFile);
+
+    if (rc != SQLITE_OK || pFile == NULL || pFile->pMethods != &kmpIoMethods || ((KmpFile *) pFile)->pTrack == NULL) {
+        return SQLITE_NOTFOUND;
+    }
+    if (!sqlite3_get_autocommit(db)) return SQLITE_MISUSE;
+    rc = kmpDeltaBegin(db);
+    if (rc != SQLITE_OK) return rc;
+    rc = kmpDeltaCopy(db, (KmpFile *) pFile, zDeltaPath, full, aHead);
+    sqlite3_exec(db, "COMMIT", NULL, NULL, NULL);
+    if (rc == SQLITE_OK) kmpDeltaInfo(aHead, aInfo, nInfo);
+    return rc;
+}
+
+/*
+ * Copies a file, for the base an incremental delta is applied to. The copy is synced with the
+ * delta pages later.
+ */
+static int kmpCopyFile(const char *zFrom, const char *zTo) {
+    unsigned char aBuf[8192];
+    FILE *pFrom = fopen(zFrom, "rb");
+    FILE *pTo;
+    size_t n;
+    int rc = SQLITE_OK;
+
+    if (pFrom == NULL) return SQLITE_CANTOPEN;
+    pTo = fopen(zTo, "wb");
+    if (pTo == NULL) {
+        fclose(pFrom);
+        return SQLITE_CANTOPEN;
+    }
+    while (rc == SQLITE_OK && (n = fread(aBuf, 1, sizeof(aBuf), pFrom)) > 0) {
+        if (fwrite(aBuf, 1, n, pTo) != n) rc = SQLITE_IOERR_WRITE;
+    }
+    if (rc == SQLITE_OK && ferror(pFrom)) rc = SQLITE_IOERR_READ;
+    if (fclose(pTo) != 0 && rc == SQLITE_OK) rc = SQLITE_IOERR_WRITE;
+    fclose(pFrom);
+    return rc;
+}
+
+int kmpsql_delta_apply(const char *zDeltaPath, const char *zTargetPath, sqlite3_int64 iBaseEpoch,
+                       sqlite3_int64 *aInfo, int nInfo) {
+    unsigned char aHead[KMP_DELTA_HEADER];
+    unsigned char aPgno[4];
+    unsigned char *aPage = NULL;
+    FILE *pDelta = fopen(zDeltaPath, "rb");
+    FILE *pTemp = NULL;
+    char *zTemp = NULL;
+    sqlite3_int64 pageSize;
+    sqlite3_int64 nPage;
+    sqlite3_int64 i;
+    sqlite3_uint64 pgno;
+    sqlite3_uint64 sum = KMP_HASH_SEED;
+    struct stat st;
+    int full;
+    int rc = SQLITE_OK;
+
+    if (pDelta == NULL) return SQLITE_CANTOPEN;
+    if (fread(aHead, KMP_DELTA_HEADER, 1, pDelta) != 1 || memcmp(aHead, KMP_DELTA_MAGIC, 8) != 0) {
+        fclose(pDelta);
+        return SQLITE_CORRUPT;
+    }
+    pageSize = (sqlite3_int64) kmpGet32(aHead + 8);
+    full = (int) (kmpGet32(aHead + 12) & 1);
+    nPage = (sqlite3_int64) kmpGet32(aHead + 36);
+    if (pageSize < 512 || pageSize > 65536 || (pageSize & (pageSize - 1)) != 0) rc = SQLITE_CORRUPT;
+    else if (fstat(fileno(pDelta), &st) != 0) rc = SQLITE_IOERR_FSTAT;
+    else if ((sqlite3_int64) st.st_size != KMP_DELTA_HEADER + nPage * (4 + pageSize)) rc = SQLITE_CORRUPT;
+    else if (!full && (iBaseEpoch < 0 || (sqlite3_uint64) iBaseEpoch != kmpGet64(aHead + 24))) rc = SQLITE_MISMATCH;
+
+    /* pages go into a copy that only replaces the target once complete, so a bad delta leaves the base intact */
+    if (rc == SQLITE_OK) {
+        aPage = sqlite3_malloc((int) pageSize);
+        zTemp = sqlite3_mprintf("%s.tmp", zTargetPath);
+        if (aPage == NULL || zTemp == NULL) rc = SQLITE_NOMEM;
+        else if (!full) rc = kmpCopyFile(zTargetPath, zTemp);
+    }
+    if (rc == SQLITE_OK) {
+        pTemp = fopen(zTemp, full ? "wb" : "r+b");
+        if (pTemp == NULL) rc = SQLITE_CANTOPEN;
+    }
+    for (i = 0; rc == SQLITE_OK && i < nPage; i++) {
+        if (fread(aPgno, 4, 1, pDelta) != 1 || fread(aPage, (size_t) pageSize, 1, pDelta) != 1) {
+            rc = SQLITE_CORRUPT;
+            break;
+        }
+        sum = kmpHash(kmpHash(sum, aPgno, 4), aPage, (int) pageSize);
+        pgno = kmpGet32(aPgno);
+        if (pgno == 0 || pgno > kmpGet32(aHead + 32)) rc = SQLITE_CORRUPT;
+        else if (fseeko(pTemp, (off_t) ((pgno - 1) * pageSize), SEEK_SET) != 0
+                 || fwrite(aPage, (size_t) pageSize, 1, pTemp) != 1) rc = SQLITE_IOERR_WRITE;
+    }
+    if (rc == SQLITE_OK && kmpDeltaSum(sum, aHead) != kmpGet64(aHead + KMP_DELTA_SUMMED)) rc = SQLITE_CORRUPT;
+    if (rc == SQLITE_OK) {
+        if (fflush(pTemp) != 0
+            || ftruncate(fileno(pTemp), (off_t) (kmpGet32(aHead + 32) * pageSize)) != 0
+            || fsync(fileno(pTemp)) != 0) rc = SQLITE_IOERR_WRITE;
+    }
+    if (pTemp != NULL && fclose(pTemp) != 0 && rc == SQLITE_OK) rc = SQLITE_IOERR_WRITE;
+    if (rc == SQLITE_OK) rc = kmpsql_file_replace(zTemp, zTargetPath);
+    if (rc != SQLITE_OK && zTemp != NULL) remove(zTemp);
+    fclose(pDelta);
+    sqlite3_free(aPage);
+    sqlite3_free(zTemp);
+    if (rc == SQLITE_OK) kmpDeltaInfo(aHead, aInfo, nInfo);
+    return rc;
+}
@@ -14,9 +14,10 @@ actual class SqliteDatabase: SqliteDatabaseNativeImpl() {
     actual fun open(
         path: String,
         readOnly: Boolean,
-        createOk: Boolean
+        createOk: Boolean,
+        vfsName: String
     ): Int {
-        return super.openImpl(path, readOnly, createOk)
+        return super.openImpl(path, readOnly, createOk, vfsName)
     }
 
     actual override fun close(): Int {
@@ -46,6 +47,10 @@ actual class SqliteDatabase: SqliteDatabaseNativeImpl() {
         return super.version()
     }
 
+    actual override fun compileOptionUsed(option: String): Boolean {
+        return super.compileOptionUsed(option)
+    }
+
     /**
      * Useful after an Insert statement when a ROWID is expected to be generated by Sqlite during
      * the insert
@@ -54,9 +59,113 @@ actual class SqliteDatabase: SqliteDatabaseNativeImpl() {
         return super.lastInsertRowid()
     }
 
+    actual override fun dataVersion(schema: String): Long {
+        return super.dataVersion(schema)
+    }
+
+    actual override fun totalChanges(): Long {
+        return super.totalChanges()
+    }
+
     actual override fun sleep(millis: Int) {
         super.sleep(millis)
     }
+
+    actual override fun registerReadaheadVfs(maxPages: Int, makeDefault: Boolean): Int {
+        return super.registerReadaheadVfs(maxPages, makeDefault)
+    }
+
+    actual override fun readaheadWindow(maxPages: Int): Int {
+        return super.readaheadWindow(maxPages)
+    }
+
+    actual override fun registerLatencyVfs(vfsName: String, config: LongArray): Int {
+        return super.registerLatencyVfs(vfsName, config)
+    }
+
+    actual override fun registerMetricsVfs(makeDefault: Boolean): Int {
+        return super.registerMetricsVfs(makeDefault)
+    }
+
+    actual override fun registerTrackingVfs(makeDefault: Boolean): Int {
+        return super.registerTrackingVfs(makeDefault)
+    }
+
+    actual override fun writeDelta(deltaPath: String, full: Boolean, info: LongArray): Int {
+        return super.writeDelta(deltaPath, full, info)
+    }
+
+    actual override fun applyDelta(deltaPath: String, targetPath: String, baseEpoch: Long, info: LongArray): Int {
+        return super.applyDelta(deltaPath, targetPath, baseEpoch, info)
+    }
+
+    actual override fun vfsMetrics(vfsName: String): LongArray {
+        return super.vfsMetrics(vfsName)
+    }
+
+    actual override fun fileMetrics(): LongArray {
+        return super.fileMetrics()
+    }
+
+    actual override fun memoryStatus(resetHighwater: Boolean): LongArray {
+        return super.memoryStatus(resetHighwater)
+    }
+
+    actual override fun dbStatus(reset: Boolean): LongArray {
+        return super.dbStatus(reset)
+    }
+
+    actual override fun serialize(schema: String): ByteArray {
+        return super.serialize(schema)
+    }
+
+    actual override fun deserialize(schema: String, image: ByteArray, readOnly: Boolean): Int {
+        return super.deserialize(schema, image, readOnly)
+    }
+
+    actual override fun deserializeMapped(schema: String, path: String): Int {
+        return super.deserializeMapped(schema, path)
+    }
+
+    actual override fun replaceFile(sourcePath: String, targetPath: String): Int {
+        return super.replaceFile(sourcePath, targetPath)
+    }
+
+    actual override fun removeFile(path: String): Int {
+        return super.removeFile(path)
+    }
+
+    actual override fun snapshotGet(schema: String, snapshot: LongArray): Int {
+        return super.snapshotGet(schema, snapshot)
+    }
+
+    actual override fun snapshotOpen(schema: String, snapshot: Long): Int {
+        return super.snapshotOpen(schema, snapshot)
+    }
+
+    actual override fun snapshotCompare(snapshot: Long, other: Long): Int {
+        return super.snapshotCompare(snapshot, other)
+    }
+
+    actual override fun snapshotFree(snapshot: Long) {
+        super.snapshotFree(snapshot)
+    }
+
+    actual override fun applyChangeset(changeset: ByteArray, conflict: ChangesetConflictHandler): Int {
+        return super.applyChangeset(changeset, conflict)
+    }
+
+    actual override fun applyChangesetFile(path: String, conflict: ChangesetConflictHandler): Int {
+        return super.applyChangesetFile(path, conflict)
+    }
+
+    actual override fun invertChangeset(changeset: ByteArray): ByteArray {
+        return super.invertChangeset(changeset)
+    }
+
+    actual override fun combineChangesets(changesets: List<ByteArray>): ByteArray {
+        return super.combineChangesets(changesets)
+    }
 }
 
 actual class SqliteStatement actual constructor(db: SqliteDatabase)
@@ -133,6 +242,10 @@ actual class SqliteStatement actual constructor(db: SqliteDatabase)
         return super.isBusy()
     }
 
+    actual override fun scanStatus(index: Int, counts: LongArray): String? {
+        return super.scanStatus(index, counts)
+    }
+
     actual override fun columnCount(): Int {
         return super.columnCount()
     }
@@ -172,4 +285,56 @@ actual class SqliteStatement actual constructor(db: SqliteDatabase)
     actual override fun columnLong(index: Int): Long {
         return super.columnLong(index)
     }
-}
\ No newline at end of file
+}
+
+actual class SqliteBackup actual constructor(destination: SqliteDatabase, source: SqliteDatabase)
+    :SqliteBackupNativeImpl(destination, source)
+{
+    actual override fun init(): Int {
+        return super.init()
+    }
+
+    actual override fun step(pages: Int): SqliteBackupResult {
+        return super.step(pages)
+    }
+
+    actual override fun remaining(): Int {
+        return super.remaining()
+    }
+
+    actual override fun pageCount(): Int {
+        return super.pageCount()
+    }
+
+    actual override fun finish(): Int {
+        return super.finish()
+    }
+}
+
+actual class SqliteSession actual constructor(db: SqliteDatabase)
+    :SqliteSessionNativeImpl(db)
+{
+    actual override fun create(schema: String, rowidTables: Boolean): Int {
+        return super.create(schema, rowidTables)
+    }
+
+    actual override fun attach(table: String): Int {
+        return super.attach(table)
+    }
+
+    actual override fun isEmpty(): Boolean {
+        return super.isEmpty()
+    }
+
+    actual override fun changeset(patchset: Boolean): ByteArray {
+        return super.changeset(patchset)
+    }
+
+    actual override fun write(path: String, patchset: Boolean): Int {
+        return super.write(path, patchset)
+    }
+
+    actual override fun delete() {
+        super.delete()
+    }
+}
@@ -2,10 +2,15 @@ package com.oldguy.kiscmp
 
 import com.oldguy.sqlcipher.*
 import cnames.structs.sqlite3
+import cnames.structs.sqlite3_backup
+import cnames.structs.sqlite3_changegroup
+import cnames.structs.sqlite3_changeset_iter
+import cnames.structs.sqlite3_session
 import cnames.structs.sqlite3_stmt
 import com.oldguy.common.io.charsets.Utf16BE
 import com.oldguy.common.io.charsets.Utf16LE
 import kotlinx.cinterop.*
+import platform.posix.memcpy
 import kotlin.experimental.ExperimentalNativeApi
 
 /**
@@ -33,7 +38,8 @@ open class SqliteDatabaseNativeImpl {
     open fun openImpl(
         path: String,
         readOnly: Boolean,
-        createOk: Boolean
+        createOk: Boolean,
+        vfsName: String
     ): Int {
         memScoped {
             val dbPtr = alloc<CPointerVar<sqlite3>>()
@@ -43,7 +49,7 @@ open class SqliteDatabaseNativeImpl {
                 SQLITE_OPEN_READWRITE + SQLITE_OPEN_CREATE
             else
                 SQLITE_OPEN_READWRITE
-            val rc = sqlite3_open_v2(path, dbPtr.ptr, openFlags, null)
+            val rc = sqlite3_open_v2(path, dbPtr.ptr, openFlags, vfsName.ifEmpty { null })
             if (rc != SQLITE_OK)
                 throw IllegalStateException("Cannot open database: $path, rc: $rc, error: ${sqlite3_errmsg(dbPtr.value)?.toKString()}")
             dbContext = dbPtr.value!!
@@ -115,6 +121,10 @@ open class SqliteDatabaseNativeImpl {
         return SQLITE_VERSION
     }
 
+    open fun compileOptionUsed(option: String): Boolean {
+        return sqlite3_compileoption_used(option) != 0
+    }
+
     /**
      * Useful after an Insert statement when a ROWID is expected to be generated by Sqlite during
      * the insert
@@ -125,9 +135,276 @@ open class SqliteDatabaseNativeImpl {
         } ?: throw SqliteException("Attempt to invoke lastInsertRowid on closed database")
     }
 
+    open fun dataVersion(schema: String): Long {
+        val db = dbContext ?: return -1
+        val sql = "PRAGMA \"${schema.replace("\"", "\"\"")}\".data_version"
+        memScoped {
+            val stmt = alloc<CPointerVar<sqlite3_stmt>>()
+            var version = -1L
+            if (sqlite3_prepare_v2(db, sql.cstr.ptr, -1, stmt.ptr, null) == SQLITE_OK
+                && sqlite3_step(stmt.value) == SQLITE_ROW)
+                version = sqlite3_column_int64(stmt.value, 0)
+            sqlite3_finalize(stmt.value)
+            return version
+        }
+    }
+
+    open fun totalChanges(): Long {
+        return dbContext?.let { sqlite3_total_changes64(it) } ?: -1
+    }
+
     open fun sleep(millis: Int) {
         sqlite3_sleep(millis)
     }
+
+    open fun registerReadaheadVfs(maxPages: Int, makeDefault: Boolean): Int {
+        return kmpsql_readahead_register(null, maxPages, if (makeDefault) 1 else 0)
+    }
+
+    open fun readaheadWindow(maxPages: Int): Int {
+        val db = dbContext ?: return -1
+        return kmpsql_readahead_file(db, "main", maxPages)
+    }
+
+    open fun registerLatencyVfs(vfsName: String, config: LongArray): Int {
+        return kmpsql_latency_register(vfsName, null, config.toCValues(), config.size)
+    }
+
+    open fun registerMetricsVfs(makeDefault: Boolean): Int {
+        return kmpsql_metrics_register(null, if (makeDefault) 1 else 0)
+    }
+
+    open fun registerTrackingVfs(makeDefault: Boolean): Int {
+        return kmpsql_tracking_register(null, if (makeDefault) 1 else 0)
+    }
+
+    open fun writeDelta(deltaPath: String, full: Boolean, info: LongArray): Int {
+        val db = dbContext ?: return SQLITE_MISUSE
+        return deltaInfo(info) { kmpsql_delta_write(db, deltaPath, if (full) 1 else 0, it, KMPSQL_DELTA_COUNT) }
+    }
+
+    open fun applyDelta(deltaPath: String, targetPath: String, baseEpoch: Long, info: LongArray): Int {
+        return deltaInfo(info) { kmpsql_delta_apply(deltaPath, targetPath, baseEpoch, it, KMPSQL_DELTA_COUNT) }
+    }
+
+    private fun deltaInfo(info: LongArray, call: (CPointer<LongVar>) -> Int): Int {
+        memScoped {
+            val values = allocArray<LongVar>(KMPSQL_DELTA_COUNT)
+            val rc = call(values)
+            if (rc == SQLITE_OK && info.size >= KMPSQL_DELTA_COUNT) {
+                for (i in 0 until KMPSQL_DELTA_COUNT) info[i] = values[i]
+            }
+            return rc
+        }
+    }
+
+    open fun vfsMetrics(vfsName: String): LongArray {
+        return metrics { kmpsql_vfs_metrics(vfsName, it, KMPSQL_METRIC_COUNT) }
+    }
+
+    open fun fileMetrics(): LongArray {
+        return dbContext?.let { db ->
+            metrics { kmpsql_vfs_file_metrics(db, "main", it, KMPSQL_METRIC_COUNT) }
+        } ?: LongArray(0)
+    }
+
+    open fun memoryStatus(resetHighwater: Boolean): LongArray {
+        return longArrayOf(sqlite3_memory_used(), sqlite3_memory_highwater(if (resetHighwater) 1 else 0))
+    }
+
+    open fun dbStatus(reset: Boolean): LongArray {
+        val db = dbContext ?: return LongArray(0)
+        val values = LongArray((SQLITE_DBSTATUS_MAX + 1) * 2)
+        memScoped {
+            val current = alloc<IntVar>()
+            val highwater = alloc<IntVar>()
+            for (op in 0..SQLITE_DBSTATUS_MAX) {
+                if (sqlite3_db_status(db, op, current.ptr, highwater.ptr, if (reset) 1 else 0) == SQLITE_OK) {
+                    values[op * 2] = current.value.toLong()
+                    values[op * 2 + 1] = highwater.value.toLong()
+                }
+            }
+        }
+        return values
+    }
+
+    open fun serialize(schema: String): ByteArray {
+        val db = dbContext ?: return ByteArray(0)
+        memScoped {
+            val size = alloc<LongVar>()
+            val image = sqlite3_serialize(db, schema, size.ptr, 0u) ?: return ByteArray(0)
+            val bytes = image.readBytes(size.value.toInt())
+            sqlite3_free(image)
+            return bytes
+        }
+    }
+
+    open fun deserialize(schema: String, image: ByteArray, readOnly: Boolean): Int {
+        val db = dbContext ?: return SQLITE_MISUSE
+        val buf = sqlite3_malloc64(maxOf(image.size, 1).toULong())?.reinterpret<UByteVar>()
+            ?: return SQLITE_NOMEM
+        if (image.isNotEmpty()) {
+            image.usePinned { memcpy(buf, it.addressOf(0), image.size.toULong()) }
+        }
+        val flags = SQLITE_DESERIALIZE_FREEONCLOSE or
+                if (readOnly) SQLITE_DESERIALIZE_READONLY else SQLITE_DESERIALIZE_RESIZEABLE
+        return sqlite3_deserialize(db, schema, buf, image.size.toLong(), image.size.toLong(), flags.toUInt())
+    }
+
+    open fun deserializeMapped(schema: String, path: String): Int {
+        val db = dbContext ?: return SQLITE_MISUSE
+        return kmpsql_deserialize_mapped(db, schema, path)
+    }
+
+    open fun replaceFile(sourcePath: String, targetPath: String): Int {
+        return kmpsql_file_replace(sourcePath, targetPath)
+    }
+
+    open fun removeFile(path: String): Int {
+        return kmpsql_file_remove(path)
+    }
+
+    open fun snapshotGet(schema: String, snapshot: LongArray): Int {
+        val db = dbContext ?: return SQLITE_MISUSE
+        memScoped {
+            val pSnapshot = alloc<CPointerVar<sqlite3_snapshot>>()
+            val rc = sqlite3_snapshot_get(db, schema, pSnapshot.ptr)
+            if (rc == SQLITE_OK)
+                snapshot[0] = pSnapshot.value.toLong()
+            return rc
+        }
+    }
+
+    open fun snapshotOpen(schema: String, snapshot: Long): Int {
+        val db = dbContext ?: return SQLITE_MISUSE
+        val pSnapshot = snapshot.toCPointer<sqlite3_snapshot>() ?: return SQLITE_MISUSE
+        return sqlite3_snapshot_open(db, schema, pSnapshot)
+    }
+
+    open fun snapshotCompare(snapshot: Long, other: Long): Int {
+        val p1 = snapshot.toCPointer<sqlite3_snapshot>() ?: return 0
+        val p2 = other.toCPointer<sqlite3_snapshot>() ?: return 0
+        return sqlite3_snapshot_cmp(p1, p2)
+    }
+
+    open fun snapshotFree(snapshot: Long) {
+        snapshot.toCPointer<sqlite3_snapshot>()?.let { sqlite3_snapshot_free(it) }
+    }
+
+    open fun applyChangeset(changeset: ByteArray, conflict: ChangesetConflictHandler): Int {
+        val db = dbContext ?: return SQLITE_MISUSE
+        return withConflictContext(conflict) { context ->
+            changeset.usePinned {
+                sqlite3changeset_apply_v2(db, changeset.size, if (changeset.isEmpty()) null else it.addressOf(0),
+                    null, conflictFunction, context, null, null, 0)
+            }
+        }
+    }
+
+    open fun applyChangesetFile(path: String, conflict: ChangesetConflictHandler): Int {
+        val db = dbContext ?: return SQLITE_MISUSE
+        return withConflictContext(conflict) { context ->
+            kmpsql_changeset_apply_file(db, path, conflictFunction, context)
+        }
+    }
+
+    /**
+     * Holds the handler for the duration of an apply. An exception thrown by the handler can not
+     * cross the C callback, so it aborts the apply and is rethrown here.
+     */
+    private fun withConflictContext(conflict: ChangesetConflictHandler, apply: (COpaquePointer) -> Int): Int {
+        val context = ConflictContext(conflict)
+        val stable = StableRef.create(context)
+        try {
+            val rc = apply(stable.asCPointer())
+            context.error?.let { throw it }
+            return rc
+        } finally {
+            stable.dispose()
+        }
+    }
+
+    open fun invertChangeset(changeset: ByteArray): ByteArray {
+        memScoped {
+            val size = alloc<IntVar>()
+            val inverted = alloc<COpaquePointerVar>()
+            val rc = changeset.usePinned {
+                sqlite3changeset_invert(changeset.size, if (changeset.isEmpty()) null else it.addressOf(0),
+                    size.ptr, inverted.ptr)
+            }
+            return changesetBytes(rc, "sqlite3changeset_invert", size.value, inverted.value)
+        }
+    }
+
+    open fun combineChangesets(changesets: List<ByteArray>): ByteArray {
+        memScoped {
+            val group = alloc<CPointerVar<sqlite3_changegroup>>()
+            var rc = sqlite3changegroup_new(group.ptr)
+            changesets.forEach { changeset ->
+                if (rc == SQLITE_OK) {
+                    rc = changeset.usePinned {
+                        sqlite3changegroup_add(group.value, changeset.size,
+                            if (changeset.isEmpty()) null else it.addressOf(0))
+                    }
+                }
+            }
+            val size = alloc<IntVar>()
+            val combined = alloc<COpaquePointerVar>()
+            if (rc == SQLITE_OK)
+                rc = sqlite3changegroup_output(group.value, size.ptr, combined.ptr)
+            sqlite3changegroup_delete(group.value)
+            return changesetBytes(rc, "sqlite3changegroup_output", size.value, combined.value)
+        }
+    }
+
+    private fun changesetBytes(rc: Int, apiName: String, size: Int, set: COpaquePointer?): ByteArray {
+        if (rc != SQLITE_OK)
+            throw SqliteException(sqlite3_errstr(rc)?.toKString() ?: "", apiName, rc)
+        val bytes = if (size > 0) set?.readBytes(size) ?: ByteArray(0) else ByteArray(0)
+        sqlite3_free(set)
+        return bytes
+    }
+
+    private fun metrics(query: (CPointer<LongVar>) -> Int): LongArray {
+        memScoped {
+            val values = allocArray<LongVar>(KMPSQL_METRIC_COUNT)
+            return if (query(values) == SQLITE_OK)
+                LongArray(KMPSQL_METRIC_COUNT) { values[it] }
+            else
+                LongArray(0)
+        }
+    }
+}
+
+private class ConflictContext(val handler: ChangesetConflictHandler) {
+    var error: Throwable? = null
+}
+
+@OptIn(ExperimentalForeignApi::class)
+private val conflictFunction = staticCFunction { pContext: COpaquePointer?, eConflict: Int, pIter: CPointer<sqlite3_changeset_iter>? ->
+    val context = pContext!!.asStableRef<ConflictContext>().get()
+    memScoped {
+        val table = alloc<CPointerVar<ByteVar>>()
+        val columns = alloc<IntVar>()
+        val op = alloc<IntVar>()
+        val indirect = alloc<IntVar>()
+        sqlite3changeset_op(pIter, table.ptr, columns.ptr, op.ptr, indirect.ptr)
+        val operation = when (op.value) {
+            SQLITE_INSERT -> ChangeOperation.Insert
+            SQLITE_UPDATE -> ChangeOperation.Update
+            else -> ChangeOperation.Delete
+        }
+        try {
+            context.handler(
+                ChangesetConflictType.entries[eConflict - SQLITE_CHANGESET_DATA],
+                table.value?.toKString() ?: "",
+                operation
+            ).ordinal
+        } catch (e: Throwable) {
+            context.error = e
+            SQLITE_CHANGESET_ABORT
+        }
+    }
 }
 
 @OptIn(ExperimentalForeignApi::class, ExperimentalNativeApi::class)
@@ -250,6 +527,25 @@ open class SqliteStatementNativeImpl(private val db: SqliteDatabaseNativeImpl) {
         return sqlite3_stmt_busy(openStatement) > 0
     }
 
+    open fun scanStatus(index: Int, counts: LongArray): String? {
+        val stmt = openStatement
+        memScoped {
+            val loops = alloc<LongVar>()
+            val visits = alloc<LongVar>()
+            val selectId = alloc<IntVar>()
+            val explain = alloc<CPointerVar<ByteVar>>()
+            if (sqlite3_stmt_scanstatus(stmt, index, SQLITE_SCANSTAT_NLOOP, loops.ptr) != 0
+                || sqlite3_stmt_scanstatus(stmt, index, SQLITE_SCANSTAT_NVISIT, visits.ptr) != 0
+                || sqlite3_stmt_scanstatus(stmt, index, SQLITE_SCANSTAT_SELECTID, selectId.ptr) != 0
+                || sqlite3_stmt_scanstatus(stmt, index, SQLITE_SCANSTAT_EXPLAIN, explain.ptr) != 0)
+                return null
+            counts[0] = loops.value
+            counts[1] = visits.value
+            counts[2] = selectId.value.toLong()
+            return explain.value?.toKString() ?: ""
+        }
+    }
+
     open fun columnCount(): Int {
         return sqlite3_column_count(openStatement)
     }
@@ -316,4 +612,109 @@ open class SqliteStatementNativeImpl(private val db: SqliteDatabaseNativeImpl) {
     open fun columnLong(index: Int): Long {
         return sqlite3_column_int64(openStatement, index)
     }
-}
\ No newline at end of file
+}
+
+@OptIn(ExperimentalForeignApi::class)
+open class SqliteBackupNativeImpl(
+    private val destination: SqliteDatabaseNativeImpl,
+    private val source: SqliteDatabaseNativeImpl
+) {
+    private var backupContext: CPointer<sqlite3_backup>? = null
+
+    open fun init(): Int {
+        val dest = destination.dbContext ?: return SQLITE_MISUSE
+        val src = source.dbContext ?: return SQLITE_MISUSE
+        backupContext = sqlite3_backup_init(dest, "main", src, "main")
+        return if (backupContext == null) sqlite3_errcode(dest) else SQLITE_OK
+    }
+
+    open fun step(pages: Int): SqliteBackupResult {
+        val backup = backupContext ?: return SqliteBackupResult.Error
+        return when (sqlite3_backup_step(backup, pages) and 0xff) {
+            SQLITE_OK -> SqliteBackupResult.Ok
+            SQLITE_DONE -> SqliteBackupResult.Done
+            SQLITE_BUSY -> SqliteBackupResult.Busy
+            SQLITE_LOCKED -> SqliteBackupResult.Locked
+            else -> SqliteBackupResult.Error
+        }
+    }
+
+    open fun remaining(): Int {
+        return backupContext?.let { sqlite3_backup_remaining(it) } ?: 0
+    }
+
+    open fun pageCount(): Int {
+        return backupContext?.let { sqlite3_backup_pagecount(it) } ?: 0
+    }
+
+    open fun finish(): Int {
+        return backupContext?.let {
+            backupContext = null
+            sqlite3_backup_finish(it)
+        } ?: SQLITE_OK
+    }
+}
+
+@OptIn(ExperimentalForeignApi::class)
+open class SqliteSessionNativeImpl(
+    private val db: SqliteDatabaseNativeImpl
+) {
+    private var sessionContext: CPointer<sqlite3_session>? = null
+
+    open fun create(schema: String, rowidTables: Boolean): Int {
+        val dbContext = db.dbContext ?: return SQLITE_MISUSE
+        memScoped {
+            val session = alloc<CPointerVar<sqlite3_session>>()
+            var rc = sqlite3session_create(dbContext, schema, session.ptr)
+            if (rc == SQLITE_OK && rowidTables) {
+                val enable = alloc<IntVar>()
+                enable.value = 1
+                rc = sqlite3session_object_config(session.value, SQLITE_SESSION_OBJCONFIG_ROWID, enable.ptr)
+                if (rc != SQLITE_OK)
+                    sqlite3session_delete(session.value)
+            }
+            if (rc == SQLITE_OK)
+                sessionContext = session.value
+            return rc
+        }
+    }
+
+    open fun attach(table: String): Int {
+        val session = sessionContext ?: return SQLITE_MISUSE
+        return sqlite3session_attach(session, table.ifEmpty { null })
+    }
+
+    open fun isEmpty(): Boolean {
+        return sessionContext?.let { sqlite3session_isempty(it) != 0 } ?: true
+    }
+
+    open fun changeset(patchset: Boolean): ByteArray {
+        val session = sessionContext ?: return ByteArray(0)
+        memScoped {
+            val size = alloc<IntVar>()
+            val set = alloc<COpaquePointerVar>()
+            val rc = if (patchset)
+                sqlite3session_patchset(session, size.ptr, set.ptr)
+            else
+                sqlite3session_changeset(session, size.ptr, set.ptr)
+            val bytes = if (rc == SQLITE_OK && size.value > 0)
+                set.value?.readBytes(size.value) ?: ByteArray(0)
+            else
+                ByteArray(0)
+            sqlite3_free(set.value)
+            return bytes
+        }
+    }
+
+    open fun write(path: String, patchset: Boolean): Int {
+        val session = sessionContext ?: return SQLITE_MISUSE
+        return kmpsql_session_write(session, path, if (patchset) 1 else 0)
+    }
+
+    open fun delete() {
+        sessionContext?.let {
+            sessionContext = null
+            sqlite3session_delete(it)
+        }
+    }
+}
@@ -66,4 +66,123 @@ class BasicTestsNative: SqlCipherTests() {
             testPasswordsAndUpgrade(SystemTemporaryDirectory.name)
         }
     }
-}
\ No newline at end of file
+
+    @Test
+    fun testReadaheadVfs() {
+        runBlocking {
+            testReadahead(SystemTemporaryDirectory.name)
+        }
+    }
+
+    @Test
+    fun testLatencyVfs() {
+        runBlocking {
+            testLatency(SystemTemporaryDirectory.name)
+        }
+    }
+
+    @Test
+    fun testBackupTo() {
+        runBlocking {
+            testBackup(SystemTemporaryDirectory.name)
+        }
+    }
+
+    @Test
+    fun testIncrementalBackup() {
+        runBlocking {
+            testBackupChanges(SystemTemporaryDirectory.name)
+        }
+    }
+
+    @Test
+    fun testMmapSize() {
+        runBlocking {
+            testMmap(SystemTemporaryDirectory.name)
+        }
+    }
+
+    @Test
+    fun testSerializeImages() {
+        runBlocking {
+            testSerialize(SystemTemporaryDirectory.name)
+        }
+    }
+
+    @Test
+    fun testSessionChangeCapture() {
+        runBlocking {
+            testChangeCapture(SystemTemporaryDirectory.name)
+        }
+    }
+
+    @Test
+    fun testChangesetApply() {
+        runBlocking {
+            testApplyChanges(SystemTemporaryDirectory.name)
+        }
+    }
+
+    @Test
+    fun testWalCheckpoints() {
+        runBlocking {
+            testWalCheckpointer(SystemTemporaryDirectory.name)
+        }
+    }
+
+    @Test
+    fun testOnlineCompaction() {
+        runBlocking {
+            testCompact(SystemTemporaryDirectory.name)
+        }
+    }
+
+    @Test
+    fun testIncrementalVacuumScheduler() {
+        runBlocking {
+            testIncrementalVacuum(SystemTemporaryDirectory.name)
+        }
+    }
+
+    @Test
+    fun testOptimizeMaintenance() {
+        runBlocking {
+            testOptimize(SystemTemporaryDirectory.name)
+        }
+    }
+
+    @Test
+    fun testQueryPlanRegressions() {
+        runBlocking {
+            testQueryPlans(SystemTemporaryDirectory.name)
+        }
+    }
+
+    @Test
+    fun testMemoryCounters() {
+        runBlocking {
+            testMemoryStatus(SystemTemporaryDirectory.name)
+        }
+    }
+
+    @Test
+    fun testReadSnapshots() {
+        runBlocking {
+            testSnapshots(SystemTemporaryDirectory.name)
+        }
+    }
+
+    @Test
+    fun testChangeTokenDetection() {
+        runBlocking {
+            testChangeTokens(SystemTemporaryDirectory.name)
+        }
+    }
+
+    @Test
+    fun testSharedMemoryReads() {
+        runBlocking {
+            testSharedMemory()
+        }
+    }
+}
@@ -2,3 +2,5 @@
 -dontwarn java.lang.invoke.StringConcatFactory
 -keep class com.oldguy.kiscmp.Sqlite3JniShim { *; }
 -keep class com.oldguy.kiscmp.Sqlite3StatementJniShim { *; }
+-keep class com.oldguy.kiscmp.Sqlite3BackupJniShim { *; }
+-keep class com.oldguy.kiscmp.Sqlite3SessionJniShim { *; }
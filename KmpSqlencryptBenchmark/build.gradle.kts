@@ -0,0 +1,44 @@
+plugins {
+    libs.plugins.also {
+        alias(it.kotlin.jvm)
+        alias(it.kotlin.allopen)
+        alias(it.jmh)
+    }
+}
+
+// renamed from :KmpSqlencrypt in settings.gradle.kts
+val sqlcipherProjectPath = ":kmp-sqlencrypt"
+evaluationDependsOn(sqlcipherProjectPath)
+val sqlcipherProject = project(sqlcipherProjectPath)
+
+dependencies {
+    jmh(project(sqlcipherProjectPath))
+    jmh(libs.kotlinx.coroutines.core)
+    jmh(libs.kotlinx.datetime)
+}
+
+// JMH generates subclasses of the @State classes
+allOpen {
+    annotation("org.openjdk.jmh.annotations.State")
+}
+
+/**
+ * gradle jmh runs every benchmark with the GC profiler, so allocations per operation (gc.alloc.rate.norm)
+ * are reported next to the time per operation. Results are written as JSON to build/results/jmh.
+ * -PjmhInclude=<regex> runs a subset, for example -PjmhInclude=JniShimBenchmark
+ */
+jmh {
+    jmhVersion.set(libs.versions.jmh)
+    profilers.add("gc")
+    resultFormat.set("JSON")
+    providers.gradleProperty("jmhInclude").orNull?.let {
+        includes.add(it)
+    }
+    jvmArgsAppend.add(
+        "-Djava.library.path=${sqlcipherProject.layout.buildDirectory.dir("jvmJni").get().asFile.absolutePath}"
+    )
+}
+
+tasks.named("jmh") {
+    dependsOn("$sqlcipherProjectPath:buildJvmJni")
+}
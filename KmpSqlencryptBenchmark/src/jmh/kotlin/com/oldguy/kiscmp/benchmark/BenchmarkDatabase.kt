@@ -0,0 +1,52 @@
+package com.oldguy.kiscmp.benchmark
+
+import com.oldguy.database.Passphrase
+import com.oldguy.kiscmp.SqlCipherDatabase
+import com.oldguy.kiscmp.sqlcipher
+import kotlinx.coroutines.runBlocking
+import java.io.File
+
+/**
+ * Encrypted database in the temporary directory used by every benchmark layer. Table bench has one
+ * column of each basic type, plus a DATETIME column selected separately so the cost of date parsing
+ * can be attributed on its own.
+ */
+object BenchmarkDatabase {
+    const val rows = 1000
+    const val key = "kmpsqlBenchmark"
+    const val pragmaKey = "PRAGMA key = '$key';"
+    const val selectColumns = "select id, i, l, d, t, b from bench"
+    const val selectById = "$selectColumns where id = ?"
+    const val selectRange = "$selectColumns where id between ? and ?"
+    const val selectDateTime = "select dt from bench"
+    const val updateById = "update bench set i = ? where id = ?"
+    val passphrase = Passphrase(key)
+
+    fun path(name: String): String = File(System.getProperty("java.io.tmpdir"), name).absolutePath
+
+    /**
+     * Creates the benchmark database as file [name] in the temporary directory, replacing any
+     * previous one.
+     * @return the open database. Close it in the trial teardown.
+     */
+    fun create(name: String): SqlCipherDatabase = runBlocking {
+        val dbPath = path(name)
+        File(dbPath).delete()
+        sqlcipher {
+            path = dbPath
+            createOk = true
+        }.also {
+            it.open(passphrase)
+            it.execute("create table bench(id INTEGER PRIMARY KEY, i INT(9), l BIGINT, d DOUBLE(15), " +
+                    "t TEXT, b BLOB, dt DATETIME);" +
+                    "with recursive c(x) as (select 1 union all select x + 1 from c where x < $rows) " +
+                    "insert into bench(i, l, d, t, b, dt) select x, x * 4294967296, x / 3.0, " +
+                    "printf('text value %d', x), randomblob(32), " +
+                    "strftime('%Y-%m-%dT%H:%M:%f', 1700000000 + x * 60, 'unixepoch') from c;")
+        }
+    }
+
+    fun delete(name: String) {
+        File(path(name)).delete()
+    }
+}
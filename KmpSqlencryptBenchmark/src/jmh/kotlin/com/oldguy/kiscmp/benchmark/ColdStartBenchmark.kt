@@ -0,0 +1,66 @@
+package com.oldguy.kiscmp.benchmark
+
+import com.oldguy.database.Passphrase
+import com.oldguy.kiscmp.sqlcipher
+import kotlinx.coroutines.runBlocking
+import org.openjdk.jmh.annotations.Benchmark
+import org.openjdk.jmh.annotations.BenchmarkMode
+import org.openjdk.jmh.annotations.Fork
+import org.openjdk.jmh.annotations.Level
+import org.openjdk.jmh.annotations.Measurement
+import org.openjdk.jmh.annotations.Mode
+import org.openjdk.jmh.annotations.OutputTimeUnit
+import org.openjdk.jmh.annotations.Scope
+import org.openjdk.jmh.annotations.Setup
+import org.openjdk.jmh.annotations.State
+import org.openjdk.jmh.annotations.Warmup
+import java.util.concurrent.TimeUnit
+
+/**
+ * Time to first query in a new JVM. Every measurement is the first call in its own fork, so it
+ * includes class loading, System.loadLibrary with JNI_OnLoad registering the natives and
+ * initializing Sqlite, and the first open. Nothing in setup touches the library.
+ *
+ * [loadShim] is the library load alone. [firstQueryPlain] adds opening a new unencrypted database
+ * and one query, [firstQueryEncrypted] adds key derivation, which usually dominates.
+ */
+@BenchmarkMode(Mode.SingleShotTime)
+@OutputTimeUnit(TimeUnit.MICROSECONDS)
+@Warmup(iterations = 0)
+@Measurement(iterations = 1)
+@Fork(20)
+@State(Scope.Thread)
+class ColdStartBenchmark {
+    private val dbName = "kmpsql_jmh_cold.db"
+
+    @Setup(Level.Iteration)
+    fun setup() {
+        BenchmarkDatabase.delete(dbName)
+    }
+
+    @Benchmark
+    fun loadShim(): Class<*> {
+        return Class.forName("com.oldguy.kiscmp.Sqlite3JniShim")
+    }
+
+    @Benchmark
+    fun firstQueryPlain(): Int = firstQuery(Passphrase())
+
+    @Benchmark
+    fun firstQueryEncrypted(): Int = firstQuery(BenchmarkDatabase.passphrase)
+
+    private fun firstQuery(passphrase: Passphrase): Int = runBlocking {
+        val dbPath = BenchmarkDatabase.path(dbName)
+        val db = sqlcipher {
+            path = dbPath
+            createOk = true
+        }
+        db.open(passphrase)
+        var count = 0
+        db.query("select count(*) from sqlite_master").retrieveOne { _, row ->
+            count = row.requireLong(0).toInt()
+        }
+        db.close()
+        count
+    }
+}
@@ -0,0 +1,130 @@
+package com.oldguy.kiscmp.benchmark
+
+import com.oldguy.kiscmp.Sqlite3JniShim
+import com.oldguy.kiscmp.Sqlite3StatementJniShim
+import org.openjdk.jmh.annotations.Benchmark
+import org.openjdk.jmh.annotations.BenchmarkMode
+import org.openjdk.jmh.annotations.Fork
+import org.openjdk.jmh.annotations.Level
+import org.openjdk.jmh.annotations.Measurement
+import org.openjdk.jmh.annotations.Mode
+import org.openjdk.jmh.annotations.OutputTimeUnit
+import org.openjdk.jmh.annotations.Scope
+import org.openjdk.jmh.annotations.Setup
+import org.openjdk.jmh.annotations.State
+import org.openjdk.jmh.annotations.TearDown
+import org.openjdk.jmh.annotations.Warmup
+import org.openjdk.jmh.infra.Blackhole
+import java.util.concurrent.TimeUnit
+
+/**
+ * Lowest layer, the JNI externals called directly. Everything measured here is a JNI crossing plus
+ * the sqlite call behind it, and any java object the C++ side creates (strings, byte arrays).
+ * [crossing] is the cost of a crossing that does almost no native work.
+ */
+@BenchmarkMode(Mode.AverageTime)
+@OutputTimeUnit(TimeUnit.NANOSECONDS)
+@Warmup(iterations = 3, time = 1)
+@Measurement(iterations = 5, time = 1)
+@Fork(1)
+@State(Scope.Thread)
+class JniShimBenchmark {
+    private val dbName = "kmpsql_jmh_shim.db"
+    private val shim = Sqlite3JniShim()
+    private val select = Sqlite3StatementJniShim()
+    private val scan = Sqlite3StatementJniShim()
+    private val bind = Sqlite3StatementJniShim()
+    private val text = "x".repeat(64)
+    private val bytes = ByteArray(64) { it.toByte() }
+    private var id = 0
+
+    @Setup(Level.Trial)
+    fun setup() {
+        BenchmarkDatabase.create(dbName).close()
+        shim.open(BenchmarkDatabase.path(dbName), false, false, "")
+        shim.exec(BenchmarkDatabase.pragmaKey)
+        select.prepare(shim.handle, BenchmarkDatabase.selectById)
+        scan.prepare(shim.handle, BenchmarkDatabase.selectColumns)
+        bind.prepare(shim.handle, "select ?")
+    }
+
+    @TearDown(Level.Trial)
+    fun tearDown() {
+        select.finalize()
+        scan.finalize()
+        bind.finalize()
+        shim.close()
+        BenchmarkDatabase.delete(dbName)
+    }
+
+    @Benchmark
+    fun crossing(): Long {
+        return shim.lastInsertRowid()
+    }
+
+    @Benchmark
+    fun prepareFinalize(): Int {
+        val statement = Sqlite3StatementJniShim()
+        statement.prepare(shim.handle, BenchmarkDatabase.selectById)
+        return statement.finalize()
+    }
+
+    @Benchmark
+    fun bindInt(): Int {
+        return bind.bindInt(1, 12345)
+    }
+
+    @Benchmark
+    fun bindText(): Int {
+        return bind.bindText(1, text)
+    }
+
+    @Benchmark
+    fun bindBytes(): Int {
+        return bind.bindBytes(1, bytes)
+    }
+
+    @Benchmark
+    fun step(): Int {
+        return nextRow()
+    }
+
+    /**
+     * One row of every type, fetched the way SelectStatement.nextRow does: type, then value
+     */
+    @Benchmark
+    fun readRow(bh: Blackhole) {
+        nextRow()
+        for (index in 0 until 6)
+            bh.consume(scan.columnTypeInt(index))
+        bh.consume(scan.columnLong(0))
+        bh.consume(scan.columnInt(1))
+        bh.consume(scan.columnLong(2))
+        bh.consume(scan.columnDouble(3))
+        bh.consume(scan.columnText(4))
+        bh.consume(scan.columnBlob(5))
+    }
+
+    @Benchmark
+    fun pointSelect(): String {
+        select.bindInt(1, id++ % BenchmarkDatabase.rows + 1)
+        select.stepInt()
+        val text = select.columnText(4)
+        select.reset()
+        return text
+    }
+
+    private fun nextRow(): Int {
+        var rc = scan.stepInt()
+        if (rc != stepRow) {
+            scan.reset()
+            rc = scan.stepInt()
+        }
+        return rc
+    }
+
+    companion object {
+        // Sqlite3StatementJniShim.stepInt value for SQLITE_ROW
+        private const val stepRow = 3
+    }
+}
@@ -0,0 +1,106 @@
+package com.oldguy.kiscmp.benchmark
+
+import com.oldguy.database.SqlValue
+import com.oldguy.database.SqlValues
+import com.oldguy.kiscmp.SelectStatement
+import com.oldguy.kiscmp.SqlCipherDatabase
+import com.oldguy.kiscmp.SqlCipherStatement
+import kotlinx.coroutines.runBlocking
+import org.openjdk.jmh.annotations.Benchmark
+import org.openjdk.jmh.annotations.BenchmarkMode
+import org.openjdk.jmh.annotations.Fork
+import org.openjdk.jmh.annotations.Level
+import org.openjdk.jmh.annotations.Measurement
+import org.openjdk.jmh.annotations.Mode
+import org.openjdk.jmh.annotations.OutputTimeUnit
+import org.openjdk.jmh.annotations.Scope
+import org.openjdk.jmh.annotations.Setup
+import org.openjdk.jmh.annotations.State
+import org.openjdk.jmh.annotations.TearDown
+import org.openjdk.jmh.annotations.Warmup
+import org.openjdk.jmh.infra.Blackhole
+import java.util.concurrent.TimeUnit
+
+/**
+ * Top layer, the SqlCipherDatabase API. nextRow builds a SqlValues of SqlValue instances per row, so
+ * compare [nextRow] with StatementBenchmark.readRow for the cost of that construction, and
+ * [nextRowDateTime] isolates DATETIME parsing. The suspend retrieve functions are run with
+ * runBlocking, [runBlockingBaseline] is that cost alone. retrieve and retrieveOne close their query,
+ * so those two include a prepare and finalize per call, compare with StatementBenchmark.prepareFinalize.
+ *
+ * The update in [execute] runs inside one transaction held open for the trial, so it measures the
+ * statement and not a commit per call.
+ */
+@BenchmarkMode(Mode.AverageTime)
+@OutputTimeUnit(TimeUnit.NANOSECONDS)
+@Warmup(iterations = 3, time = 1)
+@Measurement(iterations = 5, time = 1)
+@Fork(1)
+@State(Scope.Thread)
+class SelectBenchmark {
+    private val dbName = "kmpsql_jmh_select.db"
+    private lateinit var db: SqlCipherDatabase
+    private lateinit var scan: SelectStatement
+    private lateinit var dateTimes: SelectStatement
+    private lateinit var update: SqlCipherStatement
+    private var id = 0
+
+    @Setup(Level.Trial)
+    fun setup() {
+        db = BenchmarkDatabase.create(dbName)
+        scan = db.query(BenchmarkDatabase.selectColumns) as SelectStatement
+        dateTimes = db.query(BenchmarkDatabase.selectDateTime) as SelectStatement
+        update = db.statement(BenchmarkDatabase.updateById) as SqlCipherStatement
+        runBlocking { db.execute("BEGIN;") }
+    }
+
+    @TearDown(Level.Trial)
+    fun tearDown() {
+        runBlocking { db.execute("ROLLBACK;") }
+        db.close()
+        BenchmarkDatabase.delete(dbName)
+    }
+
+    @Benchmark
+    fun nextRow(): SqlValues {
+        return scan.nextRow().ifEmpty { scan.nextRow() }
+    }
+
+    @Benchmark
+    fun nextRowDateTime(): SqlValues {
+        return dateTimes.nextRow().ifEmpty { dateTimes.nextRow() }
+    }
+
+    @Benchmark
+    fun retrieveOne(bh: Blackhole) = runBlocking {
+        db.query(BenchmarkDatabase.selectById).retrieveOne(SqlValues(SqlValue.IntValue(nextId()))) { _, row ->
+            bh.consume(row)
+        }
+    }
+
+    /**
+     * Ten rows per call
+     */
+    @Benchmark
+    fun retrieve(bh: Blackhole) = runBlocking {
+        val first = nextId()
+        db.query(BenchmarkDatabase.selectRange).retrieve(SqlValues(SqlValue.IntValue(first), SqlValue.IntValue(first + 9))) { _, row ->
+            bh.consume(row)
+            true
+        }
+    }
+
+    @Benchmark
+    fun runBlockingBaseline(bh: Blackhole) = runBlocking {
+        bh.consume(id)
+    }
+
+    @Benchmark
+    fun execute(): Int {
+        return update.execute(SqlValues(SqlValue.IntValue(id), SqlValue.IntValue(nextId())))
+    }
+
+    private fun nextId(): Int = id++ % BenchmarkDatabase.rows + 1
+
+    private fun SqlValues.ifEmpty(next: () -> SqlValues): SqlValues = if (isEmpty) next() else this
+}
@@ -0,0 +1,57 @@
+package com.oldguy.kiscmp.benchmark
+
+import com.oldguy.database.SqlValue
+import com.oldguy.database.SqlValues
+import kotlinx.datetime.LocalDateTime
+import org.openjdk.jmh.annotations.Benchmark
+import org.openjdk.jmh.annotations.BenchmarkMode
+import org.openjdk.jmh.annotations.Fork
+import org.openjdk.jmh.annotations.Measurement
+import org.openjdk.jmh.annotations.Mode
+import org.openjdk.jmh.annotations.OutputTimeUnit
+import org.openjdk.jmh.annotations.Scope
+import org.openjdk.jmh.annotations.State
+import org.openjdk.jmh.annotations.Warmup
+import java.util.concurrent.TimeUnit
+
+/**
+ * No JNI. The Kotlin work SelectStatement.nextRow does per row after the column values are fetched:
+ * SqlValue construction for the bench table columns, and DATETIME text parsing.
+ */
+@BenchmarkMode(Mode.AverageTime)
+@OutputTimeUnit(TimeUnit.NANOSECONDS)
+@Warmup(iterations = 3, time = 1)
+@Measurement(iterations = 5, time = 1)
+@Fork(1)
+@State(Scope.Thread)
+class SqlValueBenchmark {
+    private val text = "text value 123"
+    private val bytes = ByteArray(32) { it.toByte() }
+    private val dateTimeText = "2023-11-14T22:14:20.123"
+    private val dateTimeNoMillisText = "2023-11-14T22:14:20"
+
+    @Benchmark
+    fun buildRow(): SqlValues {
+        return SqlValues().apply {
+            add(SqlValue.LongValue("id", 123L))
+            add(SqlValue.IntValue("i", 123))
+            add(SqlValue.LongValue("l", 528280977408L))
+            add(SqlValue.DoubleValue("d", 41.0))
+            add(SqlValue.StringValue("t", text))
+            add(SqlValue.BytesValue("b", bytes))
+        }
+    }
+
+    @Benchmark
+    fun parseDateTime(): LocalDateTime? {
+        return SqlValue.DateTimeValue.parse(dateTimeText)
+    }
+
+    /**
+     * Parsed by the second format, after the first one fails with an exception
+     */
+    @Benchmark
+    fun parseDateTimeNoMillis(): LocalDateTime? {
+        return SqlValue.DateTimeValue.parse(dateTimeNoMillisText)
+    }
+}
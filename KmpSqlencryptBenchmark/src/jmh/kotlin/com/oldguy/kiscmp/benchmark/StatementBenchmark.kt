@@ -0,0 +1,100 @@
+package com.oldguy.kiscmp.benchmark
+
+import com.oldguy.kiscmp.SqliteColumnType
+import com.oldguy.kiscmp.SqliteDatabase
+import com.oldguy.kiscmp.SqliteStatement
+import com.oldguy.kiscmp.SqliteStepResult
+import org.openjdk.jmh.annotations.Benchmark
+import org.openjdk.jmh.annotations.BenchmarkMode
+import org.openjdk.jmh.annotations.Fork
+import org.openjdk.jmh.annotations.Level
+import org.openjdk.jmh.annotations.Measurement
+import org.openjdk.jmh.annotations.Mode
+import org.openjdk.jmh.annotations.OutputTimeUnit
+import org.openjdk.jmh.annotations.Scope
+import org.openjdk.jmh.annotations.Setup
+import org.openjdk.jmh.annotations.State
+import org.openjdk.jmh.annotations.TearDown
+import org.openjdk.jmh.annotations.Warmup
+import org.openjdk.jmh.infra.Blackhole
+import java.util.concurrent.TimeUnit
+
+/**
+ * Second layer, the multiplatform SqliteDatabase and SqliteStatement actuals over the shims. The
+ * same operations as [JniShimBenchmark], so the difference is the actual wrapper: mapping step and
+ * column type results to enums, and delegation.
+ */
+@BenchmarkMode(Mode.AverageTime)
+@OutputTimeUnit(TimeUnit.NANOSECONDS)
+@Warmup(iterations = 3, time = 1)
+@Measurement(iterations = 5, time = 1)
+@Fork(1)
+@State(Scope.Thread)
+class StatementBenchmark {
+    private val dbName = "kmpsql_jmh_statement.db"
+    private val db = SqliteDatabase()
+    private lateinit var select: SqliteStatement
+    private lateinit var scan: SqliteStatement
+    private var id = 0
+
+    @Setup(Level.Trial)
+    fun setup() {
+        BenchmarkDatabase.create(dbName).close()
+        db.open(BenchmarkDatabase.path(dbName), false, false, "")
+        db.exec(BenchmarkDatabase.pragmaKey)
+        select = SqliteStatement(db).apply { prepare(BenchmarkDatabase.selectById) }
+        scan = SqliteStatement(db).apply { prepare(BenchmarkDatabase.selectColumns) }
+    }
+
+    @TearDown(Level.Trial)
+    fun tearDown() {
+        select.finalize()
+        scan.finalize()
+        db.close()
+        BenchmarkDatabase.delete(dbName)
+    }
+
+    @Benchmark
+    fun prepareFinalize(): Int {
+        val statement = SqliteStatement(db)
+        statement.prepare(BenchmarkDatabase.selectById)
+        return statement.finalize()
+    }
+
+    @Benchmark
+    fun step(): SqliteStepResult {
+        return nextRow()
+    }
+
+    @Benchmark
+    fun readRow(bh: Blackhole) {
+        nextRow()
+        for (index in 0 until 6) {
+            when (scan.columnType(index)) {
+                SqliteColumnType.Null -> bh.consume(null)
+                SqliteColumnType.Integer -> bh.consume(scan.columnLong(index))
+                SqliteColumnType.Float -> bh.consume(scan.columnDouble(index))
+                SqliteColumnType.Text -> bh.consume(scan.columnText(index))
+                SqliteColumnType.Blob -> bh.consume(scan.columnBlob(index))
+            }
+        }
+    }
+
+    @Benchmark
+    fun pointSelect(): String {
+        select.bindInt(1, id++ % BenchmarkDatabase.rows + 1)
+        select.step()
+        val text = select.columnText(4)
+        select.reset()
+        return text
+    }
+
+    private fun nextRow(): SqliteStepResult {
+        var rc = scan.step()
+        if (rc != SqliteStepResult.Row) {
+            scan.reset()
+            rc = scan.step()
+        }
+        return rc
+    }
+}
@@ -1,6 +1,8 @@
 plugins {
     libs.plugins.also {
         alias(it.kotlin.multiplatform) apply false
+        alias(it.kotlin.jvm) apply false
+        alias(it.kotlin.allopen) apply false
         alias(it.android.library) apply false
         alias(it.kotlinx.atomicfu) apply false
         alias(it.android.junit5) apply false
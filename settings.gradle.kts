@@ -11,4 +11,9 @@ val projectNameMavenName = "kmp-sqlencrypt"
 rootProject.name = projectNameMavenName
 
 include(":KmpSqlencrypt")
-project( ":KmpSqlencrypt" ).name = projectNameMavenName
\ No newline at end of file
+project( ":KmpSqlencrypt" ).name = projectNameMavenName
+
+// JMH benchmarks run on the desktop JVM target, which is only built on Linux
+if (System.getProperty("os.name").startsWith("Linux")) {
+    include(":KmpSqlencryptBenchmark")
+}
\ No newline at end of file